@@ -12,5 +12,15 @@ $CXX $CXXFLAGS -std=c++17 -Ilib/includes \
      fuzz/fuzz_qpackdecoder.cc -o $OUT/fuzz_qpackdecoder \
      $LIB_FUZZING_ENGINE lib/.libs/libnghttp3.a
 
+$CXX $CXXFLAGS -std=c++17 -Ilib/includes -Ilib \
+     fuzz/fuzz_check_header.cc -o $OUT/fuzz_check_header \
+     $LIB_FUZZING_ENGINE lib/.libs/libnghttp3.a
+
+$CXX $CXXFLAGS -std=c++17 -Ilib/includes -Ilib \
+     fuzz/fuzz_sfparse.cc -o $OUT/fuzz_sfparse \
+     $LIB_FUZZING_ENGINE lib/.libs/libnghttp3.a
+
 zip -j $OUT/fuzz_http3serverreq_seed_corpus.zip fuzz/corpus/fuzz_http3serverreq/*
 zip -j $OUT/fuzz_qpackdecoder_seed_corpus.zip fuzz/corpus/fuzz_qpackdecoder/*
+zip -j $OUT/fuzz_check_header_seed_corpus.zip fuzz/corpus/fuzz_check_header/*
+zip -j $OUT/fuzz_sfparse_seed_corpus.zip fuzz/corpus/fuzz_sfparse/*
@@ -0,0 +1,880 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2019 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nghttp3/nghttp3.h>
+
+#include "nghttp3_qpack.h"
+#include "nghttp3_qpack_huffman.h"
+#include "nghttp3_buf.h"
+
+/*
+ * qpackbench measures the QPACK building blocks: Huffman coding,
+ * nghttp3_qpack_encoder_encode, nghttp3_qpack_decoder_read_request,
+ * and dynamic table insertion/eviction.  The header blocks are read
+ * from QIF files given in the command-line, or generated if none is
+ * given.  Each result is written to stdout as a single line JSON
+ * object so that the output can be collected and compared across
+ * releases.
+ */
+
+/* NGHTTP3_BENCH_MAX_FIELDS is the maximum number of fields in a
+   header block. */
+#define NGHTTP3_BENCH_MAX_FIELDS 1024
+
+/* NGHTTP3_BENCH_MAX_BLOCKED_STREAMS is the maximum number of blocked
+   streams given to both encoder and decoder. */
+#define NGHTTP3_BENCH_MAX_BLOCKED_STREAMS 100
+
+/* dtable_capacities is the list of dynamic table capacities that
+   encoder, decoder, and dynamic table benchmarks run with. */
+static const size_t dtable_capacities[] = {0, 4096, 16384, 65536};
+
+typedef struct bench_block {
+  nghttp3_nv *nva;
+  size_t nvlen;
+} bench_block;
+
+typedef struct bench_input {
+  /* name is the name of input reported in the result. */
+  const char *name;
+  /* text is the QIF text which nva of blocks point to. */
+  char *text;
+  nghttp3_nv *nva;
+  bench_block *blocks;
+  size_t nblocks;
+  /* nfields is the total number of fields in blocks. */
+  size_t nfields;
+  /* nbytes is the total length of names and values in blocks. */
+  size_t nbytes;
+} bench_input;
+
+/* bench_stream is the output of encoder which is fed to decoder.
+   For each header block, the encoder stream data, if any, is
+   followed by the request stream data. */
+typedef struct bench_stream {
+  uint8_t *data;
+  size_t datalen;
+  size_t datacap;
+  /* elens and rlens are the length of encoder stream and request
+     stream data of each header block. */
+  size_t *elens;
+  size_t *rlens;
+} bench_stream;
+
+static struct {
+  /* min_duration is the minimum measured time of each benchmark in
+     nanoseconds. */
+  uint64_t min_duration;
+} config;
+
+/* sink is updated with the benchmark outputs so that the compiler
+   cannot optimize the work away. */
+static volatile size_t sink;
+
+static uint64_t timestamp(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void print_json_string(const char *s) {
+  putchar('"');
+
+  for (; *s; ++s) {
+    switch (*s) {
+    case '"':
+    case '\\':
+      putchar('\\');
+      putchar(*s);
+      break;
+    default:
+      if ((unsigned char)*s < 0x20) {
+        printf("\\u%04x", (unsigned char)*s);
+      } else {
+        putchar(*s);
+      }
+    }
+  }
+
+  putchar('"');
+}
+
+/*
+ * print_throughput prints the result of byte oriented benchmark
+ * |bench|.  |nbytes| bytes were processed in |elapsed| nanoseconds.
+ */
+static void print_throughput(const char *bench, const bench_input *input,
+                             uint64_t iterations, uint64_t nbytes,
+                             uint64_t elapsed) {
+  printf("{\"benchmark\":");
+  print_json_string(bench);
+  printf(",\"input\":");
+  print_json_string(input->name);
+  printf(",\"iterations\":%llu,\"bytes\":%llu,\"elapsed_ns\":%llu,"
+         "\"bytes_per_sec\":%.0f}\n",
+         (unsigned long long)iterations, (unsigned long long)nbytes,
+         (unsigned long long)elapsed, (double)nbytes * 1e9 / (double)elapsed);
+}
+
+/*
+ * print_latency prints the result of benchmark |bench| which ran
+ * with the dynamic table capacity |dtable_capacity|.  |nops|
+ * operations of |unit| were done in |elapsed| nanoseconds.
+ */
+static void print_latency(const char *bench, const bench_input *input,
+                          size_t dtable_capacity, const char *unit,
+                          uint64_t iterations, uint64_t nops,
+                          uint64_t elapsed) {
+  printf("{\"benchmark\":");
+  print_json_string(bench);
+  printf(",\"input\":");
+  print_json_string(input->name);
+  printf(",\"dtable_capacity\":%zu,\"iterations\":%llu,\"%ss\":%llu,"
+         "\"elapsed_ns\":%llu,\"ns_per_%s\":%.2f}\n",
+         dtable_capacity, (unsigned long long)iterations, unit,
+         (unsigned long long)nops, (unsigned long long)elapsed, unit,
+         (double)elapsed / (double)nops);
+}
+
+/*
+ * parse_qif parses the QIF text |input->text| in place.  A header
+ * block is a sequence of lines of the form "name<TAB>value", and
+ * header blocks are separated by an empty line.  Lines starting with
+ * '#' are comments.
+ */
+static int parse_qif(bench_input *input) {
+  char *p = input->text, *eol, *tab, *value;
+  size_t nlines = 0, nvlen = 0;
+  bench_block *block = NULL;
+
+  for (eol = p; (eol = strchr(eol, '\n')) != NULL; ++eol) {
+    ++nlines;
+  }
+
+  /* The last line might not end with '\n'. */
+  ++nlines;
+
+  input->nva = malloc(sizeof(nghttp3_nv) * nlines);
+  input->blocks = malloc(sizeof(bench_block) * nlines);
+  if (input->nva == NULL || input->blocks == NULL) {
+    return -1;
+  }
+
+  for (; *p; p = eol) {
+    eol = strchr(p, '\n');
+    if (eol == NULL) {
+      eol = p + strlen(p);
+    } else {
+      *eol++ = '\0';
+    }
+
+    if (*p == '#') {
+      continue;
+    }
+
+    if (*p == '\0') {
+      nvlen = 0;
+      continue;
+    }
+
+    tab = strchr(p, '\t');
+    if (tab == NULL) {
+      fprintf(stderr, "%s: could not find TAB in %s\n", input->name, p);
+      return -1;
+    }
+
+    if (nvlen == NGHTTP3_BENCH_MAX_FIELDS) {
+      fprintf(stderr, "%s: too many fields\n", input->name);
+      return -1;
+    }
+
+    *tab = '\0';
+
+    for (value = tab + 1; *value == ' '; ++value)
+      ;
+
+    if (nvlen == 0) {
+      block = &input->blocks[input->nblocks++];
+      block->nva = &input->nva[input->nfields];
+      block->nvlen = 0;
+    }
+
+    input->nva[input->nfields++] = (nghttp3_nv){
+        (uint8_t *)p,
+        (uint8_t *)value,
+        (size_t)(tab - p),
+        strlen(value),
+        NGHTTP3_NV_FLAG_NONE,
+    };
+    input->nbytes += (size_t)(tab - p) + strlen(value);
+
+    ++block->nvlen;
+    ++nvlen;
+  }
+
+  if (input->nfields == 0) {
+    fprintf(stderr, "%s: no header field found\n", input->name);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int load_qif(bench_input *input, const char *path) {
+  FILE *fp;
+  long size;
+  int rv = -1;
+
+  memset(input, 0, sizeof(*input));
+  input->name = path;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+      fseek(fp, 0, SEEK_SET) != 0) {
+    fprintf(stderr, "Could not read %s: %s\n", path, strerror(errno));
+    goto fin;
+  }
+
+  input->text = malloc((size_t)size + 1);
+  if (input->text == NULL) {
+    goto fin;
+  }
+
+  if (fread(input->text, 1, (size_t)size, fp) != (size_t)size) {
+    fprintf(stderr, "Could not read %s\n", path);
+    goto fin;
+  }
+
+  input->text[size] = '\0';
+
+  rv = parse_qif(input);
+
+fin:
+  fclose(fp);
+
+  return rv;
+}
+
+/*
+ * generate_input generates browser-like request header blocks for
+ * a page and its subresources in QIF text, and parses it into
+ * |input|.
+ */
+static int generate_input(bench_input *input) {
+  static const char *const authorities[] = {
+      "www.example.com",
+      "static.example.com",
+      "cdn.example.net",
+  };
+  static const char *const exts[] = {"js", "css", "png", "woff2"};
+  size_t textcap = 128 * 1024, textlen = 0, i;
+  int n;
+
+  memset(input, 0, sizeof(*input));
+  input->name = "builtin";
+
+  input->text = malloc(textcap);
+  if (input->text == NULL) {
+    return -1;
+  }
+
+  for (i = 0; i < 100; ++i) {
+    n = snprintf(input->text + textlen, textcap - textlen,
+                 ":method\tGET\n"
+                 ":scheme\thttps\n"
+                 ":authority\t%s\n"
+                 ":path\t/assets/%zu/%08zx.%s?v=%zu\n"
+                 "user-agent\tMozilla/5.0 (X11; Linux x86_64) "
+                 "AppleWebKit/537.36 (KHTML, like Gecko) "
+                 "Chrome/120.0.0.0 Safari/537.36\n"
+                 "accept\t*/*\n"
+                 "accept-encoding\tgzip, deflate, br\n"
+                 "accept-language\ten-US,en;q=0.9\n"
+                 "referer\thttps://www.example.com/articles/%zu\n"
+                 "cookie\tsession=%016zx; theme=dark\n"
+                 "priority\tu=%zu, i\n"
+                 "\n",
+                 authorities[i % 3], i / 10, i * 2654435761u & 0xffffffffu,
+                 exts[i % 4], i % 7, i / 25, i / 50 * 2654435761u,
+                 i % 8);
+    if (n < 0 || (size_t)n >= textcap - textlen) {
+      return -1;
+    }
+
+    textlen += (size_t)n;
+  }
+
+  return parse_qif(input);
+}
+
+static void bench_input_free(bench_input *input) {
+  free(input->blocks);
+  free(input->nva);
+  free(input->text);
+}
+
+static void bench_huffman_encode(const bench_input *input) {
+  uint8_t *out, *p;
+  size_t outlen = 0, i;
+  uint64_t iterations = 0, t, elapsed = 0;
+  const nghttp3_nv *nv;
+
+  for (i = 0; i < input->nfields; ++i) {
+    nv = &input->nva[i];
+    outlen += nghttp3_qpack_huffman_encode_count(nv->name, nv->namelen) +
+              nghttp3_qpack_huffman_encode_count(nv->value, nv->valuelen);
+  }
+
+  out = malloc(outlen + 1);
+  if (out == NULL) {
+    return;
+  }
+
+  while (elapsed < config.min_duration) {
+    t = timestamp();
+
+    p = out;
+
+    for (i = 0; i < input->nfields; ++i) {
+      nv = &input->nva[i];
+      p = nghttp3_qpack_huffman_encode(p, nv->name, nv->namelen);
+      p = nghttp3_qpack_huffman_encode(p, nv->value, nv->valuelen);
+    }
+
+    elapsed += timestamp() - t;
+    ++iterations;
+
+    sink += (size_t)(p - out);
+  }
+
+  print_throughput("huffman_encode", input, iterations,
+                   iterations * input->nbytes, elapsed);
+
+  free(out);
+}
+
+static void bench_huffman_decode(const bench_input *input) {
+  nghttp3_qpack_huffman_decode_context ctx;
+  uint8_t *enc, *out, *p;
+  size_t *enclens;
+  size_t enclen = 0, outlen, i, nstr = input->nfields * 2;
+  uint64_t iterations = 0, t, elapsed = 0;
+  const nghttp3_nv *nv;
+  const uint8_t *src;
+  nghttp3_ssize nwrite;
+
+  for (i = 0; i < input->nfields; ++i) {
+    nv = &input->nva[i];
+    enclen += nghttp3_qpack_huffman_encode_count(nv->name, nv->namelen) +
+              nghttp3_qpack_huffman_encode_count(nv->value, nv->valuelen);
+  }
+
+  enc = malloc(enclen + 1);
+  /* Decoded string is at most 8/5 times as long as the encoded
+     one. */
+  out = malloc(enclen * 2 + 1);
+  enclens = malloc(sizeof(size_t) * nstr);
+  if (enc == NULL || out == NULL || enclens == NULL) {
+    goto fin;
+  }
+
+  p = enc;
+
+  for (i = 0; i < input->nfields; ++i) {
+    nv = &input->nva[i];
+    enclens[i * 2] =
+        (size_t)(nghttp3_qpack_huffman_encode(p, nv->name, nv->namelen) - p);
+    p += enclens[i * 2];
+    enclens[i * 2 + 1] =
+        (size_t)(nghttp3_qpack_huffman_encode(p, nv->value, nv->valuelen) -
+                 p);
+    p += enclens[i * 2 + 1];
+  }
+
+  while (elapsed < config.min_duration) {
+    t = timestamp();
+
+    src = enc;
+    outlen = 0;
+
+    for (i = 0; i < nstr; ++i) {
+      nghttp3_qpack_huffman_decode_context_init(&ctx);
+      nwrite = nghttp3_qpack_huffman_decode(&ctx, out, src, enclens[i],
+                                            /* fin = */ 1);
+      if (nwrite < 0) {
+        fprintf(stderr, "nghttp3_qpack_huffman_decode: %s\n",
+                nghttp3_strerror((int)nwrite));
+        goto fin;
+      }
+
+      src += enclens[i];
+      outlen += (size_t)nwrite;
+    }
+
+    elapsed += timestamp() - t;
+    ++iterations;
+
+    sink += outlen;
+  }
+
+  print_throughput("huffman_decode", input, iterations,
+                   iterations * input->nbytes, elapsed);
+
+fin:
+  free(enclens);
+  free(out);
+  free(enc);
+}
+
+static int bench_stream_append(bench_stream *stream, const nghttp3_buf *buf) {
+  size_t len = nghttp3_buf_len(buf), cap;
+  uint8_t *p;
+
+  if (stream->datacap - stream->datalen < len) {
+    cap = nghttp3_max(stream->datacap * 2, stream->datalen + len);
+    p = realloc(stream->data, cap);
+    if (p == NULL) {
+      return -1;
+    }
+
+    stream->data = p;
+    stream->datacap = cap;
+  }
+
+  if (len) {
+    memcpy(stream->data + stream->datalen, buf->pos, len);
+    stream->datalen += len;
+  }
+
+  return 0;
+}
+
+static void bench_stream_free(bench_stream *stream) {
+  free(stream->rlens);
+  free(stream->elens);
+  free(stream->data);
+}
+
+/*
+ * run_encoder encodes all header blocks in |input| with a fresh
+ * encoder with the dynamic table capacity |dtable_capacity|, and
+ * returns the time spent in nanoseconds.  The decoder is assumed to
+ * acknowledge each header block immediately.  If |stream| is not
+ * NULL, the encoded data is appended to it.  This function returns
+ * 0 if it fails.
+ */
+static uint64_t run_encoder(const bench_input *input, size_t dtable_capacity,
+                            bench_stream *stream) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_qpack_encoder *enc;
+  nghttp3_buf pbuf, rbuf, ebuf;
+  const bench_block *block;
+  uint64_t t, elapsed = 0;
+  size_t i;
+  int rv;
+
+  rv = nghttp3_qpack_encoder_new(&enc, dtable_capacity, mem);
+  if (rv != 0) {
+    return 0;
+  }
+
+  nghttp3_qpack_encoder_set_max_dtable_capacity(enc, dtable_capacity);
+  nghttp3_qpack_encoder_set_max_blocked_streams(
+      enc, NGHTTP3_BENCH_MAX_BLOCKED_STREAMS);
+
+  nghttp3_buf_init(&pbuf);
+  nghttp3_buf_init(&rbuf);
+  nghttp3_buf_init(&ebuf);
+
+  for (i = 0; i < input->nblocks; ++i) {
+    block = &input->blocks[i];
+
+    t = timestamp();
+
+    rv = nghttp3_qpack_encoder_encode(enc, &pbuf, &rbuf, &ebuf,
+                                      (int64_t)(i * 4), block->nva,
+                                      block->nvlen);
+    nghttp3_qpack_encoder_ack_everything(enc);
+
+    elapsed += timestamp() - t;
+
+    if (rv != 0) {
+      fprintf(stderr, "nghttp3_qpack_encoder_encode: %s\n",
+              nghttp3_strerror(rv));
+      elapsed = 0;
+      break;
+    }
+
+    if (stream) {
+      stream->elens[i] = nghttp3_buf_len(&ebuf);
+      stream->rlens[i] = nghttp3_buf_len(&pbuf) + nghttp3_buf_len(&rbuf);
+
+      if (bench_stream_append(stream, &ebuf) != 0 ||
+          bench_stream_append(stream, &pbuf) != 0 ||
+          bench_stream_append(stream, &rbuf) != 0) {
+        elapsed = 0;
+        break;
+      }
+    }
+
+    nghttp3_buf_reset(&pbuf);
+    nghttp3_buf_reset(&rbuf);
+    nghttp3_buf_reset(&ebuf);
+  }
+
+  nghttp3_buf_free(&ebuf, mem);
+  nghttp3_buf_free(&rbuf, mem);
+  nghttp3_buf_free(&pbuf, mem);
+  nghttp3_qpack_encoder_del(enc);
+
+  return elapsed;
+}
+
+/*
+ * run_decoder decodes |stream| produced by run_encoder with a fresh
+ * decoder, and returns the time spent in nanoseconds.  This function
+ * returns 0 if it fails.
+ */
+static uint64_t run_decoder(const bench_input *input, size_t dtable_capacity,
+                            const bench_stream *stream) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_qpack_decoder *dec;
+  nghttp3_qpack_stream_context *sctx;
+  nghttp3_qpack_nv nv;
+  const uint8_t *p = stream->data, *end;
+  uint64_t t, elapsed = 0;
+  nghttp3_ssize nread = 0;
+  uint8_t flags = 0;
+  size_t i;
+  int rv;
+
+  rv = nghttp3_qpack_decoder_new(&dec, dtable_capacity,
+                                 NGHTTP3_BENCH_MAX_BLOCKED_STREAMS, mem);
+  if (rv != 0) {
+    return 0;
+  }
+
+  rv = nghttp3_qpack_stream_context_new(&sctx, 0, mem);
+  if (rv != 0) {
+    nghttp3_qpack_decoder_del(dec);
+    return 0;
+  }
+
+  for (i = 0; i < input->nblocks; ++i) {
+    t = timestamp();
+
+    if (stream->elens[i]) {
+      nread = nghttp3_qpack_decoder_read_encoder(dec, p, stream->elens[i]);
+      if (nread < 0) {
+        fprintf(stderr, "nghttp3_qpack_decoder_read_encoder: %s\n",
+                nghttp3_strerror((int)nread));
+        elapsed = 0;
+        break;
+      }
+
+      p += stream->elens[i];
+    }
+
+    end = p + stream->rlens[i];
+
+    for (;;) {
+      nread = nghttp3_qpack_decoder_read_request(
+          dec, sctx, &nv, &flags, p, (size_t)(end - p), /* fin = */ 1);
+      if (nread < 0) {
+        break;
+      }
+
+      p += nread;
+
+      if (flags & NGHTTP3_QPACK_DECODE_FLAG_EMIT) {
+        nghttp3_rcbuf_decref(nv.name);
+        nghttp3_rcbuf_decref(nv.value);
+      }
+
+      if (flags & (NGHTTP3_QPACK_DECODE_FLAG_FINAL |
+                   NGHTTP3_QPACK_DECODE_FLAG_BLOCKED)) {
+        break;
+      }
+    }
+
+    nghttp3_qpack_stream_context_reset(sctx);
+
+    elapsed += timestamp() - t;
+
+    if (nread < 0 || (flags & NGHTTP3_QPACK_DECODE_FLAG_BLOCKED)) {
+      fprintf(stderr, "nghttp3_qpack_decoder_read_request: %s\n",
+              nread < 0 ? nghttp3_strerror((int)nread) : "blocked");
+      elapsed = 0;
+      break;
+    }
+
+    p = end;
+  }
+
+  nghttp3_qpack_stream_context_del(sctx);
+  nghttp3_qpack_decoder_del(dec);
+
+  return elapsed;
+}
+
+static void bench_encoder_decoder(const bench_input *input,
+                                  size_t dtable_capacity) {
+  bench_stream stream;
+  uint64_t iterations, t, elapsed;
+
+  memset(&stream, 0, sizeof(stream));
+
+  stream.elens = malloc(sizeof(size_t) * input->nblocks);
+  stream.rlens = malloc(sizeof(size_t) * input->nblocks);
+  if (stream.elens == NULL || stream.rlens == NULL) {
+    goto fin;
+  }
+
+  /* Record the encoded data for the decoder benchmark.  This also
+     warms up the caches. */
+  if (run_encoder(input, dtable_capacity, &stream) == 0) {
+    goto fin;
+  }
+
+  for (iterations = 0, elapsed = 0; elapsed < config.min_duration;
+       ++iterations) {
+    t = run_encoder(input, dtable_capacity, NULL);
+    if (t == 0) {
+      goto fin;
+    }
+
+    elapsed += t;
+  }
+
+  print_latency("qpack_encode", input, dtable_capacity, "field", iterations,
+                iterations * input->nfields, elapsed);
+
+  for (iterations = 0, elapsed = 0; elapsed < config.min_duration;
+       ++iterations) {
+    t = run_decoder(input, dtable_capacity, &stream);
+    if (t == 0) {
+      goto fin;
+    }
+
+    elapsed += t;
+  }
+
+  print_latency("qpack_decode", input, dtable_capacity, "field", iterations,
+                iterations * input->nfields, elapsed);
+
+fin:
+  bench_stream_free(&stream);
+}
+
+static uint32_t hash_name(const nghttp3_nv *nv) {
+  /* 32 bit FNV-1a */
+  uint32_t h = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < nv->namelen; ++i) {
+    h ^= nv->name[i];
+    h *= 16777619u;
+  }
+
+  return h;
+}
+
+/*
+ * bench_dtable inserts all fields in |input| into the encoder's
+ * dynamic table of capacity |dtable_capacity| repeatedly.  Once the
+ * table is full, each insertion evicts the oldest entries.
+ */
+static void bench_dtable(const bench_input *input, size_t dtable_capacity) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_qpack_encoder *enc;
+  const nghttp3_nv *nv;
+  uint32_t *hashes;
+  uint64_t iterations = 0, ninserts = 0, nevicts = 0, t, elapsed = 0;
+  uint64_t absidx;
+  size_t i, len;
+  int rv;
+
+  hashes = malloc(sizeof(uint32_t) * input->nfields);
+  if (hashes == NULL) {
+    return;
+  }
+
+  for (i = 0; i < input->nfields; ++i) {
+    hashes[i] = hash_name(&input->nva[i]);
+  }
+
+  rv = nghttp3_qpack_encoder_new(&enc, dtable_capacity, mem);
+  if (rv != 0) {
+    free(hashes);
+    return;
+  }
+
+  nghttp3_qpack_encoder_set_max_dtable_capacity(enc, dtable_capacity);
+
+  while (elapsed < config.min_duration) {
+    absidx = enc->ctx.next_absidx;
+    len = nghttp3_ringbuf_len(&enc->ctx.dtable);
+
+    t = timestamp();
+
+    for (i = 0; i < input->nfields; ++i) {
+      nv = &input->nva[i];
+
+      if (nv->namelen + nv->valuelen + NGHTTP3_QPACK_ENTRY_OVERHEAD >
+          dtable_capacity) {
+        continue;
+      }
+
+      rv = nghttp3_qpack_encoder_dtable_literal_add(enc, nv, -1, hashes[i]);
+      if (rv != 0) {
+        fprintf(stderr, "nghttp3_qpack_encoder_dtable_literal_add: %s\n",
+                nghttp3_strerror(rv));
+        goto fin;
+      }
+    }
+
+    elapsed += timestamp() - t;
+    ++iterations;
+
+    ninserts += enc->ctx.next_absidx - absidx;
+    nevicts += enc->ctx.next_absidx - absidx + len -
+               nghttp3_ringbuf_len(&enc->ctx.dtable);
+  }
+
+  if (ninserts == 0) {
+    goto fin;
+  }
+
+  print_latency("dtable_insert", input, dtable_capacity, "insert",
+                iterations, ninserts, elapsed);
+
+  printf("{\"benchmark\":\"dtable_evict\",\"input\":");
+  print_json_string(input->name);
+  printf(",\"dtable_capacity\":%zu,\"inserts\":%llu,\"evicts\":%llu}\n",
+         dtable_capacity, (unsigned long long)ninserts,
+         (unsigned long long)nevicts);
+
+fin:
+  nghttp3_qpack_encoder_del(enc);
+  free(hashes);
+}
+
+static void run(const bench_input *input) {
+  size_t i;
+
+  bench_huffman_encode(input);
+  bench_huffman_decode(input);
+
+  for (i = 0; i < nghttp3_arraylen(dtable_capacities); ++i) {
+    bench_encoder_decoder(input, dtable_capacities[i]);
+  }
+
+  for (i = 0; i < nghttp3_arraylen(dtable_capacities); ++i) {
+    if (dtable_capacities[i]) {
+      bench_dtable(input, dtable_capacities[i]);
+    }
+  }
+}
+
+static void print_usage(FILE *fp) {
+  fprintf(fp, "Usage: qpackbench [-t <MSEC>] [<QIF FILE>...]\n"
+              "Options:\n"
+              "  -t <MSEC>  The minimum duration of each benchmark in\n"
+              "             milliseconds.  Default: 200\n"
+              "If no QIF file is given, the generated header blocks are\n"
+              "used.  Each result is written to stdout as JSON.\n");
+}
+
+int main(int argc, char **argv) {
+  bench_input input;
+  char *end;
+  unsigned long msec;
+  int c;
+
+  config.min_duration = 200 * 1000000ull;
+
+  while ((c = getopt(argc, argv, "ht:")) != -1) {
+    switch (c) {
+    case 'h':
+      print_usage(stdout);
+      return 0;
+    case 't':
+      errno = 0;
+      msec = strtoul(optarg, &end, 10);
+      if (errno != 0 || *end != '\0' || msec == 0) {
+        fprintf(stderr, "-t: invalid argument: %s\n", optarg);
+        return 1;
+      }
+      config.min_duration = (uint64_t)msec * 1000000;
+      break;
+    default:
+      print_usage(stderr);
+      return 1;
+    }
+  }
+
+  if (optind == argc) {
+    if (generate_input(&input) != 0) {
+      bench_input_free(&input);
+      return 1;
+    }
+
+    run(&input);
+
+    bench_input_free(&input);
+
+    return 0;
+  }
+
+  for (; optind < argc; ++optind) {
+    if (load_qif(&input, argv[optind]) != 0) {
+      bench_input_free(&input);
+      return 1;
+    }
+
+    run(&input);
+
+    bench_input_free(&input);
+  }
+
+  return 0;
+}
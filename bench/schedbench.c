@@ -0,0 +1,382 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2025 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nghttp3/nghttp3.h>
+
+#include "nghttp3_qpack.h"
+#include "nghttp3_conv.h"
+#include "nghttp3_frame.h"
+#include "nghttp3_str.h"
+#include "nghttp3_buf.h"
+#include "nghttp3_macro.h"
+
+/*
+ * schedbench measures the built-in stream scheduler of server side
+ * nghttp3_conn.  A number of incremental responses of the same
+ * urgency are written with nghttp3_conn_writev_stream, and each call
+ * sends at most one packet worth of data as QUIC stack does.  It is
+ * run with the round robin quantum of 0, which is the default, and
+ * with larger quanta given by nghttp3_conn_set_urgency_quantum.
+ * Each result is written to stdout as a single line JSON object in
+ * the same way as qpackbench.
+ */
+
+/* NGHTTP3_BENCH_PKTLEN is the maximum number of bytes sent per
+   nghttp3_conn_writev_stream call. */
+#define NGHTTP3_BENCH_PKTLEN 1200
+
+/* NGHTTP3_BENCH_CHUNKLEN is the maximum number of bytes that
+   read_data callback provides at a time. */
+#define NGHTTP3_BENCH_CHUNKLEN 16384
+
+/* NGHTTP3_BENCH_URGENCY is the urgency of all responses. */
+#define NGHTTP3_BENCH_URGENCY NGHTTP3_DEFAULT_URGENCY
+
+/* nstreams_list is the list of the number of concurrent responses. */
+static const size_t nstreams_list[] = {16, 128, 1024};
+
+/* quanta is the list of the round robin quanta. */
+static const uint64_t quanta[] = {0, 16384, 65536};
+
+typedef struct bench_response {
+  /* left is the number of response body bytes not provided yet. */
+  size_t left;
+} bench_response;
+
+static struct {
+  /* min_duration is the minimum measured time of each benchmark in
+     nanoseconds. */
+  uint64_t min_duration;
+  /* bodylen is the length of each response body. */
+  size_t bodylen;
+} config;
+
+static uint8_t body[NGHTTP3_BENCH_CHUNKLEN];
+
+/* request_frame is the HEADERS frame of request which every request
+   stream receives. */
+static uint8_t request_frame[256];
+static size_t request_framelen;
+
+static uint64_t timestamp(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * make_request_frame encodes a request HEADERS frame into
+ * request_frame.  Only the static table is used so that the same
+ * frame can be fed to any request stream.
+ */
+static int make_request_frame(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  const nghttp3_nv nva[] = {
+      {(uint8_t *)":method", (uint8_t *)"GET", 7, 3, NGHTTP3_NV_FLAG_NONE},
+      {(uint8_t *)":scheme", (uint8_t *)"https", 7, 5, NGHTTP3_NV_FLAG_NONE},
+      {(uint8_t *)":authority", (uint8_t *)"example.com", 10, 11,
+       NGHTTP3_NV_FLAG_NONE},
+      {(uint8_t *)":path", (uint8_t *)"/", 5, 1, NGHTTP3_NV_FLAG_NONE},
+  };
+  nghttp3_qpack_encoder *enc;
+  nghttp3_buf pbuf, rbuf, ebuf;
+  size_t len;
+  uint8_t *p;
+  int rv;
+
+  rv = nghttp3_qpack_encoder_new(&enc, 0, mem);
+  if (rv != 0) {
+    return -1;
+  }
+
+  nghttp3_buf_init(&pbuf);
+  nghttp3_buf_init(&rbuf);
+  nghttp3_buf_init(&ebuf);
+
+  rv = nghttp3_qpack_encoder_encode(enc, &pbuf, &rbuf, &ebuf, 0, nva,
+                                    nghttp3_arraylen(nva));
+  if (rv != 0) {
+    fprintf(stderr, "nghttp3_qpack_encoder_encode: %s\n",
+            nghttp3_strerror(rv));
+    goto fin;
+  }
+
+  len = nghttp3_buf_len(&pbuf) + nghttp3_buf_len(&rbuf);
+
+  p = nghttp3_put_varint(request_frame, NGHTTP3_FRAME_HEADERS);
+  p = nghttp3_put_varint(p, (int64_t)len);
+  p = nghttp3_cpymem(p, pbuf.pos, nghttp3_buf_len(&pbuf));
+  p = nghttp3_cpymem(p, rbuf.pos, nghttp3_buf_len(&rbuf));
+
+  request_framelen = (size_t)(p - request_frame);
+
+fin:
+  nghttp3_buf_free(&ebuf, mem);
+  nghttp3_buf_free(&rbuf, mem);
+  nghttp3_buf_free(&pbuf, mem);
+  nghttp3_qpack_encoder_del(enc);
+
+  return rv == 0 ? 0 : -1;
+}
+
+static nghttp3_ssize read_data(nghttp3_conn *conn, int64_t stream_id,
+                               nghttp3_vec *vec, size_t veccnt,
+                               uint32_t *pflags, void *conn_user_data,
+                               void *stream_user_data) {
+  bench_response *res = stream_user_data;
+  size_t n = nghttp3_min(res->left, sizeof(body));
+  (void)conn;
+  (void)stream_id;
+  (void)veccnt;
+  (void)conn_user_data;
+
+  vec[0].base = body;
+  vec[0].len = n;
+
+  res->left -= n;
+  if (res->left == 0) {
+    *pflags |= NGHTTP3_DATA_FLAG_EOF;
+  }
+
+  return 1;
+}
+
+/*
+ * run_server opens |nstreams| request streams in a fresh server
+ * connection, and writes their incremental responses with the round
+ * robin quantum |quantum|.  It returns the time spent in writing in
+ * nanoseconds, and stores the number of bytes written, the number
+ * of times that the written stream changes, and the scheduler
+ * statistics in |*pnbytes|, |*pnswitches|, and |*stats|
+ * respectively.  This function returns 0 if it fails.
+ */
+static uint64_t run_server(size_t nstreams, uint64_t quantum,
+                           uint64_t *pnbytes, uint64_t *pnswitches,
+                           nghttp3_conn_stats *stats) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  const nghttp3_nv resnv[] = {
+      {(uint8_t *)":status", (uint8_t *)"200", 7, 3, NGHTTP3_NV_FLAG_NONE},
+  };
+  const nghttp3_data_reader dr = {read_data};
+  const nghttp3_pri pri = {NGHTTP3_BENCH_URGENCY, /* inc = */ 1};
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  nghttp3_conn *conn;
+  bench_response *responses;
+  nghttp3_vec vec[16];
+  nghttp3_ssize sveccnt;
+  int64_t stream_id, last_stream_id = -1;
+  int fin;
+  size_t i, len;
+  uint64_t t, elapsed = 0, nbytes = 0, nswitches = 0;
+  int rv;
+
+  responses = malloc(sizeof(bench_response) * nstreams);
+  if (responses == NULL) {
+    return 0;
+  }
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  nghttp3_settings_default(&settings);
+
+  rv = nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, NULL);
+  if (rv != 0) {
+    free(responses);
+    return 0;
+  }
+
+  if (nghttp3_conn_bind_control_stream(conn, 3) != 0 ||
+      nghttp3_conn_bind_qpack_streams(conn, 7, 11) != 0 ||
+      nghttp3_conn_set_urgency_quantum(conn, NGHTTP3_BENCH_URGENCY,
+                                       quantum) != 0) {
+    goto fin;
+  }
+
+  for (i = 0; i < nstreams; ++i) {
+    stream_id = (int64_t)(i * 4);
+    responses[i].left = config.bodylen;
+
+    if (nghttp3_conn_read_stream(conn, stream_id, request_frame,
+                                 request_framelen, /* fin = */ 1) !=
+            (nghttp3_ssize)request_framelen ||
+        nghttp3_conn_set_stream_user_data(conn, stream_id, &responses[i]) !=
+            0 ||
+        nghttp3_conn_set_server_stream_priority(conn, stream_id, &pri) != 0 ||
+        nghttp3_conn_submit_response(conn, stream_id, resnv,
+                                     nghttp3_arraylen(resnv), &dr) != 0) {
+      fprintf(stderr, "Could not open stream %lld\n", (long long)stream_id);
+      goto fin;
+    }
+  }
+
+  t = timestamp();
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+    if (sveccnt < 0) {
+      fprintf(stderr, "nghttp3_conn_writev_stream: %s\n",
+              nghttp3_strerror((int)sveccnt));
+      elapsed = 0;
+      goto fin;
+    }
+
+    if (stream_id == -1) {
+      break;
+    }
+
+    len = nghttp3_min((size_t)nghttp3_vec_len(vec, (size_t)sveccnt),
+                      NGHTTP3_BENCH_PKTLEN);
+
+    if (nghttp3_conn_add_write_offset(conn, stream_id, len) != 0 ||
+        nghttp3_conn_add_ack_offset(conn, stream_id, len) != 0) {
+      elapsed = 0;
+      goto fin;
+    }
+
+    nbytes += len;
+
+    if (stream_id != last_stream_id) {
+      last_stream_id = stream_id;
+      ++nswitches;
+    }
+  }
+
+  elapsed = timestamp() - t;
+
+  if (elapsed == 0) {
+    elapsed = 1;
+  }
+
+  *pnbytes = nbytes;
+  *pnswitches = nswitches;
+  nghttp3_conn_get_stats(conn, stats);
+
+fin:
+  nghttp3_conn_del(conn);
+  free(responses);
+
+  return elapsed;
+}
+
+static void bench_sched(size_t nstreams, uint64_t quantum) {
+  nghttp3_conn_stats stats;
+  uint64_t iterations, t, elapsed, nbytes = 0, nswitches = 0;
+
+  for (iterations = 0, elapsed = 0; elapsed < config.min_duration;
+       ++iterations) {
+    t = run_server(nstreams, quantum, &nbytes, &nswitches, &stats);
+    if (t == 0) {
+      return;
+    }
+
+    elapsed += t;
+  }
+
+  printf("{\"benchmark\":\"sched_incremental\",\"streams\":%zu,"
+         "\"quantum\":%llu,\"iterations\":%llu,\"bytes\":%llu,"
+         "\"switches\":%llu,\"sched_pushes\":%llu,\"sched_pops\":%llu,"
+         "\"elapsed_ns\":%llu,\"ns_per_byte\":%.4f}\n",
+         nstreams, (unsigned long long)quantum,
+         (unsigned long long)iterations, (unsigned long long)nbytes,
+         (unsigned long long)nswitches, (unsigned long long)stats.sched_pushes,
+         (unsigned long long)stats.sched_pops, (unsigned long long)elapsed,
+         (double)elapsed / (double)(iterations * nbytes));
+}
+
+static void print_usage(FILE *fp) {
+  fprintf(fp, "Usage: schedbench [-t <MSEC>] [-b <SIZE>]\n"
+              "Options:\n"
+              "  -t <MSEC>  The minimum duration of each benchmark in\n"
+              "             milliseconds.  Default: 200\n"
+              "  -b <SIZE>  The length of each response body in bytes.\n"
+              "             Default: 262144\n"
+              "Each result is written to stdout as JSON.  bytes,\n"
+              "switches, sched_pushes, and sched_pops are per\n"
+              "iteration.\n");
+}
+
+int main(int argc, char **argv) {
+  char *end;
+  unsigned long n;
+  size_t i, j;
+  int c;
+
+  config.min_duration = 200 * 1000000ull;
+  config.bodylen = 256 * 1024;
+
+  while ((c = getopt(argc, argv, "b:ht:")) != -1) {
+    switch (c) {
+    case 'b':
+      errno = 0;
+      n = strtoul(optarg, &end, 10);
+      if (errno != 0 || *end != '\0' || n == 0) {
+        fprintf(stderr, "-b: invalid argument: %s\n", optarg);
+        return 1;
+      }
+      config.bodylen = (size_t)n;
+      break;
+    case 'h':
+      print_usage(stdout);
+      return 0;
+    case 't':
+      errno = 0;
+      n = strtoul(optarg, &end, 10);
+      if (errno != 0 || *end != '\0' || n == 0) {
+        fprintf(stderr, "-t: invalid argument: %s\n", optarg);
+        return 1;
+      }
+      config.min_duration = (uint64_t)n * 1000000;
+      break;
+    default:
+      print_usage(stderr);
+      return 1;
+    }
+  }
+
+  if (make_request_frame() != 0) {
+    return 1;
+  }
+
+  for (i = 0; i < nghttp3_arraylen(nstreams_list); ++i) {
+    for (j = 0; j < nghttp3_arraylen(quanta); ++j) {
+      bench_sched(nstreams_list[i], quanta[j]);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,31 @@
+#include <cstdlib>
+
+#include <nghttp3/nghttp3.h>
+
+extern "C" {
+#include "nghttp3_http.h"
+}
+
+// Checks that nghttp3_check_header_name and
+// nghttp3_check_header_value, which might use SIMD instructions,
+// return the same verdict as the table based implementations for
+// all suffixes of input, so that every alignment and tail length is
+// exercised.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  for (size_t i = 0; i <= size && i < 64; ++i) {
+    auto p = data + i;
+    auto len = size - i;
+
+    if (nghttp3_check_header_name(p, len) !=
+        nghttp3_check_header_name_generic(p, len)) {
+      abort();
+    }
+
+    if (nghttp3_check_header_value(p, len) !=
+        nghttp3_check_header_value_generic(p, len)) {
+      abort();
+    }
+  }
+
+  return 0;
+}
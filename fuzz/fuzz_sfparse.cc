@@ -0,0 +1,287 @@
+#include <cstdlib>
+#include <cstring>
+
+#include <nghttp3/nghttp3.h>
+
+extern "C" {
+#include "nghttp3_http.h"
+}
+
+// The reference parser is sfparse.c built without SIMD, renamed so
+// that it can live next to the one in libnghttp3.
+#define SF_NO_SIMD
+#define sf_parser_init ref_sf_parser_init
+#define sf_parser_param ref_sf_parser_param
+#define sf_parser_inner_list ref_sf_parser_inner_list
+#define sf_parser_dict ref_sf_parser_dict
+#define sf_parser_list ref_sf_parser_list
+#define sf_parser_item ref_sf_parser_item
+#define sf_unescape ref_sf_unescape
+#define sf_base64decode ref_sf_base64decode
+#include "sfparse.c"
+#undef sf_parser_init
+#undef sf_parser_param
+#undef sf_parser_inner_list
+#undef sf_parser_dict
+#undef sf_parser_list
+#undef sf_parser_item
+#undef sf_unescape
+#undef sf_base64decode
+
+extern "C" {
+void sf_parser_init(sf_parser *sfp, const uint8_t *data, size_t datalen);
+int sf_parser_param(sf_parser *sfp, sf_vec *dest_key, sf_value *dest_value);
+int sf_parser_inner_list(sf_parser *sfp, sf_value *dest);
+int sf_parser_dict(sf_parser *sfp, sf_vec *dest_key, sf_value *dest_value);
+int sf_parser_list(sf_parser *sfp, sf_value *dest);
+int sf_parser_item(sf_parser *sfp, sf_value *dest);
+}
+
+namespace {
+struct Parsers {
+  sf_parser sfp;
+  sf_parser ref;
+};
+
+void check_vec(const sf_vec &a, const sf_vec &b) {
+  if (a.len != b.len || a.base != b.base) {
+    abort();
+  }
+}
+
+void check_value(int rv, int ref_rv, const sf_value &a, const sf_value &b) {
+  if (rv != ref_rv) {
+    abort();
+  }
+
+  if (rv != 0) {
+    return;
+  }
+
+  if (a.type != b.type || a.flags != b.flags) {
+    abort();
+  }
+
+  switch (a.type) {
+  case SF_TYPE_BOOLEAN:
+    if (a.boolean != b.boolean) {
+      abort();
+    }
+    break;
+  case SF_TYPE_INTEGER:
+  case SF_TYPE_DATE:
+    if (a.integer != b.integer) {
+      abort();
+    }
+    break;
+  case SF_TYPE_DECIMAL:
+    if (a.decimal.numer != b.decimal.numer ||
+        a.decimal.denom != b.decimal.denom) {
+      abort();
+    }
+    break;
+  case SF_TYPE_STRING:
+  case SF_TYPE_TOKEN:
+  case SF_TYPE_BYTESEQ:
+    check_vec(a.vec, b.vec);
+    break;
+  default:
+    break;
+  }
+}
+
+// check_params compares the parameters of the current item.
+int check_params(Parsers &p) {
+  sf_vec key, ref_key;
+  sf_value val, ref_val;
+
+  for (;;) {
+    auto rv = sf_parser_param(&p.sfp, &key, &val);
+    auto ref_rv = ref_sf_parser_param(&p.ref, &ref_key, &ref_val);
+
+    check_value(rv, ref_rv, val, ref_val);
+
+    if (rv != 0) {
+      return rv == SF_ERR_EOF ? 0 : rv;
+    }
+
+    check_vec(key, ref_key);
+  }
+}
+
+// check_member compares the inner list if |val| is the one, and the
+// parameters of the current member.
+int check_member(Parsers &p, const sf_value &val) {
+  sf_value v, ref_v;
+
+  if (val.type == SF_TYPE_INNER_LIST) {
+    for (;;) {
+      auto rv = sf_parser_inner_list(&p.sfp, &v);
+      auto ref_rv = ref_sf_parser_inner_list(&p.ref, &ref_v);
+
+      check_value(rv, ref_rv, v, ref_v);
+
+      if (rv != 0) {
+        if (rv != SF_ERR_EOF) {
+          return rv;
+        }
+        break;
+      }
+
+      if (check_params(p) != 0) {
+        return -1;
+      }
+    }
+  }
+
+  return check_params(p);
+}
+
+void check_dict(const uint8_t *data, size_t size) {
+  Parsers p;
+  sf_vec key, ref_key;
+  sf_value val, ref_val;
+
+  sf_parser_init(&p.sfp, data, size);
+  ref_sf_parser_init(&p.ref, data, size);
+
+  for (;;) {
+    auto rv = sf_parser_dict(&p.sfp, &key, &val);
+    auto ref_rv = ref_sf_parser_dict(&p.ref, &ref_key, &ref_val);
+
+    check_value(rv, ref_rv, val, ref_val);
+
+    if (rv != 0) {
+      return;
+    }
+
+    check_vec(key, ref_key);
+
+    if (check_member(p, val) != 0) {
+      return;
+    }
+  }
+}
+
+void check_list(const uint8_t *data, size_t size) {
+  Parsers p;
+  sf_value val, ref_val;
+
+  sf_parser_init(&p.sfp, data, size);
+  ref_sf_parser_init(&p.ref, data, size);
+
+  for (;;) {
+    auto rv = sf_parser_list(&p.sfp, &val);
+    auto ref_rv = ref_sf_parser_list(&p.ref, &ref_val);
+
+    check_value(rv, ref_rv, val, ref_val);
+
+    if (rv != 0) {
+      return;
+    }
+
+    if (check_member(p, val) != 0) {
+      return;
+    }
+  }
+}
+
+void check_item(const uint8_t *data, size_t size) {
+  Parsers p;
+  sf_value val, ref_val;
+
+  sf_parser_init(&p.sfp, data, size);
+  ref_sf_parser_init(&p.ref, data, size);
+
+  auto rv = sf_parser_item(&p.sfp, &val);
+  auto ref_rv = ref_sf_parser_item(&p.ref, &ref_val);
+
+  check_value(rv, ref_rv, val, ref_val);
+
+  if (rv != 0 || check_member(p, val) != 0) {
+    return;
+  }
+
+  rv = sf_parser_item(&p.sfp, &val);
+  ref_rv = ref_sf_parser_item(&p.ref, &ref_val);
+
+  check_value(rv, ref_rv, val, ref_val);
+}
+
+// ref_parse_priority is nghttp3_http_parse_priority without the fast
+// path, built on top of the reference parser.
+int ref_parse_priority(nghttp3_pri *dest, const uint8_t *value,
+                       size_t valuelen) {
+  auto pri = *dest;
+  sf_parser sfp;
+  sf_vec key;
+  sf_value val;
+
+  ref_sf_parser_init(&sfp, value, valuelen);
+
+  for (;;) {
+    auto rv = ref_sf_parser_dict(&sfp, &key, &val);
+    if (rv != 0) {
+      if (rv == SF_ERR_EOF) {
+        break;
+      }
+
+      return NGHTTP3_ERR_INVALID_ARGUMENT;
+    }
+
+    if (key.len != 1) {
+      continue;
+    }
+
+    switch (key.base[0]) {
+    case 'i':
+      if (val.type != SF_TYPE_BOOLEAN) {
+        return NGHTTP3_ERR_INVALID_ARGUMENT;
+      }
+
+      pri.inc = static_cast<uint8_t>(val.boolean);
+
+      break;
+    case 'u':
+      if (val.type != SF_TYPE_INTEGER || val.integer < NGHTTP3_URGENCY_HIGH ||
+          NGHTTP3_URGENCY_LOW < val.integer) {
+        return NGHTTP3_ERR_INVALID_ARGUMENT;
+      }
+
+      pri.urgency = static_cast<uint32_t>(val.integer);
+
+      break;
+    }
+  }
+
+  *dest = pri;
+
+  return 0;
+}
+
+void check_priority(const uint8_t *data, size_t size) {
+  nghttp3_pri pri{static_cast<uint32_t>(-1), UINT8_MAX};
+  auto ref_pri = pri;
+
+  auto rv = nghttp3_http_parse_priority(&pri, data, size);
+  auto ref_rv = ref_parse_priority(&ref_pri, data, size);
+
+  if (rv != ref_rv || pri.urgency != ref_pri.urgency ||
+      pri.inc != ref_pri.inc) {
+    abort();
+  }
+}
+} // namespace
+
+// Checks that sfparse in libnghttp3, which might scan the input with
+// SIMD instructions, and nghttp3_http_parse_priority, which has a
+// fast path for the common shapes, produce the same results as the
+// byte at a time reference parser.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  check_dict(data, size);
+  check_list(data, size);
+  check_item(data, size);
+  check_priority(data, size);
+
+  return 0;
+}
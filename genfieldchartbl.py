@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+#
+# Generates nghttp3_http_field_char_class table used in
+# lib/nghttp3_http.c.  Each element is a bitwise-OR of
+# NGHTTP3_HTTP_CHAR_* flags which tell in which part of HTTP field the
+# character is not allowed.
+import sys
+import string
+
+NAME_INVALID = 0x01
+UPPER = 0x02
+VALUE_INVALID = 0x04
+METHOD_INVALID = 0x08
+AUTHORITY_INVALID = 0x10
+PATH_INVALID = 0x20
+SCHEME_INVALID = 0x40
+
+TCHAR = "!#$%&'*+-.^_`|~" + string.digits + string.ascii_letters
+
+def name(i):
+    if i < 0x21:
+        return \
+            ['NUL ', 'SOH ', 'STX ', 'ETX ', 'EOT ', 'ENQ ', 'ACK ', 'BEL ',
+             'BS  ', 'HT  ', 'LF  ', 'VT  ', 'FF  ', 'CR  ', 'SO  ', 'SI  ',
+             'DLE ', 'DC1 ', 'DC2 ', 'DC3 ', 'DC4 ', 'NAK ', 'SYN ', 'ETB ',
+             'CAN ', 'EM  ', 'SUB ', 'ESC ', 'FS  ', 'GS  ', 'RS  ', 'US  ',
+             'SPC '][i]
+    if i == 0x7f:
+        return 'DEL '
+
+def char_class(i):
+    c = chr(i)
+    v = 0
+
+    if not (c in TCHAR and c not in string.ascii_uppercase):
+        v |= NAME_INVALID
+    if c in string.ascii_uppercase:
+        v |= UPPER
+    if not (i == 0x09 or (0x20 <= i and i <= 0x7e) or 0x80 <= i):
+        v |= VALUE_INVALID
+    if c not in TCHAR:
+        v |= METHOD_INVALID
+    if not (c in string.ascii_letters or c in string.digits or
+            c in "-._~!$&'()*+,;=:@[]%"):
+        v |= AUTHORITY_INVALID
+    if not (0x21 <= i and i <= 0x7e or 0x80 <= i):
+        v |= PATH_INVALID
+    if not (c in string.ascii_letters or c in string.digits or c in '+-.'):
+        v |= SCHEME_INVALID
+
+    return v
+
+sys.stdout.write('''\
+/* Generated by genfieldchartbl.py */
+const uint8_t nghttp3_http_field_char_class[] = {
+''')
+
+for i in range(256):
+    v = char_class(i)
+
+    if 0x21 <= i and i < 0x7f:
+        sys.stdout.write('0x{:02x} /* {}    */'.format(v, chr(i)))
+    elif 0x80 <= i:
+        sys.stdout.write('0x{:02x} /* {} */'.format(v, hex(i)))
+    else:
+        sys.stdout.write('0x{:02x} /* {} */'.format(v, name(i)))
+    if i == 255:
+        sys.stdout.write('\n')
+    elif (i + 1) % 4 == 0:
+        sys.stdout.write(',\n')
+    else:
+        sys.stdout.write(', ')
+
+sys.stdout.write('};\n')
@@ -81,6 +81,15 @@ extern "C" {
  */
 typedef ptrdiff_t nghttp3_ssize;
 
+/**
+ * @typedef
+ *
+ * :type:`nghttp3_tstamp` is a timestamp in nanoseconds.  It is
+ * obtained from a monotonic clock of an application.  UINT64_MAX is
+ * not a valid timestamp.
+ */
+typedef uint64_t nghttp3_tstamp;
+
 /**
  * @macro
  *
@@ -552,6 +561,222 @@ typedef struct nghttp3_mem {
  */
 NGHTTP3_EXTERN const nghttp3_mem *nghttp3_mem_default(void);
 
+/**
+ * @macrosection
+ *
+ * Memory allocation tags
+ */
+
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_MEM_TAG_OTHER` is the tag of the allocations which
+ * are not classified by the other tags.
+ */
+#define NGHTTP3_MEM_TAG_OTHER 0
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_MEM_TAG_CONN` is the tag of :type:`nghttp3_conn`
+ * object itself.
+ */
+#define NGHTTP3_MEM_TAG_CONN 1
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_MEM_TAG_STREAM` is the tag of the memory blocks
+ * which hold stream objects.
+ */
+#define NGHTTP3_MEM_TAG_STREAM 2
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_MEM_TAG_OUT_CHUNK` is the tag of the buffers which
+ * hold outgoing stream data.
+ */
+#define NGHTTP3_MEM_TAG_OUT_CHUNK 3
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_MEM_TAG_IN_CHUNK` is the tag of the buffers which
+ * hold incoming data on a stream blocked by QPACK decoder.
+ */
+#define NGHTTP3_MEM_TAG_IN_CHUNK 4
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_MEM_TAG_QPACK_ENTRY` is the tag of QPACK dynamic
+ * table entries.
+ */
+#define NGHTTP3_MEM_TAG_QPACK_ENTRY 5
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_MEM_TAG_RCBUF` is the tag of :type:`nghttp3_rcbuf`
+ * objects, which hold field names and values.
+ */
+#define NGHTTP3_MEM_TAG_RCBUF 6
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_MEM_TAG_REGION` is the tag of the memory blocks of
+ * the region allocator enabled by
+ * :member:`nghttp3_settings.enable_region_allocator`.  The objects
+ * allocated from the region are not tagged individually.
+ */
+#define NGHTTP3_MEM_TAG_REGION 7
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_MEM_TAG_QPACK` is the tag of QPACK encoder and
+ * decoder objects, their buffers, and the bookkeeping of the header
+ * blocks which refer to dynamic table.  Dynamic table entries are
+ * tagged with :macro:`NGHTTP3_MEM_TAG_QPACK_ENTRY`.
+ */
+#define NGHTTP3_MEM_TAG_QPACK 8
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_MEM_TAG_MAX` is the number of memory allocation
+ * tags.
+ */
+#define NGHTTP3_MEM_TAG_MAX 9
+
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_malloc_tagged` is :type:`nghttp3_malloc` which also
+ * takes |tag|, one of ``NGHTTP3_MEM_TAG_*``, which describes what the
+ * memory is used for.  The |user_data| is the
+ * :member:`nghttp3_mem_tagged.user_data`.
+ */
+typedef void *(*nghttp3_malloc_tagged)(size_t size, uint32_t tag,
+                                       void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_calloc_tagged` is :type:`nghttp3_calloc` which also
+ * takes |tag|.  The |user_data| is the
+ * :member:`nghttp3_mem_tagged.user_data`.
+ */
+typedef void *(*nghttp3_calloc_tagged)(size_t nmemb, size_t size,
+                                       uint32_t tag, void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_realloc_tagged` is :type:`nghttp3_realloc` which
+ * also takes |tag|.  The |user_data| is the
+ * :member:`nghttp3_mem_tagged.user_data`.
+ */
+typedef void *(*nghttp3_realloc_tagged)(void *ptr, size_t size, uint32_t tag,
+                                        void *user_data);
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_mem_tagged` is a set of custom memory allocator
+ * functions which receive the tag of each allocation.  It is turned
+ * into :type:`nghttp3_mem` by `nghttp3_mem_tagged_init`.
+ */
+typedef struct nghttp3_mem_tagged {
+  /**
+   * :member:`user_data` is an arbitrary user supplied data.  This is
+   * passed to each allocator function.
+   */
+  void *user_data;
+  /**
+   * :member:`malloc` is a custom allocator function to replace
+   * :manpage:`malloc(3)`.
+   */
+  nghttp3_malloc_tagged malloc;
+  /**
+   * :member:`free` is a custom allocator function to replace
+   * :manpage:`free(3)`.
+   */
+  nghttp3_free free;
+  /**
+   * :member:`calloc` is a custom allocator function to replace
+   * :manpage:`calloc(3)`.
+   */
+  nghttp3_calloc_tagged calloc;
+  /**
+   * :member:`realloc` is a custom allocator function to replace
+   * :manpage:`realloc(3)`.
+   */
+  nghttp3_realloc_tagged realloc;
+} nghttp3_mem_tagged;
+
+/**
+ * @function
+ *
+ * `nghttp3_mem_tagged_init` initializes |mem| so that the library
+ * passes its allocation requests to |tmem| together with the
+ * allocation tag.  |mem| can be passed to any function which takes
+ * :type:`nghttp3_mem`.  |tmem| must outlive |mem|.  The allocations
+ * which the library does not classify are tagged with
+ * :macro:`NGHTTP3_MEM_TAG_OTHER`.
+ */
+NGHTTP3_EXTERN void nghttp3_mem_tagged_init(nghttp3_mem *mem,
+                                            nghttp3_mem_tagged *tmem);
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_mem_counter` is a memory allocator which counts the
+ * number of live bytes per allocation tag.  The details of this
+ * structure are intentionally hidden from the public API.
+ */
+typedef struct nghttp3_mem_counter nghttp3_mem_counter;
+
+/**
+ * @function
+ *
+ * `nghttp3_mem_counter_new` creates :type:`nghttp3_mem_counter`, and
+ * assigns it to |*pcounter|.  The counter allocates memory from
+ * |mem|, which may be NULL to use the default memory allocator.  Each
+ * allocation made through the counter carries a small header which
+ * records its size and tag.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGHTTP3_EXTERN int nghttp3_mem_counter_new(nghttp3_mem_counter **pcounter,
+                                           const nghttp3_mem *mem);
+
+/**
+ * @function
+ *
+ * `nghttp3_mem_counter_del` frees |counter|.  The memory allocated
+ * through |counter| must be freed before calling this function.
+ */
+NGHTTP3_EXTERN void nghttp3_mem_counter_del(nghttp3_mem_counter *counter);
+
+/**
+ * @function
+ *
+ * `nghttp3_mem_counter_get_mem` returns :type:`nghttp3_mem` which
+ * allocates memory through |counter|.  It is valid until |counter| is
+ * freed.
+ */
+NGHTTP3_EXTERN const nghttp3_mem *
+nghttp3_mem_counter_get_mem(nghttp3_mem_counter *counter);
+
+/**
+ * @function
+ *
+ * `nghttp3_mem_counter_get_live_bytes` returns the number of bytes
+ * allocated with |tag| through |counter| and not freed yet.  It
+ * returns 0 if |tag| is not less than :macro:`NGHTTP3_MEM_TAG_MAX`.
+ * The allocation headers are not included.
+ */
+NGHTTP3_EXTERN uint64_t nghttp3_mem_counter_get_live_bytes(
+    const nghttp3_mem_counter *counter, uint32_t tag);
+
 /**
  * @struct
  *
@@ -1612,7 +1837,8 @@ NGHTTP3_EXTERN void nghttp3_set_debug_vprintf_callback(
 typedef struct nghttp3_conn nghttp3_conn;
 
 #define NGHTTP3_SETTINGS_V1 1
-#define NGHTTP3_SETTINGS_VERSION NGHTTP3_SETTINGS_V1
+#define NGHTTP3_SETTINGS_V2 2
+#define NGHTTP3_SETTINGS_VERSION NGHTTP3_SETTINGS_V2
 
 /**
  * @struct
@@ -1659,6 +1885,86 @@ typedef struct nghttp3_settings {
    * Datagrams (see :rfc:`9297`).
    */
   uint8_t h3_datagram;
+  /* The following fields have been added since NGHTTP3_SETTINGS_V2. */
+  /**
+   * :member:`stream_send_buffer_high_watermark` is the number of
+   * bytes buffered for a stream, which are either unsent or unacked,
+   * at or above which
+   * :member:`nghttp3_callbacks.send_buffer_watermark` is called with
+   * nonzero |high|.  If this field is 0, stream level notification is
+   * disabled.  This is a local configuration and is not sent to a
+   * remote endpoint.
+   */
+  uint64_t stream_send_buffer_high_watermark;
+  /**
+   * :member:`stream_send_buffer_low_watermark` is the number of bytes
+   * buffered for a stream at or below which
+   * :member:`nghttp3_callbacks.send_buffer_watermark` is called with
+   * |high| = 0 after the high watermark has been reached.  It must be
+   * less than :member:`stream_send_buffer_high_watermark` if the
+   * latter is nonzero.
+   */
+  uint64_t stream_send_buffer_low_watermark;
+  /**
+   * :member:`conn_send_buffer_high_watermark` is the same as
+   * :member:`stream_send_buffer_high_watermark`, but it is applied to
+   * the number of bytes buffered for all streams in a connection.
+   */
+  uint64_t conn_send_buffer_high_watermark;
+  /**
+   * :member:`conn_send_buffer_low_watermark` is the same as
+   * :member:`stream_send_buffer_low_watermark`, but it is applied to
+   * the number of bytes buffered for all streams in a connection.
+   */
+  uint64_t conn_send_buffer_low_watermark;
+  /**
+   * :member:`conn_memory_limit` is the maximum number of bytes that a
+   * connection may use for its streams, their buffered data, and
+   * QPACK dynamic tables as reported by
+   * `nghttp3_conn_get_memory_usage`.  If it is 0, no limit is
+   * enforced.  While the usage exceeds this limit, a new request
+   * stream initiated by remote endpoint is rejected with
+   * :macro:`NGHTTP3_H3_REQUEST_REJECTED`, and if reading data makes
+   * the usage grow beyond the limit, the request stream which uses
+   * the most memory is reset with :macro:`NGHTTP3_H3_EXCESSIVE_LOAD`
+   * and its buffered incoming data are discarded.  The memory used
+   * by the request streams which are rejected, reset, or no longer
+   * read is not counted against the limit.  Streams initiated
+   * locally are not rejected.
+   */
+  uint64_t conn_memory_limit;
+  /**
+   * :member:`enable_region_allocator`, if set to nonzero, makes a
+   * connection allocate all its internal objects from memory blocks
+   * which are obtained from :type:`nghttp3_mem` in bulk.  Freed
+   * objects are kept for reuse by the connection, and memory blocks
+   * are not returned to :type:`nghttp3_mem` until `nghttp3_conn_del`
+   * is called, which releases them without visiting each object.
+   * This reduces the cost of connection teardown.
+   * :type:`nghttp3_rcbuf` objects passed to an application are not
+   * allocated from the region, and they can outlive the connection.
+   */
+  uint8_t enable_region_allocator;
+  /**
+   * :member:`qpack_unblock_budget` is the maximum number of bytes of
+   * buffered request stream data that a connection processes per
+   * call when streams blocked by QPACK decoder are unblocked.  If it
+   * is 0, all buffered data of unblocked streams are processed in
+   * `nghttp3_conn_read_stream` call which receives the encoder
+   * stream data that unblock them.  Otherwise, the remaining data
+   * are processed in the subsequent calls of
+   * `nghttp3_conn_read_stream`, `nghttp3_conn_read_streamv`,
+   * `nghttp3_conn_read_streams`, and `nghttp3_conn_writev_stream`,
+   * each of which processes at most this number of bytes.  This
+   * bounds the latency of a single call when many streams are
+   * unblocked at once.  If it is not 0, an application must call
+   * `nghttp3_conn_has_pending_unblocked_streams` after reading and
+   * writing stream data, and while it returns nonzero, keep calling
+   * `nghttp3_conn_writev_stream` even if no stream data are produced
+   * and no more data are received from the remote endpoint.
+   * Otherwise, the remaining data might never be processed.
+   */
+  size_t qpack_unblock_budget;
 } nghttp3_settings;
 
 /**
@@ -1716,6 +2022,31 @@ typedef int (*nghttp3_recv_data)(nghttp3_conn *conn, int64_t stream_id,
                                  const uint8_t *data, size_t datalen,
                                  void *conn_user_data, void *stream_user_data);
 
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_recv_datav` is a callback function which is invoked
+ * when parts of request or response body on stream identified by
+ * |stream_id| are received.  Unlike :type:`nghttp3_recv_data`, the
+ * payloads of consecutive DATA frames processed in a single read are
+ * passed at once in |vec| of length |veccnt|.  |veccnt| is always
+ * greater than 0.
+ *
+ * The application is responsible for increasing flow control credit
+ * by the total length of data in |vec|.  The frame headers between
+ * the payloads are included in the number of bytes consumed that
+ * `nghttp3_conn_read_stream` returns as usual.
+ *
+ * The implementation of this callback must return 0 if it succeeds.
+ * Returning :macro:`NGHTTP3_ERR_CALLBACK_FAILURE` will return to the
+ * caller immediately.  Any values other than 0 is treated as
+ * :macro:`NGHTTP3_ERR_CALLBACK_FAILURE`.
+ */
+typedef int (*nghttp3_recv_datav)(nghttp3_conn *conn, int64_t stream_id,
+                                  const nghttp3_vec *vec, size_t veccnt,
+                                  void *conn_user_data,
+                                  void *stream_user_data);
+
 /**
  * @functypedef
  *
@@ -1898,110 +2229,543 @@ typedef int (*nghttp3_recv_settings)(nghttp3_conn *conn,
                                      const nghttp3_settings *settings,
                                      void *conn_user_data);
 
-#define NGHTTP3_CALLBACKS_V1 1
-#define NGHTTP3_CALLBACKS_VERSION NGHTTP3_CALLBACKS_V1
-
 /**
- * @struct
+ * @functypedef
  *
- * :type:`nghttp3_callbacks` holds a set of callback functions.
- */
-typedef struct nghttp3_callbacks {
-  /**
-   * :member:`acked_stream_data` is a callback function which is
-   * invoked when data sent on a particular stream have been
-   * acknowledged by a remote endpoint.
-   */
-  nghttp3_acked_stream_data acked_stream_data;
-  /**
-   * :member:`stream_close` is a callback function which is invoked
-   * when a particular stream has closed.
-   */
-  nghttp3_stream_close stream_close;
-  /**
-   * :member:`recv_data` is a callback function which is invoked when
-   * stream data is received.
-   */
-  nghttp3_recv_data recv_data;
-  /**
-   * :member:`deferred_consume` is a callback function which is
-   * invoked when the library consumed data for a particular stream
-   * which had been blocked for synchronization between streams.
-   */
-  nghttp3_deferred_consume deferred_consume;
-  /**
-   * :member:`begin_headers` is a callback function which is invoked
-   * when an HTTP header field section has started on a particular
-   * stream.
-   */
-  nghttp3_begin_headers begin_headers;
-  /**
-   * :member:`recv_header` is a callback function which is invoked
-   * when a single HTTP header field is received on a particular
-   * stream.
-   */
-  nghttp3_recv_header recv_header;
-  /**
-   * :member:`end_headers` is a callback function which is invoked
-   * when an HTTP header field section has ended on a particular
-   * stream.
-   */
-  nghttp3_end_headers end_headers;
-  /**
-   * :member:`begin_trailers` is a callback function which is invoked
-   * when an HTTP trailer field section has started on a particular
-   * stream.
-   */
-  nghttp3_begin_headers begin_trailers;
-  /**
-   * :member:`recv_trailer` is a callback function which is invoked
-   * when a single HTTP trailer field is received on a particular
-   * stream.
-   */
-  nghttp3_recv_header recv_trailer;
-  /**
-   * :member:`end_trailers` is a callback function which is invoked
-   * when an HTTP trailer field section has ended on a particular
-   * stream.
-   */
-  nghttp3_end_headers end_trailers;
-  /**
-   * :member:`stop_sending` is a callback function which is invoked
-   * when the library asks application to send STOP_SENDING to a
-   * particular stream.
-   */
-  nghttp3_stop_sending stop_sending;
-  /**
-   * :member:`end_stream` is a callback function which is invoked when
-   * a receiving side of stream has been closed.
-   */
-  nghttp3_end_stream end_stream;
-  /**
-   * :member:`reset_stream` is a callback function which is invoked
-   * when the library asks application to reset stream (by sending
-   * RESET_STREAM).
-   */
-  nghttp3_reset_stream reset_stream;
-  /**
-   * :member:`shutdown` is a callback function which is invoked when
-   * the remote endpoint has signalled initiation of connection
-   * shutdown.
-   */
-  nghttp3_shutdown shutdown;
-  /**
-   * :member:`recv_settings` is a callback function which is invoked
-   * when SETTINGS frame is received.
-   */
-  nghttp3_recv_settings recv_settings;
-} nghttp3_callbacks;
-
-/**
- * @function
+ * :type:`nghttp3_release_blocked_data` is a callback function which
+ * is invoked when the library no longer refers to the data pointed
+ * by |data| of length |datalen| which it has kept by reference while
+ * stream identified by |stream_id| is blocked by QPACK decoder.
+ * |data| is a part of the buffer passed to
+ * `nghttp3_conn_read_stream` (or its variants), and it starts at the
+ * first byte which was not consumed by the call and ends at the end
+ * of the buffer.  A single buffer is released at most once.
  *
- * `nghttp3_settings_default` fills |settings| with the default
- * values.
+ * This callback is not called for the data still referenced when
+ * `nghttp3_conn_del` is called.
  *
- * - :member:`max_field_section_size
+ * The data kept by reference count toward
+ * :member:`nghttp3_settings.conn_memory_limit` in the same way as the
+ * data copied into the library's own buffers.
+ *
+ * The implementation of this callback must return 0 if it succeeds.
+ * Returning :macro:`NGHTTP3_ERR_CALLBACK_FAILURE` will return to the
+ * caller immediately.  Any values other than 0 is treated as
+ * :macro:`NGHTTP3_ERR_CALLBACK_FAILURE`.
+ */
+typedef int (*nghttp3_release_blocked_data)(nghttp3_conn *conn,
+                                            int64_t stream_id,
+                                            const uint8_t *data,
+                                            size_t datalen,
+                                            void *conn_user_data,
+                                            void *stream_user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_send_buffer_watermark` is a callback function which
+ * is invoked when the number of bytes buffered for sending, which
+ * are either unsent or unacknowledged, crosses a watermark configured
+ * in :type:`nghttp3_settings`.  If |high| is nonzero, |buffered|
+ * reached high watermark, and an application should stop producing
+ * data until this callback is called with |high| = 0, which indicates
+ * that |buffered| has gone down to low watermark.
+ *
+ * If |stream_id| is -1, the notification is for a connection, and
+ * |buffered| is the sum of bytes buffered for all streams.
+ * |stream_user_data| is NULL in this case.
+ *
+ * The implementation of this callback must return 0 if it succeeds.
+ * Returning :macro:`NGHTTP3_ERR_CALLBACK_FAILURE` will return to the
+ * caller immediately.  Any values other than 0 is treated as
+ * :macro:`NGHTTP3_ERR_CALLBACK_FAILURE`.
+ */
+typedef int (*nghttp3_send_buffer_watermark)(nghttp3_conn *conn,
+                                             int64_t stream_id, int high,
+                                             uint64_t buffered,
+                                             void *conn_user_data,
+                                             void *stream_user_data);
+
+/**
+ * @macrosection
+ *
+ * Trace event types
+ */
+
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_EVENT_FRAME_SENT` indicates that a frame has
+ * been serialized for sending.  The payload is
+ * ``data.frame`` of :type:`nghttp3_trace_event`.
+ */
+#define NGHTTP3_TRACE_EVENT_FRAME_SENT 0x01u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_EVENT_FRAME_RECV` indicates that the header of
+ * a frame has been received.  The payload is
+ * ``data.frame`` of :type:`nghttp3_trace_event`.
+ */
+#define NGHTTP3_TRACE_EVENT_FRAME_RECV 0x02u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT` indicates that
+ * a QPACK encoder or decoder stream instruction has been generated.
+ * The payload is ``data.qpack`` of :type:`nghttp3_trace_event`.
+ */
+#define NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT 0x03u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_RECV` indicates that
+ * a QPACK encoder or decoder stream instruction has been processed.
+ * The payload is ``data.qpack`` of :type:`nghttp3_trace_event`.
+ */
+#define NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_RECV 0x04u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_EVENT_STREAM_STATE` indicates that a stream
+ * has changed its state.  The payload is
+ * ``data.stream`` of :type:`nghttp3_trace_event`.
+ */
+#define NGHTTP3_TRACE_EVENT_STREAM_STATE 0x05u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_EVENT_SCHEDULE` indicates that the stream
+ * scheduler has chosen a request stream to write.  The payload is
+ * ``data.schedule`` of :type:`nghttp3_trace_event`.
+ */
+#define NGHTTP3_TRACE_EVENT_SCHEDULE 0x06u
+
+/**
+ * @macrosection
+ *
+ * QPACK instructions in trace events
+ */
+
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_QPACK_SET_DTABLE_CAPACITY` is Set Dynamic
+ * Table Capacity.  :member:`nghttp3_trace_qpack_instruction.value` is
+ * the capacity.
+ */
+#define NGHTTP3_TRACE_QPACK_SET_DTABLE_CAPACITY 0x01u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_QPACK_INSERT_WITH_STATIC_NAME_REF` is Insert
+ * with Name Reference to the static table.
+ * :member:`nghttp3_trace_qpack_instruction.value` is the index of the
+ * static table entry.
+ */
+#define NGHTTP3_TRACE_QPACK_INSERT_WITH_STATIC_NAME_REF 0x02u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_QPACK_INSERT_WITH_DYNAMIC_NAME_REF` is Insert
+ * with Name Reference to the dynamic table.
+ * :member:`nghttp3_trace_qpack_instruction.value` is the absolute
+ * index of the referenced entry.
+ */
+#define NGHTTP3_TRACE_QPACK_INSERT_WITH_DYNAMIC_NAME_REF 0x03u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_QPACK_INSERT_WITH_LITERAL_NAME` is Insert
+ * with Literal Name.  :member:`nghttp3_trace_qpack_instruction.value`
+ * is 0.
+ */
+#define NGHTTP3_TRACE_QPACK_INSERT_WITH_LITERAL_NAME 0x04u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_QPACK_DUPLICATE` is Duplicate.
+ * :member:`nghttp3_trace_qpack_instruction.value` is the absolute
+ * index of the duplicated entry.
+ */
+#define NGHTTP3_TRACE_QPACK_DUPLICATE 0x05u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_QPACK_SECTION_ACK` is Section
+ * Acknowledgment.  :member:`nghttp3_trace_qpack_instruction.value`
+ * is the stream ID.
+ */
+#define NGHTTP3_TRACE_QPACK_SECTION_ACK 0x06u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_QPACK_STREAM_CANCEL` is Stream Cancellation.
+ * :member:`nghttp3_trace_qpack_instruction.value` is the stream ID.
+ */
+#define NGHTTP3_TRACE_QPACK_STREAM_CANCEL 0x07u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_QPACK_INSERT_COUNT_INCREMENT` is Insert Count
+ * Increment.  :member:`nghttp3_trace_qpack_instruction.value` is the
+ * increment.
+ */
+#define NGHTTP3_TRACE_QPACK_INSERT_COUNT_INCREMENT 0x08u
+
+/**
+ * @macrosection
+ *
+ * Stream states in trace events
+ */
+
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_STREAM_OPENED` indicates that a stream has
+ * been created.
+ */
+#define NGHTTP3_TRACE_STREAM_OPENED 0x01u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_STREAM_CLOSED` indicates that a stream has
+ * been closed by `nghttp3_conn_close_stream`.
+ * :member:`nghttp3_trace_stream_state.app_error_code` is the error
+ * code passed to it.
+ */
+#define NGHTTP3_TRACE_STREAM_CLOSED 0x02u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_STREAM_QPACK_BLOCKED` indicates that a stream
+ * has been blocked by QPACK decoder.
+ */
+#define NGHTTP3_TRACE_STREAM_QPACK_BLOCKED 0x03u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_STREAM_QPACK_UNBLOCKED` indicates that a
+ * stream is no longer blocked by QPACK decoder.
+ */
+#define NGHTTP3_TRACE_STREAM_QPACK_UNBLOCKED 0x04u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_STREAM_READ_DATA_BLOCKED` indicates that
+ * :type:`nghttp3_read_data_callback` has returned
+ * :macro:`NGHTTP3_ERR_WOULDBLOCK`.
+ */
+#define NGHTTP3_TRACE_STREAM_READ_DATA_BLOCKED 0x05u
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_TRACE_STREAM_READ_DATA_RESUMED` indicates that a
+ * stream has been resumed by `nghttp3_conn_resume_stream`.
+ */
+#define NGHTTP3_TRACE_STREAM_READ_DATA_RESUMED 0x06u
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_trace_frame` is the payload of frame events.
+ */
+typedef struct nghttp3_trace_frame {
+  /**
+   * :member:`stream_id` is the stream ID which the frame is sent or
+   * received on.
+   */
+  int64_t stream_id;
+  /**
+   * :member:`type` is the frame type.
+   */
+  int64_t type;
+  /**
+   * :member:`length` is the length of the frame payload.
+   */
+  int64_t length;
+} nghttp3_trace_frame;
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_trace_qpack_instruction` is the payload of QPACK
+ * instruction events.
+ */
+typedef struct nghttp3_trace_qpack_instruction {
+  /**
+   * :member:`instruction` is one of
+   * :macro:`NGHTTP3_TRACE_QPACK_SET_DTABLE_CAPACITY
+   * <NGHTTP3_TRACE_QPACK_SET_DTABLE_CAPACITY>` and its friends.
+   */
+  uint32_t instruction;
+  /**
+   * :member:`value` is the instruction specific value.
+   */
+  uint64_t value;
+  /**
+   * :member:`insert_count` is the insert count of the dynamic table
+   * after the instruction is applied.  For Insert Count Increment and
+   * Section Acknowledgment received by QPACK encoder, it is the
+   * insert count of the encoder.
+   */
+  uint64_t insert_count;
+} nghttp3_trace_qpack_instruction;
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_trace_stream_state` is the payload of
+ * :macro:`NGHTTP3_TRACE_EVENT_STREAM_STATE`.
+ */
+typedef struct nghttp3_trace_stream_state {
+  /**
+   * :member:`stream_id` is the stream ID.
+   */
+  int64_t stream_id;
+  /**
+   * :member:`state` is one of :macro:`NGHTTP3_TRACE_STREAM_OPENED
+   * <NGHTTP3_TRACE_STREAM_OPENED>` and its friends.
+   */
+  uint32_t state;
+  /**
+   * :member:`app_error_code` is the application error code if
+   * :member:`state` is :macro:`NGHTTP3_TRACE_STREAM_CLOSED`.
+   * Otherwise it is 0.
+   */
+  uint64_t app_error_code;
+} nghttp3_trace_stream_state;
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_trace_schedule` is the payload of
+ * :macro:`NGHTTP3_TRACE_EVENT_SCHEDULE`.
+ */
+typedef struct nghttp3_trace_schedule {
+  /**
+   * :member:`stream_id` is the stream ID which is chosen.
+   */
+  int64_t stream_id;
+  /**
+   * :member:`urgency` is the urgency of the stream.
+   */
+  uint32_t urgency;
+  /**
+   * :member:`inc` is nonzero if the stream is processed
+   * incrementally.
+   */
+  uint8_t inc;
+} nghttp3_trace_schedule;
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_trace_event` is a trace event passed to
+ * :type:`nghttp3_trace`.
+ */
+typedef struct nghttp3_trace_event {
+  /**
+   * :member:`type` is one of :macro:`NGHTTP3_TRACE_EVENT_FRAME_SENT
+   * <NGHTTP3_TRACE_EVENT_FRAME_SENT>` and its friends, and it
+   * determines which member of :member:`data` is valid.
+   */
+  uint32_t type;
+  /**
+   * :member:`data` is the payload of the event.
+   */
+  union {
+    /**
+     * :member:`frame` is the payload of
+     * :macro:`NGHTTP3_TRACE_EVENT_FRAME_SENT` and
+     * :macro:`NGHTTP3_TRACE_EVENT_FRAME_RECV`.
+     */
+    nghttp3_trace_frame frame;
+    /**
+     * :member:`qpack` is the payload of
+     * :macro:`NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT` and
+     * :macro:`NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_RECV`.
+     */
+    nghttp3_trace_qpack_instruction qpack;
+    /**
+     * :member:`stream` is the payload of
+     * :macro:`NGHTTP3_TRACE_EVENT_STREAM_STATE`.
+     */
+    nghttp3_trace_stream_state stream;
+    /**
+     * :member:`schedule` is the payload of
+     * :macro:`NGHTTP3_TRACE_EVENT_SCHEDULE`.
+     */
+    nghttp3_trace_schedule schedule;
+  } data;
+} nghttp3_trace_event;
+
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_trace` is a callback function which is invoked for
+ * each event described by |ev|.  |ev| is only valid during the call.
+ * The events are emitted synchronously from the library function
+ * which causes them, so the implementation should be quick, and must
+ * not call any nghttp3 function for |conn|.
+ */
+typedef void (*nghttp3_trace)(nghttp3_conn *conn, const nghttp3_trace_event *ev,
+                              void *conn_user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_get_timestamp` is a callback function which is
+ * invoked when the library needs the current time to measure the
+ * durations reported in :type:`nghttp3_conn_stats`.  It must return
+ * the current timestamp, which must not go backwards.  It must not
+ * return UINT64_MAX.
+ */
+typedef nghttp3_tstamp (*nghttp3_get_timestamp)(nghttp3_conn *conn,
+                                                void *conn_user_data);
+
+#define NGHTTP3_CALLBACKS_V1 1
+#define NGHTTP3_CALLBACKS_V2 2
+#define NGHTTP3_CALLBACKS_VERSION NGHTTP3_CALLBACKS_V2
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_callbacks` holds a set of callback functions.
+ */
+typedef struct nghttp3_callbacks {
+  /**
+   * :member:`acked_stream_data` is a callback function which is
+   * invoked when data sent on a particular stream have been
+   * acknowledged by a remote endpoint.
+   */
+  nghttp3_acked_stream_data acked_stream_data;
+  /**
+   * :member:`stream_close` is a callback function which is invoked
+   * when a particular stream has closed.
+   */
+  nghttp3_stream_close stream_close;
+  /**
+   * :member:`recv_data` is a callback function which is invoked when
+   * stream data is received.
+   */
+  nghttp3_recv_data recv_data;
+  /**
+   * :member:`deferred_consume` is a callback function which is
+   * invoked when the library consumed data for a particular stream
+   * which had been blocked for synchronization between streams.
+   */
+  nghttp3_deferred_consume deferred_consume;
+  /**
+   * :member:`begin_headers` is a callback function which is invoked
+   * when an HTTP header field section has started on a particular
+   * stream.
+   */
+  nghttp3_begin_headers begin_headers;
+  /**
+   * :member:`recv_header` is a callback function which is invoked
+   * when a single HTTP header field is received on a particular
+   * stream.
+   */
+  nghttp3_recv_header recv_header;
+  /**
+   * :member:`end_headers` is a callback function which is invoked
+   * when an HTTP header field section has ended on a particular
+   * stream.
+   */
+  nghttp3_end_headers end_headers;
+  /**
+   * :member:`begin_trailers` is a callback function which is invoked
+   * when an HTTP trailer field section has started on a particular
+   * stream.
+   */
+  nghttp3_begin_headers begin_trailers;
+  /**
+   * :member:`recv_trailer` is a callback function which is invoked
+   * when a single HTTP trailer field is received on a particular
+   * stream.
+   */
+  nghttp3_recv_header recv_trailer;
+  /**
+   * :member:`end_trailers` is a callback function which is invoked
+   * when an HTTP trailer field section has ended on a particular
+   * stream.
+   */
+  nghttp3_end_headers end_trailers;
+  /**
+   * :member:`stop_sending` is a callback function which is invoked
+   * when the library asks application to send STOP_SENDING to a
+   * particular stream.
+   */
+  nghttp3_stop_sending stop_sending;
+  /**
+   * :member:`end_stream` is a callback function which is invoked when
+   * a receiving side of stream has been closed.
+   */
+  nghttp3_end_stream end_stream;
+  /**
+   * :member:`reset_stream` is a callback function which is invoked
+   * when the library asks application to reset stream (by sending
+   * RESET_STREAM).
+   */
+  nghttp3_reset_stream reset_stream;
+  /**
+   * :member:`shutdown` is a callback function which is invoked when
+   * the remote endpoint has signalled initiation of connection
+   * shutdown.
+   */
+  nghttp3_shutdown shutdown;
+  /**
+   * :member:`recv_settings` is a callback function which is invoked
+   * when SETTINGS frame is received.
+   */
+  nghttp3_recv_settings recv_settings;
+  /* The following fields have been added since NGHTTP3_CALLBACKS_V2. */
+  /**
+   * :member:`send_buffer_watermark` is a callback function which is
+   * invoked when the number of bytes buffered for sending crosses
+   * watermark.
+   */
+  nghttp3_send_buffer_watermark send_buffer_watermark;
+  /**
+   * :member:`recv_datav` is a callback function which is invoked when
+   * request or response body is received.  If this field is set,
+   * :member:`recv_data` is not called.
+   */
+  nghttp3_recv_datav recv_datav;
+  /**
+   * :member:`release_blocked_data` is a callback function which is
+   * invoked when the library releases the incoming data which it
+   * keeps by reference.  If this field is set, the data received on
+   * a request stream blocked by QPACK decoder are not copied, and the
+   * application must keep the buffer passed to
+   * `nghttp3_conn_read_stream` (or its variants) unmodified until
+   * this callback is called for it.  Otherwise, they are copied to
+   * the buffers allocated from the connection.
+   */
+  nghttp3_release_blocked_data release_blocked_data;
+  /**
+   * :member:`trace` is a callback function which is invoked for the
+   * structured trace events.  If it is NULL, no event is generated,
+   * and tracing costs a single branch at each trace point.
+   */
+  nghttp3_trace trace;
+  /**
+   * :member:`get_timestamp` is a callback function which returns the
+   * current time.  If it is NULL, the library does not measure any
+   * durations, and the histograms in :type:`nghttp3_conn_stats` stay
+   * empty.
+   */
+  nghttp3_get_timestamp get_timestamp;
+} nghttp3_callbacks;
+
+/**
+ * @function
+ *
+ * `nghttp3_settings_default` fills |settings| with the default
+ * values.
+ *
+ * - :member:`max_field_section_size
  *   <nghttp3_settings.max_field_section_size>` = :expr:`((1ull << 62) - 1)`
  * - :member:`qpack_max_dtable_capacity
  *   <nghttp3_settings.qpack_max_dtable_capacity>` = 0
@@ -2027,6 +2791,9 @@ nghttp3_settings_default_versioned(int settings_version,
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
+ * :macro:`NGHTTP3_ERR_INVALID_ARGUMENT`
+ *     A low watermark in |settings| is not less than the
+ *     corresponding nonzero high watermark.
  * :macro:`NGHTTP3_ERR_NOMEM`
  *     Out of memory.
  */
@@ -2048,6 +2815,9 @@ nghttp3_conn_client_new_versioned(nghttp3_conn **pconn, int callbacks_version,
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
+ * :macro:`NGHTTP3_ERR_INVALID_ARGUMENT`
+ *     A low watermark in |settings| is not less than the
+ *     corresponding nonzero high watermark.
  * :macro:`NGHTTP3_ERR_NOMEM`
  *     Out of memory.
  */
@@ -2134,6 +2904,84 @@ NGHTTP3_EXTERN nghttp3_ssize nghttp3_conn_read_stream(nghttp3_conn *conn,
                                                       const uint8_t *src,
                                                       size_t srclen, int fin);
 
+/**
+ * @function
+ *
+ * `nghttp3_conn_read_streamv` is similar to `nghttp3_conn_read_stream`,
+ * but it reads data given in |vec| of length |veccnt| on stream
+ * identified by |stream_id|.  The data is treated as if they are
+ * concatenated in order, and frames that span across the elements of
+ * |vec| are parsed without copying.  The stream is looked up only
+ * once per call.  If |fin| is nonzero, the data is the last data from
+ * remote endpoint in this stream.
+ *
+ * This function returns the number of bytes consumed, or one of the
+ * following negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_INVALID_ARGUMENT`
+ *     The total length of data in |vec| is too large.
+ * :macro:`NGHTTP3_ERR_NOMEM`
+ *     Out of memory.
+ * :macro:`NGHTTP3_ERR_CALLBACK_FAILURE`
+ *     User callback failed.
+ *
+ * It may return the other error codes just like
+ * `nghttp3_conn_read_stream`.  The negative error code means that
+ * |conn| encountered a connection error.
+ */
+NGHTTP3_EXTERN nghttp3_ssize nghttp3_conn_read_streamv(nghttp3_conn *conn,
+                                                       int64_t stream_id,
+                                                       const nghttp3_vec *vec,
+                                                       size_t veccnt, int fin);
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_stream_input` is a chunk of data received on a
+ * stream, which is passed to `nghttp3_conn_read_streams`.
+ */
+typedef struct nghttp3_stream_input {
+  /**
+   * :member:`stream_id` is the stream ID on which the data is
+   * received.
+   */
+  int64_t stream_id;
+  /**
+   * :member:`data` points to the received data.
+   */
+  const uint8_t *data;
+  /**
+   * :member:`datalen` is the length of :member:`data`.
+   */
+  size_t datalen;
+  /**
+   * :member:`fin` is nonzero if :member:`data` is the last data from
+   * remote endpoint in this stream.
+   */
+  int fin;
+} nghttp3_stream_input;
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_read_streams` reads |ninputs| chunks of stream data
+ * given in |inputs| in order, which typically come from a single
+ * QUIC packet.  It is equivalent to calling
+ * `nghttp3_conn_read_stream` for each element of |inputs|, but
+ * consecutive elements for the same stream share a stream lookup,
+ * and the connection-wide checks are done once per call.  The number
+ * of bytes consumed for inputs[i] is assigned to consumed[i].
+ * |consumed| must have at least |ninputs| elements.
+ *
+ * This function returns 0 if it succeeds, or the negative error code
+ * that `nghttp3_conn_read_stream` returns.  The negative error code
+ * means that |conn| encountered a connection error, and the contents
+ * of |consumed| are unspecified.
+ */
+NGHTTP3_EXTERN int nghttp3_conn_read_streams(nghttp3_conn *conn,
+                                             const nghttp3_stream_input *inputs,
+                                             size_t ninputs, size_t *consumed);
+
 /**
  * @function
  *
@@ -2190,11 +3038,37 @@ NGHTTP3_EXTERN nghttp3_ssize nghttp3_conn_writev_stream(nghttp3_conn *conn,
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
- * :macro:`NGHTTP3_ERR_NOMEM`
- *     Out of memory.
+ * :macro:`NGHTTP3_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGHTTP3_EXTERN int nghttp3_conn_add_write_offset(nghttp3_conn *conn,
+                                                 int64_t stream_id, size_t n);
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_set_write_budget` tells |conn| the number of bytes
+ * |budget| that underlying QUIC stack is able to send now, e.g.,
+ * congestion window minus bytes in flight, or the number of bytes
+ * that pacer allows to send.  By default, the library calls
+ * :type:`nghttp3_read_data_callback` at most once per
+ * `nghttp3_conn_writev_stream` call, and stops buffering frames once
+ * 4096 bytes are buffered.  If budget is given, the library keeps
+ * pulling stream data until the buffered unsent data reaches the
+ * budget, so that a single `nghttp3_conn_writev_stream` call can
+ * fill what the QUIC stack is able to send.  The budget is clamped to the internal lower
+ * and upper bounds so that a stream makes progress without
+ * buffering excessively.
+ *
+ * The budget is decreased by the number of bytes passed to
+ * `nghttp3_conn_add_write_offset`.  An application can call this
+ * function per connection, or before each
+ * `nghttp3_conn_writev_stream` call to give a per call budget.
+ *
+ * If |budget| is 0, the library goes back to its built-in default.
  */
-NGHTTP3_EXTERN int nghttp3_conn_add_write_offset(nghttp3_conn *conn,
-                                                 int64_t stream_id, size_t n);
+NGHTTP3_EXTERN void nghttp3_conn_set_write_budget(nghttp3_conn *conn,
+                                                  uint64_t budget);
 
 /**
  * @function
@@ -2725,6 +3599,186 @@ NGHTTP3_EXTERN int nghttp3_conn_set_server_stream_priority_versioned(
     nghttp3_conn *conn, int64_t stream_id, int pri_version,
     const nghttp3_pri *pri);
 
+/**
+ * @function
+ *
+ * `nghttp3_conn_set_stream_deadline` sets the completion deadline
+ * |deadline| to a stream denoted by |stream_id|.  |stream_id| must
+ * identify client initiated bidirectional stream.  |deadline| is an
+ * application defined timestamp (e.g., nanoseconds from an arbitrary
+ * point in time), and only its order matters.
+ *
+ * The built-in scheduler writes the streams of the same urgency in
+ * the order of earliest deadline first.  Streams without deadline
+ * come after them, and they are scheduled in the same way as
+ * before.  Passing ``UINT64_MAX`` as |deadline| removes the deadline.
+ * Deadline is not used by the scheduler set by
+ * `nghttp3_conn_set_scheduler_versioned`.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_INVALID_ARGUMENT`
+ *     |stream_id| is not a client initiated bidirectional stream ID.
+ * :macro:`NGHTTP3_ERR_STREAM_NOT_FOUND`
+ *     Stream not found.
+ * :macro:`NGHTTP3_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGHTTP3_EXTERN int nghttp3_conn_set_stream_deadline(nghttp3_conn *conn,
+                                                    int64_t stream_id,
+                                                    uint64_t deadline);
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_set_urgency_quantum` makes the built-in scheduler of
+ * |conn| share bandwidth among incremental streams of urgency level
+ * |urgency| by deficit round robin with the byte quantum |quantum|.
+ * A stream can write up to |quantum| bytes in its round before the
+ * other incremental streams of the same urgency get their turn.  A
+ * larger quantum reduces the scheduling overhead for many parallel
+ * transfers at the expense of the latency of interleaving.
+ *
+ * If |quantum| is 0, which is the default, an incremental stream
+ * yields to the other streams every time it writes a few hundred
+ * bytes.  Non-incremental streams are not affected by this setting.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_INVALID_ARGUMENT`
+ *     |urgency| is larger than :macro:`NGHTTP3_URGENCY_LOW`.
+ */
+NGHTTP3_EXTERN int nghttp3_conn_set_urgency_quantum(nghttp3_conn *conn,
+                                                    uint32_t urgency,
+                                                    uint64_t quantum);
+
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_scheduler_schedule` is a callback function which is
+ * invoked when a stream denoted by |stream_id| has data to send and
+ * is not scheduled yet.  |pri| is the current priority of the stream.
+ * It is not called for a stream which is already scheduled.
+ *
+ * The implementation of this callback must return 0 if it succeeds.
+ * Returning :macro:`NGHTTP3_ERR_CALLBACK_FAILURE` will return to the
+ * caller immediately.  Any values other than 0 is treated as
+ * :macro:`NGHTTP3_ERR_CALLBACK_FAILURE`.
+ */
+typedef int (*nghttp3_scheduler_schedule)(nghttp3_conn *conn,
+                                          int64_t stream_id,
+                                          const nghttp3_pri *pri,
+                                          void *sched_user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_scheduler_unschedule` is a callback function which
+ * is invoked when a stream denoted by |stream_id| has no data to send
+ * for now, is blocked, is closed, or its priority is about to
+ * change.  In the last case,
+ * :member:`nghttp3_scheduler.schedule` is called with the new
+ * priority right after this callback returns.
+ */
+typedef void (*nghttp3_scheduler_unschedule)(nghttp3_conn *conn,
+                                             int64_t stream_id,
+                                             void *sched_user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_scheduler_next` is a callback function which is
+ * invoked when the library needs a stream to write next.  It must
+ * return the ID of one of the scheduled streams, or -1 if there is no
+ * scheduled stream.  The returned stream stays scheduled until
+ * :member:`nghttp3_scheduler.unschedule` is called.  If the returned
+ * ID does not denote a scheduled stream, the library calls
+ * :member:`nghttp3_scheduler.unschedule` with that ID, and invokes
+ * this callback again.
+ */
+typedef int64_t (*nghttp3_scheduler_next)(nghttp3_conn *conn,
+                                          void *sched_user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`nghttp3_scheduler_on_write` is a callback function which is
+ * invoked when |n| bytes are written to a stream denoted by
+ * |stream_id|, that is when `nghttp3_conn_add_write_offset` is
+ * called.  A scheduler can use this callback to account the amount
+ * of data sent per stream.
+ */
+typedef void (*nghttp3_scheduler_on_write)(nghttp3_conn *conn,
+                                           int64_t stream_id, uint64_t n,
+                                           void *sched_user_data);
+
+#define NGHTTP3_SCHEDULER_V1 1
+#define NGHTTP3_SCHEDULER_VERSION NGHTTP3_SCHEDULER_V1
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_scheduler` is a set of callback functions which
+ * implement a stream scheduler.  It only schedules client initiated
+ * bidirectional streams.  Control stream and QPACK streams are always
+ * written before them.  A stream which is closed while it is
+ * scheduled is unscheduled before it is deleted.  `nghttp3_conn_del`
+ * does not call :member:`nghttp3_scheduler.unschedule`; the
+ * scheduler state must be discarded along with the connection.
+ */
+typedef struct nghttp3_scheduler {
+  /**
+   * :member:`schedule` is invoked when a stream becomes ready to be
+   * written.  This field must be set.
+   */
+  nghttp3_scheduler_schedule schedule;
+  /**
+   * :member:`unschedule` is invoked when a stream is no longer ready
+   * to be written.  This field must be set.
+   */
+  nghttp3_scheduler_unschedule unschedule;
+  /**
+   * :member:`next` is invoked to get a stream to write next.  This
+   * field must be set.
+   */
+  nghttp3_scheduler_next next;
+  /**
+   * :member:`on_write` is invoked when data is written to a stream.
+   * This field is optional.
+   */
+  nghttp3_scheduler_on_write on_write;
+  /**
+   * :member:`user_data` is an arbitrary pointer which is passed to
+   * the callback functions above.
+   */
+  void *user_data;
+} nghttp3_scheduler;
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_set_scheduler_versioned` replaces the built-in
+ * stream scheduler (:rfc:`9218` extensible priorities) of |conn|
+ * with |scheduler|.  The library keeps a copy of |scheduler|.  This
+ * function must be called before any stream is scheduled, that is
+ * before submitting any request or response.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGHTTP3_ERR_INVALID_ARGUMENT`
+ *     A mandatory callback in |scheduler| is NULL.
+ * :macro:`NGHTTP3_ERR_INVALID_STATE`
+ *     A stream has already been scheduled, or a scheduler has already
+ *     been set.
+ */
+NGHTTP3_EXTERN int
+nghttp3_conn_set_scheduler_versioned(nghttp3_conn *conn,
+                                     int scheduler_version,
+                                     const nghttp3_scheduler *scheduler);
+
 /**
  * @function
  *
@@ -2754,6 +3808,349 @@ NGHTTP3_EXTERN int nghttp3_check_header_name(const uint8_t *name, size_t len);
  */
 NGHTTP3_EXTERN int nghttp3_check_header_value(const uint8_t *value, size_t len);
 
+/**
+ * @function
+ *
+ * `nghttp3_conn_get_memory_usage` returns the number of bytes that
+ * |conn| uses for its streams, their buffered outgoing and incoming
+ * data, and QPACK dynamic tables.  Small bookkeeping allocations are
+ * not counted.
+ */
+NGHTTP3_EXTERN uint64_t nghttp3_conn_get_memory_usage(nghttp3_conn *conn);
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_get_stream_memory_usage` returns the number of bytes
+ * that a stream identified by |stream_id| uses for itself and its
+ * buffered outgoing and incoming data.  It returns 0 if the stream is
+ * not found.
+ */
+NGHTTP3_EXTERN uint64_t
+nghttp3_conn_get_stream_memory_usage(nghttp3_conn *conn, int64_t stream_id);
+
+/**
+ * @macrosection
+ *
+ * Frame type indices for connection statistics
+ */
+
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_STATS_FRAME_DATA` is the index of DATA frame in
+ * :member:`nghttp3_conn_stats.tx_frames` and
+ * :member:`nghttp3_conn_stats.rx_frames`.
+ */
+#define NGHTTP3_STATS_FRAME_DATA 0
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_STATS_FRAME_HEADERS` is the index of HEADERS frame.
+ */
+#define NGHTTP3_STATS_FRAME_HEADERS 1
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_STATS_FRAME_CANCEL_PUSH` is the index of
+ * CANCEL_PUSH frame.
+ */
+#define NGHTTP3_STATS_FRAME_CANCEL_PUSH 2
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_STATS_FRAME_SETTINGS` is the index of SETTINGS
+ * frame.
+ */
+#define NGHTTP3_STATS_FRAME_SETTINGS 3
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_STATS_FRAME_PUSH_PROMISE` is the index of
+ * PUSH_PROMISE frame.
+ */
+#define NGHTTP3_STATS_FRAME_PUSH_PROMISE 4
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_STATS_FRAME_GOAWAY` is the index of GOAWAY frame.
+ */
+#define NGHTTP3_STATS_FRAME_GOAWAY 5
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_STATS_FRAME_MAX_PUSH_ID` is the index of
+ * MAX_PUSH_ID frame.
+ */
+#define NGHTTP3_STATS_FRAME_MAX_PUSH_ID 6
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_STATS_FRAME_PRIORITY_UPDATE` is the index of
+ * PRIORITY_UPDATE frames for both request and push streams.
+ */
+#define NGHTTP3_STATS_FRAME_PRIORITY_UPDATE 7
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_STATS_FRAME_OTHER` is the index of all other frame
+ * types, including reserved and unknown ones.
+ */
+#define NGHTTP3_STATS_FRAME_OTHER 8
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_STATS_FRAME_MAX` is the number of frame type
+ * indices.
+ */
+#define NGHTTP3_STATS_FRAME_MAX 9
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_frame_stats` is the number of frames of a particular
+ * type and their size.
+ */
+typedef struct nghttp3_frame_stats {
+  /**
+   * :member:`frames` is the number of frames.
+   */
+  uint64_t frames;
+  /**
+   * :member:`bytes` is the sum of the payload length of the frames.
+   * Frame headers are not included.
+   */
+  uint64_t bytes;
+} nghttp3_frame_stats;
+
+/**
+ * @macro
+ *
+ * :macro:`NGHTTP3_HISTOGRAM_BUCKETS` is the number of buckets in
+ * :type:`nghttp3_histogram`.
+ */
+#define NGHTTP3_HISTOGRAM_BUCKETS 64
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_histogram` is a distribution of durations in
+ * nanoseconds.  The bucket ``i`` counts the samples ``v`` such that
+ * ``2^i <= v < 2^(i + 1)``, except that the bucket 0 also counts the
+ * samples of 0.
+ */
+typedef struct nghttp3_histogram {
+  /**
+   * :member:`count` is the number of samples.
+   */
+  uint64_t count;
+  /**
+   * :member:`sum` is the sum of samples.
+   */
+  uint64_t sum;
+  /**
+   * :member:`min` is the smallest sample.  It is 0 if there is no
+   * sample.
+   */
+  uint64_t min;
+  /**
+   * :member:`max` is the largest sample.
+   */
+  uint64_t max;
+  /**
+   * :member:`buckets` is the number of samples in each log2 bucket.
+   */
+  uint64_t buckets[NGHTTP3_HISTOGRAM_BUCKETS];
+} nghttp3_histogram;
+
+#define NGHTTP3_CONN_STATS_V1 1
+#define NGHTTP3_CONN_STATS_VERSION NGHTTP3_CONN_STATS_V1
+
+/**
+ * @struct
+ *
+ * :type:`nghttp3_conn_stats` is a set of counters which describe what
+ * a connection has done since it was created.  All counters are
+ * cumulative unless noted otherwise.
+ */
+typedef struct nghttp3_conn_stats {
+  /**
+   * :member:`tx_frames` is the frames written to the outgoing
+   * streams, indexed by :macro:`NGHTTP3_STATS_FRAME_DATA
+   * <NGHTTP3_STATS_FRAME_DATA>` and its friends.  A frame is counted
+   * when it is serialized, which might be earlier than when it is
+   * actually sent.
+   */
+  nghttp3_frame_stats tx_frames[NGHTTP3_STATS_FRAME_MAX];
+  /**
+   * :member:`rx_frames` is the frames received on control and
+   * request streams.  A frame is counted when its header is
+   * received.
+   */
+  nghttp3_frame_stats rx_frames[NGHTTP3_STATS_FRAME_MAX];
+  /**
+   * :member:`tx_field_bytes` is the sum of the length of name and
+   * value of the fields encoded by QPACK encoder.  Compare it with
+   * the bytes of HEADERS frames in :member:`tx_frames` plus
+   * :member:`tx_qpack_encoder_stream_bytes` to get the compression
+   * ratio.
+   */
+  uint64_t tx_field_bytes;
+  /**
+   * :member:`rx_field_bytes` is the sum of the length of name and
+   * value of the fields decoded by QPACK decoder.
+   */
+  uint64_t rx_field_bytes;
+  /**
+   * :member:`tx_qpack_encoder_stream_bytes` is the number of bytes
+   * written to QPACK encoder stream.
+   */
+  uint64_t tx_qpack_encoder_stream_bytes;
+  /**
+   * :member:`rx_qpack_encoder_stream_bytes` is the number of bytes
+   * received on QPACK encoder stream.
+   */
+  uint64_t rx_qpack_encoder_stream_bytes;
+  /**
+   * :member:`tx_qpack_decoder_stream_bytes` is the number of bytes
+   * written to QPACK decoder stream.
+   */
+  uint64_t tx_qpack_decoder_stream_bytes;
+  /**
+   * :member:`rx_qpack_decoder_stream_bytes` is the number of bytes
+   * received on QPACK decoder stream.
+   */
+  uint64_t rx_qpack_decoder_stream_bytes;
+  /**
+   * :member:`qpack_encoder_dtable_hits` is the number of encoded
+   * field lines which refer to an entry in the dynamic table of QPACK
+   * encoder.
+   */
+  uint64_t qpack_encoder_dtable_hits;
+  /**
+   * :member:`qpack_encoder_dtable_inserts` is the number of entries
+   * inserted into the dynamic table of QPACK encoder.
+   */
+  uint64_t qpack_encoder_dtable_inserts;
+  /**
+   * :member:`qpack_encoder_dtable_evictions` is the number of entries
+   * evicted from the dynamic table of QPACK encoder.
+   */
+  uint64_t qpack_encoder_dtable_evictions;
+  /**
+   * :member:`qpack_decoder_dtable_hits` is the number of decoded
+   * field lines which refer to an entry in the dynamic table of QPACK
+   * decoder.
+   */
+  uint64_t qpack_decoder_dtable_hits;
+  /**
+   * :member:`qpack_decoder_dtable_inserts` is the number of entries
+   * inserted into the dynamic table of QPACK decoder.
+   */
+  uint64_t qpack_decoder_dtable_inserts;
+  /**
+   * :member:`qpack_decoder_dtable_evictions` is the number of entries
+   * evicted from the dynamic table of QPACK decoder.
+   */
+  uint64_t qpack_decoder_dtable_evictions;
+  /**
+   * :member:`qpack_blocked_streams` is the number of times that a
+   * stream got blocked by QPACK decoder.
+   */
+  uint64_t qpack_blocked_streams;
+  /**
+   * :member:`qpack_blocked_bytes` is the number of bytes which are
+   * buffered because the stream is blocked by QPACK decoder.
+   */
+  uint64_t qpack_blocked_bytes;
+  /**
+   * :member:`max_qpack_blocked_streams` is the maximum number of
+   * streams which are blocked by QPACK decoder at the same time.
+   */
+  uint64_t max_qpack_blocked_streams;
+  /**
+   * :member:`sched_pushes` is the number of times that a stream is
+   * pushed into the stream scheduler, including the times that an
+   * already scheduled stream is rescheduled.
+   */
+  uint64_t sched_pushes;
+  /**
+   * :member:`sched_pops` is the number of times that a stream is
+   * removed from the stream scheduler.
+   */
+  uint64_t sched_pops;
+  /**
+   * :member:`max_outq_len` is the maximum number of buffers which are
+   * queued for sending in a single stream at the same time.
+   */
+  uint64_t max_outq_len;
+  /**
+   * :member:`max_send_buffered` is the maximum number of bytes which
+   * are buffered in all streams at the same time, either unsent or
+   * unacknowledged.
+   */
+  uint64_t max_send_buffered;
+  /**
+   * :member:`qpack_blocked_time` is the distribution of the time that
+   * streams spend blocked by QPACK decoder.  The histograms below are
+   * only updated if :member:`nghttp3_callbacks.get_timestamp` is set.
+   */
+  nghttp3_histogram qpack_blocked_time;
+  /**
+   * :member:`headers_time` is the distribution of the time from the
+   * arrival of HEADERS frame header on a request stream until the
+   * field section is decoded and
+   * :member:`nghttp3_callbacks.end_headers` or
+   * :member:`nghttp3_callbacks.end_trailers` is called.  It includes
+   * the time spent blocked by QPACK decoder.
+   */
+  nghttp3_histogram headers_time;
+  /**
+   * :member:`sched_wait_time` is the distribution of the time from
+   * when a request stream is scheduled until it is chosen by
+   * `nghttp3_conn_writev_stream`.
+   */
+  nghttp3_histogram sched_wait_time;
+  /**
+   * :member:`read_data_blocked_time` is the distribution of the time
+   * from when :type:`nghttp3_read_data_callback` returns
+   * :macro:`NGHTTP3_ERR_WOULDBLOCK` until `nghttp3_conn_resume_stream`
+   * is called for the stream.
+   */
+  nghttp3_histogram read_data_blocked_time;
+  /**
+   * :member:`first_byte_time` is the distribution of the time from
+   * when the first byte of a request stream is queued until it is
+   * returned by `nghttp3_conn_writev_stream`.
+   */
+  nghttp3_histogram first_byte_time;
+} nghttp3_conn_stats;
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_get_stats` copies the statistics of |conn| into
+ * |*stats|.  The counters are plain integers which are updated as
+ * |conn| does its work, so they are cheap enough to be always
+ * maintained, and this function can be called at any time.
+ */
+NGHTTP3_EXTERN void nghttp3_conn_get_stats_versioned(nghttp3_conn *conn,
+                                                     int stats_version,
+                                                     nghttp3_conn_stats *stats);
+
+/**
+ * @function
+ *
+ * `nghttp3_conn_compact` releases the memory which |conn| holds but
+ * does not currently use: the excess capacity of the internal queues
+ * grown while |conn| was busy, the pooled memory blocks of the
+ * streams and the output chunks which are all freed, and the
+ * temporary buffers for QPACK encoding.  |conn| stays fully usable,
+ * and the memory is allocated again when needed.  This function is
+ * intended to be called when |conn| gets idle.
+ */
+NGHTTP3_EXTERN void nghttp3_conn_compact(nghttp3_conn *conn);
+
 /**
  * @function
  *
@@ -2763,6 +4160,22 @@ NGHTTP3_EXTERN int nghttp3_check_header_value(const uint8_t *value, size_t len);
  */
 NGHTTP3_EXTERN int nghttp3_conn_is_drained(nghttp3_conn *conn);
 
+/**
+ * @function
+ *
+ * `nghttp3_conn_has_pending_unblocked_streams` returns nonzero if
+ * |conn| has the buffered data of the streams unblocked by QPACK
+ * decoder which are not processed yet because of
+ * :member:`nghttp3_settings.qpack_unblock_budget`.  The next call of
+ * `nghttp3_conn_writev_stream` processes them within the budget.  An
+ * application typically schedules another call of
+ * `nghttp3_conn_writev_stream`, for example in the next iteration of
+ * its event loop, while this function returns nonzero.  It always
+ * returns 0 if :member:`nghttp3_settings.qpack_unblock_budget` is 0.
+ */
+NGHTTP3_EXTERN int
+nghttp3_conn_has_pending_unblocked_streams(nghttp3_conn *conn);
+
 /**
  * @macrosection
  *
@@ -2874,6 +4287,23 @@ NGHTTP3_EXTERN int nghttp3_err_is_fatal(int liberr);
   nghttp3_conn_get_stream_priority_versioned((CONN), NGHTTP3_PRI_VERSION,      \
                                              (DEST), (STREAM_ID))
 
+/*
+ * `nghttp3_conn_get_stats` is a wrapper around
+ * `nghttp3_conn_get_stats_versioned` to set the correct struct
+ * version.
+ */
+#define nghttp3_conn_get_stats(CONN, STATS)                                    \
+  nghttp3_conn_get_stats_versioned((CONN), NGHTTP3_CONN_STATS_VERSION, (STATS))
+
+/*
+ * `nghttp3_conn_set_scheduler` is a wrapper around
+ * `nghttp3_conn_set_scheduler_versioned` to set the correct struct
+ * version.
+ */
+#define nghttp3_conn_set_scheduler(CONN, SCHEDULER)                            \
+  nghttp3_conn_set_scheduler_versioned((CONN), NGHTTP3_SCHEDULER_VERSION,      \
+                                       (SCHEDULER))
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,12 +29,13 @@
 
 #include "nghttp3_mem.h"
 
-void nghttp3_balloc_init(nghttp3_balloc *balloc, size_t blklen,
+void nghttp3_balloc_init(nghttp3_balloc *balloc, size_t blklen, uint32_t tag,
                          const nghttp3_mem *mem) {
   assert((blklen & 0xfu) == 0);
 
   balloc->mem = mem;
   balloc->blklen = blklen;
+  balloc->tag = tag;
   balloc->head = NULL;
   nghttp3_buf_wrap_init(&balloc->buf, (void *)"", 0);
 }
@@ -66,8 +67,9 @@ int nghttp3_balloc_get(nghttp3_balloc *balloc, void **pbuf, size_t n) {
   assert(n <= balloc->blklen);
 
   if (nghttp3_buf_left(&balloc->buf) < n) {
-    p = nghttp3_mem_malloc(balloc->mem, sizeof(nghttp3_memblock_hd) + 0x10u +
-                                            balloc->blklen);
+    p = nghttp3_mem_malloc_tag(balloc->mem, balloc->tag,
+                               sizeof(nghttp3_memblock_hd) + 0x10u +
+                                   balloc->blklen);
     if (p == NULL) {
       return NGHTTP3_ERR_NOMEM;
     }
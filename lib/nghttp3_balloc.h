@@ -53,6 +53,8 @@ typedef struct nghttp3_balloc {
   const nghttp3_mem *mem;
   /* blklen is the size of memory block. */
   size_t blklen;
+  /* tag is the allocation tag of memory blocks. */
+  uint32_t tag;
   /* head points to the list of memory block allocated so far. */
   nghttp3_memblock_hd *head;
   /* buf wraps the current memory block for allocation requests. */
@@ -61,9 +63,10 @@ typedef struct nghttp3_balloc {
 
 /*
  * nghttp3_balloc_init initializes |balloc| with |blklen| which is the
- * size of memory block.
+ * size of memory block.  Memory blocks are allocated with the
+ * allocation tag |tag|.
  */
-void nghttp3_balloc_init(nghttp3_balloc *balloc, size_t blklen,
+void nghttp3_balloc_init(nghttp3_balloc *balloc, size_t blklen, uint32_t tag,
                          const nghttp3_mem *mem);
 
 /*
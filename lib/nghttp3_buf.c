@@ -52,7 +52,8 @@ size_t nghttp3_buf_cap(const nghttp3_buf *buf) {
 
 void nghttp3_buf_reset(nghttp3_buf *buf) { buf->pos = buf->last = buf->begin; }
 
-int nghttp3_buf_reserve(nghttp3_buf *buf, size_t size, const nghttp3_mem *mem) {
+int nghttp3_buf_reserve(nghttp3_buf *buf, size_t size, uint32_t tag,
+                        const nghttp3_mem *mem) {
   uint8_t *p;
   nghttp3_ssize pos_offset, last_offset;
 
@@ -63,7 +64,7 @@ int nghttp3_buf_reserve(nghttp3_buf *buf, size_t size, const nghttp3_mem *mem) {
   pos_offset = buf->pos - buf->begin;
   last_offset = buf->last - buf->begin;
 
-  p = nghttp3_mem_realloc(mem, buf->begin, size);
+  p = nghttp3_mem_realloc_tag(mem, tag, buf->begin, size);
   if (p == NULL) {
     return NGHTTP3_ERR_NOMEM;
   }
@@ -42,7 +42,19 @@ void nghttp3_buf_wrap_init(nghttp3_buf *buf, uint8_t *src, size_t len);
  */
 size_t nghttp3_buf_cap(const nghttp3_buf *buf);
 
-int nghttp3_buf_reserve(nghttp3_buf *buf, size_t size, const nghttp3_mem *mem);
+/*
+ * nghttp3_buf_reserve makes the capacity of |buf| at least |size|
+ * bytes.  The buffer is reallocated with allocation tag |tag| if
+ * necessary.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory.
+ */
+int nghttp3_buf_reserve(nghttp3_buf *buf, size_t size, uint32_t tag,
+                        const nghttp3_mem *mem);
 
 /*
  * nghttp3_buf_swap swaps |a| and |b|.
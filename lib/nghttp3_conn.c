@@ -34,6 +34,9 @@
 #include "nghttp3_conv.h"
 #include "nghttp3_http.h"
 #include "nghttp3_unreachable.h"
+#include "nghttp3_probe.h"
+#include "nghttp3_settings.h"
+#include "nghttp3_callbacks.h"
 
 /* NGHTTP3_QPACK_ENCODER_MAX_DTABLE_CAPACITY is the upper bound of the
    dynamic table capacity that QPACK encoder is willing to use. */
@@ -194,6 +197,112 @@ static int conn_call_recv_settings(nghttp3_conn *conn) {
   return 0;
 }
 
+/*
+ * conn_qpack_trace forwards |ev| generated by QPACK encoder or
+ * decoder to nghttp3_callbacks.trace.
+ */
+static void conn_qpack_trace(const nghttp3_trace_event *ev, void *user_data) {
+  nghttp3_conn *conn = user_data;
+
+  conn->callbacks.trace(conn, ev, conn->user_data);
+}
+
+/*
+ * histogram_bucket returns the index of the bucket of
+ * nghttp3_histogram which |v| falls into.
+ */
+static size_t histogram_bucket(uint64_t v) {
+  size_t n = 0;
+
+  if (v >> 32) {
+    v >>= 32;
+    n += 32;
+  }
+  if (v >> 16) {
+    v >>= 16;
+    n += 16;
+  }
+  if (v >> 8) {
+    v >>= 8;
+    n += 8;
+  }
+  if (v >> 4) {
+    v >>= 4;
+    n += 4;
+  }
+  if (v >> 2) {
+    v >>= 2;
+    n += 2;
+  }
+  if (v >> 1) {
+    n += 1;
+  }
+
+  return n;
+}
+
+static void histogram_add(nghttp3_histogram *h, uint64_t v) {
+  if (h->count == 0 || v < h->min) {
+    h->min = v;
+  }
+  if (v > h->max) {
+    h->max = v;
+  }
+
+  ++h->count;
+  h->sum += v;
+  ++h->buckets[histogram_bucket(v)];
+}
+
+void nghttp3_conn_start_timer(nghttp3_conn *conn, nghttp3_stream *stream,
+                              nghttp3_stream_timer timer) {
+  size_t i;
+
+  if (!conn->callbacks.get_timestamp) {
+    return;
+  }
+
+  if (stream->ts == NULL) {
+    stream->ts = nghttp3_mem_malloc_tag(
+        stream->mem, NGHTTP3_MEM_TAG_STREAM,
+        sizeof(nghttp3_tstamp) * NGHTTP3_STREAM_TIMER_MAX);
+    if (stream->ts == NULL) {
+      return;
+    }
+
+    for (i = 0; i < NGHTTP3_STREAM_TIMER_MAX; ++i) {
+      stream->ts[i] = NGHTTP3_TSTAMP_NONE;
+    }
+  } else if (stream->ts[timer] != NGHTTP3_TSTAMP_NONE) {
+    return;
+  }
+
+  stream->ts[timer] = conn->callbacks.get_timestamp(conn, conn->user_data);
+}
+
+/*
+ * conn_stop_timer adds the time elapsed since the start time of
+ * |timer| of |stream| to |h|, and resets the start time to
+ * NGHTTP3_TSTAMP_NONE.  It does nothing if |timer| has not been
+ * started.
+ */
+static void conn_stop_timer(nghttp3_conn *conn, nghttp3_histogram *h,
+                            nghttp3_stream *stream,
+                            nghttp3_stream_timer timer) {
+  nghttp3_tstamp ts, start;
+
+  if (stream->ts == NULL || stream->ts[timer] == NGHTTP3_TSTAMP_NONE) {
+    return;
+  }
+
+  start = stream->ts[timer];
+  ts = conn->callbacks.get_timestamp(conn, conn->user_data);
+
+  histogram_add(h, ts > start ? ts - start : 0);
+
+  stream->ts[timer] = NGHTTP3_TSTAMP_NONE;
+}
+
 static int ricnt_less(const nghttp3_pq_entry *lhsx,
                       const nghttp3_pq_entry *rhsx) {
   nghttp3_stream *lhs =
@@ -209,6 +318,10 @@ static int cycle_less(const nghttp3_pq_entry *lhsx,
   const nghttp3_tnode *lhs = nghttp3_struct_of(lhsx, nghttp3_tnode, pe);
   const nghttp3_tnode *rhs = nghttp3_struct_of(rhsx, nghttp3_tnode, pe);
 
+  if (lhs->deadline != rhs->deadline) {
+    return lhs->deadline < rhs->deadline;
+  }
+
   if (lhs->cycle == rhs->cycle) {
     return lhs->id < rhs->id;
   }
@@ -216,6 +329,73 @@ static int cycle_less(const nghttp3_pq_entry *lhsx,
   return rhs->cycle - lhs->cycle <= NGHTTP3_TNODE_MAX_CYCLE_GAP;
 }
 
+/*
+ * conn_get_stream_cache_slot returns the slot in conn->stream_cache
+ * for |stream_id|, or NULL if conn->stream_cache is not allocated.
+ */
+static nghttp3_stream **conn_get_stream_cache_slot(nghttp3_conn *conn,
+                                                   int64_t stream_id) {
+  if (conn->stream_cache == NULL) {
+    return NULL;
+  }
+
+  return &conn->stream_cache[(uint64_t)stream_id &
+                             (conn->stream_cachelen - 1)];
+}
+
+/*
+ * conn_stream_cachelen returns the number of slots in
+ * conn->stream_cache.  Stream IDs of the same type are 4 apart, so 4
+ * slots are reserved per concurrent stream.
+ */
+static size_t conn_stream_cachelen(nghttp3_conn *conn) {
+  size_t n = NGHTTP3_CONN_STREAM_CACHE_MIN_SIZE;
+
+  if (conn->max_concurrent_streams == 0) {
+    return NGHTTP3_CONN_STREAM_CACHE_DEFAULT_SIZE;
+  }
+
+  for (; n < NGHTTP3_CONN_STREAM_CACHE_MAX_SIZE &&
+         n / 4 < conn->max_concurrent_streams;) {
+    n *= 2;
+  }
+
+  return n;
+}
+
+/*
+ * conn_cache_stream stores |stream| in conn->stream_cache, allocating
+ * it if it has not been allocated yet.  The cache is optional, and
+ * this function does nothing if the allocation fails.
+ */
+static void conn_cache_stream(nghttp3_conn *conn, nghttp3_stream *stream) {
+  size_t len;
+
+  if (conn->stream_cache == NULL) {
+    len = conn_stream_cachelen(conn);
+
+    conn->stream_cache = nghttp3_mem_calloc_tag(
+        conn->mem, NGHTTP3_MEM_TAG_CONN, len, sizeof(nghttp3_stream *));
+    if (conn->stream_cache == NULL) {
+      return;
+    }
+
+    conn->stream_cachelen = len;
+  }
+
+  *conn_get_stream_cache_slot(conn, stream->node.id) = stream;
+}
+
+/* conn_field_validator lets QPACK decoder compute HTTP field
+   validation verdicts while it decodes literals, so that HTTP layer
+   does not scan the same bytes again. */
+static const nghttp3_qpack_field_validator conn_field_validator = {
+    nghttp3_http_field_char_class,
+    nghttp3_http_field_name_verdict,
+    nghttp3_http_field_value_verdict,
+    NGHTTP3_HTTP_FIELD_NAME_MASK,
+};
+
 static int conn_new(nghttp3_conn **pconn, int server, int callbacks_version,
                     const nghttp3_callbacks *callbacks, int settings_version,
                     const nghttp3_settings *settings, const nghttp3_mem *mem,
@@ -223,31 +403,74 @@ static int conn_new(nghttp3_conn **pconn, int server, int callbacks_version,
   int rv;
   nghttp3_conn *conn;
   size_t i;
-  (void)callbacks_version;
-  (void)settings_version;
+  nghttp3_settings settingsbuf;
+  nghttp3_callbacks callbacksbuf;
+  const nghttp3_mem *parent_mem;
+
+  settings = nghttp3_settings_convert_to_latest(&settingsbuf,
+                                                settings_version, settings);
+  callbacks = nghttp3_callbacks_convert_to_latest(
+      &callbacksbuf, callbacks_version, callbacks);
+
+  if ((settings->stream_send_buffer_high_watermark &&
+       settings->stream_send_buffer_low_watermark >=
+           settings->stream_send_buffer_high_watermark) ||
+      (settings->conn_send_buffer_high_watermark &&
+       settings->conn_send_buffer_low_watermark >=
+           settings->conn_send_buffer_high_watermark)) {
+    return NGHTTP3_ERR_INVALID_ARGUMENT;
+  }
 
   if (mem == NULL) {
     mem = nghttp3_mem_default();
   }
 
-  conn = nghttp3_mem_calloc(mem, 1, sizeof(nghttp3_conn));
+  parent_mem = mem;
+
+  conn = nghttp3_mem_calloc_tag(mem, NGHTTP3_MEM_TAG_CONN, 1,
+                                sizeof(nghttp3_conn));
   if (conn == NULL) {
     return NGHTTP3_ERR_NOMEM;
   }
 
+  if (settings->enable_region_allocator) {
+    nghttp3_region_init(&conn->region, mem);
+    conn->flags |= NGHTTP3_CONN_FLAG_REGION_ALLOCATOR;
+    mem = nghttp3_region_get_mem(&conn->region);
+  }
+
   nghttp3_objalloc_init(&conn->out_chunk_objalloc,
-                        NGHTTP3_STREAM_MIN_CHUNK_SIZE * 16, mem);
-  nghttp3_objalloc_stream_init(&conn->stream_objalloc, 64, mem);
+                        NGHTTP3_STREAM_MIN_CHUNK_SIZE * 16,
+                        NGHTTP3_MEM_TAG_OUT_CHUNK, mem);
+
+  /* Each memory block holds a few chunks of its class so that a
+     stream which buffers small chunks does not pin a large block. */
+  for (i = 0; i < NGHTTP3_STREAM_NUM_IN_CHUNK_CLASSES; ++i) {
+    nghttp3_objalloc_init(
+        &conn->in_chunk_objalloc[i],
+        ((size_t)NGHTTP3_STREAM_MIN_CHUNK_SIZE << (2 * i)) *
+            NGHTTP3_CONN_IN_CHUNK_BLOCK_NMEMB,
+        NGHTTP3_MEM_TAG_IN_CHUNK, mem);
+  }
+
+  nghttp3_objalloc_stream_init(&conn->stream_objalloc, 64,
+                               NGHTTP3_MEM_TAG_STREAM, mem);
 
   nghttp3_map_init(&conn->streams, mem);
 
+  /* The rcbufs produced by QPACK decoder are passed to an
+     application, and they may outlive conn.  They are allocated from
+     the parent allocator even if the region allocator is enabled. */
   rv = nghttp3_qpack_decoder_init(&conn->qdec,
                                   settings->qpack_max_dtable_capacity,
-                                  settings->qpack_blocked_streams, mem);
+                                  settings->qpack_blocked_streams, parent_mem);
   if (rv != 0) {
     goto qdec_init_fail;
   }
 
+  nghttp3_qpack_decoder_set_field_validator(&conn->qdec,
+                                            &conn_field_validator);
+
   rv = nghttp3_qpack_encoder_init(
       &conn->qenc, settings->qpack_encoder_max_dtable_capacity, mem);
   if (rv != 0) {
@@ -255,6 +478,7 @@ static int conn_new(nghttp3_conn **pconn, int server, int callbacks_version,
   }
 
   nghttp3_pq_init(&conn->qpack_blocked_streams, ricnt_less, mem);
+  nghttp3_pq_init(&conn->qpack_unblocked_streams, ricnt_less, mem);
 
   for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
     nghttp3_pq_init(&conn->sched[i].spq, cycle_less, mem);
@@ -275,6 +499,11 @@ static int conn_new(nghttp3_conn **pconn, int server, int callbacks_version,
   conn->tx.goaway_id = NGHTTP3_VARINT_MAX + 1;
   conn->rx.max_stream_id_bidi = -4;
 
+  if (callbacks->trace) {
+    nghttp3_qpack_encoder_set_trace(&conn->qenc, conn_qpack_trace, conn);
+    nghttp3_qpack_decoder_set_trace(&conn->qdec, conn_qpack_trace, conn);
+  }
+
   *pconn = conn;
 
   return 0;
@@ -284,7 +513,18 @@ qenc_init_fail:
 qdec_init_fail:
   nghttp3_map_free(&conn->streams);
   nghttp3_objalloc_free(&conn->stream_objalloc);
+
+  for (i = 0; i < NGHTTP3_STREAM_NUM_IN_CHUNK_CLASSES; ++i) {
+    nghttp3_objalloc_free(&conn->in_chunk_objalloc[i]);
+  }
+
   nghttp3_objalloc_free(&conn->out_chunk_objalloc);
+
+  if (conn->flags & NGHTTP3_CONN_FLAG_REGION_ALLOCATOR) {
+    mem = conn->region.balloc.mem;
+    nghttp3_region_free(&conn->region);
+  }
+
   nghttp3_mem_free(mem, conn);
 
   return rv;
@@ -334,13 +574,37 @@ static int free_stream(void *data, void *ptr) {
   return 0;
 }
 
+static int free_stream_qpack_context(void *data, void *ptr) {
+  nghttp3_stream *stream = data;
+
+  (void)ptr;
+
+  nghttp3_qpack_stream_context_free(&stream->qpack_sctx);
+
+  return 0;
+}
+
 void nghttp3_conn_del(nghttp3_conn *conn) {
+  const nghttp3_mem *mem;
   size_t i;
 
   if (conn == NULL) {
     return;
   }
 
+  if (conn->flags & NGHTTP3_CONN_FLAG_REGION_ALLOCATOR) {
+    /* All objects owned by conn are in region except for QPACK
+       decoder and the rcbufs it produced. */
+    nghttp3_map_each(&conn->streams, free_stream_qpack_context, NULL);
+    nghttp3_qpack_decoder_free(&conn->qdec);
+
+    mem = conn->region.balloc.mem;
+    nghttp3_region_free(&conn->region);
+    nghttp3_mem_free(mem, conn);
+
+    return;
+  }
+
   nghttp3_buf_free(&conn->tx.qpack.ebuf, conn->mem);
   nghttp3_buf_free(&conn->tx.qpack.rbuf, conn->mem);
 
@@ -350,6 +614,7 @@ void nghttp3_conn_del(nghttp3_conn *conn) {
     nghttp3_pq_free(&conn->sched[i].spq);
   }
 
+  nghttp3_pq_free(&conn->qpack_unblocked_streams);
   nghttp3_pq_free(&conn->qpack_blocked_streams);
 
   nghttp3_qpack_encoder_free(&conn->qenc);
@@ -358,7 +623,14 @@ void nghttp3_conn_del(nghttp3_conn *conn) {
   nghttp3_map_each_free(&conn->streams, free_stream, NULL);
   nghttp3_map_free(&conn->streams);
 
+  nghttp3_mem_free(conn->mem, conn->stream_cache);
+
   nghttp3_objalloc_free(&conn->stream_objalloc);
+
+  for (i = 0; i < NGHTTP3_STREAM_NUM_IN_CHUNK_CLASSES; ++i) {
+    nghttp3_objalloc_free(&conn->in_chunk_objalloc[i]);
+  }
+
   nghttp3_objalloc_free(&conn->out_chunk_objalloc);
 
   nghttp3_mem_free(conn->mem, conn);
@@ -379,13 +651,204 @@ static int conn_bidi_idtr_open(nghttp3_conn *conn, int64_t stream_id) {
   return 0;
 }
 
-nghttp3_ssize nghttp3_conn_read_stream(nghttp3_conn *conn, int64_t stream_id,
-                                       const uint8_t *src, size_t srclen,
-                                       int fin) {
+typedef struct conn_memory_scan {
+  /* heaviest is the request stream which uses the most memory among
+     those which are still read. */
+  nghttp3_stream *heaviest;
+  /* released_mem_used is the sum of the memory used by the request
+     streams which are no longer read. */
+  uint64_t released_mem_used;
+} conn_memory_scan;
+
+static int conn_scan_stream_memory(void *data, void *ptr) {
+  nghttp3_stream *stream = data;
+  conn_memory_scan *scan = ptr;
+
+  if (!nghttp3_client_stream_bidi(stream->node.id)) {
+    return 0;
+  }
+
+  /* The memory of the streams which are already rejected or no longer
+     read is released when QUIC stack closes them.  Do not count it
+     again. */
+  if ((stream->flags &
+       (NGHTTP3_STREAM_FLAG_SHUT_RD | NGHTTP3_STREAM_FLAG_CLOSED)) ||
+      stream->rstate.state == NGHTTP3_REQ_STREAM_STATE_IGN_REST) {
+    scan->released_mem_used += stream->mem_used;
+    return 0;
+  }
+
+  if (scan->heaviest == NULL || scan->heaviest->mem_used < stream->mem_used) {
+    scan->heaviest = stream;
+  }
+
+  return 0;
+}
+
+/*
+ * conn_memory_limit_exceeded returns nonzero if the memory usage of
+ * |conn| exceeds the configured limit.  The memory used by the
+ * request streams which are no longer read is not counted.  If
+ * |pheaviest| is not NULL, the request stream which uses the most
+ * memory is assigned to it when this function returns nonzero.  It
+ * might be NULL.
+ */
+static int conn_memory_limit_exceeded(nghttp3_conn *conn,
+                                      nghttp3_stream **pheaviest) {
+  uint64_t limit = conn->local.settings.conn_memory_limit;
+  uint64_t usage;
+  conn_memory_scan scan = {0};
+
+  if (limit == 0) {
+    return 0;
+  }
+
+  usage = nghttp3_conn_get_memory_usage(conn);
+  if (usage <= limit) {
+    return 0;
+  }
+
+  nghttp3_map_each(&conn->streams, conn_scan_stream_memory, &scan);
+
+  if (usage - scan.released_mem_used <= limit) {
+    return 0;
+  }
+
+  if (pheaviest) {
+    *pheaviest = scan.heaviest;
+  }
+
+  return 1;
+}
+
+/*
+ * conn_buffer_blocked_data buffers |datalen| bytes of data pointed by
+ * |data| which are received while |stream| is blocked by QPACK
+ * decoder.  The data are kept by reference if release_blocked_data
+ * callback is set, and copied otherwise.
+ */
+static int conn_buffer_blocked_data(nghttp3_conn *conn,
+                                    nghttp3_stream *stream,
+                                    const uint8_t *data, size_t datalen) {
+  conn->stats.qpack_blocked_bytes += datalen;
+
+  if (conn->callbacks.release_blocked_data) {
+    return nghttp3_stream_buffer_data_ref(stream, data, datalen);
+  }
+
+  return nghttp3_stream_buffer_data(stream, data, datalen);
+}
+
+/*
+ * conn_pop_blocked_data removes the first buffer in stream->inq, and
+ * calls release_blocked_data callback if the buffer refers to the
+ * memory of an application.
+ */
+static int conn_pop_blocked_data(nghttp3_conn *conn, nghttp3_stream *stream) {
+  nghttp3_typed_buf *tbuf = nghttp3_ringbuf_get(stream->inq, 0);
+  int rv;
+
+  if (tbuf->type == NGHTTP3_BUF_TYPE_ALIEN &&
+      conn->callbacks.release_blocked_data) {
+    rv = conn->callbacks.release_blocked_data(
+        conn, stream->node.id, tbuf->buf.begin, nghttp3_buf_cap(&tbuf->buf),
+        conn->user_data, stream->user_data);
+    if (rv != 0) {
+      return NGHTTP3_ERR_CALLBACK_FAILURE;
+    }
+  }
+
+  nghttp3_stream_pop_buffered_data(stream);
+
+  return 0;
+}
+
+/*
+ * conn_release_blocked_data removes all buffers in stream->inq.
+ */
+static int conn_release_blocked_data(nghttp3_conn *conn,
+                                     nghttp3_stream *stream) {
+  int rv;
+
+  if (stream->inq == NULL) {
+    return 0;
+  }
+
+  for (; nghttp3_ringbuf_len(stream->inq);) {
+    rv = conn_pop_blocked_data(conn, stream);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  return 0;
+}
+
+static int conn_process_unblocked_streams(nghttp3_conn *conn);
+
+/*
+ * conn_enforce_memory_limit resets the request stream which uses the
+ * most memory if the memory usage of |conn| exceeds the configured
+ * limit, and it has grown from |usage_before| which is the usage
+ * before the current read call.  Reading data which does not
+ * allocate memory never resets a stream, even if the memory used by
+ * a local application keeps the usage above the limit.  The buffered
+ * incoming data of the stream are discarded immediately.  The memory
+ * used for outgoing data is released when the stream is closed by
+ * QUIC stack, and it is not counted in the meantime.
+ */
+static int conn_enforce_memory_limit(nghttp3_conn *conn,
+                                     uint64_t usage_before) {
+  nghttp3_stream *stream = NULL;
+  size_t datalen;
+  int rv;
+
+  if (nghttp3_conn_get_memory_usage(conn) <= usage_before ||
+      !conn_memory_limit_exceeded(conn, &stream) || stream == NULL) {
+    return 0;
+  }
+
+  stream->flags |= NGHTTP3_STREAM_FLAG_SHUT_RD;
+
+  datalen = nghttp3_stream_get_buffered_datalen(stream);
+
+  rv = conn_release_blocked_data(conn, stream);
+  if (rv != 0) {
+    return rv;
+  }
+
+  rv = conn_call_deferred_consume(conn, stream, datalen);
+  if (rv != 0) {
+    return rv;
+  }
+
+  rv = nghttp3_qpack_decoder_cancel_stream(&conn->qdec, stream->node.id);
+  if (rv != 0) {
+    return rv;
+  }
+
+  rv = conn_call_stop_sending(conn, stream, NGHTTP3_H3_EXCESSIVE_LOAD);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return conn_call_reset_stream(conn, stream, NGHTTP3_H3_EXCESSIVE_LOAD);
+}
+
+/*
+ * conn_open_read_stream finds the stream identified by |stream_id|,
+ * or creates it if it is a new stream initiated by remote endpoint.
+ * |empty_fin| is nonzero if the data to be read is empty and it ends
+ * the stream.  It assigns NULL to |*pstream| if the data should be
+ * ignored.
+ */
+static int conn_open_read_stream(nghttp3_conn *conn, nghttp3_stream **pstream,
+                                 int64_t stream_id, int empty_fin) {
   nghttp3_stream *stream;
-  size_t bidi_nproc;
   int rv;
 
+  *pstream = NULL;
+
   stream = nghttp3_conn_find_stream(conn, stream_id);
   if (stream == NULL) {
     /* TODO Assert idtr */
@@ -412,8 +875,9 @@ nghttp3_ssize nghttp3_conn_read_stream(nghttp3_conn *conn, int64_t stream_id,
           return rv;
         }
 
-        if ((conn->flags & NGHTTP3_CONN_FLAG_GOAWAY_QUEUED) &&
-            conn->tx.goaway_id <= stream_id) {
+        if (((conn->flags & NGHTTP3_CONN_FLAG_GOAWAY_QUEUED) &&
+             conn->tx.goaway_id <= stream_id) ||
+            conn_memory_limit_exceeded(conn, NULL)) {
           stream->rstate.state = NGHTTP3_REQ_STREAM_STATE_IGN_REST;
 
           rv = nghttp3_conn_reject_stream(conn, stream);
@@ -423,7 +887,7 @@ nghttp3_ssize nghttp3_conn_read_stream(nghttp3_conn *conn, int64_t stream_id,
         }
       } else {
         /* unidirectional stream */
-        if (srclen == 0 && fin) {
+        if (empty_fin) {
           return 0;
         }
 
@@ -436,7 +900,7 @@ nghttp3_ssize nghttp3_conn_read_stream(nghttp3_conn *conn, int64_t stream_id,
       stream->rx.hstate = NGHTTP3_HTTP_STATE_REQ_INITIAL;
       stream->tx.hstate = NGHTTP3_HTTP_STATE_REQ_INITIAL;
     } else if (nghttp3_stream_uni(stream_id)) {
-      if (srclen == 0 && fin) {
+      if (empty_fin) {
         return 0;
       }
 
@@ -461,20 +925,197 @@ nghttp3_ssize nghttp3_conn_read_stream(nghttp3_conn *conn, int64_t stream_id,
     }
   }
 
-  if (srclen == 0 && !fin) {
-    return 0;
-  }
+  *pstream = stream;
 
-  if (nghttp3_stream_uni(stream_id)) {
+  return 0;
+}
+
+/*
+ * conn_read_stream_data reads |srclen| bytes of data pointed by |src|
+ * on |stream|.  |fin| is nonzero if this is the last data on
+ * |stream|.
+ */
+static nghttp3_ssize conn_read_stream_data(nghttp3_conn *conn,
+                                           nghttp3_stream *stream,
+                                           const uint8_t *src, size_t srclen,
+                                           int fin) {
+  size_t bidi_nproc;
+
+  if (nghttp3_stream_uni(stream->node.id)) {
     return nghttp3_conn_read_uni(conn, stream, src, srclen, fin);
   }
 
   if (fin) {
     stream->flags |= NGHTTP3_STREAM_FLAG_READ_EOF;
   }
+
   return nghttp3_conn_read_bidi(conn, &bidi_nproc, stream, src, srclen, fin);
 }
 
+nghttp3_ssize nghttp3_conn_read_stream(nghttp3_conn *conn, int64_t stream_id,
+                                       const uint8_t *src, size_t srclen,
+                                       int fin) {
+  nghttp3_stream *stream;
+  nghttp3_ssize nconsumed;
+  uint64_t usage_before = nghttp3_conn_get_memory_usage(conn);
+  int rv;
+
+  rv = conn_process_unblocked_streams(conn);
+  if (rv != 0) {
+    return rv;
+  }
+
+  rv = conn_open_read_stream(conn, &stream, stream_id, srclen == 0 && fin);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if (stream == NULL || (srclen == 0 && !fin)) {
+    return 0;
+  }
+
+  nconsumed = conn_read_stream_data(conn, stream, src, srclen, fin);
+
+  if (nconsumed < 0 || conn->local.settings.conn_memory_limit == 0) {
+    return nconsumed;
+  }
+
+  rv = conn_enforce_memory_limit(conn, usage_before);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return nconsumed;
+}
+
+nghttp3_ssize nghttp3_conn_read_streamv(nghttp3_conn *conn, int64_t stream_id,
+                                        const nghttp3_vec *vec, size_t veccnt,
+                                        int fin) {
+  nghttp3_stream *stream;
+  nghttp3_ssize nread, nconsumed = 0;
+  size_t i, last = veccnt;
+  uint64_t datalen = 0;
+  uint64_t usage_before;
+  int rv;
+
+  for (i = 0; i < veccnt; ++i) {
+    if (vec[i].len == 0) {
+      continue;
+    }
+
+    if (vec[i].len > NGHTTP3_MAX_VARINT - datalen) {
+      return NGHTTP3_ERR_INVALID_ARGUMENT;
+    }
+
+    datalen += vec[i].len;
+    last = i;
+  }
+
+  usage_before = nghttp3_conn_get_memory_usage(conn);
+
+  rv = conn_process_unblocked_streams(conn);
+  if (rv != 0) {
+    return rv;
+  }
+
+  rv = conn_open_read_stream(conn, &stream, stream_id, datalen == 0 && fin);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if (stream == NULL || (datalen == 0 && !fin)) {
+    return 0;
+  }
+
+  if (datalen == 0) {
+    return conn_read_stream_data(conn, stream, NULL, 0, fin);
+  }
+
+  /* The stream is never deleted while it is reading non-empty data,
+     so that it is safe to keep using stream across fragments. */
+  for (i = 0; i <= last; ++i) {
+    if (vec[i].len == 0) {
+      continue;
+    }
+
+    nread = conn_read_stream_data(conn, stream, vec[i].base, vec[i].len,
+                                  fin && i == last);
+    if (nread < 0) {
+      return nread;
+    }
+
+    nconsumed += nread;
+  }
+
+  if (conn->local.settings.conn_memory_limit == 0) {
+    return nconsumed;
+  }
+
+  rv = conn_enforce_memory_limit(conn, usage_before);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return nconsumed;
+}
+
+int nghttp3_conn_read_streams(nghttp3_conn *conn,
+                              const nghttp3_stream_input *inputs,
+                              size_t ninputs, size_t *consumed) {
+  nghttp3_stream *stream = NULL;
+  const nghttp3_stream_input *in;
+  nghttp3_ssize nread;
+  size_t i;
+  uint64_t usage_before = nghttp3_conn_get_memory_usage(conn);
+  int rv;
+
+  rv = conn_process_unblocked_streams(conn);
+  if (rv != 0) {
+    return rv;
+  }
+
+  for (i = 0; i < ninputs; ++i) {
+    in = &inputs[i];
+    consumed[i] = 0;
+
+    /* Reuse the stream of the previous input unless it has finished.
+       A stream is never deleted while reading its non-final data. */
+    if (stream == NULL || stream->node.id != in->stream_id) {
+      rv = conn_open_read_stream(conn, &stream, in->stream_id,
+                                 in->datalen == 0 && in->fin);
+      if (rv != 0) {
+        return rv;
+      }
+
+      if (stream == NULL) {
+        continue;
+      }
+    }
+
+    if (in->datalen == 0 && !in->fin) {
+      continue;
+    }
+
+    nread =
+        conn_read_stream_data(conn, stream, in->data, in->datalen, in->fin);
+    if (nread < 0) {
+      return (int)nread;
+    }
+
+    consumed[i] = (size_t)nread;
+
+    if (in->fin) {
+      stream = NULL;
+    }
+  }
+
+  if (conn->local.settings.conn_memory_limit == 0) {
+    return 0;
+  }
+
+  return conn_enforce_memory_limit(conn, usage_before);
+}
+
 static nghttp3_ssize conn_read_type(nghttp3_conn *conn, nghttp3_stream *stream,
                                     const uint8_t *src, size_t srclen,
                                     int fin) {
@@ -671,6 +1312,14 @@ nghttp3_ssize nghttp3_conn_read_control(nghttp3_conn *conn,
       rstate->left = rstate->fr.hd.length = rvint->acc;
       nghttp3_varint_read_state_reset(rvint);
 
+      nghttp3_frame_stats_add(conn->stats.rx_frames, rstate->fr.hd.type,
+                              rstate->fr.hd.length);
+
+      if (conn->callbacks.trace) {
+        nghttp3_conn_trace_frame(conn, NGHTTP3_TRACE_EVENT_FRAME_RECV,
+                                 stream->node.id, &rstate->fr.hd);
+      }
+
       if (!(conn->flags & NGHTTP3_CONN_FLAG_SETTINGS_RECVED)) {
         if (rstate->fr.hd.type != NGHTTP3_FRAME_SETTINGS) {
           return NGHTTP3_ERR_H3_MISSING_SETTINGS;
@@ -1038,8 +1687,103 @@ nghttp3_ssize nghttp3_conn_read_control(nghttp3_conn *conn,
   return (nghttp3_ssize)nconsumed;
 }
 
+static int conn_call_send_buffer_watermark(nghttp3_conn *conn,
+                                           int64_t stream_id, int high,
+                                           uint64_t buffered,
+                                           void *stream_user_data) {
+  int rv;
+
+  if (!conn->callbacks.send_buffer_watermark) {
+    return 0;
+  }
+
+  rv = conn->callbacks.send_buffer_watermark(conn, stream_id, high, buffered,
+                                             conn->user_data,
+                                             stream_user_data);
+  if (rv != 0) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
+/*
+ * conn_check_send_buffer_high calls send_buffer_watermark callback if
+ * the number of bytes buffered for sending reaches high watermark.
+ * |stream| is checked if it is not NULL, and then |conn| is checked.
+ */
+static int conn_check_send_buffer_high(nghttp3_conn *conn,
+                                       nghttp3_stream *stream) {
+  uint64_t buffered;
+  int rv;
+
+  if (stream && conn->local.settings.stream_send_buffer_high_watermark &&
+      !(stream->flags & NGHTTP3_STREAM_FLAG_SEND_BUFFER_HIGH)) {
+    buffered = nghttp3_stream_get_send_buffered(stream);
+    if (buffered >= conn->local.settings.stream_send_buffer_high_watermark) {
+      stream->flags |= NGHTTP3_STREAM_FLAG_SEND_BUFFER_HIGH;
+
+      rv = conn_call_send_buffer_watermark(conn, stream->node.id, /* high = */ 1,
+                                           buffered, stream->user_data);
+      if (rv != 0) {
+        return rv;
+      }
+    }
+  }
+
+  if (conn->local.settings.conn_send_buffer_high_watermark &&
+      !(conn->flags & NGHTTP3_CONN_FLAG_SEND_BUFFER_HIGH) &&
+      conn->tx.send_buffered >=
+          conn->local.settings.conn_send_buffer_high_watermark) {
+    conn->flags |= NGHTTP3_CONN_FLAG_SEND_BUFFER_HIGH;
+
+    return conn_call_send_buffer_watermark(
+        conn, -1, /* high = */ 1, conn->tx.send_buffered, NULL);
+  }
+
+  return 0;
+}
+
+/*
+ * conn_check_send_buffer_low calls send_buffer_watermark callback if
+ * the number of bytes buffered for sending goes down to low
+ * watermark after it reached high watermark.  |stream| is checked if
+ * it is not NULL, and then |conn| is checked.
+ */
+static int conn_check_send_buffer_low(nghttp3_conn *conn,
+                                      nghttp3_stream *stream) {
+  uint64_t buffered;
+  int rv;
+
+  if (stream && (stream->flags & NGHTTP3_STREAM_FLAG_SEND_BUFFER_HIGH)) {
+    buffered = nghttp3_stream_get_send_buffered(stream);
+    if (buffered <= conn->local.settings.stream_send_buffer_low_watermark) {
+      stream->flags &= (uint16_t)~NGHTTP3_STREAM_FLAG_SEND_BUFFER_HIGH;
+
+      rv = conn_call_send_buffer_watermark(conn, stream->node.id, /* high = */ 0,
+                                           buffered, stream->user_data);
+      if (rv != 0) {
+        return rv;
+      }
+    }
+  }
+
+  if ((conn->flags & NGHTTP3_CONN_FLAG_SEND_BUFFER_HIGH) &&
+      conn->tx.send_buffered <=
+          conn->local.settings.conn_send_buffer_low_watermark) {
+    conn->flags &= (uint16_t)~NGHTTP3_CONN_FLAG_SEND_BUFFER_HIGH;
+
+    return conn_call_send_buffer_watermark(
+        conn, -1, /* high = */ 0, conn->tx.send_buffered, NULL);
+  }
+
+  return 0;
+}
+
 static int conn_delete_stream(nghttp3_conn *conn, nghttp3_stream *stream) {
   int bidi = nghttp3_client_stream_bidi(stream->node.id);
+  uint64_t send_buffered = nghttp3_stream_get_send_buffered(stream);
+  nghttp3_stream **pslot;
   int rv;
 
   rv = conn_call_deferred_consume(conn, stream,
@@ -1048,6 +1792,11 @@ static int conn_delete_stream(nghttp3_conn *conn, nghttp3_stream *stream) {
     return rv;
   }
 
+  rv = conn_release_blocked_data(conn, stream);
+  if (rv != 0) {
+    return rv;
+  }
+
   if (bidi && conn->callbacks.stream_close) {
     rv = conn->callbacks.stream_close(conn, stream->node.id, stream->error_code,
                                       conn->user_data, stream->user_data);
@@ -1067,46 +1816,82 @@ static int conn_delete_stream(nghttp3_conn *conn, nghttp3_stream *stream) {
 
   assert(0 == rv);
 
+  pslot = conn_get_stream_cache_slot(conn, stream->node.id);
+  if (pslot && *pslot == stream) {
+    *pslot = NULL;
+  }
+
+  assert(conn->mem_used >= stream->mem_used);
+  conn->mem_used -= stream->mem_used;
+
+  assert(conn->tx.unsent_bytes >= stream->unsent_bytes);
+  conn->tx.unsent_bytes -= stream->unsent_bytes;
+
+  nghttp3_conn_unschedule_stream(conn, stream);
+
   nghttp3_stream_del(stream);
 
-  return 0;
+  if (send_buffered == 0) {
+    return 0;
+  }
+
+  assert(conn->tx.send_buffered >= send_buffered);
+  conn->tx.send_buffered -= send_buffered;
+
+  return conn_check_send_buffer_low(conn, NULL);
 }
 
+/*
+ * conn_process_blocked_stream_data processes the data buffered in
+ * |stream| while it was blocked by QPACK decoder.  It processes at
+ * most |*pbudget| bytes, and decreases |*pbudget| by the number of
+ * bytes processed.  If |stream| has buffered data left after
+ * exhausting |*pbudget|, it is pushed to
+ * conn->qpack_unblocked_streams to be processed later.
+ */
 static int conn_process_blocked_stream_data(nghttp3_conn *conn,
-                                            nghttp3_stream *stream) {
-  nghttp3_buf *buf;
+                                            nghttp3_stream *stream,
+                                            size_t *pbudget) {
+  nghttp3_typed_buf *tbuf;
   size_t nproc;
   nghttp3_ssize nconsumed;
   int rv;
   size_t len;
+  size_t buflen, datalen;
 
   assert(nghttp3_client_stream_bidi(stream->node.id));
 
-  for (;;) {
-    len = nghttp3_ringbuf_len(&stream->inq);
+  for (; stream->inq && *pbudget;) {
+    len = nghttp3_ringbuf_len(stream->inq);
     if (len == 0) {
       break;
     }
 
-    buf = nghttp3_ringbuf_get(&stream->inq, 0);
+    tbuf = nghttp3_ringbuf_get(stream->inq, 0);
+    buflen = nghttp3_buf_len(&tbuf->buf);
+    datalen = nghttp3_min(buflen, *pbudget);
 
     nconsumed = nghttp3_conn_read_bidi(
-        conn, &nproc, stream, buf->pos, nghttp3_buf_len(buf),
-        len == 1 && (stream->flags & NGHTTP3_STREAM_FLAG_READ_EOF));
+        conn, &nproc, stream, tbuf->buf.pos, datalen,
+        len == 1 && datalen == buflen &&
+            (stream->flags & NGHTTP3_STREAM_FLAG_READ_EOF));
     if (nconsumed < 0) {
       return (int)nconsumed;
     }
 
-    buf->pos += nproc;
+    tbuf->buf.pos += nproc;
+    *pbudget -= nproc;
 
     rv = conn_call_deferred_consume(conn, stream, (size_t)nconsumed);
     if (rv != 0) {
       return 0;
     }
 
-    if (nghttp3_buf_len(buf) == 0) {
-      nghttp3_buf_free(buf, stream->mem);
-      nghttp3_ringbuf_pop_front(&stream->inq);
+    if (nghttp3_buf_len(&tbuf->buf) == 0) {
+      rv = conn_pop_blocked_data(conn, stream);
+      if (rv != 0) {
+        return rv;
+      }
     }
 
     if (stream->flags & NGHTTP3_STREAM_FLAG_QPACK_DECODE_BLOCKED) {
@@ -1114,8 +1899,18 @@ static int conn_process_blocked_stream_data(nghttp3_conn *conn,
     }
   }
 
-  if (!(stream->flags & NGHTTP3_STREAM_FLAG_QPACK_DECODE_BLOCKED) &&
-      (stream->flags & NGHTTP3_STREAM_FLAG_CLOSED)) {
+  if (stream->flags & NGHTTP3_STREAM_FLAG_QPACK_DECODE_BLOCKED) {
+    return 0;
+  }
+
+  if (stream->inq && nghttp3_ringbuf_len(stream->inq)) {
+    stream->flags |= NGHTTP3_STREAM_FLAG_QPACK_DECODE_BLOCKED;
+
+    return nghttp3_pq_push(&conn->qpack_unblocked_streams,
+                           &stream->qpack_blocked_pe);
+  }
+
+  if (stream->flags & NGHTTP3_STREAM_FLAG_CLOSED) {
     assert(stream->qpack_blocked_pe.index == NGHTTP3_PQ_BAD_INDEX);
 
     rv = conn_delete_stream(conn, stream);
@@ -1127,6 +1922,37 @@ static int conn_process_blocked_stream_data(nghttp3_conn *conn,
   return 0;
 }
 
+/*
+ * conn_process_unblocked_streams processes the buffered data of
+ * streams in conn->qpack_unblocked_streams within the budget
+ * specified by qpack_unblock_budget.
+ */
+static int conn_process_unblocked_streams(nghttp3_conn *conn) {
+  nghttp3_stream *stream;
+  size_t budget = conn->local.settings.qpack_unblock_budget;
+  int rv;
+
+  if (budget == 0) {
+    budget = SIZE_MAX;
+  }
+
+  for (; !nghttp3_pq_empty(&conn->qpack_unblocked_streams) && budget;) {
+    stream = nghttp3_struct_of(nghttp3_pq_top(&conn->qpack_unblocked_streams),
+                               nghttp3_stream, qpack_blocked_pe);
+
+    nghttp3_pq_pop(&conn->qpack_unblocked_streams);
+    stream->qpack_blocked_pe.index = NGHTTP3_PQ_BAD_INDEX;
+    stream->flags &= (uint16_t)~NGHTTP3_STREAM_FLAG_QPACK_DECODE_BLOCKED;
+
+    rv = conn_process_blocked_stream_data(conn, stream, &budget);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  return 0;
+}
+
 nghttp3_ssize nghttp3_conn_read_qpack_encoder(nghttp3_conn *conn,
                                               const uint8_t *src,
                                               size_t srclen) {
@@ -1139,6 +1965,8 @@ nghttp3_ssize nghttp3_conn_read_qpack_encoder(nghttp3_conn *conn,
     return nconsumed;
   }
 
+  conn->stats.rx_qpack_encoder_stream_bytes += (uint64_t)nconsumed;
+
   for (; !nghttp3_pq_empty(&conn->qpack_blocked_streams);) {
     stream = nghttp3_struct_of(nghttp3_pq_top(&conn->qpack_blocked_streams),
                                nghttp3_stream, qpack_blocked_pe);
@@ -1149,21 +1977,33 @@ nghttp3_ssize nghttp3_conn_read_qpack_encoder(nghttp3_conn *conn,
 
     nghttp3_conn_qpack_blocked_streams_pop(conn);
     stream->qpack_blocked_pe.index = NGHTTP3_PQ_BAD_INDEX;
-    stream->flags &= (uint16_t)~NGHTTP3_STREAM_FLAG_QPACK_DECODE_BLOCKED;
 
-    rv = conn_process_blocked_stream_data(conn, stream);
+    rv = nghttp3_pq_push(&conn->qpack_unblocked_streams,
+                         &stream->qpack_blocked_pe);
     if (rv != 0) {
       return rv;
     }
   }
 
+  rv = conn_process_unblocked_streams(conn);
+  if (rv != 0) {
+    return rv;
+  }
+
   return nconsumed;
 }
 
 nghttp3_ssize nghttp3_conn_read_qpack_decoder(nghttp3_conn *conn,
                                               const uint8_t *src,
                                               size_t srclen) {
-  return nghttp3_qpack_encoder_read_decoder(&conn->qenc, src, srclen);
+  nghttp3_ssize nconsumed =
+      nghttp3_qpack_encoder_read_decoder(&conn->qenc, src, srclen);
+
+  if (nconsumed > 0) {
+    conn->stats.rx_qpack_decoder_stream_bytes += (uint64_t)nconsumed;
+  }
+
+  return nconsumed;
 }
 
 static nghttp3_tnode *stream_get_sched_node(nghttp3_stream *stream) {
@@ -1190,6 +2030,30 @@ static int conn_update_stream_priority(nghttp3_conn *conn,
   return 0;
 }
 
+/*
+ * conn_flush_recv_datav passes the DATA payloads collected in |datav|
+ * to recv_datav callback, and resets |*pdatavcnt| to 0.
+ */
+static int conn_flush_recv_datav(nghttp3_conn *conn, nghttp3_stream *stream,
+                                 const nghttp3_vec *datav, size_t *pdatavcnt) {
+  int rv;
+
+  if (*pdatavcnt == 0) {
+    return 0;
+  }
+
+  rv = conn->callbacks.recv_datav(conn, stream->node.id, datav, *pdatavcnt,
+                                  conn->user_data, stream->user_data);
+
+  *pdatavcnt = 0;
+
+  if (rv != 0) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
 nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
                                      nghttp3_stream *stream, const uint8_t *src,
                                      size_t srclen, int fin) {
@@ -1201,6 +2065,11 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
   size_t nconsumed = 0;
   int busy = 0;
   size_t len;
+  /* datav collects DATA payloads which are delivered together to
+     recv_datav callback.  It is flushed before any other callback is
+     called, and before returning from this function. */
+  nghttp3_vec datav[16];
+  size_t datavcnt = 0;
 
   if (stream->flags & NGHTTP3_STREAM_FLAG_SHUT_RD) {
     *pnproc = srclen;
@@ -1215,7 +2084,7 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
       return 0;
     }
 
-    rv = nghttp3_stream_buffer_data(stream, p, (size_t)(end - p));
+    rv = conn_buffer_blocked_data(conn, stream, p, (size_t)(end - p));
     if (rv != 0) {
       return rv;
     }
@@ -1261,6 +2130,14 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
       rstate->left = rstate->fr.hd.length = rvint->acc;
       nghttp3_varint_read_state_reset(rvint);
 
+      nghttp3_frame_stats_add(conn->stats.rx_frames, rstate->fr.hd.type,
+                              rstate->fr.hd.length);
+
+      if (conn->callbacks.trace) {
+        nghttp3_conn_trace_frame(conn, NGHTTP3_TRACE_EVENT_FRAME_RECV,
+                                 stream->node.id, &rstate->fr.hd);
+      }
+
       switch (rstate->fr.hd.type) {
       case NGHTTP3_FRAME_DATA:
         rv = nghttp3_stream_transit_rx_http_state(
@@ -1280,6 +2157,11 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
         rstate->state = NGHTTP3_REQ_STREAM_STATE_DATA;
         break;
       case NGHTTP3_FRAME_HEADERS:
+        rv = conn_flush_recv_datav(conn, stream, datav, &datavcnt);
+        if (rv != 0) {
+          return rv;
+        }
+
         rv = nghttp3_stream_transit_rx_http_state(
             stream, NGHTTP3_HTTP_EVENT_HEADERS_BEGIN);
         if (rv != 0) {
@@ -1316,6 +2198,8 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
           return rv;
         }
 
+        nghttp3_conn_start_timer(conn, stream, NGHTTP3_STREAM_TIMER_HEADERS);
+
         rstate->state = NGHTTP3_REQ_STREAM_STATE_HEADERS;
         break;
       case NGHTTP3_FRAME_PUSH_PROMISE: /* We do not support push */
@@ -1339,9 +2223,27 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
       break;
     case NGHTTP3_REQ_STREAM_STATE_DATA:
       len = (size_t)nghttp3_min(rstate->left, (int64_t)(end - p));
-      rv = nghttp3_conn_on_data(conn, stream, p, len);
-      if (rv != 0) {
-        return rv;
+      if (conn->callbacks.recv_datav) {
+        rv = nghttp3_http_on_data_chunk(stream, len);
+        if (rv != 0) {
+          return rv;
+        }
+
+        if (datavcnt == nghttp3_arraylen(datav)) {
+          rv = conn_flush_recv_datav(conn, stream, datav, &datavcnt);
+          if (rv != 0) {
+            return rv;
+          }
+        }
+
+        datav[datavcnt].base = (uint8_t *)p;
+        datav[datavcnt].len = len;
+        ++datavcnt;
+      } else {
+        rv = nghttp3_conn_on_data(conn, stream, p, len);
+        if (rv != 0) {
+          return rv;
+        }
       }
       p += len;
       rstate->left -= (int64_t)len;
@@ -1374,7 +2276,7 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
 
       if (stream->flags & NGHTTP3_STREAM_FLAG_QPACK_DECODE_BLOCKED) {
         if (p != end && nghttp3_stream_get_buffered_datalen(stream) == 0) {
-          rv = nghttp3_stream_buffer_data(stream, p, (size_t)(end - p));
+          rv = conn_buffer_blocked_data(conn, stream, p, (size_t)(end - p));
           if (rv != 0) {
             return rv;
           }
@@ -1439,6 +2341,9 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
         return rv;
       }
 
+      conn_stop_timer(conn, &conn->stats.headers_time, stream,
+                      NGHTTP3_STREAM_TIMER_HEADERS);
+
       rv = nghttp3_stream_transit_rx_http_state(stream,
                                                 NGHTTP3_HTTP_EVENT_HEADERS_END);
       assert(0 == rv);
@@ -1477,6 +2382,11 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
       nghttp3_stream_read_state_reset(rstate);
       break;
     case NGHTTP3_REQ_STREAM_STATE_IGN_REST:
+      rv = conn_flush_recv_datav(conn, stream, datav, &datavcnt);
+      if (rv != 0) {
+        return rv;
+      }
+
       nconsumed += (size_t)(end - p);
       *pnproc = (size_t)(end - src);
       return (nghttp3_ssize)nconsumed;
@@ -1484,6 +2394,11 @@ nghttp3_ssize nghttp3_conn_read_bidi(nghttp3_conn *conn, size_t *pnproc,
   }
 
 almost_done:
+  rv = conn_flush_recv_datav(conn, stream, datav, &datavcnt);
+  if (rv != 0) {
+    return rv;
+  }
+
   if (fin) {
     switch (rstate->state) {
     case NGHTTP3_REQ_STREAM_STATE_FRAME_TYPE:
@@ -1530,13 +2445,45 @@ int nghttp3_conn_on_data(nghttp3_conn *conn, nghttp3_stream *stream,
     return NGHTTP3_ERR_CALLBACK_FAILURE;
   }
 
-  return 0;
+  return 0;
+}
+
+static nghttp3_pq *conn_get_sched_pq(nghttp3_conn *conn, nghttp3_tnode *tnode) {
+  assert(tnode->pri.urgency < NGHTTP3_URGENCY_LEVELS);
+
+  return &conn->sched[tnode->pri.urgency].spq;
+}
+
+/*
+ * rcbuf_mem_used returns the number of bytes allocated for |rcbuf|,
+ * or 0 if it is NULL or static.
+ */
+static size_t rcbuf_mem_used(const nghttp3_rcbuf *rcbuf) {
+  if (rcbuf == NULL || nghttp3_rcbuf_is_static(rcbuf)) {
+    return 0;
+  }
+
+  return sizeof(nghttp3_rcbuf) + rcbuf->len;
 }
 
-static nghttp3_pq *conn_get_sched_pq(nghttp3_conn *conn, nghttp3_tnode *tnode) {
-  assert(tnode->pri.urgency < NGHTTP3_URGENCY_LEVELS);
+/*
+ * conn_update_qpack_mem_used charges the buffers of the field which
+ * QPACK decoder is decoding for |stream| to stream->mem_used.  The
+ * fields passed to an application are not charged because they are
+ * released when the callback returns unless the application keeps
+ * them.
+ */
+static void conn_update_qpack_mem_used(nghttp3_stream *stream) {
+  nghttp3_qpack_read_state *rstate = &stream->qpack_sctx.rstate;
+  size_t n = rcbuf_mem_used(rstate->name) + rcbuf_mem_used(rstate->value);
 
-  return &conn->sched[tnode->pri.urgency].spq;
+  if (n > stream->qpack_mem_used) {
+    nghttp3_stream_add_mem_used(stream, n - stream->qpack_mem_used);
+  } else {
+    nghttp3_stream_sub_mem_used(stream, stream->qpack_mem_used - n);
+  }
+
+  stream->qpack_mem_used = n;
 }
 
 static nghttp3_ssize conn_decode_headers(nghttp3_conn *conn,
@@ -1585,6 +2532,8 @@ static nghttp3_ssize conn_decode_headers(nghttp3_conn *conn,
       return (int)nread;
     }
 
+    conn_update_qpack_mem_used(stream);
+
     buf.pos += nread;
 
     if (flags & NGHTTP3_QPACK_DECODE_FLAG_BLOCKED) {
@@ -1611,8 +2560,10 @@ static nghttp3_ssize conn_decode_headers(nghttp3_conn *conn,
     }
 
     if (flags & NGHTTP3_QPACK_DECODE_FLAG_EMIT) {
+      conn->stats.rx_field_bytes += nv.name->len + nv.value->len;
+
       rv = nghttp3_http_on_header(
-          http, &nv, request, trailers,
+          http, &nv, stream->qpack_sctx.verdict, request, trailers,
           conn->server && conn->local.settings.enable_connect_protocol);
       switch (rv) {
       case NGHTTP3_ERR_MALFORMED_HTTP_HEADER:
@@ -1827,14 +2778,12 @@ int nghttp3_conn_create_stream(nghttp3_conn *conn, nghttp3_stream **pstream,
   };
 
   rv = nghttp3_stream_new(&stream, stream_id, &callbacks,
-                          &conn->out_chunk_objalloc, &conn->stream_objalloc,
-                          conn->mem);
+                          &conn->out_chunk_objalloc, conn->in_chunk_objalloc,
+                          &conn->stream_objalloc, conn->mem);
   if (rv != 0) {
     return rv;
   }
 
-  stream->conn = conn;
-
   rv = nghttp3_map_insert(&conn->streams, (nghttp3_map_key_type)stream->node.id,
                           stream);
   if (rv != 0) {
@@ -1842,10 +2791,22 @@ int nghttp3_conn_create_stream(nghttp3_conn *conn, nghttp3_stream **pstream,
     return rv;
   }
 
+  stream->conn = conn;
+  conn->mem_used += stream->mem_used;
+
+  conn_cache_stream(conn, stream);
+
   if (conn->server && nghttp3_client_stream_bidi(stream_id)) {
     ++conn->remote.bidi.num_streams;
   }
 
+  NGHTTP3_PROBE2(stream_open, conn, stream_id);
+
+  if (conn->callbacks.trace) {
+    nghttp3_conn_trace_stream_state(conn, stream_id,
+                                    NGHTTP3_TRACE_STREAM_OPENED, 0);
+  }
+
   *pstream = stream;
 
   return 0;
@@ -1853,6 +2814,12 @@ int nghttp3_conn_create_stream(nghttp3_conn *conn, nghttp3_stream **pstream,
 
 nghttp3_stream *nghttp3_conn_find_stream(nghttp3_conn *conn,
                                          int64_t stream_id) {
+  nghttp3_stream **pslot = conn_get_stream_cache_slot(conn, stream_id);
+
+  if (pslot && *pslot && (*pslot)->node.id == stream_id) {
+    return *pslot;
+  }
+
   return nghttp3_map_find(&conn->streams, (nghttp3_map_key_type)stream_id);
 }
 
@@ -1928,6 +2895,30 @@ int nghttp3_conn_bind_qpack_streams(nghttp3_conn *conn, int64_t qenc_stream_id,
   return nghttp3_stream_write_stream_type(stream);
 }
 
+/*
+ * conn_get_min_unsent_bytes returns the number of bytes that |stream|
+ * should buffer in its outq before it is written.  Write budget is
+ * shared by all streams in |conn|, and the unsent bytes buffered by
+ * the other streams are charged against it first.
+ */
+static uint64_t conn_get_min_unsent_bytes(nghttp3_conn *conn,
+                                          nghttp3_stream *stream) {
+  uint64_t budget, others;
+
+  if (!(conn->flags & NGHTTP3_CONN_FLAG_WRITE_BUDGET_SET)) {
+    return NGHTTP3_MIN_UNSENT_BYTES;
+  }
+
+  budget = nghttp3_min(conn->tx.write_budget, NGHTTP3_MAX_UNSENT_BYTES);
+
+  assert(conn->tx.unsent_bytes >= stream->unsent_bytes);
+
+  others = conn->tx.unsent_bytes - stream->unsent_bytes;
+  budget = budget > others ? budget - others : 0;
+
+  return nghttp3_max(budget, NGHTTP3_STREAM_MIN_WRITELEN);
+}
+
 static nghttp3_ssize conn_writev_stream(nghttp3_conn *conn, int64_t *pstream_id,
                                         int *pfin, nghttp3_vec *vec,
                                         size_t veccnt, nghttp3_stream *stream) {
@@ -1939,7 +2930,14 @@ static nghttp3_ssize conn_writev_stream(nghttp3_conn *conn, int64_t *pstream_id,
   /* If stream is blocked by read callback, don't attempt to fill
      more. */
   if (!(stream->flags & NGHTTP3_STREAM_FLAG_READ_DATA_BLOCKED)) {
-    rv = nghttp3_stream_fill_outq(stream);
+    rv = nghttp3_stream_fill_outq(stream,
+                                  conn_get_min_unsent_bytes(conn, stream));
+    if (rv != 0) {
+      return rv;
+    }
+
+    rv = conn_check_send_buffer_high(
+        conn, nghttp3_client_stream_bidi(stream->node.id) ? stream : NULL);
     if (rv != 0) {
       return rv;
     }
@@ -1969,15 +2967,25 @@ static nghttp3_ssize conn_writev_stream(nghttp3_conn *conn, int64_t *pstream_id,
 
   *pstream_id = stream->node.id;
 
+  if (n) {
+    conn_stop_timer(conn, &conn->stats.first_byte_time, stream,
+                    NGHTTP3_STREAM_TIMER_FIRST_QUEUED);
+  }
+
   return n;
 }
 
-nghttp3_ssize nghttp3_conn_writev_stream(nghttp3_conn *conn,
-                                         int64_t *pstream_id, int *pfin,
-                                         nghttp3_vec *vec, size_t veccnt) {
+/*
+ * conn_writev writes data to send on the stream chosen by the
+ * scheduler.  See nghttp3_conn_writev_stream for the parameters and
+ * the return value.
+ */
+static nghttp3_ssize conn_writev(nghttp3_conn *conn, int64_t *pstream_id,
+                                 int *pfin, nghttp3_vec *vec, size_t veccnt) {
   nghttp3_ssize ncnt;
   nghttp3_stream *stream;
   int rv;
+  nghttp3_trace_event ev;
 
   *pstream_id = -1;
   *pfin = 0;
@@ -1986,6 +2994,11 @@ nghttp3_ssize nghttp3_conn_writev_stream(nghttp3_conn *conn,
     return 0;
   }
 
+  rv = conn_process_unblocked_streams(conn);
+  if (rv != 0) {
+    return rv;
+  }
+
   if (conn->tx.ctrl && !nghttp3_stream_is_blocked(conn->tx.ctrl)) {
     ncnt =
         conn_writev_stream(conn, pstream_id, pfin, vec, veccnt, conn->tx.ctrl);
@@ -2020,6 +3033,18 @@ nghttp3_ssize nghttp3_conn_writev_stream(nghttp3_conn *conn,
     return 0;
   }
 
+  conn_stop_timer(conn, &conn->stats.sched_wait_time, stream,
+                  NGHTTP3_STREAM_TIMER_SCHED);
+
+  if (conn->callbacks.trace) {
+    ev.type = NGHTTP3_TRACE_EVENT_SCHEDULE;
+    ev.data.schedule.stream_id = stream->node.id;
+    ev.data.schedule.urgency = stream->node.pri.urgency;
+    ev.data.schedule.inc = stream->node.pri.inc;
+
+    conn->callbacks.trace(conn, &ev, conn->user_data);
+  }
+
   ncnt = conn_writev_stream(conn, pstream_id, pfin, vec, veccnt, stream);
   if (ncnt < 0) {
     return ncnt;
@@ -2033,10 +3058,40 @@ nghttp3_ssize nghttp3_conn_writev_stream(nghttp3_conn *conn,
   return ncnt;
 }
 
+nghttp3_ssize nghttp3_conn_writev_stream(nghttp3_conn *conn,
+                                         int64_t *pstream_id, int *pfin,
+                                         nghttp3_vec *vec, size_t veccnt) {
+  nghttp3_ssize ncnt = conn_writev(conn, pstream_id, pfin, vec, veccnt);
+
+  NGHTTP3_PROBE4(writev_stream, conn, *pstream_id, *pfin, ncnt);
+
+  return ncnt;
+}
+
 nghttp3_stream *nghttp3_conn_get_next_tx_stream(nghttp3_conn *conn) {
   size_t i;
   nghttp3_tnode *tnode;
   nghttp3_pq *pq;
+  nghttp3_stream *stream;
+  int64_t stream_id;
+
+  if (conn->flags & NGHTTP3_CONN_FLAG_CUSTOM_SCHEDULER) {
+    for (;;) {
+      stream_id = conn->scheduler.next(conn, conn->scheduler.user_data);
+      if (stream_id < 0) {
+        return NULL;
+      }
+
+      stream = nghttp3_conn_find_stream(conn, stream_id);
+      if (stream && (stream->flags & NGHTTP3_STREAM_FLAG_SCHEDULED)) {
+        return stream;
+      }
+
+      /* Drop the stale stream ID so that it does not stall the other
+         streams. */
+      conn->scheduler.unschedule(conn, stream_id, conn->scheduler.user_data);
+    }
+  }
 
   for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
     pq = &conn->sched[i].spq;
@@ -2064,10 +3119,20 @@ int nghttp3_conn_add_write_offset(nghttp3_conn *conn, int64_t stream_id,
 
   stream->unscheduled_nwrite += n;
 
+  if (conn->flags & NGHTTP3_CONN_FLAG_WRITE_BUDGET_SET) {
+    conn->tx.write_budget -= nghttp3_min(conn->tx.write_budget, n);
+  }
+
   if (!nghttp3_client_stream_bidi(stream->node.id)) {
     return 0;
   }
 
+  if ((conn->flags & NGHTTP3_CONN_FLAG_CUSTOM_SCHEDULER) &&
+      conn->scheduler.on_write) {
+    conn->scheduler.on_write(conn, stream->node.id, n,
+                             conn->scheduler.user_data);
+  }
+
   if (!nghttp3_stream_require_schedule(stream)) {
     nghttp3_conn_unschedule_stream(conn, stream);
     return 0;
@@ -2080,15 +3145,34 @@ int nghttp3_conn_add_write_offset(nghttp3_conn *conn, int64_t stream_id,
   return nghttp3_conn_schedule_stream(conn, stream);
 }
 
+void nghttp3_conn_set_write_budget(nghttp3_conn *conn, uint64_t budget) {
+  if (budget == 0) {
+    conn->flags &= (uint16_t)~NGHTTP3_CONN_FLAG_WRITE_BUDGET_SET;
+    conn->tx.write_budget = 0;
+
+    return;
+  }
+
+  conn->flags |= NGHTTP3_CONN_FLAG_WRITE_BUDGET_SET;
+  conn->tx.write_budget = budget;
+}
+
 int nghttp3_conn_add_ack_offset(nghttp3_conn *conn, int64_t stream_id,
                                 uint64_t n) {
   nghttp3_stream *stream = nghttp3_conn_find_stream(conn, stream_id);
+  int rv;
 
   if (stream == NULL) {
     return 0;
   }
 
-  return nghttp3_stream_add_ack_offset(stream, n);
+  rv = nghttp3_stream_add_ack_offset(stream, n);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return conn_check_send_buffer_low(
+      conn, nghttp3_client_stream_bidi(stream->node.id) ? stream : NULL);
 }
 
 static int conn_submit_headers_data(nghttp3_conn *conn, nghttp3_stream *stream,
@@ -2130,24 +3214,72 @@ static int conn_submit_headers_data(nghttp3_conn *conn, nghttp3_stream *stream,
   return 0;
 }
 
+/*
+ * conn_custom_schedule_stream schedules |stream| with an application
+ * supplied scheduler.
+ */
+static int conn_custom_schedule_stream(nghttp3_conn *conn,
+                                       nghttp3_stream *stream) {
+  int rv;
+
+  stream->unscheduled_nwrite = 0;
+
+  if (stream->flags & NGHTTP3_STREAM_FLAG_SCHEDULED) {
+    return 0;
+  }
+
+  rv = conn->scheduler.schedule(conn, stream->node.id, &stream->node.pri,
+                                conn->scheduler.user_data);
+  if (rv != 0) {
+    return NGHTTP3_ERR_CALLBACK_FAILURE;
+  }
+
+  stream->flags |= NGHTTP3_STREAM_FLAG_SCHEDULED;
+
+  ++conn->stats.sched_pushes;
+
+  nghttp3_conn_start_timer(conn, stream, NGHTTP3_STREAM_TIMER_SCHED);
+
+  return 0;
+}
+
 int nghttp3_conn_schedule_stream(nghttp3_conn *conn, nghttp3_stream *stream) {
   /* Assume that stream stays on the same urgency level */
   nghttp3_tnode *node = stream_get_sched_node(stream);
+  uint64_t quantum;
   int rv;
 
-  rv = nghttp3_tnode_schedule(node, conn_get_sched_pq(conn, node),
-                              stream->unscheduled_nwrite);
+  if (conn->flags & NGHTTP3_CONN_FLAG_CUSTOM_SCHEDULER) {
+    return conn_custom_schedule_stream(conn, stream);
+  }
+
+  quantum = conn->sched[node->pri.urgency].quantum;
+  if (quantum) {
+    rv = nghttp3_tnode_schedule_drr(node, conn_get_sched_pq(conn, node),
+                                    stream->unscheduled_nwrite, quantum);
+  } else {
+    rv = nghttp3_tnode_schedule(node, conn_get_sched_pq(conn, node),
+                                stream->unscheduled_nwrite);
+  }
   if (rv != 0) {
     return rv;
   }
 
   stream->unscheduled_nwrite = 0;
 
+  ++conn->stats.sched_pushes;
+
+  nghttp3_conn_start_timer(conn, stream, NGHTTP3_STREAM_TIMER_SCHED);
+
   return 0;
 }
 
 int nghttp3_conn_ensure_stream_scheduled(nghttp3_conn *conn,
                                          nghttp3_stream *stream) {
+  if (conn->flags & NGHTTP3_CONN_FLAG_CUSTOM_SCHEDULER) {
+    return conn_custom_schedule_stream(conn, stream);
+  }
+
   if (nghttp3_tnode_is_scheduled(stream_get_sched_node(stream))) {
     return 0;
   }
@@ -2159,7 +3291,69 @@ void nghttp3_conn_unschedule_stream(nghttp3_conn *conn,
                                     nghttp3_stream *stream) {
   nghttp3_tnode *node = stream_get_sched_node(stream);
 
+  if (stream->ts) {
+    stream->ts[NGHTTP3_STREAM_TIMER_SCHED] = NGHTTP3_TSTAMP_NONE;
+  }
+
+  if (conn->flags & NGHTTP3_CONN_FLAG_CUSTOM_SCHEDULER) {
+    if (!(stream->flags & NGHTTP3_STREAM_FLAG_SCHEDULED)) {
+      return;
+    }
+
+    stream->flags &= (uint16_t)~NGHTTP3_STREAM_FLAG_SCHEDULED;
+
+    conn->scheduler.unschedule(conn, stream->node.id,
+                               conn->scheduler.user_data);
+
+    ++conn->stats.sched_pops;
+
+    return;
+  }
+
+  if (!nghttp3_tnode_is_scheduled(node)) {
+    return;
+  }
+
   nghttp3_tnode_unschedule(node, conn_get_sched_pq(conn, node));
+
+  ++conn->stats.sched_pops;
+}
+
+int nghttp3_conn_set_urgency_quantum(nghttp3_conn *conn, uint32_t urgency,
+                                     uint64_t quantum) {
+  if (urgency >= NGHTTP3_URGENCY_LEVELS) {
+    return NGHTTP3_ERR_INVALID_ARGUMENT;
+  }
+
+  conn->sched[urgency].quantum = quantum;
+
+  return 0;
+}
+
+int nghttp3_conn_set_scheduler_versioned(nghttp3_conn *conn,
+                                         int scheduler_version,
+                                         const nghttp3_scheduler *scheduler) {
+  size_t i;
+  (void)scheduler_version;
+
+  if (!scheduler->schedule || !scheduler->unschedule || !scheduler->next) {
+    return NGHTTP3_ERR_INVALID_ARGUMENT;
+  }
+
+  if (conn->flags & NGHTTP3_CONN_FLAG_CUSTOM_SCHEDULER) {
+    return NGHTTP3_ERR_INVALID_STATE;
+  }
+
+  for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
+    if (!nghttp3_pq_empty(&conn->sched[i].spq)) {
+      return NGHTTP3_ERR_INVALID_STATE;
+    }
+  }
+
+  conn->scheduler = *scheduler;
+  conn->flags |= NGHTTP3_CONN_FLAG_CUSTOM_SCHEDULER;
+
+  return 0;
 }
 
 int nghttp3_conn_submit_request(nghttp3_conn *conn, int64_t stream_id,
@@ -2394,6 +3588,16 @@ int nghttp3_conn_resume_stream(nghttp3_conn *conn, int64_t stream_id) {
     return 0;
   }
 
+  if (stream->flags & NGHTTP3_STREAM_FLAG_READ_DATA_BLOCKED) {
+    conn_stop_timer(conn, &conn->stats.read_data_blocked_time, stream,
+                    NGHTTP3_STREAM_TIMER_READ_DATA_BLOCKED);
+
+    if (conn->callbacks.trace) {
+      nghttp3_conn_trace_stream_state(
+          conn, stream_id, NGHTTP3_TRACE_STREAM_READ_DATA_RESUMED, 0);
+    }
+  }
+
   stream->flags &= (uint16_t)~NGHTTP3_STREAM_FLAG_READ_DATA_BLOCKED;
 
   if (nghttp3_client_stream_bidi(stream->node.id) &&
@@ -2419,6 +3623,14 @@ int nghttp3_conn_close_stream(nghttp3_conn *conn, int64_t stream_id,
 
   stream->error_code = app_error_code;
 
+  NGHTTP3_PROBE3(stream_close, conn, stream_id, app_error_code);
+
+  if (conn->callbacks.trace) {
+    nghttp3_conn_trace_stream_state(conn, stream_id,
+                                    NGHTTP3_TRACE_STREAM_CLOSED,
+                                    app_error_code);
+  }
+
   nghttp3_conn_unschedule_stream(conn, stream);
 
   if (stream->qpack_blocked_pe.index == NGHTTP3_PQ_BAD_INDEX) {
@@ -2450,17 +3662,78 @@ int nghttp3_conn_shutdown_stream_read(nghttp3_conn *conn, int64_t stream_id) {
 
 int nghttp3_conn_qpack_blocked_streams_push(nghttp3_conn *conn,
                                             nghttp3_stream *stream) {
+  int rv;
+
   assert(stream->qpack_blocked_pe.index == NGHTTP3_PQ_BAD_INDEX);
 
-  return nghttp3_pq_push(&conn->qpack_blocked_streams,
-                         &stream->qpack_blocked_pe);
+  rv = nghttp3_pq_push(&conn->qpack_blocked_streams,
+                       &stream->qpack_blocked_pe);
+  if (rv != 0) {
+    return rv;
+  }
+
+  ++conn->stats.qpack_blocked_streams;
+  conn->stats.max_qpack_blocked_streams =
+      nghttp3_max(conn->stats.max_qpack_blocked_streams,
+                  nghttp3_pq_size(&conn->qpack_blocked_streams));
+
+  NGHTTP3_PROBE2(qpack_blocked, conn, stream->node.id);
+
+  nghttp3_conn_start_timer(conn, stream, NGHTTP3_STREAM_TIMER_QPACK_BLOCKED);
+
+  if (conn->callbacks.trace) {
+    nghttp3_conn_trace_stream_state(conn, stream->node.id,
+                                    NGHTTP3_TRACE_STREAM_QPACK_BLOCKED, 0);
+  }
+
+  return 0;
 }
 
 void nghttp3_conn_qpack_blocked_streams_pop(nghttp3_conn *conn) {
+  nghttp3_stream *stream;
+
   assert(!nghttp3_pq_empty(&conn->qpack_blocked_streams));
+
+  stream = nghttp3_struct_of(nghttp3_pq_top(&conn->qpack_blocked_streams),
+                             nghttp3_stream, qpack_blocked_pe);
+
+  NGHTTP3_PROBE2(qpack_unblocked, conn, stream->node.id);
+
+  conn_stop_timer(conn, &conn->stats.qpack_blocked_time, stream,
+                  NGHTTP3_STREAM_TIMER_QPACK_BLOCKED);
+
+  if (conn->callbacks.trace) {
+    nghttp3_conn_trace_stream_state(conn, stream->node.id,
+                                    NGHTTP3_TRACE_STREAM_QPACK_UNBLOCKED, 0);
+  }
+
   nghttp3_pq_pop(&conn->qpack_blocked_streams);
 }
 
+void nghttp3_conn_trace_frame(nghttp3_conn *conn, uint32_t type,
+                              int64_t stream_id, const nghttp3_frame_hd *hd) {
+  nghttp3_trace_event ev;
+
+  ev.type = type;
+  ev.data.frame.stream_id = stream_id;
+  ev.data.frame.type = hd->type;
+  ev.data.frame.length = hd->length;
+
+  conn->callbacks.trace(conn, &ev, conn->user_data);
+}
+
+void nghttp3_conn_trace_stream_state(nghttp3_conn *conn, int64_t stream_id,
+                                     uint32_t state, uint64_t app_error_code) {
+  nghttp3_trace_event ev;
+
+  ev.type = NGHTTP3_TRACE_EVENT_STREAM_STATE;
+  ev.data.stream.stream_id = stream_id;
+  ev.data.stream.state = state;
+  ev.data.stream.app_error_code = app_error_code;
+
+  conn->callbacks.trace(conn, &ev, conn->user_data);
+}
+
 void nghttp3_conn_set_max_client_streams_bidi(nghttp3_conn *conn,
                                               uint64_t max_streams) {
   assert(conn->server);
@@ -2473,6 +3746,17 @@ void nghttp3_conn_set_max_concurrent_streams(nghttp3_conn *conn,
                                              size_t max_concurrent_streams) {
   nghttp3_qpack_decoder_set_max_concurrent_streams(&conn->qdec,
                                                    max_concurrent_streams);
+
+  conn->max_concurrent_streams = max_concurrent_streams;
+
+  if (conn->stream_cache &&
+      conn->stream_cachelen != conn_stream_cachelen(conn)) {
+    /* It is just a cache.  Drop it, and allocate the new one when
+       the next stream is created. */
+    nghttp3_mem_free(conn->mem, conn->stream_cache);
+    conn->stream_cache = NULL;
+    conn->stream_cachelen = 0;
+  }
 }
 
 int nghttp3_conn_set_stream_user_data(nghttp3_conn *conn, int64_t stream_id,
@@ -2583,6 +3867,115 @@ int nghttp3_conn_set_server_stream_priority_versioned(nghttp3_conn *conn,
   return conn_update_stream_priority(conn, stream, pri);
 }
 
+int nghttp3_conn_set_stream_deadline(nghttp3_conn *conn, int64_t stream_id,
+                                     uint64_t deadline) {
+  nghttp3_stream *stream;
+
+  if (!nghttp3_client_stream_bidi(stream_id)) {
+    return NGHTTP3_ERR_INVALID_ARGUMENT;
+  }
+
+  stream = nghttp3_conn_find_stream(conn, stream_id);
+  if (stream == NULL) {
+    return NGHTTP3_ERR_STREAM_NOT_FOUND;
+  }
+
+  if (stream->node.deadline == deadline) {
+    return 0;
+  }
+
+  if (!nghttp3_tnode_is_scheduled(&stream->node)) {
+    stream->node.deadline = deadline;
+    return 0;
+  }
+
+  nghttp3_conn_unschedule_stream(conn, stream);
+
+  stream->node.deadline = deadline;
+
+  return nghttp3_conn_schedule_stream(conn, stream);
+}
+
+uint64_t nghttp3_conn_get_memory_usage(nghttp3_conn *conn) {
+  return conn->mem_used + conn->qenc.ctx.dtable_size +
+         conn->qdec.ctx.dtable_size + nghttp3_buf_cap(&conn->tx.qpack.rbuf) +
+         nghttp3_buf_cap(&conn->tx.qpack.ebuf);
+}
+
+void nghttp3_conn_get_stats_versioned(nghttp3_conn *conn, int stats_version,
+                                      nghttp3_conn_stats *stats) {
+  (void)stats_version;
+
+  *stats = conn->stats;
+
+  stats->qpack_encoder_dtable_hits = conn->qenc.ctx.dtable_hits;
+  stats->qpack_encoder_dtable_inserts = conn->qenc.ctx.next_absidx;
+  stats->qpack_encoder_dtable_evictions =
+      conn->qenc.ctx.next_absidx - nghttp3_ringbuf_len(&conn->qenc.ctx.dtable);
+  stats->qpack_decoder_dtable_hits = conn->qdec.ctx.dtable_hits;
+  stats->qpack_decoder_dtable_inserts = conn->qdec.ctx.next_absidx;
+  stats->qpack_decoder_dtable_evictions =
+      conn->qdec.ctx.next_absidx - nghttp3_ringbuf_len(&conn->qdec.ctx.dtable);
+}
+
+uint64_t nghttp3_conn_get_stream_memory_usage(nghttp3_conn *conn,
+                                              int64_t stream_id) {
+  nghttp3_stream *stream = nghttp3_conn_find_stream(conn, stream_id);
+
+  if (stream == NULL) {
+    return 0;
+  }
+
+  return stream->mem_used;
+}
+
+static int conn_compact_stream(void *data, void *ptr) {
+  (void)ptr;
+
+  nghttp3_stream_compact(data);
+
+  return 0;
+}
+
+/*
+ * conn_compact_buf frees the memory of |buf| if it holds no data.
+ */
+static void conn_compact_buf(nghttp3_buf *buf, const nghttp3_mem *mem) {
+  if (nghttp3_buf_len(buf)) {
+    return;
+  }
+
+  nghttp3_buf_free(buf, mem);
+  nghttp3_buf_init(buf);
+}
+
+void nghttp3_conn_compact(nghttp3_conn *conn) {
+  size_t i;
+
+  nghttp3_map_each(&conn->streams, conn_compact_stream, NULL);
+
+  for (i = 0; i < NGHTTP3_URGENCY_LEVELS; ++i) {
+    nghttp3_pq_shrink(&conn->sched[i].spq);
+  }
+
+  nghttp3_pq_shrink(&conn->qpack_blocked_streams);
+  nghttp3_pq_shrink(&conn->qpack_unblocked_streams);
+
+  /* These buffers are only used while HEADERS frame is being
+     written.  Do not free the one which still has data in it. */
+  conn_compact_buf(&conn->tx.qpack.rbuf, conn->mem);
+  conn_compact_buf(&conn->tx.qpack.ebuf, conn->mem);
+
+  nghttp3_objalloc_compact(&conn->stream_objalloc, sizeof(nghttp3_stream));
+  nghttp3_objalloc_compact(&conn->out_chunk_objalloc,
+                           NGHTTP3_STREAM_MIN_CHUNK_SIZE);
+
+  for (i = 0; i < NGHTTP3_STREAM_NUM_IN_CHUNK_CLASSES; ++i) {
+    nghttp3_objalloc_compact(&conn->in_chunk_objalloc[i],
+                             (size_t)NGHTTP3_STREAM_MIN_CHUNK_SIZE << (2 * i));
+  }
+}
+
 int nghttp3_conn_is_drained(nghttp3_conn *conn) {
   assert(conn->server);
 
@@ -2592,12 +3985,22 @@ int nghttp3_conn_is_drained(nghttp3_conn *conn) {
          nghttp3_ringbuf_len(&conn->tx.ctrl->frq) == 0;
 }
 
+int nghttp3_conn_has_pending_unblocked_streams(nghttp3_conn *conn) {
+  return !nghttp3_pq_empty(&conn->qpack_unblocked_streams);
+}
+
 void nghttp3_settings_default_versioned(int settings_version,
                                         nghttp3_settings *settings) {
-  (void)settings_version;
+  size_t len = nghttp3_settingslen_version(settings_version);
+
+  memset(settings, 0, len);
 
-  memset(settings, 0, sizeof(nghttp3_settings));
-  settings->max_field_section_size = NGHTTP3_VARINT_MAX;
-  settings->qpack_encoder_max_dtable_capacity =
-      NGHTTP3_QPACK_ENCODER_MAX_DTABLE_CAPACITY;
+  switch (settings_version) {
+  case NGHTTP3_SETTINGS_VERSION:
+  case NGHTTP3_SETTINGS_V1:
+    settings->max_field_section_size = NGHTTP3_VARINT_MAX;
+    settings->qpack_encoder_max_dtable_capacity =
+        NGHTTP3_QPACK_ENCODER_MAX_DTABLE_CAPACITY;
+    break;
+  }
 }
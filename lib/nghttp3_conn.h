@@ -37,6 +37,7 @@
 #include "nghttp3_tnode.h"
 #include "nghttp3_idtr.h"
 #include "nghttp3_gaptr.h"
+#include "nghttp3_region.h"
 
 #define NGHTTP3_VARINT_MAX ((1ull << 62) - 1)
 
@@ -71,6 +72,34 @@
 /* NGHTTP3_CONN_FLAG_GOAWAY_QUEUED indicates that GOAWAY frame has
    been submitted for transmission. */
 #define NGHTTP3_CONN_FLAG_GOAWAY_QUEUED 0x0040u
+/* NGHTTP3_CONN_FLAG_WRITE_BUDGET_SET indicates that an application
+   has given write budget with nghttp3_conn_set_write_budget. */
+#define NGHTTP3_CONN_FLAG_WRITE_BUDGET_SET 0x0080u
+/* NGHTTP3_CONN_FLAG_SEND_BUFFER_HIGH indicates that the number of
+   bytes buffered for sending in all streams has reached high
+   watermark and low watermark notification is pending. */
+#define NGHTTP3_CONN_FLAG_SEND_BUFFER_HIGH 0x0100u
+/* NGHTTP3_CONN_FLAG_CUSTOM_SCHEDULER indicates that an application
+   supplied scheduler is used instead of sched. */
+#define NGHTTP3_CONN_FLAG_CUSTOM_SCHEDULER 0x0200u
+/* NGHTTP3_CONN_FLAG_REGION_ALLOCATOR indicates that all objects
+   owned by a connection are allocated from region. */
+#define NGHTTP3_CONN_FLAG_REGION_ALLOCATOR 0x0400u
+
+/* NGHTTP3_CONN_STREAM_CACHE_MIN_SIZE and
+   NGHTTP3_CONN_STREAM_CACHE_MAX_SIZE are the lower and upper bounds
+   of the number of slots in the stream cache.  They must be a power
+   of 2. */
+#define NGHTTP3_CONN_STREAM_CACHE_MIN_SIZE 16
+#define NGHTTP3_CONN_STREAM_CACHE_MAX_SIZE 512
+/* NGHTTP3_CONN_STREAM_CACHE_DEFAULT_SIZE is the number of slots in
+   the stream cache if nghttp3_conn_set_max_concurrent_streams has
+   not been called. */
+#define NGHTTP3_CONN_STREAM_CACHE_DEFAULT_SIZE 128
+
+/* NGHTTP3_CONN_IN_CHUNK_BLOCK_NMEMB is the number of chunks in a
+   memory block of each in_chunk_objalloc. */
+#define NGHTTP3_CONN_IN_CHUNK_BLOCK_NMEMB 4
 
 typedef struct nghttp3_chunk {
   nghttp3_opl_entry oplent;
@@ -80,19 +109,62 @@ nghttp3_objalloc_def(chunk, nghttp3_chunk, oplent);
 
 struct nghttp3_conn {
   nghttp3_objalloc out_chunk_objalloc;
+  /* in_chunk_objalloc is the object pools of the buffers which store
+     the incoming data of streams blocked by QPACK decoder.  Element
+     i pools the buffers of size NGHTTP3_STREAM_MIN_CHUNK_SIZE << (2 *
+     i). */
+  nghttp3_objalloc in_chunk_objalloc[NGHTTP3_STREAM_NUM_IN_CHUNK_CLASSES];
   nghttp3_objalloc stream_objalloc;
   nghttp3_callbacks callbacks;
   nghttp3_map streams;
+  /* stream_cache is a modulo cache in front of streams.  A stream is
+     cached at stream_cache[stream_id & (stream_cachelen - 1)].  Since
+     stream IDs are assigned sequentially, it covers the recent window
+     of stream IDs.  A newer stream evicts an older one in the same
+     slot, and a lookup which misses the cache falls back to streams.
+     It is allocated when the first stream is created, and it is
+     NULL if the allocation failed. */
+  nghttp3_stream **stream_cache;
+  /* stream_cachelen is the number of slots in stream_cache.  It is a
+     power of 2, or 0 if stream_cache is NULL. */
+  size_t stream_cachelen;
+  /* max_concurrent_streams is the value given by
+     nghttp3_conn_set_max_concurrent_streams.  It is used to size
+     stream_cache. */
+  size_t max_concurrent_streams;
   nghttp3_qpack_decoder qdec;
   nghttp3_qpack_encoder qenc;
   nghttp3_pq qpack_blocked_streams;
+  /* qpack_unblocked_streams contains streams which are no longer
+     blocked by QPACK decoder, but whose buffered data have not been
+     processed yet because of qpack_unblock_budget.  Streams in this
+     queue still have NGHTTP3_STREAM_FLAG_QPACK_DECODE_BLOCKED set so
+     that incoming data are appended to the buffered data. */
+  nghttp3_pq qpack_unblocked_streams;
   struct {
     nghttp3_pq spq;
+    /* quantum is the number of bytes that an incremental stream can
+       write per round in deficit round robin mode.  If it is 0,
+       incremental streams are rescheduled every
+       NGHTTP3_STREAM_MIN_WRITELEN bytes written. */
+    uint64_t quantum;
   } sched[NGHTTP3_URGENCY_LEVELS];
+  /* scheduler is an application supplied scheduler.  It is only used
+     if NGHTTP3_CONN_FLAG_CUSTOM_SCHEDULER is set. */
+  nghttp3_scheduler scheduler;
+  /* region is the allocator from which mem allocates memory if
+     NGHTTP3_CONN_FLAG_REGION_ALLOCATOR is set. */
+  nghttp3_region region;
   const nghttp3_mem *mem;
   void *user_data;
   int server;
   uint16_t flags;
+  /* mem_used is the sum of nghttp3_stream.mem_used of all streams. */
+  uint64_t mem_used;
+  /* stats is the statistics returned by nghttp3_conn_get_stats.
+     The counters which can be derived from other fields are filled
+     in when they are read. */
+  nghttp3_conn_stats stats;
 
   struct {
     nghttp3_settings settings;
@@ -143,6 +215,18 @@ struct nghttp3_conn {
     nghttp3_stream *qdec;
     /* goaway_id is the latest ID sent in GOAWAY frame. */
     int64_t goaway_id;
+    /* write_budget is the number of bytes that underlying QUIC stack
+       is able to send.  It is decreased by the number of bytes
+       written.  It is only used if
+       NGHTTP3_CONN_FLAG_WRITE_BUDGET_SET is set. */
+    uint64_t write_budget;
+    /* unsent_bytes is the number of bytes in outq of all streams
+       which are not written yet.  They are charged against
+       write_budget. */
+    uint64_t unsent_bytes;
+    /* send_buffered is the number of bytes in outq of all streams
+       which are either unsent or unacknowledged. */
+    uint64_t send_buffered;
   } tx;
 };
 
@@ -189,6 +273,33 @@ int nghttp3_conn_qpack_blocked_streams_push(nghttp3_conn *conn,
 
 void nghttp3_conn_qpack_blocked_streams_pop(nghttp3_conn *conn);
 
+/*
+ * nghttp3_conn_start_timer records the current time as the start
+ * time of |timer| of |stream| if nghttp3_callbacks.get_timestamp is
+ * set, and |timer| has not been started.  It allocates stream->ts if
+ * it has not been allocated yet.  Timing is optional, and this
+ * function does nothing if the allocation fails.
+ */
+void nghttp3_conn_start_timer(nghttp3_conn *conn, nghttp3_stream *stream,
+                              nghttp3_stream_timer timer);
+
+/*
+ * nghttp3_conn_trace_frame passes the frame header |hd| sent or
+ * received on the stream |stream_id| to nghttp3_callbacks.trace.
+ * |type| is either NGHTTP3_TRACE_EVENT_FRAME_SENT or
+ * NGHTTP3_TRACE_EVENT_FRAME_RECV.  The trace callback must be set.
+ */
+void nghttp3_conn_trace_frame(nghttp3_conn *conn, uint32_t type,
+                              int64_t stream_id, const nghttp3_frame_hd *hd);
+
+/*
+ * nghttp3_conn_trace_stream_state passes the state change |state| of
+ * the stream |stream_id| to nghttp3_callbacks.trace.  The trace
+ * callback must be set.
+ */
+void nghttp3_conn_trace_stream_state(nghttp3_conn *conn, int64_t stream_id,
+                                     uint32_t state, uint64_t app_error_code);
+
 int nghttp3_conn_schedule_stream(nghttp3_conn *conn, nghttp3_stream *stream);
 
 int nghttp3_conn_ensure_stream_scheduled(nghttp3_conn *conn,
@@ -201,3 +201,41 @@ void nghttp3_frame_priority_update_free(nghttp3_frame_priority_update *fr,
 
   nghttp3_mem_free(mem, fr->data);
 }
+
+void nghttp3_frame_stats_add(nghttp3_frame_stats *fs, int64_t type,
+                             int64_t len) {
+  size_t idx;
+
+  switch (type) {
+  case NGHTTP3_FRAME_DATA:
+    idx = NGHTTP3_STATS_FRAME_DATA;
+    break;
+  case NGHTTP3_FRAME_HEADERS:
+    idx = NGHTTP3_STATS_FRAME_HEADERS;
+    break;
+  case NGHTTP3_FRAME_CANCEL_PUSH:
+    idx = NGHTTP3_STATS_FRAME_CANCEL_PUSH;
+    break;
+  case NGHTTP3_FRAME_SETTINGS:
+    idx = NGHTTP3_STATS_FRAME_SETTINGS;
+    break;
+  case NGHTTP3_FRAME_PUSH_PROMISE:
+    idx = NGHTTP3_STATS_FRAME_PUSH_PROMISE;
+    break;
+  case NGHTTP3_FRAME_GOAWAY:
+    idx = NGHTTP3_STATS_FRAME_GOAWAY;
+    break;
+  case NGHTTP3_FRAME_MAX_PUSH_ID:
+    idx = NGHTTP3_STATS_FRAME_MAX_PUSH_ID;
+    break;
+  case NGHTTP3_FRAME_PRIORITY_UPDATE:
+  case NGHTTP3_FRAME_PRIORITY_UPDATE_PUSH_ID:
+    idx = NGHTTP3_STATS_FRAME_PRIORITY_UPDATE;
+    break;
+  default:
+    idx = NGHTTP3_STATS_FRAME_OTHER;
+  }
+
+  ++fs[idx].frames;
+  fs[idx].bytes += (uint64_t)len;
+}
@@ -229,4 +229,12 @@ void nghttp3_frame_headers_free(nghttp3_frame_headers *fr,
 void nghttp3_frame_priority_update_free(nghttp3_frame_priority_update *fr,
                                         const nghttp3_mem *mem);
 
+/*
+ * nghttp3_frame_stats_add counts a frame of type |type| which has
+ * |len| bytes payload into the element of |fs| for that type.  |fs|
+ * must have NGHTTP3_STATS_FRAME_MAX elements.
+ */
+void nghttp3_frame_stats_add(nghttp3_frame_stats *fs, int64_t type,
+                             int64_t len);
+
 #endif /* NGHTTP3_FRAME_H */
@@ -34,6 +34,10 @@
 #include "nghttp3_unreachable.h"
 #include "sfparse.h"
 
+#ifdef NGHTTP3_HTTP_SIMD
+#  include <immintrin.h>
+#endif /* NGHTTP3_HTTP_SIMD */
+
 static uint8_t downcase(uint8_t c) {
   return 'A' <= c && c <= 'Z' ? (uint8_t)(c - 'A' + 'a') : c;
 }
@@ -117,6 +121,60 @@ static int is_ws(uint8_t c) {
   }
 }
 
+/*
+ * http_parse_priority_fast parses the most common shapes of priority
+ * field value, that is "u=N", "u=N,i", "u=N, i", and "i", where N
+ * is a valid urgency, without running Structured Field parser.  It
+ * returns nonzero and updates |dest| if |value| of length |valuelen|
+ * has one of those shapes.  Otherwise it returns 0, and the value
+ * must be parsed by Structured Field parser.
+ */
+static int http_parse_priority_fast(nghttp3_pri *dest, const uint8_t *value,
+                                    size_t valuelen) {
+  if (valuelen == 1) {
+    if (value[0] != 'i') {
+      return 0;
+    }
+
+    dest->inc = 1;
+
+    return 1;
+  }
+
+  if (valuelen < 3 || value[0] != 'u' || value[1] != '=' ||
+      value[2] < '0' + NGHTTP3_URGENCY_HIGH ||
+      '0' + NGHTTP3_URGENCY_LOW < value[2]) {
+    return 0;
+  }
+
+  switch (valuelen) {
+  case 3:
+    break;
+  case 5:
+    if (value[3] != ',' || value[4] != 'i') {
+      return 0;
+    }
+
+    dest->inc = 1;
+
+    break;
+  case 6:
+    if (value[3] != ',' || value[4] != ' ' || value[5] != 'i') {
+      return 0;
+    }
+
+    dest->inc = 1;
+
+    break;
+  default:
+    return 0;
+  }
+
+  dest->urgency = (uint32_t)(value[2] - '0');
+
+  return 1;
+}
+
 int nghttp3_http_parse_priority(nghttp3_pri *dest, const uint8_t *value,
                                 size_t valuelen) {
   nghttp3_pri pri = *dest;
@@ -125,6 +183,10 @@ int nghttp3_http_parse_priority(nghttp3_pri *dest, const uint8_t *value,
   sf_value val;
   int rv;
 
+  if (http_parse_priority_fast(dest, value, valuelen)) {
+    return 0;
+  }
+
   sf_parser_init(&sfp, value, valuelen);
 
   for (;;) {
@@ -641,54 +703,242 @@ static int check_path(const uint8_t *value, size_t len) {
   return 1;
 }
 
-int nghttp3_http_on_header(nghttp3_http_state *http, nghttp3_qpack_nv *nv,
-                           int request, int trailers, int connect_protocol) {
-  int rv;
+uint8_t nghttp3_http_check_field_name(const uint8_t *name, size_t len) {
   size_t i;
   uint8_t c;
 
-  if (!nghttp3_check_header_name(nv->name->base, nv->name->len)) {
-    if (nv->name->len > 0 && nv->name->base[0] == ':') {
-      return NGHTTP3_ERR_MALFORMED_HTTP_HEADER;
+  if (nghttp3_check_header_name(name, len)) {
+    return NGHTTP3_HTTP_FIELD_NAME_CHECKED | NGHTTP3_HTTP_FIELD_NAME_VALID;
+  }
+
+  for (i = 0; i < len; ++i) {
+    c = name[i];
+    if ('A' <= c && c <= 'Z') {
+      return NGHTTP3_HTTP_FIELD_NAME_CHECKED | NGHTTP3_HTTP_FIELD_NAME_UPPER;
     }
-    /* header field name must be lower-cased without exception */
-    for (i = 0; i < nv->name->len; ++i) {
-      c = nv->name->base[i];
-      if ('A' <= c && c <= 'Z') {
-        return NGHTTP3_ERR_MALFORMED_HTTP_HEADER;
-      }
+  }
+
+  return NGHTTP3_HTTP_FIELD_NAME_CHECKED;
+}
+
+static int check_field_value(int32_t token, const uint8_t *value, size_t len,
+                             int request) {
+  switch (token) {
+  case NGHTTP3_QPACK_TOKEN__METHOD:
+    return check_method(value, len);
+  case NGHTTP3_QPACK_TOKEN__SCHEME:
+    return check_scheme(value, len);
+  case NGHTTP3_QPACK_TOKEN__AUTHORITY:
+  case NGHTTP3_QPACK_TOKEN_HOST:
+    if (request) {
+      return check_authority(value, len);
     }
-    /* When ignoring regular header fields, we set this flag so that
-       we still enforce header field ordering rule for pseudo header
-       fields. */
-    http->flags |= NGHTTP3_HTTP_FLAG_PSEUDO_HEADER_DISALLOWED;
-    return NGHTTP3_ERR_REMOVE_HTTP_HEADER;
+    /* The use of host field in response field section is
+       undefined. */
+    return nghttp3_check_header_value(value, len);
+  case NGHTTP3_QPACK_TOKEN__PATH:
+    return check_path(value, len);
+  default:
+    return nghttp3_check_header_value(value, len);
   }
+}
 
-  assert(nv->name->len > 0);
+uint8_t nghttp3_http_check_field_value(int32_t token, const uint8_t *value,
+                                       size_t len) {
+  uint8_t verdict = NGHTTP3_HTTP_FIELD_VALUE_CHECKED;
+  int req_valid = check_field_value(token, value, len, /* request = */ 1);
 
-  switch (nv->token) {
+  if (req_valid) {
+    verdict |= NGHTTP3_HTTP_FIELD_VALUE_REQ_VALID;
+  }
+
+  switch (token) {
+  case NGHTTP3_QPACK_TOKEN__AUTHORITY:
+  case NGHTTP3_QPACK_TOKEN_HOST:
+    if (check_field_value(token, value, len, /* request = */ 0)) {
+      verdict |= NGHTTP3_HTTP_FIELD_VALUE_RES_VALID;
+    }
+    break;
+  default:
+    if (req_valid) {
+      verdict |= NGHTTP3_HTTP_FIELD_VALUE_RES_VALID;
+    }
+  }
+
+  return verdict;
+}
+
+/* Generated by genfieldchartbl.py */
+const uint8_t nghttp3_http_field_char_class[] = {
+    0x7d /* NUL  */, 0x7d /* SOH  */, 0x7d /* STX  */, 0x7d /* ETX  */,
+    0x7d /* EOT  */, 0x7d /* ENQ  */, 0x7d /* ACK  */, 0x7d /* BEL  */,
+    0x7d /* BS   */, 0x79 /* HT   */, 0x7d /* LF   */, 0x7d /* VT   */,
+    0x7d /* FF   */, 0x7d /* CR   */, 0x7d /* SO   */, 0x7d /* SI   */,
+    0x7d /* DLE  */, 0x7d /* DC1  */, 0x7d /* DC2  */, 0x7d /* DC3  */,
+    0x7d /* DC4  */, 0x7d /* NAK  */, 0x7d /* SYN  */, 0x7d /* ETB  */,
+    0x7d /* CAN  */, 0x7d /* EM   */, 0x7d /* SUB  */, 0x7d /* ESC  */,
+    0x7d /* FS   */, 0x7d /* GS   */, 0x7d /* RS   */, 0x7d /* US   */,
+    0x79 /* SPC  */, 0x40 /* !    */, 0x59 /* "    */, 0x50 /* #    */,
+    0x40 /* $    */, 0x40 /* %    */, 0x40 /* &    */, 0x40 /* '    */,
+    0x49 /* (    */, 0x49 /* )    */, 0x40 /* *    */, 0x00 /* +    */,
+    0x49 /* ,    */, 0x00 /* -    */, 0x00 /* .    */, 0x59 /* /    */,
+    0x00 /* 0    */, 0x00 /* 1    */, 0x00 /* 2    */, 0x00 /* 3    */,
+    0x00 /* 4    */, 0x00 /* 5    */, 0x00 /* 6    */, 0x00 /* 7    */,
+    0x00 /* 8    */, 0x00 /* 9    */, 0x49 /* :    */, 0x49 /* ;    */,
+    0x59 /* <    */, 0x49 /* =    */, 0x59 /* >    */, 0x59 /* ?    */,
+    0x49 /* @    */, 0x03 /* A    */, 0x03 /* B    */, 0x03 /* C    */,
+    0x03 /* D    */, 0x03 /* E    */, 0x03 /* F    */, 0x03 /* G    */,
+    0x03 /* H    */, 0x03 /* I    */, 0x03 /* J    */, 0x03 /* K    */,
+    0x03 /* L    */, 0x03 /* M    */, 0x03 /* N    */, 0x03 /* O    */,
+    0x03 /* P    */, 0x03 /* Q    */, 0x03 /* R    */, 0x03 /* S    */,
+    0x03 /* T    */, 0x03 /* U    */, 0x03 /* V    */, 0x03 /* W    */,
+    0x03 /* X    */, 0x03 /* Y    */, 0x03 /* Z    */, 0x49 /* [    */,
+    0x59 /* \    */, 0x49 /* ]    */, 0x50 /* ^    */, 0x40 /* _    */,
+    0x50 /* `    */, 0x00 /* a    */, 0x00 /* b    */, 0x00 /* c    */,
+    0x00 /* d    */, 0x00 /* e    */, 0x00 /* f    */, 0x00 /* g    */,
+    0x00 /* h    */, 0x00 /* i    */, 0x00 /* j    */, 0x00 /* k    */,
+    0x00 /* l    */, 0x00 /* m    */, 0x00 /* n    */, 0x00 /* o    */,
+    0x00 /* p    */, 0x00 /* q    */, 0x00 /* r    */, 0x00 /* s    */,
+    0x00 /* t    */, 0x00 /* u    */, 0x00 /* v    */, 0x00 /* w    */,
+    0x00 /* x    */, 0x00 /* y    */, 0x00 /* z    */, 0x59 /* {    */,
+    0x50 /* |    */, 0x59 /* }    */, 0x40 /* ~    */, 0x7d /* DEL  */,
+    0x59 /* 0x80 */, 0x59 /* 0x81 */, 0x59 /* 0x82 */, 0x59 /* 0x83 */,
+    0x59 /* 0x84 */, 0x59 /* 0x85 */, 0x59 /* 0x86 */, 0x59 /* 0x87 */,
+    0x59 /* 0x88 */, 0x59 /* 0x89 */, 0x59 /* 0x8a */, 0x59 /* 0x8b */,
+    0x59 /* 0x8c */, 0x59 /* 0x8d */, 0x59 /* 0x8e */, 0x59 /* 0x8f */,
+    0x59 /* 0x90 */, 0x59 /* 0x91 */, 0x59 /* 0x92 */, 0x59 /* 0x93 */,
+    0x59 /* 0x94 */, 0x59 /* 0x95 */, 0x59 /* 0x96 */, 0x59 /* 0x97 */,
+    0x59 /* 0x98 */, 0x59 /* 0x99 */, 0x59 /* 0x9a */, 0x59 /* 0x9b */,
+    0x59 /* 0x9c */, 0x59 /* 0x9d */, 0x59 /* 0x9e */, 0x59 /* 0x9f */,
+    0x59 /* 0xa0 */, 0x59 /* 0xa1 */, 0x59 /* 0xa2 */, 0x59 /* 0xa3 */,
+    0x59 /* 0xa4 */, 0x59 /* 0xa5 */, 0x59 /* 0xa6 */, 0x59 /* 0xa7 */,
+    0x59 /* 0xa8 */, 0x59 /* 0xa9 */, 0x59 /* 0xaa */, 0x59 /* 0xab */,
+    0x59 /* 0xac */, 0x59 /* 0xad */, 0x59 /* 0xae */, 0x59 /* 0xaf */,
+    0x59 /* 0xb0 */, 0x59 /* 0xb1 */, 0x59 /* 0xb2 */, 0x59 /* 0xb3 */,
+    0x59 /* 0xb4 */, 0x59 /* 0xb5 */, 0x59 /* 0xb6 */, 0x59 /* 0xb7 */,
+    0x59 /* 0xb8 */, 0x59 /* 0xb9 */, 0x59 /* 0xba */, 0x59 /* 0xbb */,
+    0x59 /* 0xbc */, 0x59 /* 0xbd */, 0x59 /* 0xbe */, 0x59 /* 0xbf */,
+    0x59 /* 0xc0 */, 0x59 /* 0xc1 */, 0x59 /* 0xc2 */, 0x59 /* 0xc3 */,
+    0x59 /* 0xc4 */, 0x59 /* 0xc5 */, 0x59 /* 0xc6 */, 0x59 /* 0xc7 */,
+    0x59 /* 0xc8 */, 0x59 /* 0xc9 */, 0x59 /* 0xca */, 0x59 /* 0xcb */,
+    0x59 /* 0xcc */, 0x59 /* 0xcd */, 0x59 /* 0xce */, 0x59 /* 0xcf */,
+    0x59 /* 0xd0 */, 0x59 /* 0xd1 */, 0x59 /* 0xd2 */, 0x59 /* 0xd3 */,
+    0x59 /* 0xd4 */, 0x59 /* 0xd5 */, 0x59 /* 0xd6 */, 0x59 /* 0xd7 */,
+    0x59 /* 0xd8 */, 0x59 /* 0xd9 */, 0x59 /* 0xda */, 0x59 /* 0xdb */,
+    0x59 /* 0xdc */, 0x59 /* 0xdd */, 0x59 /* 0xde */, 0x59 /* 0xdf */,
+    0x59 /* 0xe0 */, 0x59 /* 0xe1 */, 0x59 /* 0xe2 */, 0x59 /* 0xe3 */,
+    0x59 /* 0xe4 */, 0x59 /* 0xe5 */, 0x59 /* 0xe6 */, 0x59 /* 0xe7 */,
+    0x59 /* 0xe8 */, 0x59 /* 0xe9 */, 0x59 /* 0xea */, 0x59 /* 0xeb */,
+    0x59 /* 0xec */, 0x59 /* 0xed */, 0x59 /* 0xee */, 0x59 /* 0xef */,
+    0x59 /* 0xf0 */, 0x59 /* 0xf1 */, 0x59 /* 0xf2 */, 0x59 /* 0xf3 */,
+    0x59 /* 0xf4 */, 0x59 /* 0xf5 */, 0x59 /* 0xf6 */, 0x59 /* 0xf7 */,
+    0x59 /* 0xf8 */, 0x59 /* 0xf9 */, 0x59 /* 0xfa */, 0x59 /* 0xfb */,
+    0x59 /* 0xfc */, 0x59 /* 0xfd */, 0x59 /* 0xfe */, 0x59 /* 0xff */
+};
+
+uint8_t nghttp3_http_field_name_verdict(const uint8_t *name, size_t len,
+                                        uint8_t cls) {
+  if (len && name[0] == ':') {
+    /* Colon is only allowed at the beginning of pseudo header field
+       name, which cannot be told from cls.  Leave it unchecked. */
+    return 0;
+  }
+
+  if (len && !(cls & NGHTTP3_HTTP_CHAR_NAME_INVALID)) {
+    return NGHTTP3_HTTP_FIELD_NAME_CHECKED | NGHTTP3_HTTP_FIELD_NAME_VALID;
+  }
+
+  if (cls & NGHTTP3_HTTP_CHAR_UPPER) {
+    return NGHTTP3_HTTP_FIELD_NAME_CHECKED | NGHTTP3_HTTP_FIELD_NAME_UPPER;
+  }
+
+  return NGHTTP3_HTTP_FIELD_NAME_CHECKED;
+}
+
+uint8_t nghttp3_http_field_value_verdict(int32_t token, const uint8_t *value,
+                                         size_t len, uint8_t cls) {
+  uint8_t verdict = NGHTTP3_HTTP_FIELD_VALUE_CHECKED;
+  int valid;
+
+  /* This must agree with nghttp3_check_header_value. */
+  switch (len) {
+  case 0:
+    valid = 1;
+    break;
+  case 1:
+    valid = !is_ws(*value);
+    break;
+  default:
+    valid = !is_ws(*value) && !is_ws(*(value + len - 1)) &&
+            !(cls & NGHTTP3_HTTP_CHAR_VALUE_INVALID);
+  }
+
+  switch (token) {
   case NGHTTP3_QPACK_TOKEN__METHOD:
-    rv = check_method(nv->value->base, nv->value->len);
+    valid = len && !(cls & NGHTTP3_HTTP_CHAR_METHOD_INVALID);
     break;
   case NGHTTP3_QPACK_TOKEN__SCHEME:
-    rv = check_scheme(nv->value->base, nv->value->len);
+    valid = len &&
+            (('A' <= value[0] && value[0] <= 'Z') ||
+             ('a' <= value[0] && value[0] <= 'z')) &&
+            !(cls & NGHTTP3_HTTP_CHAR_SCHEME_INVALID);
     break;
   case NGHTTP3_QPACK_TOKEN__AUTHORITY:
   case NGHTTP3_QPACK_TOKEN_HOST:
-    if (request) {
-      rv = check_authority(nv->value->base, nv->value->len);
-    } else {
-      /* The use of host field in response field section is
-         undefined. */
-      rv = nghttp3_check_header_value(nv->value->base, nv->value->len);
+    /* The use of host field in response field section is undefined,
+       and it is checked as a regular field value. */
+    if (valid) {
+      verdict |= NGHTTP3_HTTP_FIELD_VALUE_RES_VALID;
     }
-    break;
+    if (!(cls & NGHTTP3_HTTP_CHAR_AUTHORITY_INVALID)) {
+      verdict |= NGHTTP3_HTTP_FIELD_VALUE_REQ_VALID;
+    }
+    return verdict;
   case NGHTTP3_QPACK_TOKEN__PATH:
-    rv = check_path(nv->value->base, nv->value->len);
+    valid = !(cls & NGHTTP3_HTTP_CHAR_PATH_INVALID);
     break;
-  default:
-    rv = nghttp3_check_header_value(nv->value->base, nv->value->len);
+  }
+
+  if (valid) {
+    verdict |=
+        NGHTTP3_HTTP_FIELD_VALUE_REQ_VALID | NGHTTP3_HTTP_FIELD_VALUE_RES_VALID;
+  }
+
+  return verdict;
+}
+
+int nghttp3_http_on_header(nghttp3_http_state *http, nghttp3_qpack_nv *nv,
+                           uint8_t verdict, int request, int trailers,
+                           int connect_protocol) {
+  int rv;
+
+  if (!(verdict & NGHTTP3_HTTP_FIELD_NAME_CHECKED)) {
+    verdict |= nghttp3_http_check_field_name(nv->name->base, nv->name->len);
+  }
+
+  if (!(verdict & NGHTTP3_HTTP_FIELD_NAME_VALID)) {
+    if (nv->name->len > 0 && nv->name->base[0] == ':') {
+      return NGHTTP3_ERR_MALFORMED_HTTP_HEADER;
+    }
+    /* header field name must be lower-cased without exception */
+    if (verdict & NGHTTP3_HTTP_FIELD_NAME_UPPER) {
+      return NGHTTP3_ERR_MALFORMED_HTTP_HEADER;
+    }
+    /* When ignoring regular header fields, we set this flag so that
+       we still enforce header field ordering rule for pseudo header
+       fields. */
+    http->flags |= NGHTTP3_HTTP_FLAG_PSEUDO_HEADER_DISALLOWED;
+    return NGHTTP3_ERR_REMOVE_HTTP_HEADER;
+  }
+
+  assert(nv->name->len > 0);
+
+  if (verdict & NGHTTP3_HTTP_FIELD_VALUE_CHECKED) {
+    rv = (verdict & (request ? NGHTTP3_HTTP_FIELD_VALUE_REQ_VALID
+                             : NGHTTP3_HTTP_FIELD_VALUE_RES_VALID)) != 0;
+  } else {
+    rv = check_field_value(nv->token, nv->value->base, nv->value->len,
+                           request);
   }
 
   if (rv == 0) {
@@ -887,23 +1137,15 @@ static const int VALID_HD_NAME_CHARS[] = {
     0 /* 0xfc */, 0 /* 0xfd */, 0 /* 0xfe */, 0 /* 0xff */
 };
 
-int nghttp3_check_header_name(const uint8_t *name, size_t len) {
+static int check_header_name_chars(const uint8_t *name, size_t len) {
   const uint8_t *last;
-  if (len == 0) {
-    return 0;
-  }
-  if (*name == ':') {
-    if (len == 1) {
-      return 0;
-    }
-    ++name;
-    --len;
-  }
+
   for (last = name + len; name != last; ++name) {
     if (!VALID_HD_NAME_CHARS[*name]) {
       return 0;
     }
   }
+
   return 1;
 }
 
@@ -975,9 +1217,216 @@ static const int VALID_HD_VALUE_CHARS[] = {
     1 /* 0xfc */, 1 /* 0xfd */, 1 /* 0xfe */, 1 /* 0xff */
 };
 
-int nghttp3_check_header_value(const uint8_t *value, size_t len) {
+static int check_header_value_chars(const uint8_t *value, size_t len) {
   const uint8_t *last;
 
+  for (last = value + len; value != last; ++value) {
+    if (!VALID_HD_VALUE_CHARS[*value]) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+#ifdef NGHTTP3_HTTP_SIMD
+/*
+ * The SIMD implementations below check 16 or 32 bytes at a time.
+ * They require that |len| is at least the block size, and the last
+ * block is loaded from the end of the input, overlapping with the
+ * previous block.
+ */
+
+/*
+ * in_range_sse2 returns the mask of the bytes in |x| which are in
+ * range [lo, hi], inclusive.
+ */
+static __m128i in_range_sse2(__m128i x, uint8_t lo, uint8_t hi) {
+  __m128i d = _mm_sub_epi8(x, _mm_set1_epi8((char)lo));
+
+  return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8((char)(hi - lo))), d);
+}
+
+static int check_header_name_chars_sse2(const uint8_t *name, size_t len) {
+  const uint8_t *last = name + len - 16;
+  __m128i x, ok;
+
+  for (;;) {
+    x = _mm_loadu_si128((const __m128i *)(const void *)name);
+
+    /* ! #-' *-+ --. 0-9 ^-z | ~ */
+    ok = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('!')),
+                      in_range_sse2(x, '#', '\''));
+    ok = _mm_or_si128(ok, in_range_sse2(x, '*', '+'));
+    ok = _mm_or_si128(ok, in_range_sse2(x, '-', '.'));
+    ok = _mm_or_si128(ok, in_range_sse2(x, '0', '9'));
+    ok = _mm_or_si128(ok, in_range_sse2(x, '^', 'z'));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(x, _mm_set1_epi8('|')));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(x, _mm_set1_epi8('~')));
+
+    if (_mm_movemask_epi8(ok) != 0xffff) {
+      return 0;
+    }
+
+    if (name == last) {
+      return 1;
+    }
+
+    name += 16;
+    if (name > last) {
+      name = last;
+    }
+  }
+}
+
+static int check_header_value_chars_sse2(const uint8_t *value, size_t len) {
+  const uint8_t *last = value + len - 16;
+  __m128i x, bad;
+
+  for (;;) {
+    x = _mm_loadu_si128((const __m128i *)(const void *)value);
+
+    /* 0x00-0x1f except for HT, and DEL */
+    bad = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(0x1f)), x);
+    bad = _mm_andnot_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\t')), bad);
+    bad = _mm_or_si128(bad, _mm_cmpeq_epi8(x, _mm_set1_epi8(0x7f)));
+
+    if (_mm_movemask_epi8(bad)) {
+      return 0;
+    }
+
+    if (value == last) {
+      return 1;
+    }
+
+    value += 16;
+    if (value > last) {
+      value = last;
+    }
+  }
+}
+
+/*
+ * check_header_name_chars_avx2 looks up 2 tables by low and high
+ * nibbles of each byte.  The entry of the low nibble table has the
+ * bit of each high nibble which makes a valid character with it.
+ * High nibble 0x8-0xf has no bit.
+ */
+__attribute__((target("avx2"))) static int
+check_header_name_chars_avx2(const uint8_t *name, size_t len) {
+  const uint8_t *last = name + len - 32;
+  const __m256i lotbl = _mm256_setr_epi8(
+      (char)0xc8, (char)0xcc, (char)0xc8, (char)0xcc, (char)0xcc, (char)0xcc,
+      (char)0xcc, (char)0xcc, (char)0xc8, (char)0xc8, (char)0xc4, 0x44,
+      (char)0xc0, 0x44, (char)0xe4, 0x60, (char)0xc8, (char)0xcc, (char)0xc8,
+      (char)0xcc, (char)0xcc, (char)0xcc, (char)0xcc, (char)0xcc, (char)0xc8,
+      (char)0xc8, (char)0xc4, 0x44, (char)0xc0, 0x44, (char)0xe4, 0x60);
+  const __m256i hitbl = _mm256_setr_epi8(
+      0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0,
+      0, 0, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0,
+      0, 0, 0, 0);
+  const __m256i nibmask = _mm256_set1_epi8(0x0f);
+  __m256i x, lo, hi, bits;
+
+  for (;;) {
+    x = _mm256_loadu_si256((const __m256i *)(const void *)name);
+
+    lo = _mm256_shuffle_epi8(lotbl, _mm256_and_si256(x, nibmask));
+    hi = _mm256_shuffle_epi8(
+        hitbl, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibmask));
+    bits = _mm256_and_si256(lo, hi);
+
+    if (_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(bits, _mm256_setzero_si256()))) {
+      return 0;
+    }
+
+    if (name == last) {
+      return 1;
+    }
+
+    name += 32;
+    if (name > last) {
+      name = last;
+    }
+  }
+}
+
+__attribute__((target("avx2"))) static int
+check_header_value_chars_avx2(const uint8_t *value, size_t len) {
+  const uint8_t *last = value + len - 32;
+  __m256i x, bad;
+
+  for (;;) {
+    x = _mm256_loadu_si256((const __m256i *)(const void *)value);
+
+    bad = _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(0x1f)), x);
+    bad = _mm256_andnot_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t')),
+                              bad);
+    bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(0x7f)));
+
+    if (_mm256_movemask_epi8(bad)) {
+      return 0;
+    }
+
+    if (value == last) {
+      return 1;
+    }
+
+    value += 32;
+    if (value > last) {
+      value = last;
+    }
+  }
+}
+
+/*
+ * The functions below choose the implementation by the length of
+ * input and the CPU features.  __builtin_cpu_supports reads the
+ * result of CPUID which is cached at startup.
+ */
+static int check_header_name_chars_simd(const uint8_t *name, size_t len) {
+  if (len >= 32 && __builtin_cpu_supports("avx2")) {
+    return check_header_name_chars_avx2(name, len);
+  }
+
+  if (len >= 16) {
+    return check_header_name_chars_sse2(name, len);
+  }
+
+  return check_header_name_chars(name, len);
+}
+
+static int check_header_value_chars_simd(const uint8_t *value, size_t len) {
+  if (len >= 32 && __builtin_cpu_supports("avx2")) {
+    return check_header_value_chars_avx2(value, len);
+  }
+
+  if (len >= 16) {
+    return check_header_value_chars_sse2(value, len);
+  }
+
+  return check_header_value_chars(value, len);
+}
+#endif /* NGHTTP3_HTTP_SIMD */
+
+static int check_header_name(const uint8_t *name, size_t len,
+                             int (*check_chars)(const uint8_t *, size_t)) {
+  if (len == 0) {
+    return 0;
+  }
+  if (*name == ':') {
+    if (len == 1) {
+      return 0;
+    }
+    ++name;
+    --len;
+  }
+  return check_chars(name, len);
+}
+
+static int check_header_value(const uint8_t *value, size_t len,
+                              int (*check_chars)(const uint8_t *, size_t)) {
   switch (len) {
   case 0:
     return 1;
@@ -989,12 +1438,31 @@ int nghttp3_check_header_value(const uint8_t *value, size_t len) {
     }
   }
 
-  for (last = value + len; value != last; ++value) {
-    if (!VALID_HD_VALUE_CHARS[*value]) {
-      return 0;
-    }
-  }
-  return 1;
+  return check_chars(value, len);
+}
+
+int nghttp3_check_header_name(const uint8_t *name, size_t len) {
+#ifdef NGHTTP3_HTTP_SIMD
+  return check_header_name(name, len, check_header_name_chars_simd);
+#else  /* !NGHTTP3_HTTP_SIMD */
+  return check_header_name(name, len, check_header_name_chars);
+#endif /* !NGHTTP3_HTTP_SIMD */
+}
+
+int nghttp3_check_header_value(const uint8_t *value, size_t len) {
+#ifdef NGHTTP3_HTTP_SIMD
+  return check_header_value(value, len, check_header_value_chars_simd);
+#else  /* !NGHTTP3_HTTP_SIMD */
+  return check_header_value(value, len, check_header_value_chars);
+#endif /* !NGHTTP3_HTTP_SIMD */
+}
+
+int nghttp3_check_header_name_generic(const uint8_t *name, size_t len) {
+  return check_header_name(name, len, check_header_name_chars);
+}
+
+int nghttp3_check_header_value_generic(const uint8_t *value, size_t len) {
+  return check_header_value(value, len, check_header_value_chars);
 }
 
 int nghttp3_pri_eq(const nghttp3_pri *a, const nghttp3_pri *b) {
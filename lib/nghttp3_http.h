@@ -32,6 +32,14 @@
 
 #include <nghttp3/nghttp3.h>
 
+/* NGHTTP3_HTTP_SIMD is defined if nghttp3_check_header_name and
+   nghttp3_check_header_value use SSE2 and, if CPU supports it, AVX2
+   instructions. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) &&         \
+    defined(__SSE2__)
+#  define NGHTTP3_HTTP_SIMD
+#endif
+
 typedef struct nghttp3_stream nghttp3_stream;
 
 typedef struct nghttp3_http_state nghttp3_http_state;
@@ -82,12 +90,73 @@ typedef struct nghttp3_http_state nghttp3_http_state;
    while parsing priority header field. */
 #define NGHTTP3_HTTP_FLAG_BAD_PRIORITY 0x010000u
 
+/* HTTP field validation verdicts.  QPACK decoder computes a verdict
+   while it decodes a literal field, and caches it in dynamic table
+   entry so that the references to the entry do not validate the same
+   bytes again. */
+
+/* NGHTTP3_HTTP_FIELD_NAME_CHECKED is set if field name has been
+   validated, and NGHTTP3_HTTP_FIELD_NAME_VALID and
+   NGHTTP3_HTTP_FIELD_NAME_UPPER are meaningful. */
+#define NGHTTP3_HTTP_FIELD_NAME_CHECKED 0x01u
+/* NGHTTP3_HTTP_FIELD_NAME_VALID is set if field name is valid. */
+#define NGHTTP3_HTTP_FIELD_NAME_VALID 0x02u
+/* NGHTTP3_HTTP_FIELD_NAME_UPPER is set if invalid field name
+   contains upper-cased character. */
+#define NGHTTP3_HTTP_FIELD_NAME_UPPER 0x04u
+#define NGHTTP3_HTTP_FIELD_NAME_MASK                                           \
+  (NGHTTP3_HTTP_FIELD_NAME_CHECKED | NGHTTP3_HTTP_FIELD_NAME_VALID |           \
+   NGHTTP3_HTTP_FIELD_NAME_UPPER)
+/* NGHTTP3_HTTP_FIELD_VALUE_CHECKED is set if field value has been
+   validated, and NGHTTP3_HTTP_FIELD_VALUE_REQ_VALID and
+   NGHTTP3_HTTP_FIELD_VALUE_RES_VALID are meaningful. */
+#define NGHTTP3_HTTP_FIELD_VALUE_CHECKED 0x08u
+/* NGHTTP3_HTTP_FIELD_VALUE_REQ_VALID is set if field value is valid
+   in request field section. */
+#define NGHTTP3_HTTP_FIELD_VALUE_REQ_VALID 0x10u
+/* NGHTTP3_HTTP_FIELD_VALUE_RES_VALID is set if field value is valid
+   in response field section. */
+#define NGHTTP3_HTTP_FIELD_VALUE_RES_VALID 0x20u
+
+/* Character classes of HTTP field.  nghttp3_http_field_char_class
+   maps a byte to a bitwise-OR of the following flags, each of which
+   is set if the byte is not allowed in the corresponding part of
+   field.  OR-ing the classes of all bytes of a string tells which
+   checks it fails without looking at the bytes again. */
+
+/* NGHTTP3_HTTP_CHAR_NAME_INVALID is set if a character is not
+   allowed in field name.  Colon is included. */
+#define NGHTTP3_HTTP_CHAR_NAME_INVALID 0x01u
+/* NGHTTP3_HTTP_CHAR_UPPER is set if a character is upper-cased. */
+#define NGHTTP3_HTTP_CHAR_UPPER 0x02u
+/* NGHTTP3_HTTP_CHAR_VALUE_INVALID is set if a character is not
+   allowed in field value. */
+#define NGHTTP3_HTTP_CHAR_VALUE_INVALID 0x04u
+/* NGHTTP3_HTTP_CHAR_METHOD_INVALID is set if a character is not
+   allowed in :method. */
+#define NGHTTP3_HTTP_CHAR_METHOD_INVALID 0x08u
+/* NGHTTP3_HTTP_CHAR_AUTHORITY_INVALID is set if a character is not
+   allowed in :authority and host in request. */
+#define NGHTTP3_HTTP_CHAR_AUTHORITY_INVALID 0x10u
+/* NGHTTP3_HTTP_CHAR_PATH_INVALID is set if a character is not
+   allowed in :path. */
+#define NGHTTP3_HTTP_CHAR_PATH_INVALID 0x20u
+/* NGHTTP3_HTTP_CHAR_SCHEME_INVALID is set if a character is not
+   allowed in :scheme. */
+#define NGHTTP3_HTTP_CHAR_SCHEME_INVALID 0x40u
+
+extern const uint8_t nghttp3_http_field_char_class[];
+
 /*
  * This function is called when HTTP header field |nv| received for
  * |http|.  This function will validate |nv| against the current state
- * of stream.  Pass nonzero if this is request headers. Pass nonzero
- * to |trailers| if |nv| is included in trailers.  |connect_protocol|
- * is nonzero if Extended CONNECT Method is enabled.
+ * of stream.  |verdict| is the cached validation verdict of |nv|
+ * which is a bitwise-OR of zero or more of
+ * NGHTTP3_HTTP_FIELD_* flags.  Those parts of |nv| which are not
+ * marked as checked in |verdict| are validated by this function.
+ * Pass nonzero if this is request headers. Pass nonzero to
+ * |trailers| if |nv| is included in trailers.  |connect_protocol| is
+ * nonzero if Extended CONNECT Method is enabled.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -99,7 +168,43 @@ typedef struct nghttp3_http_state nghttp3_http_state;
  *     if it was not received because of compatibility reasons.
  */
 int nghttp3_http_on_header(nghttp3_http_state *http, nghttp3_qpack_nv *nv,
-                           int request, int trailers, int connect_protocol);
+                           uint8_t verdict, int request, int trailers,
+                           int connect_protocol);
+
+/*
+ * nghttp3_http_check_field_name validates field name |name| of
+ * length |len|, and returns the verdict which is a bitwise-OR of
+ * NGHTTP3_HTTP_FIELD_NAME_* flags.
+ */
+uint8_t nghttp3_http_check_field_name(const uint8_t *name, size_t len);
+
+/*
+ * nghttp3_http_check_field_value validates field value |value| of
+ * length |len| whose field name is identified by |token|, and
+ * returns the verdict which is a bitwise-OR of
+ * NGHTTP3_HTTP_FIELD_VALUE_* flags.
+ */
+uint8_t nghttp3_http_check_field_value(int32_t token, const uint8_t *value,
+                                       size_t len);
+
+/*
+ * nghttp3_http_field_name_verdict returns the verdict of field name
+ * |name| of length |len| from |cls| which is the character classes
+ * of |name| OR-ed together.  Pseudo header field name is left
+ * unchecked.
+ */
+uint8_t nghttp3_http_field_name_verdict(const uint8_t *name, size_t len,
+                                        uint8_t cls);
+
+/*
+ * nghttp3_http_field_value_verdict returns the verdict of field value
+ * |value| of length |len| whose field name is identified by |token|
+ * from |cls| which is the character classes of |value| OR-ed
+ * together.  It returns the same verdict as
+ * nghttp3_http_check_field_value.
+ */
+uint8_t nghttp3_http_field_value_verdict(int32_t token, const uint8_t *value,
+                                         size_t len, uint8_t cls);
 
 /*
  * This function is called when request header is received.  This
@@ -170,4 +275,15 @@ int nghttp3_http_parse_priority(nghttp3_pri *dest, const uint8_t *value,
 
 int nghttp3_pri_eq(const nghttp3_pri *a, const nghttp3_pri *b);
 
+/*
+ * nghttp3_check_header_name_generic and
+ * nghttp3_check_header_value_generic are the same as
+ * nghttp3_check_header_name and nghttp3_check_header_value
+ * respectively, but they always check one byte at a time using
+ * lookup tables.  They are the reference of SIMD implementations.
+ */
+int nghttp3_check_header_name_generic(const uint8_t *name, size_t len);
+
+int nghttp3_check_header_value_generic(const uint8_t *value, size_t len);
+
 #endif /* NGHTTP3_HTTP_H */
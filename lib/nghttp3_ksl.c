@@ -60,7 +60,7 @@ void nghttp3_ksl_init(nghttp3_ksl *ksl, nghttp3_ksl_compar compar,
 
   nghttp3_objalloc_init(&ksl->blkalloc,
                         ((ksl_blklen(nodelen) + 0xfu) & ~(uintptr_t)0xfu) * 8,
-                        mem);
+                        NGHTTP3_MEM_TAG_OTHER, mem);
 
   ksl->head = NULL;
   ksl->front = ksl->back = NULL;
@@ -27,6 +27,7 @@
 #include "nghttp3_mem.h"
 
 #include <stdio.h>
+#include <string.h>
 
 static void *default_malloc(size_t size, void *user_data) {
   (void)user_data;
@@ -57,6 +58,85 @@ static nghttp3_mem mem_default = {NULL, default_malloc, default_free,
 
 const nghttp3_mem *nghttp3_mem_default(void) { return &mem_default; }
 
+/* The functions below are installed to nghttp3_mem by
+   nghttp3_mem_tagged_init.  They are called for the untagged
+   allocation requests. */
+static void *tagged_malloc(size_t size, void *user_data) {
+  nghttp3_mem_tagged *tmem = user_data;
+
+  return tmem->malloc(size, NGHTTP3_MEM_TAG_OTHER, tmem->user_data);
+}
+
+static void tagged_free(void *ptr, void *user_data) {
+  nghttp3_mem_tagged *tmem = user_data;
+
+  tmem->free(ptr, tmem->user_data);
+}
+
+static void *tagged_calloc(size_t nmemb, size_t size, void *user_data) {
+  nghttp3_mem_tagged *tmem = user_data;
+
+  return tmem->calloc(nmemb, size, NGHTTP3_MEM_TAG_OTHER, tmem->user_data);
+}
+
+static void *tagged_realloc(void *ptr, size_t size, void *user_data) {
+  nghttp3_mem_tagged *tmem = user_data;
+
+  return tmem->realloc(ptr, size, NGHTTP3_MEM_TAG_OTHER, tmem->user_data);
+}
+
+void nghttp3_mem_tagged_init(nghttp3_mem *mem, nghttp3_mem_tagged *tmem) {
+  mem->user_data = tmem;
+  mem->malloc = tagged_malloc;
+  mem->free = tagged_free;
+  mem->calloc = tagged_calloc;
+  mem->realloc = tagged_realloc;
+}
+
+/*
+ * mem_malloc_tag, mem_calloc_tag, and mem_realloc_tag pass |tag| to
+ * the allocator if |mem| is initialized by nghttp3_mem_tagged_init.
+ * Otherwise, |tag| is ignored.
+ */
+static void *mem_malloc_tag(const nghttp3_mem *mem, uint32_t tag,
+                            size_t size) {
+  nghttp3_mem_tagged *tmem;
+
+  if (mem->malloc != tagged_malloc) {
+    return mem->malloc(size, mem->user_data);
+  }
+
+  tmem = mem->user_data;
+
+  return tmem->malloc(size, tag, tmem->user_data);
+}
+
+static void *mem_calloc_tag(const nghttp3_mem *mem, uint32_t tag,
+                            size_t nmemb, size_t size) {
+  nghttp3_mem_tagged *tmem;
+
+  if (mem->calloc != tagged_calloc) {
+    return mem->calloc(nmemb, size, mem->user_data);
+  }
+
+  tmem = mem->user_data;
+
+  return tmem->calloc(nmemb, size, tag, tmem->user_data);
+}
+
+static void *mem_realloc_tag(const nghttp3_mem *mem, uint32_t tag, void *ptr,
+                             size_t size) {
+  nghttp3_mem_tagged *tmem;
+
+  if (mem->realloc != tagged_realloc) {
+    return mem->realloc(ptr, size, mem->user_data);
+  }
+
+  tmem = mem->user_data;
+
+  return tmem->realloc(ptr, size, tag, tmem->user_data);
+}
+
 #ifndef MEMDEBUG
 void *nghttp3_mem_malloc(const nghttp3_mem *mem, size_t size) {
   return mem->malloc(size, mem->user_data);
@@ -73,6 +153,21 @@ void *nghttp3_mem_calloc(const nghttp3_mem *mem, size_t nmemb, size_t size) {
 void *nghttp3_mem_realloc(const nghttp3_mem *mem, void *ptr, size_t size) {
   return mem->realloc(ptr, size, mem->user_data);
 }
+
+void *nghttp3_mem_malloc_tag(const nghttp3_mem *mem, uint32_t tag,
+                             size_t size) {
+  return mem_malloc_tag(mem, tag, size);
+}
+
+void *nghttp3_mem_calloc_tag(const nghttp3_mem *mem, uint32_t tag,
+                             size_t nmemb, size_t size) {
+  return mem_calloc_tag(mem, tag, nmemb, size);
+}
+
+void *nghttp3_mem_realloc_tag(const nghttp3_mem *mem, uint32_t tag, void *ptr,
+                              size_t size) {
+  return mem_realloc_tag(mem, tag, ptr, size);
+}
 #else  /* MEMDEBUG */
 void *nghttp3_mem_malloc_debug(const nghttp3_mem *mem, size_t size,
                                const char *func, const char *file,
@@ -121,4 +216,191 @@ void *nghttp3_mem_realloc_debug(const nghttp3_mem *mem, void *ptr, size_t size,
 
   return nptr;
 }
+
+void *nghttp3_mem_malloc_tag_debug(const nghttp3_mem *mem, uint32_t tag,
+                                   size_t size, const char *func,
+                                   const char *file, size_t line) {
+  void *nptr = mem_malloc_tag(mem, tag, size);
+
+  fprintf(stderr, "malloc %p size=%zu tag=%u in %s at %s:%zu\n", nptr, size,
+          tag, func, file, line);
+
+  return nptr;
+}
+
+void *nghttp3_mem_calloc_tag_debug(const nghttp3_mem *mem, uint32_t tag,
+                                   size_t nmemb, size_t size, const char *func,
+                                   const char *file, size_t line) {
+  void *nptr = mem_calloc_tag(mem, tag, nmemb, size);
+
+  fprintf(stderr, "calloc %p nmemb=%zu size=%zu tag=%u in %s at %s:%zu\n",
+          nptr, nmemb, size, tag, func, file, line);
+
+  return nptr;
+}
+
+void *nghttp3_mem_realloc_tag_debug(const nghttp3_mem *mem, uint32_t tag,
+                                    void *ptr, size_t size, const char *func,
+                                    const char *file, size_t line) {
+  void *nptr = mem_realloc_tag(mem, tag, ptr, size);
+
+  fprintf(stderr, "realloc %p ptr=%p size=%zu tag=%u in %s at %s:%zu\n", nptr,
+          ptr, size, tag, func, file, line);
+
+  return nptr;
+}
 #endif /* MEMDEBUG */
+
+/*
+ * mem_counter_hd precedes every object allocated by
+ * nghttp3_mem_counter.  Its size is 16 bytes to keep the alignment of
+ * the object.
+ */
+typedef struct mem_counter_hd {
+  /* size is the size of the object. */
+  uint64_t size;
+  /* tag is the allocation tag of the object. */
+  uint32_t tag;
+  uint32_t pad;
+} mem_counter_hd;
+
+/*
+ * mem_counter_track records the allocation of |size| bytes tagged
+ * with |tag| in the header |hd|, and returns the pointer to the
+ * object which follows |hd|.
+ */
+static void *mem_counter_track(nghttp3_mem_counter *counter,
+                               mem_counter_hd *hd, uint32_t tag, size_t size) {
+  if (tag >= NGHTTP3_MEM_TAG_MAX) {
+    tag = NGHTTP3_MEM_TAG_OTHER;
+  }
+
+  hd->size = size;
+  hd->tag = tag;
+  hd->pad = 0;
+
+  counter->live_bytes[tag] += size;
+
+  return hd + 1;
+}
+
+static void *mem_counter_malloc(size_t size, uint32_t tag, void *user_data) {
+  nghttp3_mem_counter *counter = user_data;
+  mem_counter_hd *hd;
+
+  if (size > SIZE_MAX - sizeof(*hd)) {
+    return NULL;
+  }
+
+  hd = nghttp3_mem_malloc(counter->mem, sizeof(*hd) + size);
+  if (hd == NULL) {
+    return NULL;
+  }
+
+  return mem_counter_track(counter, hd, tag, size);
+}
+
+static void mem_counter_free(void *ptr, void *user_data) {
+  nghttp3_mem_counter *counter = user_data;
+  mem_counter_hd *hd;
+
+  if (ptr == NULL) {
+    return;
+  }
+
+  hd = (mem_counter_hd *)ptr - 1;
+
+  counter->live_bytes[hd->tag] -= hd->size;
+
+  nghttp3_mem_free(counter->mem, hd);
+}
+
+static void *mem_counter_calloc(size_t nmemb, size_t size, uint32_t tag,
+                                void *user_data) {
+  nghttp3_mem_counter *counter = user_data;
+  mem_counter_hd *hd;
+
+  if (size && nmemb > (SIZE_MAX - sizeof(*hd)) / size) {
+    return NULL;
+  }
+
+  hd = nghttp3_mem_calloc(counter->mem, 1, sizeof(*hd) + nmemb * size);
+  if (hd == NULL) {
+    return NULL;
+  }
+
+  return mem_counter_track(counter, hd, tag, nmemb * size);
+}
+
+static void *mem_counter_realloc(void *ptr, size_t size, uint32_t tag,
+                                 void *user_data) {
+  nghttp3_mem_counter *counter = user_data;
+  mem_counter_hd *hd, *nhd;
+
+  if (ptr == NULL) {
+    return mem_counter_malloc(size, tag, user_data);
+  }
+
+  if (size > SIZE_MAX - sizeof(*hd)) {
+    return NULL;
+  }
+
+  hd = (mem_counter_hd *)ptr - 1;
+
+  nhd = nghttp3_mem_realloc(counter->mem, hd, sizeof(*hd) + size);
+  if (nhd == NULL) {
+    return NULL;
+  }
+
+  counter->live_bytes[nhd->tag] -= nhd->size;
+
+  return mem_counter_track(counter, nhd, tag, size);
+}
+
+int nghttp3_mem_counter_new(nghttp3_mem_counter **pcounter,
+                            const nghttp3_mem *mem) {
+  nghttp3_mem_counter *counter;
+
+  if (mem == NULL) {
+    mem = nghttp3_mem_default();
+  }
+
+  counter = nghttp3_mem_malloc(mem, sizeof(nghttp3_mem_counter));
+  if (counter == NULL) {
+    return NGHTTP3_ERR_NOMEM;
+  }
+
+  counter->mem = mem;
+  counter->tmem.user_data = counter;
+  counter->tmem.malloc = mem_counter_malloc;
+  counter->tmem.free = mem_counter_free;
+  counter->tmem.calloc = mem_counter_calloc;
+  counter->tmem.realloc = mem_counter_realloc;
+  nghttp3_mem_tagged_init(&counter->tagged_mem, &counter->tmem);
+  memset(counter->live_bytes, 0, sizeof(counter->live_bytes));
+
+  *pcounter = counter;
+
+  return 0;
+}
+
+void nghttp3_mem_counter_del(nghttp3_mem_counter *counter) {
+  if (counter == NULL) {
+    return;
+  }
+
+  nghttp3_mem_free(counter->mem, counter);
+}
+
+const nghttp3_mem *nghttp3_mem_counter_get_mem(nghttp3_mem_counter *counter) {
+  return &counter->tagged_mem;
+}
+
+uint64_t nghttp3_mem_counter_get_live_bytes(const nghttp3_mem_counter *counter,
+                                            uint32_t tag) {
+  if (tag >= NGHTTP3_MEM_TAG_MAX) {
+    return 0;
+  }
+
+  return counter->live_bytes[tag];
+}
@@ -40,6 +40,14 @@ void *nghttp3_mem_malloc(const nghttp3_mem *mem, size_t size);
 void nghttp3_mem_free(const nghttp3_mem *mem, void *ptr);
 void *nghttp3_mem_calloc(const nghttp3_mem *mem, size_t nmemb, size_t size);
 void *nghttp3_mem_realloc(const nghttp3_mem *mem, void *ptr, size_t size);
+/* The variants below pass |tag|, one of NGHTTP3_MEM_TAG_*, to the
+   allocator if |mem| is initialized by nghttp3_mem_tagged_init. */
+void *nghttp3_mem_malloc_tag(const nghttp3_mem *mem, uint32_t tag,
+                             size_t size);
+void *nghttp3_mem_calloc_tag(const nghttp3_mem *mem, uint32_t tag,
+                             size_t nmemb, size_t size);
+void *nghttp3_mem_realloc_tag(const nghttp3_mem *mem, uint32_t tag, void *ptr,
+                              size_t size);
 #else /* MEMDEBUG */
 void *nghttp3_mem_malloc_debug(const nghttp3_mem *mem, size_t size,
                                const char *func, const char *file, size_t line);
@@ -75,6 +83,47 @@ void *nghttp3_mem_realloc_debug(const nghttp3_mem *mem, void *ptr, size_t size,
 #  define nghttp3_mem_realloc(MEM, PTR, SIZE)                                  \
     nghttp3_mem_realloc_debug((MEM), (PTR), (SIZE), __func__, __FILE__,        \
                               __LINE__)
+
+void *nghttp3_mem_malloc_tag_debug(const nghttp3_mem *mem, uint32_t tag,
+                                   size_t size, const char *func,
+                                   const char *file, size_t line);
+
+#  define nghttp3_mem_malloc_tag(MEM, TAG, SIZE)                               \
+    nghttp3_mem_malloc_tag_debug((MEM), (TAG), (SIZE), __func__, __FILE__,     \
+                                 __LINE__)
+
+void *nghttp3_mem_calloc_tag_debug(const nghttp3_mem *mem, uint32_t tag,
+                                   size_t nmemb, size_t size, const char *func,
+                                   const char *file, size_t line);
+
+#  define nghttp3_mem_calloc_tag(MEM, TAG, NMEMB, SIZE)                        \
+    nghttp3_mem_calloc_tag_debug((MEM), (TAG), (NMEMB), (SIZE), __func__,      \
+                                 __FILE__, __LINE__)
+
+void *nghttp3_mem_realloc_tag_debug(const nghttp3_mem *mem, uint32_t tag,
+                                    void *ptr, size_t size, const char *func,
+                                    const char *file, size_t line);
+
+#  define nghttp3_mem_realloc_tag(MEM, TAG, PTR, SIZE)                         \
+    nghttp3_mem_realloc_tag_debug((MEM), (TAG), (PTR), (SIZE), __func__,       \
+                                  __FILE__, __LINE__)
 #endif /* MEMDEBUG */
 
+/*
+ * nghttp3_mem_counter is the memory allocator returned by
+ * nghttp3_mem_counter_new.
+ */
+struct nghttp3_mem_counter {
+  /* mem is the underlying memory allocator. */
+  const nghttp3_mem *mem;
+  /* tmem receives the allocation requests made through tagged_mem. */
+  nghttp3_mem_tagged tmem;
+  /* tagged_mem is the memory allocator returned by
+     nghttp3_mem_counter_get_mem. */
+  nghttp3_mem tagged_mem;
+  /* live_bytes is the number of bytes allocated and not freed yet per
+     tag. */
+  uint64_t live_bytes[NGHTTP3_MEM_TAG_MAX];
+};
+
 #endif /* NGHTTP3_MEM_H */
@@ -25,9 +25,11 @@
  */
 #include "nghttp3_objalloc.h"
 
+#include <assert.h>
+
 void nghttp3_objalloc_init(nghttp3_objalloc *objalloc, size_t blklen,
-                           const nghttp3_mem *mem) {
-  nghttp3_balloc_init(&objalloc->balloc, blklen, mem);
+                           uint32_t tag, const nghttp3_mem *mem) {
+  nghttp3_balloc_init(&objalloc->balloc, blklen, tag, mem);
   nghttp3_opl_init(&objalloc->opl);
 }
 
@@ -39,3 +41,180 @@ void nghttp3_objalloc_clear(nghttp3_objalloc *objalloc) {
   nghttp3_opl_clear(&objalloc->opl);
   nghttp3_balloc_clear(&objalloc->balloc);
 }
+
+/*
+ * memblock_start returns the address of the first object in a memory
+ * block |hd|.
+ */
+static uint8_t *memblock_start(nghttp3_memblock_hd *hd) {
+  return (uint8_t *)(((uintptr_t)hd + sizeof(nghttp3_memblock_hd) + 0xfu) &
+                     ~(uintptr_t)0xfu);
+}
+
+/*
+ * opl_merge merges the free lists |a| and |b| which are sorted by
+ * address, and returns the head of the merged list.
+ */
+static nghttp3_opl_entry *opl_merge(nghttp3_opl_entry *a,
+                                    nghttp3_opl_entry *b) {
+  nghttp3_opl_entry *head = NULL, **pent = &head;
+
+  for (; a && b; pent = &(*pent)->next) {
+    if ((uintptr_t)a < (uintptr_t)b) {
+      *pent = a;
+      a = a->next;
+    } else {
+      *pent = b;
+      b = b->next;
+    }
+  }
+
+  *pent = a ? a : b;
+
+  return head;
+}
+
+/*
+ * opl_sort sorts the free list |head| by address without allocating
+ * memory, and returns the new head.
+ */
+static nghttp3_opl_entry *opl_sort(nghttp3_opl_entry *head) {
+  nghttp3_opl_entry *slow, *fast, *rest;
+
+  if (head == NULL || head->next == NULL) {
+    return head;
+  }
+
+  for (slow = head, fast = head->next; fast && fast->next;
+       slow = slow->next, fast = fast->next->next)
+    ;
+
+  rest = slow->next;
+  slow->next = NULL;
+
+  return opl_merge(opl_sort(head), opl_sort(rest));
+}
+
+/*
+ * memblock_merge merges the memory block lists |a| and |b| which are
+ * sorted by address, and returns the head of the merged list.
+ */
+static nghttp3_memblock_hd *memblock_merge(nghttp3_memblock_hd *a,
+                                           nghttp3_memblock_hd *b) {
+  nghttp3_memblock_hd *head = NULL, **phd = &head;
+
+  for (; a && b; phd = &(*phd)->next) {
+    if ((uintptr_t)a < (uintptr_t)b) {
+      *phd = a;
+      a = a->next;
+    } else {
+      *phd = b;
+      b = b->next;
+    }
+  }
+
+  *phd = a ? a : b;
+
+  return head;
+}
+
+/*
+ * memblock_sort sorts the memory block list |head| by address
+ * without allocating memory, and returns the new head.
+ */
+static nghttp3_memblock_hd *memblock_sort(nghttp3_memblock_hd *head) {
+  nghttp3_memblock_hd *slow, *fast, *rest;
+
+  if (head == NULL || head->next == NULL) {
+    return head;
+  }
+
+  for (slow = head, fast = head->next; fast && fast->next;
+       slow = slow->next, fast = fast->next->next)
+    ;
+
+  rest = slow->next;
+  slow->next = NULL;
+
+  return memblock_merge(memblock_sort(head), memblock_sort(rest));
+}
+
+void nghttp3_objalloc_compact(nghttp3_objalloc *objalloc, size_t objlen) {
+  nghttp3_balloc *balloc = &objalloc->balloc;
+  nghttp3_memblock_hd *cur = balloc->head, *hd, *next, *blocks, **phd;
+  nghttp3_opl_entry *ent, **pent;
+  size_t nobj, nfree;
+  uint8_t *start;
+  int cur_freed = 0;
+
+  objlen = (objlen + 0xfu) & ~(size_t)0xfu;
+
+  assert(objlen);
+  assert(objlen <= balloc->blklen);
+
+  if (cur == NULL) {
+    return;
+  }
+
+  /* With both lists sorted by address, the free objects of each
+     memory block are found in a single pass. */
+  objalloc->opl.head = opl_sort(objalloc->opl.head);
+  blocks = memblock_sort(cur);
+
+  pent = &objalloc->opl.head;
+  phd = &blocks;
+
+  for (hd = blocks; hd; hd = next) {
+    next = hd->next;
+    start = memblock_start(hd);
+
+    if (hd == cur) {
+      nobj = (size_t)(balloc->buf.last - start) / objlen;
+    } else {
+      nobj = balloc->blklen / objlen;
+    }
+
+    for (; *pent && (uintptr_t)*pent < (uintptr_t)start;
+         pent = &(*pent)->next)
+      ;
+
+    for (nfree = 0, ent = *pent;
+         ent && (uintptr_t)ent < (uintptr_t)(start + balloc->blklen);
+         ent = ent->next) {
+      ++nfree;
+    }
+
+    if (nfree != nobj) {
+      /* The current block is put back to the head of the list
+         below. */
+      if (hd != cur) {
+        *phd = hd;
+        phd = &hd->next;
+      }
+
+      continue;
+    }
+
+    /* Remove the free objects in the released block from free
+       list. */
+    *pent = ent;
+
+    if (hd == cur) {
+      cur_freed = 1;
+    }
+
+    nghttp3_mem_free(balloc->mem, hd);
+  }
+
+  *phd = NULL;
+
+  if (cur_freed) {
+    balloc->head = blocks;
+    nghttp3_buf_wrap_init(&balloc->buf, (void *)"", 0);
+
+    return;
+  }
+
+  cur->next = blocks;
+  balloc->head = cur;
+}
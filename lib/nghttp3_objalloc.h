@@ -48,11 +48,11 @@ typedef struct nghttp3_objalloc {
 } nghttp3_objalloc;
 
 /*
- * nghttp3_objalloc_init initializes |objalloc|.  |blklen| is directly
- * passed to nghttp3_balloc_init.
+ * nghttp3_objalloc_init initializes |objalloc|.  |blklen| and |tag|
+ * are directly passed to nghttp3_balloc_init.
  */
 void nghttp3_objalloc_init(nghttp3_objalloc *objalloc, size_t blklen,
-                           const nghttp3_mem *mem);
+                           uint32_t tag, const nghttp3_mem *mem);
 
 /*
  * nghttp3_objalloc_free releases all allocated resources.
@@ -65,12 +65,22 @@ void nghttp3_objalloc_free(nghttp3_objalloc *objalloc);
  */
 void nghttp3_objalloc_clear(nghttp3_objalloc *objalloc);
 
+/*
+ * nghttp3_objalloc_compact releases the memory blocks all objects of
+ * which are in the free list.  |objlen| is the size of object
+ * allocated from |objalloc|, and all objects must have the same size.
+ * The free list is sorted by address as a side effect.
+ */
+void nghttp3_objalloc_compact(nghttp3_objalloc *objalloc, size_t objlen);
+
 #ifndef NOMEMPOOL
 #  define nghttp3_objalloc_def(NAME, TYPE, OPLENTFIELD)                        \
     inline static void nghttp3_objalloc_##NAME##_init(                         \
-        nghttp3_objalloc *objalloc, size_t nmemb, const nghttp3_mem *mem) {    \
+        nghttp3_objalloc *objalloc, size_t nmemb, uint32_t tag,                \
+        const nghttp3_mem *mem) {                                              \
       nghttp3_objalloc_init(                                                   \
-          objalloc, ((sizeof(TYPE) + 0xfu) & ~(uintptr_t)0xfu) * nmemb, mem);  \
+          objalloc, ((sizeof(TYPE) + 0xfu) & ~(uintptr_t)0xfu) * nmemb, tag,   \
+          mem);                                                                \
     }                                                                          \
                                                                                \
     inline static TYPE *nghttp3_objalloc_##NAME##_get(                         \
@@ -117,19 +127,23 @@ void nghttp3_objalloc_clear(nghttp3_objalloc *objalloc);
 #else /* NOMEMPOOL */
 #  define nghttp3_objalloc_def(NAME, TYPE, OPLENTFIELD)                        \
     inline static void nghttp3_objalloc_##NAME##_init(                         \
-        nghttp3_objalloc *objalloc, size_t nmemb, const nghttp3_mem *mem) {    \
+        nghttp3_objalloc *objalloc, size_t nmemb, uint32_t tag,                \
+        const nghttp3_mem *mem) {                                              \
       nghttp3_objalloc_init(                                                   \
-          objalloc, ((sizeof(TYPE) + 0xfu) & ~(uintptr_t)0xfu) * nmemb, mem);  \
+          objalloc, ((sizeof(TYPE) + 0xfu) & ~(uintptr_t)0xfu) * nmemb, tag,   \
+          mem);                                                                \
     }                                                                          \
                                                                                \
     inline static TYPE *nghttp3_objalloc_##NAME##_get(                         \
         nghttp3_objalloc *objalloc) {                                          \
-      return nghttp3_mem_malloc(objalloc->balloc.mem, sizeof(TYPE));           \
+      return nghttp3_mem_malloc_tag(objalloc->balloc.mem,                      \
+                                    objalloc->balloc.tag, sizeof(TYPE));       \
     }                                                                          \
                                                                                \
     inline static TYPE *nghttp3_objalloc_##NAME##_len_get(                     \
         nghttp3_objalloc *objalloc, size_t len) {                              \
-      return nghttp3_mem_malloc(objalloc->balloc.mem, len);                    \
+      return nghttp3_mem_malloc_tag(objalloc->balloc.mem,                      \
+                                    objalloc->balloc.tag, len);                \
     }                                                                          \
                                                                                \
     inline static void nghttp3_objalloc_##NAME##_release(                      \
@@ -166,3 +166,30 @@ int nghttp3_pq_each(const nghttp3_pq *pq, nghttp3_pq_item_cb fun, void *arg) {
 }
 
 void nghttp3_pq_clear(nghttp3_pq *pq) { pq->length = 0; }
+
+void nghttp3_pq_shrink(nghttp3_pq *pq) {
+  void *nq;
+  size_t ncapacity;
+
+  if (pq->length == 0) {
+    nghttp3_mem_free(pq->mem, pq->q);
+    pq->q = NULL;
+    pq->capacity = 0;
+
+    return;
+  }
+
+  ncapacity = nghttp3_max(4, pq->length);
+  if (ncapacity >= pq->capacity) {
+    return;
+  }
+
+  nq = nghttp3_mem_realloc(pq->mem, pq->q,
+                           ncapacity * sizeof(nghttp3_pq_entry *));
+  if (nq == NULL) {
+    return;
+  }
+
+  pq->q = nq;
+  pq->capacity = ncapacity;
+}
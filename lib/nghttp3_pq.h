@@ -126,4 +126,11 @@ void nghttp3_pq_remove(nghttp3_pq *pq, nghttp3_pq_entry *item);
 
 void nghttp3_pq_clear(nghttp3_pq *pq);
 
+/*
+ * nghttp3_pq_shrink releases the excess capacity of |pq|.  If |pq| is
+ * empty, the underlying array is freed.  If memory allocation fails,
+ * |pq| is left unchanged.
+ */
+void nghttp3_pq_shrink(nghttp3_pq *pq);
+
 #endif /* NGHTTP3_PQ_H */
@@ -0,0 +1,72 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2026 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP3_PROBE_H
+#define NGHTTP3_PROBE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+/*
+ * NGHTTP3_PROBEn defines a USDT probe |NAME| in the provider
+ * "nghttp3" with n arguments.  Probes are compiled in only if the
+ * library is configured with USDT support.  Otherwise, they expand to
+ * nothing, and their arguments are not evaluated.
+ *
+ * The probes and their arguments are:
+ *
+ * - stream_open(conn, stream_id)
+ * - stream_close(conn, stream_id, app_error_code)
+ * - writev_stream(conn, stream_id, fin, ncnt): the result of
+ *   nghttp3_conn_writev_stream.
+ * - qpack_blocked(conn, stream_id)
+ * - qpack_unblocked(conn, stream_id)
+ * - qpack_dtable_insert(ctx, absidx, space)
+ * - qpack_dtable_evict(ctx, absidx, space): ctx is either a QPACK
+ *   encoder or decoder.
+ * - read_data_blocked(conn, stream_id): read_data returned
+ *   NGHTTP3_ERR_WOULDBLOCK.
+ */
+#ifdef HAVE_USDT
+#  include <sys/sdt.h>
+
+#  define NGHTTP3_PROBE2(NAME, A1, A2) DTRACE_PROBE2(nghttp3, NAME, A1, A2)
+#  define NGHTTP3_PROBE3(NAME, A1, A2, A3)                                     \
+    DTRACE_PROBE3(nghttp3, NAME, A1, A2, A3)
+#  define NGHTTP3_PROBE4(NAME, A1, A2, A3, A4)                                 \
+    DTRACE_PROBE4(nghttp3, NAME, A1, A2, A3, A4)
+#else /* !HAVE_USDT */
+#  define NGHTTP3_PROBE2(NAME, A1, A2)                                         \
+    do {                                                                       \
+    } while (0)
+#  define NGHTTP3_PROBE3(NAME, A1, A2, A3)                                     \
+    do {                                                                       \
+    } while (0)
+#  define NGHTTP3_PROBE4(NAME, A1, A2, A3, A4)                                 \
+    do {                                                                       \
+    } while (0)
+#endif /* !HAVE_USDT */
+
+#endif /* NGHTTP3_PROBE_H */
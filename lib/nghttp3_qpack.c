@@ -33,6 +33,7 @@
 #include "nghttp3_macro.h"
 #include "nghttp3_debug.h"
 #include "nghttp3_unreachable.h"
+#include "nghttp3_probe.h"
 
 /* NGHTTP3_QPACK_MAX_QPACK_STREAMS is the maximum number of concurrent
    nghttp3_qpack_stream object to handle a client which never cancel
@@ -852,7 +853,7 @@ static int qpack_context_init(nghttp3_qpack_context *ctx,
     ;
 
   rv = nghttp3_ringbuf_init(&ctx->dtable, len2, sizeof(nghttp3_qpack_entry *),
-                            mem);
+                            NGHTTP3_MEM_TAG_QPACK_ENTRY, mem);
   if (rv != 0) {
     return rv;
   }
@@ -864,11 +865,31 @@ static int qpack_context_init(nghttp3_qpack_context *ctx,
   ctx->max_dtable_capacity = 0;
   ctx->max_blocked_streams = max_blocked_streams;
   ctx->next_absidx = 0;
+  ctx->dtable_hits = 0;
+  ctx->trace = NULL;
+  ctx->trace_user_data = NULL;
   ctx->bad = 0;
 
   return 0;
 }
 
+/*
+ * qpack_context_trace calls ctx->trace with a QPACK instruction event
+ * of type |type|.  |instruction| is the instruction, and |value| is
+ * its instruction specific value.  ctx->trace must not be NULL.
+ */
+static void qpack_context_trace(nghttp3_qpack_context *ctx, uint32_t type,
+                                uint32_t instruction, uint64_t value) {
+  nghttp3_trace_event ev;
+
+  ev.type = type;
+  ev.data.qpack.instruction = instruction;
+  ev.data.qpack.value = value;
+  ev.data.qpack.insert_count = ctx->next_absidx;
+
+  ctx->trace(&ev, ctx->trace_user_data);
+}
+
 static void qpack_context_free(nghttp3_qpack_context *ctx) {
   nghttp3_qpack_entry *ent;
   size_t i, len = nghttp3_ringbuf_len(&ctx->dtable);
@@ -972,6 +993,13 @@ void nghttp3_qpack_encoder_set_max_blocked_streams(
   encoder->ctx.max_blocked_streams = max_blocked_streams;
 }
 
+void nghttp3_qpack_encoder_set_trace(nghttp3_qpack_encoder *encoder,
+                                     nghttp3_qpack_trace trace,
+                                     void *user_data) {
+  encoder->ctx.trace = trace;
+  encoder->ctx.trace_user_data = user_data;
+}
+
 uint64_t nghttp3_qpack_encoder_get_min_cnt(nghttp3_qpack_encoder *encoder) {
   assert(!nghttp3_pq_empty(&encoder->min_cnts));
 
@@ -985,6 +1013,7 @@ void nghttp3_qpack_encoder_shrink_dtable(nghttp3_qpack_encoder *encoder) {
   const nghttp3_mem *mem = encoder->ctx.mem;
   uint64_t min_cnt = UINT64_MAX;
   size_t len;
+  size_t space;
   nghttp3_qpack_entry *ent;
 
   if (encoder->ctx.dtable_size <= encoder->ctx.max_dtable_capacity) {
@@ -1002,8 +1031,10 @@ void nghttp3_qpack_encoder_shrink_dtable(nghttp3_qpack_encoder *encoder) {
       return;
     }
 
-    encoder->ctx.dtable_size -=
-        table_space(ent->nv.name->len, ent->nv.value->len);
+    space = table_space(ent->nv.name->len, ent->nv.value->len);
+    encoder->ctx.dtable_size -= space;
+
+    NGHTTP3_PROBE3(qpack_dtable_evict, &encoder->ctx, ent->absidx, space);
 
     nghttp3_ringbuf_pop_back(dtable);
     qpack_map_remove(&encoder->dtable_map, ent);
@@ -1124,7 +1155,7 @@ static int reserve_buf_internal(nghttp3_buf *buf, size_t extra_size,
   for (; n < need; n *= 2)
     ;
 
-  return nghttp3_buf_reserve(buf, n, mem);
+  return nghttp3_buf_reserve(buf, n, NGHTTP3_MEM_TAG_QPACK, mem);
 }
 
 static int reserve_buf_small(nghttp3_buf *buf, size_t extra_size,
@@ -1267,8 +1298,22 @@ int nghttp3_qpack_encoder_process_dtable_update(nghttp3_qpack_encoder *encoder,
 
 int nghttp3_qpack_encoder_write_set_dtable_cap(nghttp3_qpack_encoder *encoder,
                                                nghttp3_buf *ebuf, size_t cap) {
+  int rv;
+
   DEBUGF("qpack::encode: Set Dynamic Table Capacity capacity=%zu\n", cap);
-  return qpack_write_number(ebuf, 0x20, cap, 5, encoder->ctx.mem);
+
+  rv = qpack_write_number(ebuf, 0x20, cap, 5, encoder->ctx.mem);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if (encoder->ctx.trace) {
+    qpack_context_trace(&encoder->ctx,
+                        NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT,
+                        NGHTTP3_TRACE_QPACK_SET_DTABLE_CAPACITY, cap);
+  }
+
+  return 0;
 }
 
 nghttp3_qpack_stream *
@@ -1658,8 +1703,8 @@ nghttp3_qpack_lookup_result nghttp3_qpack_encoder_lookup_dtable(
 int nghttp3_qpack_header_block_ref_new(nghttp3_qpack_header_block_ref **pref,
                                        uint64_t max_cnt, uint64_t min_cnt,
                                        const nghttp3_mem *mem) {
-  nghttp3_qpack_header_block_ref *ref =
-      nghttp3_mem_malloc(mem, sizeof(nghttp3_qpack_header_block_ref));
+  nghttp3_qpack_header_block_ref *ref = nghttp3_mem_malloc_tag(
+      mem, NGHTTP3_MEM_TAG_QPACK, sizeof(nghttp3_qpack_header_block_ref));
 
   if (ref == NULL) {
     return NGHTTP3_ERR_NOMEM;
@@ -1695,13 +1740,15 @@ int nghttp3_qpack_stream_new(nghttp3_qpack_stream **pstream, int64_t stream_id,
   int rv;
   nghttp3_qpack_stream *stream;
 
-  stream = nghttp3_mem_malloc(mem, sizeof(nghttp3_qpack_stream));
+  stream = nghttp3_mem_malloc_tag(mem, NGHTTP3_MEM_TAG_QPACK,
+                                  sizeof(nghttp3_qpack_stream));
   if (stream == NULL) {
     return NGHTTP3_ERR_NOMEM;
   }
 
   rv = nghttp3_ringbuf_init(&stream->refs, 4,
-                            sizeof(nghttp3_qpack_header_block_ref *), mem);
+                            sizeof(nghttp3_qpack_header_block_ref *),
+                            NGHTTP3_MEM_TAG_QPACK, mem);
   if (rv != 0) {
     nghttp3_mem_free(mem, stream);
     return rv;
@@ -1801,6 +1848,8 @@ int nghttp3_qpack_encoder_write_dynamic_indexed(nghttp3_qpack_encoder *encoder,
          " base=%" PRIu64 "\n",
          absidx, base);
 
+  ++encoder->ctx.dtable_hits;
+
   if (absidx < base) {
     return qpack_write_number(rbuf, 0x80, base - absidx - 1, 6,
                               encoder->ctx.mem);
@@ -1889,6 +1938,8 @@ int nghttp3_qpack_encoder_write_dynamic_indexed_name(
          "absidx=%" PRIu64 " base=%" PRIu64 " never=%d\n",
          absidx, base, (nv->flags & NGHTTP3_NV_FLAG_NEVER_INDEX) != 0);
 
+  ++encoder->ctx.dtable_hits;
+
   if (absidx < base) {
     fb = (uint8_t)(0x40 |
                    ((nv->flags & NGHTTP3_NV_FLAG_NEVER_INDEX) ? 0x20 : 0));
@@ -2049,6 +2100,7 @@ int nghttp3_qpack_context_dtable_add(nghttp3_qpack_context *ctx,
   nghttp3_qpack_entry *new_ent, **p, *ent;
   const nghttp3_mem *mem = ctx->mem;
   size_t space;
+  size_t ent_space;
   size_t i;
   int rv;
 
@@ -2061,7 +2113,10 @@ int nghttp3_qpack_context_dtable_add(nghttp3_qpack_context *ctx,
     assert(i);
     ent = *(nghttp3_qpack_entry **)nghttp3_ringbuf_get(&ctx->dtable, i - 1);
 
-    ctx->dtable_size -= table_space(ent->nv.name->len, ent->nv.value->len);
+    ent_space = table_space(ent->nv.name->len, ent->nv.value->len);
+    ctx->dtable_size -= ent_space;
+
+    NGHTTP3_PROBE3(qpack_dtable_evict, ctx, ent->absidx, ent_space);
 
     nghttp3_ringbuf_pop_back(&ctx->dtable);
     if (dtable_map) {
@@ -2072,7 +2127,8 @@ int nghttp3_qpack_context_dtable_add(nghttp3_qpack_context *ctx,
     nghttp3_mem_free(mem, ent);
   }
 
-  new_ent = nghttp3_mem_malloc(mem, sizeof(nghttp3_qpack_entry));
+  new_ent = nghttp3_mem_malloc_tag(mem, NGHTTP3_MEM_TAG_QPACK_ENTRY,
+                                   sizeof(nghttp3_qpack_entry));
   if (new_ent == NULL) {
     return NGHTTP3_ERR_NOMEM;
   }
@@ -2098,6 +2154,8 @@ int nghttp3_qpack_context_dtable_add(nghttp3_qpack_context *ctx,
   ctx->dtable_size += space;
   ctx->dtable_sum += space;
 
+  NGHTTP3_PROBE3(qpack_dtable_insert, ctx, new_ent->absidx, space);
+
   return 0;
 
 fail:
@@ -2131,6 +2189,12 @@ int nghttp3_qpack_encoder_dtable_static_add(nghttp3_qpack_encoder *encoder,
 
   rv = nghttp3_qpack_context_dtable_add(&encoder->ctx, &qnv,
                                         &encoder->dtable_map, hash);
+  if (rv == 0 && encoder->ctx.trace) {
+    qpack_context_trace(&encoder->ctx,
+                        NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT,
+                        NGHTTP3_TRACE_QPACK_INSERT_WITH_STATIC_NAME_REF,
+                        absidx);
+  }
 
   nghttp3_rcbuf_decref(qnv.value);
 
@@ -2161,6 +2225,12 @@ int nghttp3_qpack_encoder_dtable_dynamic_add(nghttp3_qpack_encoder *encoder,
 
   rv = nghttp3_qpack_context_dtable_add(&encoder->ctx, &qnv,
                                         &encoder->dtable_map, hash);
+  if (rv == 0 && encoder->ctx.trace) {
+    qpack_context_trace(&encoder->ctx,
+                        NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT,
+                        NGHTTP3_TRACE_QPACK_INSERT_WITH_DYNAMIC_NAME_REF,
+                        absidx);
+  }
 
   nghttp3_rcbuf_decref(qnv.value);
   nghttp3_rcbuf_decref(qnv.name);
@@ -2182,6 +2252,11 @@ int nghttp3_qpack_encoder_dtable_duplicate_add(nghttp3_qpack_encoder *encoder,
 
   rv = nghttp3_qpack_context_dtable_add(&encoder->ctx, &qnv,
                                         &encoder->dtable_map, ent->hash);
+  if (rv == 0 && encoder->ctx.trace) {
+    qpack_context_trace(&encoder->ctx,
+                        NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT,
+                        NGHTTP3_TRACE_QPACK_DUPLICATE, absidx);
+  }
 
   nghttp3_rcbuf_decref(qnv.name);
   nghttp3_rcbuf_decref(qnv.value);
@@ -2212,6 +2287,11 @@ int nghttp3_qpack_encoder_dtable_literal_add(nghttp3_qpack_encoder *encoder,
 
   rv = nghttp3_qpack_context_dtable_add(&encoder->ctx, &qnv,
                                         &encoder->dtable_map, hash);
+  if (rv == 0 && encoder->ctx.trace) {
+    qpack_context_trace(&encoder->ctx,
+                        NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT,
+                        NGHTTP3_TRACE_QPACK_INSERT_WITH_LITERAL_NAME, 0);
+  }
 
   nghttp3_rcbuf_decref(qnv.value);
   nghttp3_rcbuf_decref(qnv.name);
@@ -2244,6 +2324,7 @@ void nghttp3_qpack_entry_init(nghttp3_qpack_entry *ent, nghttp3_qpack_nv *qnv,
   ent->sum = sum;
   ent->absidx = absidx;
   ent->hash = hash;
+  ent->verdict = 0;
 
   nghttp3_rcbuf_incref(ent->nv.name);
   nghttp3_rcbuf_incref(ent->nv.value);
@@ -2507,6 +2588,24 @@ static nghttp3_ssize qpack_read_varint(int *fin,
   return (nghttp3_ssize)(p + 1 - begin);
 }
 
+/*
+ * qpack_encoder_trace_instruction returns the trace event instruction
+ * which corresponds to decoder stream instruction |opcode|.
+ */
+static uint32_t
+qpack_encoder_trace_instruction(nghttp3_qpack_decoder_stream_opcode opcode) {
+  switch (opcode) {
+  case NGHTTP3_QPACK_DS_OPCODE_ICNT_INCREMENT:
+    return NGHTTP3_TRACE_QPACK_INSERT_COUNT_INCREMENT;
+  case NGHTTP3_QPACK_DS_OPCODE_SECTION_ACK:
+    return NGHTTP3_TRACE_QPACK_SECTION_ACK;
+  case NGHTTP3_QPACK_DS_OPCODE_STREAM_CANCEL:
+    return NGHTTP3_TRACE_QPACK_STREAM_CANCEL;
+  default:
+    nghttp3_unreachable();
+  }
+}
+
 nghttp3_ssize nghttp3_qpack_encoder_read_decoder(nghttp3_qpack_encoder *encoder,
                                                  const uint8_t *src,
                                                  size_t srclen) {
@@ -2579,6 +2678,13 @@ nghttp3_ssize nghttp3_qpack_encoder_read_decoder(nghttp3_qpack_encoder *encoder,
         nghttp3_unreachable();
       }
 
+      if (encoder->ctx.trace) {
+        qpack_context_trace(&encoder->ctx,
+                            NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_RECV,
+                            qpack_encoder_trace_instruction(encoder->opcode),
+                            encoder->rstate.left);
+      }
+
       encoder->state = NGHTTP3_QPACK_DS_STATE_OPCODE;
       nghttp3_qpack_read_state_reset(&encoder->rstate);
       break;
@@ -2652,6 +2758,8 @@ void nghttp3_qpack_read_state_reset(nghttp3_qpack_read_state *rstate) {
   rstate->never = 0;
   rstate->dynamic = 0;
   rstate->huffman_encoded = 0;
+  rstate->namecls = 0;
+  rstate->valuecls = 0;
 }
 
 int nghttp3_qpack_decoder_init(nghttp3_qpack_decoder *decoder,
@@ -2670,6 +2778,7 @@ int nghttp3_qpack_decoder_init(nghttp3_qpack_decoder *decoder,
   decoder->opcode = 0;
   decoder->written_icnt = 0;
   decoder->max_concurrent_streams = 0;
+  decoder->validator = NULL;
 
   nghttp3_qpack_read_state_reset(&decoder->rstate);
   nghttp3_buf_init(&decoder->dbuf);
@@ -2677,16 +2786,56 @@ int nghttp3_qpack_decoder_init(nghttp3_qpack_decoder *decoder,
   return 0;
 }
 
+void nghttp3_qpack_decoder_set_field_validator(
+    nghttp3_qpack_decoder *decoder,
+    const nghttp3_qpack_field_validator *validator) {
+  decoder->validator = validator;
+}
+
+void nghttp3_qpack_decoder_set_trace(nghttp3_qpack_decoder *decoder,
+                                     nghttp3_qpack_trace trace,
+                                     void *user_data) {
+  decoder->ctx.trace = trace;
+  decoder->ctx.trace_user_data = user_data;
+}
+
 void nghttp3_qpack_decoder_free(nghttp3_qpack_decoder *decoder) {
   nghttp3_buf_free(&decoder->dbuf, decoder->ctx.mem);
   nghttp3_qpack_read_state_free(&decoder->rstate);
   qpack_context_free(&decoder->ctx);
 }
 
+/*
+ * qpack_decoder_char_class returns the character class table of the
+ * field validator of |decoder|, or NULL if it has none.
+ */
+static const uint8_t *
+qpack_decoder_char_class(nghttp3_qpack_decoder *decoder) {
+  return decoder->validator ? decoder->validator->char_class : NULL;
+}
+
+/*
+ * qpack_classify ORs the character classes of |len| bytes pointed by
+ * |p| looked up in |char_class| into |*pcls|.
+ */
+static void qpack_classify(const uint8_t *char_class, const uint8_t *p,
+                           size_t len, uint8_t *pcls) {
+  const uint8_t *last = p + len;
+  uint8_t cls = *pcls;
+
+  for (; p != last; ++p) {
+    cls |= char_class[*p];
+  }
+
+  *pcls = cls;
+}
+
 /*
  * qpack_read_huffman_string decodes huffman string in buffer [begin,
  * end) and writes the decoded string to |dest|.  This function
- * assumes the buffer pointed by |dest| has enough space.
+ * assumes the buffer pointed by |dest| has enough space.  If
+ * |char_class| is not NULL, the character classes of the decoded
+ * bytes looked up in it are OR-ed into |*pcls|.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -2694,10 +2843,10 @@ void nghttp3_qpack_decoder_free(nghttp3_qpack_decoder *decoder) {
  * NGHTTP3_ERR_QPACK_FATAL
  *     Could not decode huffman string.
  */
-static nghttp3_ssize qpack_read_huffman_string(nghttp3_qpack_read_state *rstate,
-                                               nghttp3_buf *dest,
-                                               const uint8_t *begin,
-                                               const uint8_t *end) {
+static nghttp3_ssize
+qpack_read_huffman_string(nghttp3_qpack_read_state *rstate, nghttp3_buf *dest,
+                          const uint8_t *char_class, uint8_t *pcls,
+                          const uint8_t *begin, const uint8_t *end) {
   nghttp3_ssize nwrite;
   size_t len = (size_t)(end - begin);
   int fin = 0;
@@ -2707,8 +2856,8 @@ static nghttp3_ssize qpack_read_huffman_string(nghttp3_qpack_read_state *rstate,
     fin = 1;
   }
 
-  nwrite = nghttp3_qpack_huffman_decode(&rstate->huffman_ctx, dest->last, begin,
-                                        len, fin);
+  nwrite = nghttp3_qpack_huffman_decode(&rstate->huffman_ctx, dest->last,
+                                        begin, len, fin);
   if (nwrite < 0) {
     return nwrite;
   }
@@ -2717,17 +2866,32 @@ static nghttp3_ssize qpack_read_huffman_string(nghttp3_qpack_read_state *rstate,
     return NGHTTP3_ERR_QPACK_FATAL;
   }
 
+  if (char_class) {
+    qpack_classify(char_class, dest->last, (size_t)nwrite, pcls);
+  }
+
   dest->last += nwrite;
   rstate->left -= len;
   return (nghttp3_ssize)len;
 }
 
+/*
+ * qpack_read_string copies string in buffer [begin, end) to |dest|.
+ * If |char_class| is not NULL, the character classes of the copied
+ * bytes looked up in it are OR-ed into |*pcls|.
+ */
 static nghttp3_ssize qpack_read_string(nghttp3_qpack_read_state *rstate,
-                                       nghttp3_buf *dest, const uint8_t *begin,
+                                       nghttp3_buf *dest,
+                                       const uint8_t *char_class,
+                                       uint8_t *pcls, const uint8_t *begin,
                                        const uint8_t *end) {
   size_t len = (size_t)(end - begin);
   size_t n = (size_t)nghttp3_min((uint64_t)len, rstate->left);
 
+  if (char_class) {
+    qpack_classify(char_class, begin, n, pcls);
+  }
+
   dest->last = nghttp3_cpymem(dest->last, begin, n);
 
   rstate->left -= n;
@@ -2848,6 +3012,13 @@ nghttp3_ssize nghttp3_qpack_decoder_read_encoder(nghttp3_qpack_decoder *decoder,
           goto fail;
         }
 
+        if (decoder->ctx.trace) {
+          qpack_context_trace(&decoder->ctx,
+                              NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_RECV,
+                              NGHTTP3_TRACE_QPACK_SET_DTABLE_CAPACITY,
+                              decoder->rstate.left);
+        }
+
         decoder->state = NGHTTP3_QPACK_ES_STATE_OPCODE;
         nghttp3_qpack_read_state_reset(&decoder->rstate);
         break;
@@ -2923,8 +3094,9 @@ nghttp3_ssize nghttp3_qpack_decoder_read_encoder(nghttp3_qpack_decoder *decoder,
                             decoder->rstate.name->len);
       break;
     case NGHTTP3_QPACK_ES_STATE_READ_NAME_HUFFMAN:
-      nread = qpack_read_huffman_string(&decoder->rstate,
-                                        &decoder->rstate.namebuf, p, end);
+      nread = qpack_read_huffman_string(
+          &decoder->rstate, &decoder->rstate.namebuf,
+          qpack_decoder_char_class(decoder), &decoder->rstate.namecls, p, end);
       if (nread < 0) {
         assert(NGHTTP3_ERR_QPACK_FATAL == nread);
         rv = NGHTTP3_ERR_QPACK_ENCODER_STREAM_ERROR;
@@ -2943,8 +3115,9 @@ nghttp3_ssize nghttp3_qpack_decoder_read_encoder(nghttp3_qpack_decoder *decoder,
       decoder->rstate.prefix = 7;
       break;
     case NGHTTP3_QPACK_ES_STATE_READ_NAME:
-      nread =
-          qpack_read_string(&decoder->rstate, &decoder->rstate.namebuf, p, end);
+      nread = qpack_read_string(
+          &decoder->rstate, &decoder->rstate.namebuf,
+          qpack_decoder_char_class(decoder), &decoder->rstate.namecls, p, end);
       if (nread < 0) {
         rv = (int)nread;
         goto fail;
@@ -3008,8 +3181,9 @@ nghttp3_ssize nghttp3_qpack_decoder_read_encoder(nghttp3_qpack_decoder *decoder,
       busy = 1;
       break;
     case NGHTTP3_QPACK_ES_STATE_READ_VALUE_HUFFMAN:
-      nread = qpack_read_huffman_string(&decoder->rstate,
-                                        &decoder->rstate.valuebuf, p, end);
+      nread = qpack_read_huffman_string(
+          &decoder->rstate, &decoder->rstate.valuebuf,
+          qpack_decoder_char_class(decoder), &decoder->rstate.valuecls, p, end);
       if (nread < 0) {
         assert(NGHTTP3_ERR_QPACK_FATAL == nread);
         rv = NGHTTP3_ERR_QPACK_ENCODER_STREAM_ERROR;
@@ -3042,8 +3216,9 @@ nghttp3_ssize nghttp3_qpack_decoder_read_encoder(nghttp3_qpack_decoder *decoder,
       nghttp3_qpack_read_state_reset(&decoder->rstate);
       break;
     case NGHTTP3_QPACK_ES_STATE_READ_VALUE:
-      nread = qpack_read_string(&decoder->rstate, &decoder->rstate.valuebuf, p,
-                                end);
+      nread = qpack_read_string(
+          &decoder->rstate, &decoder->rstate.valuebuf,
+          qpack_decoder_char_class(decoder), &decoder->rstate.valuecls, p, end);
       if (nread < 0) {
         rv = (int)nread;
         goto fail;
@@ -3088,6 +3263,7 @@ int nghttp3_qpack_decoder_set_max_dtable_capacity(
     nghttp3_qpack_decoder *decoder, size_t max_dtable_capacity) {
   nghttp3_qpack_entry *ent;
   size_t i;
+  size_t space;
   nghttp3_qpack_context *ctx = &decoder->ctx;
   const nghttp3_mem *mem = ctx->mem;
 
@@ -3102,7 +3278,10 @@ int nghttp3_qpack_decoder_set_max_dtable_capacity(
     assert(i);
     ent = *(nghttp3_qpack_entry **)nghttp3_ringbuf_get(&ctx->dtable, i - 1);
 
-    ctx->dtable_size -= table_space(ent->nv.name->len, ent->nv.value->len);
+    space = table_space(ent->nv.name->len, ent->nv.value->len);
+    ctx->dtable_size -= space;
+
+    NGHTTP3_PROBE3(qpack_dtable_evict, ctx, ent->absidx, space);
 
     nghttp3_ringbuf_pop_back(&ctx->dtable);
     nghttp3_qpack_entry_free(ent);
@@ -3125,6 +3304,66 @@ int nghttp3_qpack_decoder_dtable_indexed_add(nghttp3_qpack_decoder *decoder) {
   return nghttp3_qpack_decoder_dtable_static_add(decoder);
 }
 
+/*
+ * qpack_decoder_name_verdict returns the verdict of the name in
+ * |rstate| from its character classes computed while it was decoded.
+ * It returns 0 if |decoder| has no field validator.
+ */
+static uint8_t qpack_decoder_name_verdict(nghttp3_qpack_decoder *decoder,
+                                          nghttp3_qpack_read_state *rstate) {
+  if (!decoder->validator) {
+    return 0;
+  }
+
+  return decoder->validator->name_verdict(
+      rstate->name->base, rstate->name->len, rstate->namecls);
+}
+
+/*
+ * qpack_decoder_value_verdict returns the verdict of the value in
+ * |rstate| whose name is identified by |token| from its character
+ * classes computed while it was decoded.  It returns 0 if |decoder|
+ * has no field validator.
+ */
+static uint8_t qpack_decoder_value_verdict(nghttp3_qpack_decoder *decoder,
+                                           nghttp3_qpack_read_state *rstate,
+                                           int32_t token) {
+  if (!decoder->validator) {
+    return 0;
+  }
+
+  return decoder->validator->value_verdict(
+      token, rstate->value->base, rstate->value->len, rstate->valuecls);
+}
+
+/*
+ * qpack_decoder_name_ref_verdict returns the verdict of the value in
+ * |rstate| paired with the name of dynamic table entry |ent|.  The
+ * verdict of the name is taken from |ent|.  It returns 0 if
+ * |decoder| has no field validator.
+ */
+static uint8_t qpack_decoder_name_ref_verdict(nghttp3_qpack_decoder *decoder,
+                                              nghttp3_qpack_read_state *rstate,
+                                              nghttp3_qpack_entry *ent) {
+  if (!decoder->validator) {
+    return 0;
+  }
+
+  return (uint8_t)((ent->verdict & decoder->validator->name_mask) |
+                   decoder->validator->value_verdict(
+                       ent->nv.token, rstate->value->base, rstate->value->len,
+                       rstate->valuecls));
+}
+
+/*
+ * qpack_decoder_set_verdict stores |verdict| to the entry that has
+ * just been inserted into dynamic table.
+ */
+static void qpack_decoder_set_verdict(nghttp3_qpack_decoder *decoder,
+                                      uint8_t verdict) {
+  nghttp3_qpack_context_dtable_top(&decoder->ctx)->verdict = verdict;
+}
+
 int nghttp3_qpack_decoder_dtable_static_add(nghttp3_qpack_decoder *decoder) {
   nghttp3_qpack_nv qnv;
   int rv;
@@ -3143,6 +3382,18 @@ int nghttp3_qpack_decoder_dtable_static_add(nghttp3_qpack_decoder *decoder) {
   qnv.flags = NGHTTP3_NV_FLAG_NONE;
 
   rv = nghttp3_qpack_context_dtable_add(&decoder->ctx, &qnv, NULL, 0);
+  if (rv == 0) {
+    qpack_decoder_set_verdict(
+        decoder,
+        qpack_decoder_value_verdict(decoder, &decoder->rstate, shd->token));
+
+    if (decoder->ctx.trace) {
+      qpack_context_trace(&decoder->ctx,
+                          NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_RECV,
+                          NGHTTP3_TRACE_QPACK_INSERT_WITH_STATIC_NAME_REF,
+                          decoder->rstate.absidx);
+    }
+  }
 
   nghttp3_rcbuf_decref(qnv.value);
 
@@ -3153,6 +3404,7 @@ int nghttp3_qpack_decoder_dtable_dynamic_add(nghttp3_qpack_decoder *decoder) {
   nghttp3_qpack_nv qnv;
   int rv;
   nghttp3_qpack_entry *ent;
+  uint8_t verdict;
 
   ent = nghttp3_qpack_context_dtable_get(&decoder->ctx, decoder->rstate.absidx);
 
@@ -3166,9 +3418,22 @@ int nghttp3_qpack_decoder_dtable_dynamic_add(nghttp3_qpack_decoder *decoder) {
   qnv.token = ent->nv.token;
   qnv.flags = NGHTTP3_NV_FLAG_NONE;
 
+  /* ent might be evicted by the insertion below. */
+  verdict = qpack_decoder_name_ref_verdict(decoder, &decoder->rstate, ent);
+
   nghttp3_rcbuf_incref(qnv.name);
 
   rv = nghttp3_qpack_context_dtable_add(&decoder->ctx, &qnv, NULL, 0);
+  if (rv == 0) {
+    qpack_decoder_set_verdict(decoder, verdict);
+
+    if (decoder->ctx.trace) {
+      qpack_context_trace(&decoder->ctx,
+                          NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_RECV,
+                          NGHTTP3_TRACE_QPACK_INSERT_WITH_DYNAMIC_NAME_REF,
+                          decoder->rstate.absidx);
+    }
+  }
 
   nghttp3_rcbuf_decref(qnv.value);
   nghttp3_rcbuf_decref(qnv.name);
@@ -3180,6 +3445,7 @@ int nghttp3_qpack_decoder_dtable_duplicate_add(nghttp3_qpack_decoder *decoder) {
   int rv;
   nghttp3_qpack_entry *ent;
   nghttp3_qpack_nv qnv;
+  uint8_t verdict;
 
   DEBUGF("qpack::decode: Insert duplicate absidx=%" PRIu64 "\n",
          decoder->rstate.absidx);
@@ -3192,10 +3458,22 @@ int nghttp3_qpack_decoder_dtable_duplicate_add(nghttp3_qpack_decoder *decoder) {
   }
 
   qnv = ent->nv;
+  /* ent might be evicted by the insertion below. */
+  verdict = ent->verdict;
   nghttp3_rcbuf_incref(qnv.name);
   nghttp3_rcbuf_incref(qnv.value);
 
   rv = nghttp3_qpack_context_dtable_add(&decoder->ctx, &qnv, NULL, 0);
+  if (rv == 0) {
+    qpack_decoder_set_verdict(decoder, verdict);
+
+    if (decoder->ctx.trace) {
+      qpack_context_trace(&decoder->ctx,
+                          NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_RECV,
+                          NGHTTP3_TRACE_QPACK_DUPLICATE,
+                          decoder->rstate.absidx);
+    }
+  }
 
   nghttp3_rcbuf_decref(qnv.value);
   nghttp3_rcbuf_decref(qnv.name);
@@ -3222,6 +3500,19 @@ int nghttp3_qpack_decoder_dtable_literal_add(nghttp3_qpack_decoder *decoder) {
   qnv.flags = NGHTTP3_NV_FLAG_NONE;
 
   rv = nghttp3_qpack_context_dtable_add(&decoder->ctx, &qnv, NULL, 0);
+  if (rv == 0) {
+    qpack_decoder_set_verdict(
+        decoder,
+        (uint8_t)(qpack_decoder_name_verdict(decoder, &decoder->rstate) |
+                  qpack_decoder_value_verdict(decoder, &decoder->rstate,
+                                              qnv.token)));
+
+    if (decoder->ctx.trace) {
+      qpack_context_trace(&decoder->ctx,
+                          NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_RECV,
+                          NGHTTP3_TRACE_QPACK_INSERT_WITH_LITERAL_NAME, 0);
+    }
+  }
 
   nghttp3_rcbuf_decref(qnv.value);
   nghttp3_rcbuf_decref(qnv.name);
@@ -3248,6 +3539,7 @@ void nghttp3_qpack_stream_context_init(nghttp3_qpack_stream_context *sctx,
   sctx->ricnt = 0;
   sctx->dbase_sign = 0;
   sctx->base = 0;
+  sctx->verdict = 0;
 }
 
 void nghttp3_qpack_stream_context_free(nghttp3_qpack_stream_context *sctx) {
@@ -3494,8 +3786,9 @@ nghttp3_qpack_decoder_read_request(nghttp3_qpack_decoder *decoder,
                             sctx->rstate.name->len);
       break;
     case NGHTTP3_QPACK_RS_STATE_READ_NAME_HUFFMAN:
-      nread = qpack_read_huffman_string(&sctx->rstate, &sctx->rstate.namebuf, p,
-                                        end);
+      nread = qpack_read_huffman_string(
+          &sctx->rstate, &sctx->rstate.namebuf,
+          qpack_decoder_char_class(decoder), &sctx->rstate.namecls, p, end);
       if (nread < 0) {
         assert(NGHTTP3_ERR_QPACK_FATAL == nread);
         rv = NGHTTP3_ERR_QPACK_DECOMPRESSION_FAILED;
@@ -3514,7 +3807,9 @@ nghttp3_qpack_decoder_read_request(nghttp3_qpack_decoder *decoder,
       sctx->rstate.prefix = 7;
       break;
     case NGHTTP3_QPACK_RS_STATE_READ_NAME:
-      nread = qpack_read_string(&sctx->rstate, &sctx->rstate.namebuf, p, end);
+      nread = qpack_read_string(
+          &sctx->rstate, &sctx->rstate.namebuf,
+          qpack_decoder_char_class(decoder), &sctx->rstate.namecls, p, end);
       if (nread < 0) {
         rv = (int)nread;
         goto fail;
@@ -3577,8 +3872,9 @@ nghttp3_qpack_decoder_read_request(nghttp3_qpack_decoder *decoder,
       busy = 1;
       break;
     case NGHTTP3_QPACK_RS_STATE_READ_VALUE_HUFFMAN:
-      nread = qpack_read_huffman_string(&sctx->rstate, &sctx->rstate.valuebuf,
-                                        p, end);
+      nread = qpack_read_huffman_string(
+          &sctx->rstate, &sctx->rstate.valuebuf,
+          qpack_decoder_char_class(decoder), &sctx->rstate.valuecls, p, end);
       if (nread < 0) {
         assert(NGHTTP3_ERR_QPACK_FATAL == nread);
         rv = NGHTTP3_ERR_QPACK_DECOMPRESSION_FAILED;
@@ -3616,7 +3912,9 @@ nghttp3_qpack_decoder_read_request(nghttp3_qpack_decoder *decoder,
 
       return p - src;
     case NGHTTP3_QPACK_RS_STATE_READ_VALUE:
-      nread = qpack_read_string(&sctx->rstate, &sctx->rstate.valuebuf, p, end);
+      nread = qpack_read_string(
+          &sctx->rstate, &sctx->rstate.valuebuf,
+          qpack_decoder_char_class(decoder), &sctx->rstate.valuecls, p, end);
       if (nread < 0) {
         rv = (int)nread;
         goto fail;
@@ -3719,6 +4017,13 @@ int nghttp3_qpack_decoder_write_section_ack(
     decoder->written_icnt = sctx->ricnt;
   }
 
+  if (decoder->ctx.trace) {
+    qpack_context_trace(&decoder->ctx,
+                        NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT,
+                        NGHTTP3_TRACE_QPACK_SECTION_ACK,
+                        (uint64_t)sctx->stream_id);
+  }
+
   return 0;
 }
 
@@ -3760,6 +4065,12 @@ void nghttp3_qpack_decoder_write_decoder(nghttp3_qpack_decoder *decoder,
     dbuf->last = nghttp3_qpack_put_varint(p, n, 6);
 
     decoder->written_icnt = decoder->ctx.next_absidx;
+
+    if (decoder->ctx.trace) {
+      qpack_context_trace(&decoder->ctx,
+                          NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT,
+                          NGHTTP3_TRACE_QPACK_INSERT_COUNT_INCREMENT, n);
+    }
   }
 
   nghttp3_buf_reset(&decoder->dbuf);
@@ -3785,6 +4096,13 @@ int nghttp3_qpack_decoder_cancel_stream(nghttp3_qpack_decoder *decoder,
   *p = 0x40;
   decoder->dbuf.last = nghttp3_qpack_put_varint(p, (uint64_t)stream_id, 6);
 
+  if (decoder->ctx.trace) {
+    qpack_context_trace(&decoder->ctx,
+                        NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT,
+                        NGHTTP3_TRACE_QPACK_STREAM_CANCEL,
+                        (uint64_t)stream_id);
+  }
+
   return 0;
 }
 
@@ -3903,6 +4221,7 @@ qpack_decoder_emit_static_indexed(nghttp3_qpack_decoder *decoder,
   nv->value = (nghttp3_rcbuf *)&shd->value;
   nv->token = shd->token;
   nv->flags = NGHTTP3_NV_FLAG_NONE;
+  sctx->verdict = 0;
 }
 
 static void
@@ -3913,6 +4232,9 @@ qpack_decoder_emit_dynamic_indexed(nghttp3_qpack_decoder *decoder,
       nghttp3_qpack_context_dtable_get(&decoder->ctx, sctx->rstate.absidx);
 
   *nv = ent->nv;
+  sctx->verdict = ent->verdict;
+
+  ++decoder->ctx.dtable_hits;
 
   nghttp3_rcbuf_incref(nv->name);
   nghttp3_rcbuf_incref(nv->value);
@@ -3936,13 +4258,14 @@ qpack_decoder_emit_static_indexed_name(nghttp3_qpack_decoder *decoder,
                                        nghttp3_qpack_stream_context *sctx,
                                        nghttp3_qpack_nv *nv) {
   const nghttp3_qpack_static_header *shd = &stable[sctx->rstate.absidx];
-  (void)decoder;
 
   nv->name = (nghttp3_rcbuf *)&shd->name;
   nv->value = sctx->rstate.value;
   nv->token = shd->token;
   nv->flags =
       sctx->rstate.never ? NGHTTP3_NV_FLAG_NEVER_INDEX : NGHTTP3_NV_FLAG_NONE;
+  sctx->verdict =
+      qpack_decoder_value_verdict(decoder, &sctx->rstate, shd->token);
 
   sctx->rstate.value = NULL;
 }
@@ -3961,11 +4284,14 @@ qpack_decoder_emit_dynamic_indexed_name(nghttp3_qpack_decoder *decoder,
 
   ent = nghttp3_qpack_context_dtable_get(&decoder->ctx, sctx->rstate.absidx);
 
+  ++decoder->ctx.dtable_hits;
+
   nv->name = ent->nv.name;
   nv->value = sctx->rstate.value;
   nv->token = ent->nv.token;
   nv->flags =
       sctx->rstate.never ? NGHTTP3_NV_FLAG_NEVER_INDEX : NGHTTP3_NV_FLAG_NONE;
+  sctx->verdict = qpack_decoder_name_ref_verdict(decoder, &sctx->rstate, ent);
 
   nghttp3_rcbuf_incref(nv->name);
 
@@ -3995,8 +4321,6 @@ int nghttp3_qpack_decoder_emit_indexed_name(nghttp3_qpack_decoder *decoder,
 void nghttp3_qpack_decoder_emit_literal(nghttp3_qpack_decoder *decoder,
                                         nghttp3_qpack_stream_context *sctx,
                                         nghttp3_qpack_nv *nv) {
-  (void)decoder;
-
   DEBUGF("qpack::decode: Emit literal name=%*s value=%*s\n",
          (int)sctx->rstate.name->len, sctx->rstate.name->base,
          (int)sctx->rstate.value->len, sctx->rstate.value->base);
@@ -4006,6 +4330,9 @@ void nghttp3_qpack_decoder_emit_literal(nghttp3_qpack_decoder *decoder,
   nv->token = qpack_lookup_token(nv->name->base, nv->name->len);
   nv->flags =
       sctx->rstate.never ? NGHTTP3_NV_FLAG_NEVER_INDEX : NGHTTP3_NV_FLAG_NONE;
+  sctx->verdict =
+      (uint8_t)(qpack_decoder_name_verdict(decoder, &sctx->rstate) |
+                qpack_decoder_value_verdict(decoder, &sctx->rstate, nv->token));
 
   sctx->rstate.name = NULL;
   sctx->rstate.value = NULL;
@@ -4017,7 +4344,8 @@ int nghttp3_qpack_encoder_new(nghttp3_qpack_encoder **pencoder,
   int rv;
   nghttp3_qpack_encoder *p;
 
-  p = nghttp3_mem_malloc(mem, sizeof(nghttp3_qpack_encoder));
+  p = nghttp3_mem_malloc_tag(mem, NGHTTP3_MEM_TAG_QPACK,
+                             sizeof(nghttp3_qpack_encoder));
   if (p == NULL) {
     return NGHTTP3_ERR_NOMEM;
   }
@@ -4050,7 +4378,8 @@ int nghttp3_qpack_stream_context_new(nghttp3_qpack_stream_context **psctx,
                                      const nghttp3_mem *mem) {
   nghttp3_qpack_stream_context *p;
 
-  p = nghttp3_mem_malloc(mem, sizeof(nghttp3_qpack_stream_context));
+  p = nghttp3_mem_malloc_tag(mem, NGHTTP3_MEM_TAG_QPACK,
+                             sizeof(nghttp3_qpack_stream_context));
   if (p == NULL) {
     return NGHTTP3_ERR_NOMEM;
   }
@@ -4082,7 +4411,8 @@ int nghttp3_qpack_decoder_new(nghttp3_qpack_decoder **pdecoder,
   int rv;
   nghttp3_qpack_decoder *p;
 
-  p = nghttp3_mem_malloc(mem, sizeof(nghttp3_qpack_decoder));
+  p = nghttp3_mem_malloc_tag(mem, NGHTTP3_MEM_TAG_QPACK,
+                             sizeof(nghttp3_qpack_decoder));
   if (p == NULL) {
     return NGHTTP3_ERR_NOMEM;
   }
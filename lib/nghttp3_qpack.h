@@ -78,6 +78,10 @@ struct nghttp3_qpack_entry {
   uint64_t absidx;
   /* The hash value for header name (nv.name). */
   uint32_t hash;
+  /* verdict is the cached validation verdict of nv returned by the
+     field validator of decoder.  It is 0 if decoder has no field
+     validator, and it is not used by encoder. */
+  uint8_t verdict;
 };
 
 /* The entry used for static table. */
@@ -144,6 +148,13 @@ void nghttp3_qpack_stream_pop_ref(nghttp3_qpack_stream *stream);
 
 #define NGHTTP3_QPACK_ENTRY_OVERHEAD 32
 
+/*
+ * nghttp3_qpack_trace is a function which is called with the trace
+ * event |ev| when a QPACK instruction is sent or received.
+ */
+typedef void (*nghttp3_qpack_trace)(const nghttp3_trace_event *ev,
+                                    void *user_data);
+
 typedef struct nghttp3_qpack_context {
   /* dtable is a dynamic table */
   nghttp3_ringbuf dtable;
@@ -166,6 +177,13 @@ typedef struct nghttp3_qpack_context {
   /* next_absidx is the next absolute index for nghttp3_qpack_entry.
      It is equivalent to insert count. */
   uint64_t next_absidx;
+  /* dtable_hits is the number of field lines which refer to an entry
+     in dtable. */
+  uint64_t dtable_hits;
+  /* trace, if not NULL, is called with trace_user_data when a QPACK
+     instruction is sent or received. */
+  nghttp3_qpack_trace trace;
+  void *trace_user_data;
   /* If inflate/deflate error occurred, this value is set to 1 and
      further invocation of inflate/deflate will fail with
      NGHTTP3_ERR_QPACK_FATAL. */
@@ -185,6 +203,11 @@ typedef struct nghttp3_qpack_read_state {
   int never;
   int dynamic;
   int huffman_encoded;
+  /* namecls and valuecls are the character classes of name and value
+     OR-ed together while they are decoded.  They are only computed
+     if decoder has a field validator. */
+  uint8_t namecls;
+  uint8_t valuecls;
 } nghttp3_qpack_read_state;
 
 void nghttp3_qpack_read_state_free(nghttp3_qpack_read_state *rstate);
@@ -276,6 +299,15 @@ int nghttp3_qpack_encoder_init(nghttp3_qpack_encoder *encoder,
  */
 void nghttp3_qpack_encoder_free(nghttp3_qpack_encoder *encoder);
 
+/*
+ * nghttp3_qpack_encoder_set_trace makes |encoder| call |trace| with
+ * |user_data| for each QPACK instruction which it generates or
+ * processes.  Pass NULL to |trace| to disable tracing.
+ */
+void nghttp3_qpack_encoder_set_trace(nghttp3_qpack_encoder *encoder,
+                                     nghttp3_qpack_trace trace,
+                                     void *user_data);
+
 /*
  * nghttp3_qpack_encoder_encode_nv encodes |nv|.  It writes request
  * stream into |rbuf| and writes encoder stream into |ebuf|.  |nv| is
@@ -761,6 +793,32 @@ typedef enum nghttp3_qpack_request_stream_opcode {
   NGHTTP3_QPACK_RS_OPCODE_LITERAL,
 } nghttp3_qpack_request_stream_opcode;
 
+/*
+ * nghttp3_qpack_field_validator is a set of functions which
+ * nghttp3_qpack_decoder uses to validate literal field names and
+ * values while it decodes them.  The verdicts are opaque to decoder.
+ * It caches them in dynamic table entries and reports them in
+ * nghttp3_qpack_stream_context.verdict.
+ */
+typedef struct nghttp3_qpack_field_validator {
+  /* char_class maps a byte to its character classes.  The classes of
+     all bytes of a name or a value are OR-ed together while it is
+     decoded. */
+  const uint8_t *char_class;
+  /* name_verdict returns the verdict of field name |name| of length
+     |len| whose character classes are |cls|. */
+  uint8_t (*name_verdict)(const uint8_t *name, size_t len, uint8_t cls);
+  /* value_verdict returns the verdict of field value |value| of
+     length |len| whose field name is identified by |token|, and
+     whose character classes are |cls|. */
+  uint8_t (*value_verdict)(int32_t token, const uint8_t *value, size_t len,
+                           uint8_t cls);
+  /* name_mask is the bits of verdict which name_verdict returns.
+     They are carried over when a new value is paired with the name
+     of a dynamic table entry. */
+  uint8_t name_mask;
+} nghttp3_qpack_field_validator;
+
 struct nghttp3_qpack_decoder {
   nghttp3_qpack_context ctx;
   /* state is a current state of reading encoder stream. */
@@ -779,6 +837,9 @@ struct nghttp3_qpack_decoder {
      unidirectional streams which potentially receives QPACK encoded
      HEADER frame. */
   size_t max_concurrent_streams;
+  /* validator is the field validator, or NULL if fields are not
+     validated while they are decoded. */
+  const nghttp3_qpack_field_validator *validator;
 };
 
 /*
@@ -798,6 +859,27 @@ int nghttp3_qpack_decoder_init(nghttp3_qpack_decoder *decoder,
                                size_t max_blocked_streams,
                                const nghttp3_mem *mem);
 
+/*
+ * nghttp3_qpack_decoder_set_field_validator makes |decoder| validate
+ * literal field names and values with |validator| while they are
+ * decoded.  The result is available in
+ * nghttp3_qpack_stream_context.verdict when a field is emitted.
+ * Pass NULL to |validator| to disable validation.  |validator| must
+ * outlive |decoder|.
+ */
+void nghttp3_qpack_decoder_set_field_validator(
+    nghttp3_qpack_decoder *decoder,
+    const nghttp3_qpack_field_validator *validator);
+
+/*
+ * nghttp3_qpack_decoder_set_trace makes |decoder| call |trace| with
+ * |user_data| for each QPACK instruction which it generates or
+ * processes.  Pass NULL to |trace| to disable tracing.
+ */
+void nghttp3_qpack_decoder_set_trace(nghttp3_qpack_decoder *decoder,
+                                     nghttp3_qpack_trace trace,
+                                     void *user_data);
+
 /*
  * nghttp3_qpack_decoder_free frees memory allocated for |decoder|.
  * This function does not free memory pointed by |decoder|.
@@ -895,6 +977,9 @@ struct nghttp3_qpack_stream_context {
   uint64_t base;
   /* dbase_sign is the delta base sign in Header Block Prefix. */
   int dbase_sign;
+  /* verdict is the validation verdict of the header field that has
+     just been emitted.  It is 0 if decoder has no field validator. */
+  uint8_t verdict;
 };
 
 /*
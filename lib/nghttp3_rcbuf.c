@@ -34,7 +34,8 @@ int nghttp3_rcbuf_new(nghttp3_rcbuf **rcbuf_ptr, size_t size,
                       const nghttp3_mem *mem) {
   uint8_t *p;
 
-  p = nghttp3_mem_malloc(mem, sizeof(nghttp3_rcbuf) + size);
+  p = nghttp3_mem_malloc_tag(mem, NGHTTP3_MEM_TAG_RCBUF,
+                             sizeof(nghttp3_rcbuf) + size);
   if (p == NULL) {
     return NGHTTP3_ERR_NOMEM;
   }
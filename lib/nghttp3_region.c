@@ -0,0 +1,249 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2026 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp3_region.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include "nghttp3_mem.h"
+#include "nghttp3_macro.h"
+
+/* NGHTTP3_REGION_CLASS_LARGE is the size class of large
+   allocations. */
+#define NGHTTP3_REGION_CLASS_LARGE UINT32_MAX
+
+/*
+ * nghttp3_region_hd precedes every object allocated by
+ * nghttp3_region.  Its size is 16 bytes to keep the alignment of the
+ * object.
+ */
+typedef struct nghttp3_region_hd {
+  /* cls is the size class of the object, or
+     NGHTTP3_REGION_CLASS_LARGE. */
+  uint32_t cls;
+  uint32_t pad;
+  /* len is the usable length of the object. */
+  uint64_t len;
+} nghttp3_region_hd;
+
+/* NGHTTP3_REGION_LARGE_HDLEN is the length of nghttp3_region_large
+   rounded up to 16 bytes. */
+#define NGHTTP3_REGION_LARGE_HDLEN                                             \
+  ((sizeof(nghttp3_region_large) + 0xfu) & ~(size_t)0xfu)
+
+static void *region_malloc(size_t size, void *user_data);
+static void region_free(void *ptr, void *user_data);
+static void *region_calloc(size_t nmemb, size_t size, void *user_data);
+static void *region_realloc(void *ptr, size_t size, void *user_data);
+
+void nghttp3_region_init(nghttp3_region *region, const nghttp3_mem *mem) {
+  size_t i;
+
+  nghttp3_balloc_init(&region->balloc, NGHTTP3_REGION_BLKLEN,
+                      NGHTTP3_MEM_TAG_REGION, mem);
+
+  for (i = 0; i < NGHTTP3_REGION_NUM_CLASSES; ++i) {
+    nghttp3_opl_init(&region->free[i]);
+  }
+
+  region->large = NULL;
+
+  region->mem.user_data = region;
+  region->mem.malloc = region_malloc;
+  region->mem.free = region_free;
+  region->mem.calloc = region_calloc;
+  region->mem.realloc = region_realloc;
+}
+
+void nghttp3_region_free(nghttp3_region *region) {
+  nghttp3_region_large *p, *next;
+
+  for (p = region->large; p; p = next) {
+    next = p->next;
+    nghttp3_mem_free(region->balloc.mem, p);
+  }
+
+  region->large = NULL;
+
+  nghttp3_balloc_free(&region->balloc);
+}
+
+const nghttp3_mem *nghttp3_region_get_mem(nghttp3_region *region) {
+  return &region->mem;
+}
+
+/*
+ * region_get_class returns the smallest size class which can hold
+ * |size| bytes, or NGHTTP3_REGION_NUM_CLASSES if there is no such
+ * class.
+ */
+static size_t region_get_class(size_t size) {
+  size_t cls = 0;
+  size_t len = 16;
+
+  for (; len < size && cls < NGHTTP3_REGION_NUM_CLASSES; len <<= 1, ++cls)
+    ;
+
+  return cls;
+}
+
+static void *region_malloc_large(nghttp3_region *region, size_t size) {
+  nghttp3_region_large *large;
+  nghttp3_region_hd *hd;
+
+  if (size > SIZE_MAX - NGHTTP3_REGION_LARGE_HDLEN - sizeof(*hd)) {
+    return NULL;
+  }
+
+  large = nghttp3_mem_malloc_tag(region->balloc.mem, NGHTTP3_MEM_TAG_REGION,
+                                 NGHTTP3_REGION_LARGE_HDLEN + sizeof(*hd) +
+                                     size);
+  if (large == NULL) {
+    return NULL;
+  }
+
+  large->prev = NULL;
+  large->next = region->large;
+  if (region->large) {
+    region->large->prev = large;
+  }
+  region->large = large;
+
+  hd = (nghttp3_region_hd *)(void *)((uint8_t *)large +
+                                     NGHTTP3_REGION_LARGE_HDLEN);
+  hd->cls = NGHTTP3_REGION_CLASS_LARGE;
+  hd->len = size;
+
+  return hd + 1;
+}
+
+static void *region_malloc(size_t size, void *user_data) {
+  nghttp3_region *region = user_data;
+  nghttp3_region_hd *hd;
+  nghttp3_opl_entry *oplent;
+  size_t cls = region_get_class(size);
+  size_t len;
+  int rv;
+
+  if (cls == NGHTTP3_REGION_NUM_CLASSES) {
+    return region_malloc_large(region, size);
+  }
+
+  oplent = nghttp3_opl_pop(&region->free[cls]);
+  if (oplent) {
+    return oplent;
+  }
+
+  len = (size_t)16 << cls;
+
+  rv = nghttp3_balloc_get(&region->balloc, (void **)&hd, sizeof(*hd) + len);
+  if (rv != 0) {
+    return NULL;
+  }
+
+  hd->cls = (uint32_t)cls;
+  hd->len = len;
+
+  return hd + 1;
+}
+
+static void region_free(void *ptr, void *user_data) {
+  nghttp3_region *region = user_data;
+  nghttp3_region_hd *hd;
+  nghttp3_region_large *large;
+
+  if (ptr == NULL) {
+    return;
+  }
+
+  hd = (nghttp3_region_hd *)ptr - 1;
+
+  if (hd->cls != NGHTTP3_REGION_CLASS_LARGE) {
+    assert(hd->cls < NGHTTP3_REGION_NUM_CLASSES);
+
+    nghttp3_opl_push(&region->free[hd->cls], ptr);
+
+    return;
+  }
+
+  large = (nghttp3_region_large *)(void *)((uint8_t *)hd -
+                                           NGHTTP3_REGION_LARGE_HDLEN);
+
+  if (large->prev) {
+    large->prev->next = large->next;
+  } else {
+    region->large = large->next;
+  }
+
+  if (large->next) {
+    large->next->prev = large->prev;
+  }
+
+  nghttp3_mem_free(region->balloc.mem, large);
+}
+
+static void *region_calloc(size_t nmemb, size_t size, void *user_data) {
+  void *p;
+
+  if (size && nmemb > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  p = region_malloc(nmemb * size, user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  memset(p, 0, nmemb * size);
+
+  return p;
+}
+
+static void *region_realloc(void *ptr, size_t size, void *user_data) {
+  nghttp3_region_hd *hd;
+  void *p;
+
+  if (ptr == NULL) {
+    return region_malloc(size, user_data);
+  }
+
+  hd = (nghttp3_region_hd *)ptr - 1;
+
+  /* Keep the object unless it gets less than half of its size. */
+  if (size <= hd->len && size > hd->len / 2) {
+    return ptr;
+  }
+
+  p = region_malloc(size, user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  memcpy(p, ptr, (size_t)nghttp3_min(hd->len, (uint64_t)size));
+
+  region_free(ptr, user_data);
+
+  return p;
+}
@@ -0,0 +1,92 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2026 nghttp3 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP3_REGION_H
+#define NGHTTP3_REGION_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <nghttp3/nghttp3.h>
+
+#include "nghttp3_balloc.h"
+#include "nghttp3_opl.h"
+
+/* NGHTTP3_REGION_NUM_CLASSES is the number of size classes.  The
+   usable length of size class i is 16 << i bytes. */
+#define NGHTTP3_REGION_NUM_CLASSES 11
+
+/* NGHTTP3_REGION_BLKLEN is the size of memory block from which
+   objects of size classes are carved. */
+#define NGHTTP3_REGION_BLKLEN 65536
+
+typedef struct nghttp3_region_large nghttp3_region_large;
+
+/*
+ * nghttp3_region_large is the header of an allocation which is too
+ * large for any size class.  Such allocations are made by the
+ * underlying allocator individually, and linked together so that
+ * they are freed by nghttp3_region_free.
+ */
+struct nghttp3_region_large {
+  nghttp3_region_large *prev, *next;
+};
+
+/*
+ * nghttp3_region is a region based memory allocator.  It carves
+ * objects from memory blocks allocated by nghttp3_balloc, and keeps
+ * freed objects in per size class free lists for reuse.  Memory
+ * blocks are never returned to the underlying allocator until
+ * nghttp3_region_free is called, which releases all objects at once.
+ */
+typedef struct nghttp3_region {
+  nghttp3_balloc balloc;
+  /* free is the free lists per size class. */
+  nghttp3_opl free[NGHTTP3_REGION_NUM_CLASSES];
+  /* large is the list of large allocations. */
+  nghttp3_region_large *large;
+  /* mem is the allocator which allocates memory from this object. */
+  nghttp3_mem mem;
+} nghttp3_region;
+
+/*
+ * nghttp3_region_init initializes |region|.  |mem| is the underlying
+ * allocator.
+ */
+void nghttp3_region_init(nghttp3_region *region, const nghttp3_mem *mem);
+
+/*
+ * nghttp3_region_free releases all memory allocated by |region|
+ * including the objects that are not freed yet.
+ */
+void nghttp3_region_free(nghttp3_region *region);
+
+/*
+ * nghttp3_region_get_mem returns the allocator which allocates memory
+ * from |region|.
+ */
+const nghttp3_mem *nghttp3_region_get_mem(nghttp3_region *region);
+
+#endif /* NGHTTP3_REGION_H */
@@ -45,7 +45,7 @@ unsigned int __popcnt(unsigned int x) {
 #endif
 
 int nghttp3_ringbuf_init(nghttp3_ringbuf *rb, size_t nmemb, size_t size,
-                         const nghttp3_mem *mem) {
+                         uint32_t tag, const nghttp3_mem *mem) {
   if (nmemb) {
 #ifdef WIN32
     assert(1 == __popcnt((unsigned int)nmemb));
@@ -53,7 +53,7 @@ int nghttp3_ringbuf_init(nghttp3_ringbuf *rb, size_t nmemb, size_t size,
     assert(1 == __builtin_popcount((unsigned int)nmemb));
 #endif
 
-    rb->buf = nghttp3_mem_malloc(mem, nmemb * size);
+    rb->buf = nghttp3_mem_malloc_tag(mem, tag, nmemb * size);
     if (rb->buf == NULL) {
       return NGHTTP3_ERR_NOMEM;
     }
@@ -66,6 +66,7 @@ int nghttp3_ringbuf_init(nghttp3_ringbuf *rb, size_t nmemb, size_t size,
   rb->size = size;
   rb->first = 0;
   rb->len = 0;
+  rb->tag = tag;
 
   return 0;
 }
@@ -133,7 +134,7 @@ int nghttp3_ringbuf_reserve(nghttp3_ringbuf *rb, size_t nmemb) {
   assert(1 == __builtin_popcount((unsigned int)nmemb));
 #endif
 
-  buf = nghttp3_mem_malloc(rb->mem, nmemb * rb->size);
+  buf = nghttp3_mem_malloc_tag(rb->mem, rb->tag, nmemb * rb->size);
   if (buf == NULL) {
     return NGHTTP3_ERR_NOMEM;
   }
@@ -158,3 +159,44 @@ int nghttp3_ringbuf_reserve(nghttp3_ringbuf *rb, size_t nmemb) {
 
   return 0;
 }
+
+void nghttp3_ringbuf_shrink(nghttp3_ringbuf *rb) {
+  uint8_t *buf;
+  size_t nmemb;
+
+  if (rb->len == 0) {
+    nghttp3_mem_free(rb->mem, rb->buf);
+    rb->buf = NULL;
+    rb->nmemb = 0;
+    rb->first = 0;
+
+    return;
+  }
+
+  for (nmemb = 1; nmemb < rb->len; nmemb *= 2)
+    ;
+
+  if (nmemb >= rb->nmemb) {
+    return;
+  }
+
+  buf = nghttp3_mem_malloc_tag(rb->mem, rb->tag, nmemb * rb->size);
+  if (buf == NULL) {
+    return;
+  }
+
+  if (rb->first + rb->len <= rb->nmemb) {
+    memcpy(buf, rb->buf + rb->first * rb->size, rb->len * rb->size);
+  } else {
+    memcpy(buf, rb->buf + rb->first * rb->size,
+           (rb->nmemb - rb->first) * rb->size);
+    memcpy(buf + (rb->nmemb - rb->first) * rb->size, rb->buf,
+           (rb->len - (rb->nmemb - rb->first)) * rb->size);
+  }
+
+  nghttp3_mem_free(rb->mem, rb->buf);
+
+  rb->buf = buf;
+  rb->nmemb = nmemb;
+  rb->first = 0;
+}
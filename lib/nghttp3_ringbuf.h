@@ -47,12 +47,15 @@ typedef struct nghttp3_ringbuf {
   size_t first;
   /* len is the number of elements actually stored. */
   size_t len;
+  /* tag is the allocation tag of the underlying buffer. */
+  uint32_t tag;
 } nghttp3_ringbuf;
 
 /*
  * nghttp3_ringbuf_init initializes |rb|.  |nmemb| is the number of
  * elements that can be stored in this buffer.  |size| is the size of
- * each element.  |size| must be power of 2.
+ * each element.  |size| must be power of 2.  The underlying buffer is
+ * allocated with allocation tag |tag|.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -61,7 +64,7 @@ typedef struct nghttp3_ringbuf {
  *     Out of memory.
  */
 int nghttp3_ringbuf_init(nghttp3_ringbuf *rb, size_t nmemb, size_t size,
-                         const nghttp3_mem *mem);
+                         uint32_t tag, const nghttp3_mem *mem);
 
 /*
  * nghttp3_ringbuf_free frees resources allocated for |rb|.  This
@@ -110,4 +113,14 @@ int nghttp3_ringbuf_full(nghttp3_ringbuf *rb);
 
 int nghttp3_ringbuf_reserve(nghttp3_ringbuf *rb, size_t nmemb);
 
+/*
+ * nghttp3_ringbuf_shrink releases the excess capacity of |rb|.  If
+ * |rb| is empty, the underlying buffer is freed.  Otherwise, the
+ * capacity is reduced to the smallest power of 2 which is equal to or
+ * larger than the number of stored elements.  The stored elements are
+ * moved, and the pointers to them are invalidated.  If memory
+ * allocation fails, |rb| is left unchanged.
+ */
+void nghttp3_ringbuf_shrink(nghttp3_ringbuf *rb);
+
 #endif /* NGHTTP3_RINGBUF_H */
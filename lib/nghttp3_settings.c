@@ -0,0 +1,59 @@
+/*
+ * nghttp3
+ *
+ * Copyright (c) 2024 nghttp3 contributors
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp3_settings.h"
+
+#include <string.h>
+
+#include "nghttp3_unreachable.h"
+
+const nghttp3_settings *
+nghttp3_settings_convert_to_latest(nghttp3_settings *dest,
+                                   int settings_version,
+                                   const nghttp3_settings *src) {
+  if (settings_version == NGHTTP3_SETTINGS_VERSION) {
+    return src;
+  }
+
+  nghttp3_settings_default(dest);
+
+  memcpy(dest, src, nghttp3_settingslen_version(settings_version));
+
+  return dest;
+}
+
+size_t nghttp3_settingslen_version(int settings_version) {
+  nghttp3_settings settings;
+
+  switch (settings_version) {
+  case NGHTTP3_SETTINGS_VERSION:
+    return sizeof(settings);
+  case NGHTTP3_SETTINGS_V1:
+    return offsetof(nghttp3_settings, h3_datagram) +
+           sizeof(settings.h3_datagram);
+  default:
+    nghttp3_unreachable();
+  }
+}
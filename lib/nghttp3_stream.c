@@ -36,6 +36,7 @@
 #include "nghttp3_http.h"
 #include "nghttp3_vec.h"
 #include "nghttp3_unreachable.h"
+#include "nghttp3_probe.h"
 
 /* NGHTTP3_STREAM_MAX_COPY_THRES is the maximum size of buffer which
    makes a copy to outq. */
@@ -47,6 +48,7 @@
 int nghttp3_stream_new(nghttp3_stream **pstream, int64_t stream_id,
                        const nghttp3_stream_callbacks *callbacks,
                        nghttp3_objalloc *out_chunk_objalloc,
+                       nghttp3_objalloc *in_chunk_objalloc,
                        nghttp3_objalloc *stream_objalloc,
                        const nghttp3_mem *mem) {
   nghttp3_stream *stream = nghttp3_objalloc_stream_get(stream_objalloc);
@@ -58,14 +60,17 @@ int nghttp3_stream_new(nghttp3_stream **pstream, int64_t stream_id,
   memset(stream, 0, sizeof(*stream));
 
   stream->out_chunk_objalloc = out_chunk_objalloc;
+  stream->in_chunk_objalloc = in_chunk_objalloc;
   stream->stream_objalloc = stream_objalloc;
 
   nghttp3_tnode_init(&stream->node, stream_id);
 
-  nghttp3_ringbuf_init(&stream->frq, 0, sizeof(nghttp3_frame_entry), mem);
-  nghttp3_ringbuf_init(&stream->chunks, 0, sizeof(nghttp3_buf), mem);
-  nghttp3_ringbuf_init(&stream->outq, 0, sizeof(nghttp3_typed_buf), mem);
-  nghttp3_ringbuf_init(&stream->inq, 0, sizeof(nghttp3_buf), mem);
+  nghttp3_ringbuf_init(&stream->frq, 0, sizeof(nghttp3_frame_entry),
+                       NGHTTP3_MEM_TAG_STREAM, mem);
+  nghttp3_ringbuf_init(&stream->chunks, 0, sizeof(nghttp3_buf),
+                       NGHTTP3_MEM_TAG_OUT_CHUNK, mem);
+  nghttp3_ringbuf_init(&stream->outq, 0, sizeof(nghttp3_typed_buf),
+                       NGHTTP3_MEM_TAG_OUT_CHUNK, mem);
 
   nghttp3_qpack_stream_context_init(&stream->qpack_sctx, stream_id, mem);
 
@@ -76,6 +81,7 @@ int nghttp3_stream_new(nghttp3_stream **pstream, int64_t stream_id,
   stream->rx.http.content_length = -1;
   stream->rx.http.pri.urgency = NGHTTP3_DEFAULT_URGENCY;
   stream->error_code = NGHTTP3_H3_NO_ERROR;
+  stream->mem_used = sizeof(nghttp3_stream);
 
   if (callbacks) {
     stream->callbacks = *callbacks;
@@ -100,16 +106,43 @@ static void delete_outq(nghttp3_ringbuf *outq, const nghttp3_mem *mem) {
   nghttp3_ringbuf_free(outq);
 }
 
-static void delete_chunks(nghttp3_ringbuf *chunks, const nghttp3_mem *mem) {
-  nghttp3_buf *buf;
-  size_t i, len = nghttp3_ringbuf_len(chunks);
+/*
+ * in_chunk_class returns the index of the smallest size class of
+ * incoming data buffer which can hold |len| bytes.  If |len| is
+ * larger than the largest class, it returns the largest one.
+ */
+static size_t in_chunk_class(size_t len) {
+  size_t i;
+
+  for (i = 0; i < NGHTTP3_STREAM_NUM_IN_CHUNK_CLASSES - 1; ++i) {
+    if (len <= ((size_t)NGHTTP3_STREAM_MIN_CHUNK_SIZE << (2 * i))) {
+      break;
+    }
+  }
+
+  return i;
+}
+
+static void release_in_chunk(nghttp3_typed_buf *tbuf,
+                             nghttp3_objalloc *in_chunk_objalloc) {
+  if (tbuf->type != NGHTTP3_BUF_TYPE_PRIVATE) {
+    return;
+  }
+
+  nghttp3_objalloc_chunk_release(
+      &in_chunk_objalloc[in_chunk_class(nghttp3_buf_cap(&tbuf->buf))],
+      (nghttp3_chunk *)(void *)tbuf->buf.begin);
+}
+
+static void delete_in_chunks(nghttp3_ringbuf *inq,
+                             nghttp3_objalloc *in_chunk_objalloc) {
+  size_t i, len = nghttp3_ringbuf_len(inq);
 
   for (i = 0; i < len; ++i) {
-    buf = nghttp3_ringbuf_get(chunks, i);
-    nghttp3_buf_free(buf, mem);
+    release_in_chunk(nghttp3_ringbuf_get(inq, i), in_chunk_objalloc);
   }
 
-  nghttp3_ringbuf_free(chunks);
+  nghttp3_ringbuf_free(inq);
 }
 
 static void delete_out_chunks(nghttp3_ringbuf *chunks,
@@ -160,7 +193,11 @@ void nghttp3_stream_del(nghttp3_stream *stream) {
   }
 
   nghttp3_qpack_stream_context_free(&stream->qpack_sctx);
-  delete_chunks(&stream->inq, stream->mem);
+  if (stream->inq) {
+    delete_in_chunks(stream->inq, stream->in_chunk_objalloc);
+    nghttp3_mem_free(stream->mem, stream->inq);
+  }
+  nghttp3_mem_free(stream->mem, stream->ts);
   delete_outq(&stream->outq, stream->mem);
   delete_out_chunks(&stream->chunks, stream->out_chunk_objalloc, stream->mem);
   delete_frq(&stream->frq, stream->mem);
@@ -242,14 +279,15 @@ int nghttp3_stream_frq_add(nghttp3_stream *stream,
   return 0;
 }
 
-int nghttp3_stream_fill_outq(nghttp3_stream *stream) {
+int nghttp3_stream_fill_outq(nghttp3_stream *stream,
+                             uint64_t min_unsent_bytes) {
   nghttp3_ringbuf *frq = &stream->frq;
   nghttp3_frame_entry *frent;
   int data_eof;
   int rv;
 
   for (; nghttp3_ringbuf_len(frq) &&
-         stream->unsent_bytes < NGHTTP3_MIN_UNSENT_BYTES;) {
+         stream->unsent_bytes < min_unsent_bytes;) {
     frent = nghttp3_ringbuf_get(frq, 0);
 
     switch (frent->fr.hd.type) {
@@ -275,6 +313,12 @@ int nghttp3_stream_fill_outq(nghttp3_stream *stream) {
         return 0;
       }
       if (!data_eof) {
+        /* If application gives write budget, keep reading data until
+           the number of unsent bytes reaches |min_unsent_bytes|. */
+        if (stream->conn &&
+            (stream->conn->flags & NGHTTP3_CONN_FLAG_WRITE_BUDGET_SET)) {
+          continue;
+        }
         return 0;
       }
       break;
@@ -303,6 +347,42 @@ int nghttp3_stream_fill_outq(nghttp3_stream *stream) {
   return 0;
 }
 
+/*
+ * stream_count_frame counts an outgoing frame described by |hd| in
+ * the statistics of the connection which |stream| belongs to, and
+ * passes it to the trace callback if it is set.
+ */
+static void stream_count_frame(nghttp3_stream *stream,
+                               const nghttp3_frame_hd *hd) {
+  nghttp3_conn *conn = stream->conn;
+
+  if (conn == NULL) {
+    return;
+  }
+
+  nghttp3_frame_stats_add(conn->stats.tx_frames, hd->type, hd->length);
+
+  if (conn->callbacks.trace) {
+    nghttp3_conn_trace_frame(conn, NGHTTP3_TRACE_EVENT_FRAME_SENT,
+                             stream->node.id, hd);
+  }
+}
+
+/*
+ * nva_len returns the sum of the length of name and value in |nva| of
+ * length |nvlen|.
+ */
+static uint64_t nva_len(const nghttp3_nv *nva, size_t nvlen) {
+  uint64_t n = 0;
+  size_t i;
+
+  for (i = 0; i < nvlen; ++i) {
+    n += nva[i].namelen + nva[i].valuelen;
+  }
+
+  return n;
+}
+
 static void typed_buf_shared_init(nghttp3_typed_buf *tbuf,
                                   const nghttp3_buf *chunk) {
   nghttp3_typed_buf_init(tbuf, chunk, NGHTTP3_BUF_TYPE_SHARED);
@@ -381,6 +461,8 @@ int nghttp3_stream_write_settings(nghttp3_stream *stream,
 
   tbuf.buf.last = chunk->last;
 
+  stream_count_frame(stream, &fr.settings.hd);
+
   return nghttp3_stream_outq_add(stream, &tbuf);
 }
 
@@ -406,6 +488,8 @@ int nghttp3_stream_write_goaway(nghttp3_stream *stream,
 
   tbuf.buf.last = chunk->last;
 
+  stream_count_frame(stream, &fr->hd);
+
   return nghttp3_stream_outq_add(stream, &tbuf);
 }
 
@@ -431,6 +515,8 @@ int nghttp3_stream_write_priority_update(nghttp3_stream *stream,
 
   tbuf.buf.last = chunk->last;
 
+  stream_count_frame(stream, &fr->hd);
+
   return nghttp3_stream_outq_add(stream, &tbuf);
 }
 
@@ -492,6 +578,13 @@ int nghttp3_stream_write_header_block(nghttp3_stream *stream,
 
   chunk->last = nghttp3_frame_write_hd(chunk->last, &hd);
 
+  stream_count_frame(stream, &hd);
+
+  if (stream->conn) {
+    stream->conn->stats.tx_field_bytes += nva_len(nva, nvlen);
+    stream->conn->stats.tx_qpack_encoder_stream_bytes += ebuflen;
+  }
+
   chunk->last = nghttp3_cpymem(chunk->last, pbuf.pos, pbuflen);
   nghttp3_buf_init(&pbuf);
 
@@ -526,7 +619,7 @@ int nghttp3_stream_write_header_block(nghttp3_stream *stream,
     nghttp3_typed_buf_init(&tbuf, ebuf, NGHTTP3_BUF_TYPE_PRIVATE);
     rv = nghttp3_stream_outq_add(qenc_stream, &tbuf);
     if (rv != 0) {
-      return rv;
+      goto fail;
     }
     nghttp3_buf_init(ebuf);
   } else if (ebuflen) {
@@ -557,6 +650,10 @@ int nghttp3_stream_write_header_block(nghttp3_stream *stream,
   return 0;
 
 fail:
+  /* rbuf and ebuf are shared by all streams.  Do not leave the
+     partially written header block in them. */
+  nghttp3_buf_reset(rbuf);
+  nghttp3_buf_reset(ebuf);
 
   return rv;
 }
@@ -589,6 +686,17 @@ int nghttp3_stream_write_data(nghttp3_stream *stream, int *peof,
   if (sveccnt < 0) {
     if (sveccnt == NGHTTP3_ERR_WOULDBLOCK) {
       stream->flags |= NGHTTP3_STREAM_FLAG_READ_DATA_BLOCKED;
+
+      NGHTTP3_PROBE2(read_data_blocked, conn, stream->node.id);
+
+      nghttp3_conn_start_timer(conn, stream,
+                               NGHTTP3_STREAM_TIMER_READ_DATA_BLOCKED);
+
+      if (conn->callbacks.trace) {
+        nghttp3_conn_trace_stream_state(
+            conn, stream->node.id, NGHTTP3_TRACE_STREAM_READ_DATA_BLOCKED, 0);
+      }
+
       return 0;
     }
     return NGHTTP3_ERR_CALLBACK_FAILURE;
@@ -643,6 +751,8 @@ int nghttp3_stream_write_data(nghttp3_stream *stream, int *peof,
 
   tbuf.buf.last = chunk->last;
 
+  stream_count_frame(stream, &hd);
+
   rv = nghttp3_stream_outq_add(stream, &tbuf);
   if (rv != 0) {
     return rv;
@@ -698,6 +808,8 @@ int nghttp3_stream_write_qpack_decoder_stream(nghttp3_stream *stream) {
 
   tbuf.buf.last = chunk->last;
 
+  stream->conn->stats.tx_qpack_decoder_stream_bytes += len;
+
   return nghttp3_stream_outq_add(stream, &tbuf);
 }
 
@@ -716,6 +828,20 @@ int nghttp3_stream_outq_add(nghttp3_stream *stream,
   stream->tx.offset += buflen;
   stream->unsent_bytes += buflen;
 
+  if (stream->conn) {
+    if (stream->tx.offset == buflen && buflen &&
+        nghttp3_client_stream_bidi(stream->node.id)) {
+      nghttp3_conn_start_timer(stream->conn, stream,
+                               NGHTTP3_STREAM_TIMER_FIRST_QUEUED);
+    }
+
+    stream->conn->tx.unsent_bytes += buflen;
+    stream->conn->tx.send_buffered += buflen;
+    stream->conn->stats.max_send_buffered =
+        nghttp3_max(stream->conn->stats.max_send_buffered,
+                    stream->conn->tx.send_buffered);
+  }
+
   if (len) {
     dest = nghttp3_ringbuf_get(outq, len - 1);
     if (dest->type == tbuf->type && dest->type == NGHTTP3_BUF_TYPE_SHARED &&
@@ -746,6 +872,15 @@ int nghttp3_stream_outq_add(nghttp3_stream *stream,
   dest = nghttp3_ringbuf_push_back(outq);
   *dest = *tbuf;
 
+  if (stream->conn) {
+    stream->conn->stats.max_outq_len =
+        nghttp3_max(stream->conn->stats.max_outq_len, len + 1);
+  }
+
+  if (tbuf->type == NGHTTP3_BUF_TYPE_PRIVATE) {
+    nghttp3_stream_add_mem_used(stream, nghttp3_buf_cap(&tbuf->buf));
+  }
+
   return 0;
 }
 
@@ -771,7 +906,7 @@ int nghttp3_stream_ensure_chunk(nghttp3_stream *stream, size_t need) {
     p = (uint8_t *)nghttp3_objalloc_chunk_len_get(stream->out_chunk_objalloc,
                                                   n);
   } else {
-    p = nghttp3_mem_malloc(stream->mem, n);
+    p = nghttp3_mem_malloc_tag(stream->mem, NGHTTP3_MEM_TAG_OUT_CHUNK, n);
   }
   if (p == NULL) {
     return NGHTTP3_ERR_NOMEM;
@@ -788,6 +923,8 @@ int nghttp3_stream_ensure_chunk(nghttp3_stream *stream, size_t need) {
   chunk = nghttp3_ringbuf_push_back(chunks);
   nghttp3_buf_wrap_init(chunk, p, n);
 
+  nghttp3_stream_add_mem_used(stream, n);
+
   return 0;
 }
 
@@ -881,6 +1018,11 @@ void nghttp3_stream_add_outq_offset(nghttp3_stream *stream, size_t n) {
   stream->unsent_bytes -= n;
   stream->outq_idx = i;
   stream->outq_offset = offset;
+
+  if (stream->conn) {
+    assert(stream->conn->tx.unsent_bytes >= n);
+    stream->conn->tx.unsent_bytes -= n;
+  }
 }
 
 int nghttp3_stream_outq_write_done(nghttp3_stream *stream) {
@@ -897,6 +1039,7 @@ static void stream_pop_outq_entry(nghttp3_stream *stream,
 
   switch (tbuf->type) {
   case NGHTTP3_BUF_TYPE_PRIVATE:
+    nghttp3_stream_sub_mem_used(stream, nghttp3_buf_cap(&tbuf->buf));
     nghttp3_buf_free(&tbuf->buf, stream->mem);
     break;
   case NGHTTP3_BUF_TYPE_ALIEN:
@@ -910,6 +1053,8 @@ static void stream_pop_outq_entry(nghttp3_stream *stream,
     assert(chunk->end == tbuf->buf.end);
 
     if (chunk->last == tbuf->buf.last) {
+      nghttp3_stream_sub_mem_used(stream, nghttp3_buf_cap(chunk));
+
       if (nghttp3_buf_cap(chunk) == NGHTTP3_STREAM_MIN_CHUNK_SIZE) {
         nghttp3_objalloc_chunk_release(stream->out_chunk_objalloc,
                                        (nghttp3_chunk *)(void *)chunk->begin);
@@ -935,6 +1080,14 @@ int nghttp3_stream_add_ack_offset(nghttp3_stream *stream, uint64_t n) {
   nghttp3_typed_buf *tbuf;
   int rv;
 
+  nack = nghttp3_min(n, nghttp3_stream_get_send_buffered(stream));
+  stream->tx.nacked += nack;
+
+  if (stream->conn) {
+    assert(stream->conn->tx.send_buffered >= nack);
+    stream->conn->tx.send_buffered -= nack;
+  }
+
   for (; nghttp3_ringbuf_len(outq);) {
     tbuf = nghttp3_ringbuf_get(outq, 0);
     buflen = nghttp3_buf_len(&tbuf->buf);
@@ -981,45 +1134,89 @@ int nghttp3_stream_add_ack_offset(nghttp3_stream *stream, uint64_t n) {
   return 0;
 }
 
+uint64_t nghttp3_stream_get_send_buffered(nghttp3_stream *stream) {
+  return stream->tx.offset - stream->tx.nacked;
+}
+
+static int stream_ensure_inq(nghttp3_stream *stream) {
+  nghttp3_ringbuf *inq = stream->inq;
+  size_t nlen;
+  int rv;
+
+  if (inq == NULL) {
+    inq = nghttp3_mem_malloc_tag(stream->mem, NGHTTP3_MEM_TAG_IN_CHUNK,
+                                 sizeof(nghttp3_ringbuf));
+    if (inq == NULL) {
+      return NGHTTP3_ERR_NOMEM;
+    }
+
+    nghttp3_ringbuf_init(inq, 0, sizeof(nghttp3_typed_buf),
+                         NGHTTP3_MEM_TAG_IN_CHUNK, stream->mem);
+
+    stream->inq = inq;
+
+    nghttp3_stream_add_mem_used(stream, sizeof(nghttp3_ringbuf));
+  }
+
+  if (!nghttp3_ringbuf_full(inq)) {
+    return 0;
+  }
+
+  nlen = nghttp3_max(NGHTTP3_MIN_RBLEN, nghttp3_ringbuf_len(inq) * 2);
+  rv = nghttp3_ringbuf_reserve(inq, nlen);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return 0;
+}
+
 int nghttp3_stream_buffer_data(nghttp3_stream *stream, const uint8_t *data,
                                size_t datalen) {
-  nghttp3_ringbuf *inq = &stream->inq;
-  size_t len = nghttp3_ringbuf_len(inq);
-  nghttp3_buf *buf;
+  nghttp3_ringbuf *inq = stream->inq;
+  size_t len;
+  nghttp3_typed_buf *tbuf;
   size_t nwrite;
   uint8_t *rawbuf;
-  size_t bufleft;
+  size_t cls, chunklen;
   int rv;
 
-  if (len) {
-    buf = nghttp3_ringbuf_get(inq, len - 1);
-    bufleft = nghttp3_buf_left(buf);
-    nwrite = nghttp3_min(datalen, bufleft);
-    buf->last = nghttp3_cpymem(buf->last, data, nwrite);
-    data += nwrite;
-    datalen -= nwrite;
+  if (inq) {
+    len = nghttp3_ringbuf_len(inq);
+
+    if (len) {
+      tbuf = nghttp3_ringbuf_get(inq, len - 1);
+      if (tbuf->type == NGHTTP3_BUF_TYPE_PRIVATE) {
+        nwrite = nghttp3_min(datalen, nghttp3_buf_left(&tbuf->buf));
+        tbuf->buf.last = nghttp3_cpymem(tbuf->buf.last, data, nwrite);
+        data += nwrite;
+        datalen -= nwrite;
+      }
+    }
   }
 
   for (; datalen;) {
-    if (nghttp3_ringbuf_full(inq)) {
-      size_t nlen =
-          nghttp3_max(NGHTTP3_MIN_RBLEN, nghttp3_ringbuf_len(inq) * 2);
-      rv = nghttp3_ringbuf_reserve(inq, nlen);
-      if (rv != 0) {
-        return rv;
-      }
+    rv = stream_ensure_inq(stream);
+    if (rv != 0) {
+      return rv;
     }
 
-    rawbuf = nghttp3_mem_malloc(stream->mem, 16384);
+    cls = in_chunk_class(datalen);
+    chunklen = (size_t)NGHTTP3_STREAM_MIN_CHUNK_SIZE << (2 * cls);
+
+    rawbuf = (uint8_t *)nghttp3_objalloc_chunk_len_get(
+        &stream->in_chunk_objalloc[cls], chunklen);
     if (rawbuf == NULL) {
       return NGHTTP3_ERR_NOMEM;
     }
 
-    buf = nghttp3_ringbuf_push_back(inq);
-    nghttp3_buf_wrap_init(buf, rawbuf, 16384);
-    bufleft = nghttp3_buf_left(buf);
-    nwrite = nghttp3_min(datalen, bufleft);
-    buf->last = nghttp3_cpymem(buf->last, data, nwrite);
+    tbuf = nghttp3_ringbuf_push_back(stream->inq);
+    nghttp3_buf_wrap_init(&tbuf->buf, rawbuf, chunklen);
+    tbuf->type = NGHTTP3_BUF_TYPE_PRIVATE;
+    nghttp3_stream_add_mem_used(stream, chunklen);
+
+    nwrite = nghttp3_min(datalen, chunklen);
+    tbuf->buf.last = nghttp3_cpymem(tbuf->buf.last, data, nwrite);
     data += nwrite;
     datalen -= nwrite;
   }
@@ -1027,20 +1224,106 @@ int nghttp3_stream_buffer_data(nghttp3_stream *stream, const uint8_t *data,
   return 0;
 }
 
+int nghttp3_stream_buffer_data_ref(nghttp3_stream *stream,
+                                   const uint8_t *data, size_t datalen) {
+  nghttp3_typed_buf *tbuf;
+  int rv;
+
+  if (datalen == 0) {
+    return 0;
+  }
+
+  rv = stream_ensure_inq(stream);
+  if (rv != 0) {
+    return rv;
+  }
+
+  tbuf = nghttp3_ringbuf_push_back(stream->inq);
+  nghttp3_buf_wrap_init(&tbuf->buf, (uint8_t *)data, datalen);
+  tbuf->buf.last = tbuf->buf.end;
+  tbuf->type = NGHTTP3_BUF_TYPE_ALIEN;
+  /* The referenced data are pinned on behalf of the stream, and they
+     are subject to the memory limit as if they were copied. */
+  nghttp3_stream_add_mem_used(stream, datalen);
+
+  return 0;
+}
+
+void nghttp3_stream_pop_buffered_data(nghttp3_stream *stream) {
+  nghttp3_typed_buf *tbuf;
+
+  assert(stream->inq);
+  assert(nghttp3_ringbuf_len(stream->inq));
+
+  tbuf = nghttp3_ringbuf_get(stream->inq, 0);
+
+  nghttp3_stream_sub_mem_used(stream, nghttp3_buf_cap(&tbuf->buf));
+  release_in_chunk(tbuf, stream->in_chunk_objalloc);
+
+  nghttp3_ringbuf_pop_front(stream->inq);
+}
+
 size_t nghttp3_stream_get_buffered_datalen(nghttp3_stream *stream) {
-  nghttp3_ringbuf *inq = &stream->inq;
-  size_t len = nghttp3_ringbuf_len(inq);
+  nghttp3_ringbuf *inq = stream->inq;
+  size_t len;
   size_t i, n = 0;
-  nghttp3_buf *buf;
+  nghttp3_typed_buf *tbuf;
+
+  if (inq == NULL) {
+    return 0;
+  }
+
+  len = nghttp3_ringbuf_len(inq);
 
   for (i = 0; i < len; ++i) {
-    buf = nghttp3_ringbuf_get(inq, i);
-    n += nghttp3_buf_len(buf);
+    tbuf = nghttp3_ringbuf_get(inq, i);
+    n += nghttp3_buf_len(&tbuf->buf);
   }
 
   return n;
 }
 
+void nghttp3_stream_add_mem_used(nghttp3_stream *stream, size_t n) {
+  stream->mem_used += n;
+
+  if (stream->conn) {
+    stream->conn->mem_used += n;
+  }
+}
+
+void nghttp3_stream_sub_mem_used(nghttp3_stream *stream, size_t n) {
+  assert(stream->mem_used >= n);
+
+  stream->mem_used -= n;
+
+  if (stream->conn) {
+    assert(stream->conn->mem_used >= n);
+
+    stream->conn->mem_used -= n;
+  }
+}
+
+void nghttp3_stream_compact(nghttp3_stream *stream) {
+  nghttp3_ringbuf_shrink(&stream->frq);
+  nghttp3_ringbuf_shrink(&stream->chunks);
+  nghttp3_ringbuf_shrink(&stream->outq);
+
+  if (stream->inq == NULL) {
+    return;
+  }
+
+  if (nghttp3_ringbuf_len(stream->inq) == 0) {
+    nghttp3_ringbuf_free(stream->inq);
+    nghttp3_mem_free(stream->mem, stream->inq);
+    stream->inq = NULL;
+    nghttp3_stream_sub_mem_used(stream, sizeof(nghttp3_ringbuf));
+
+    return;
+  }
+
+  nghttp3_ringbuf_shrink(stream->inq);
+}
+
 int nghttp3_stream_transit_rx_http_state(nghttp3_stream *stream,
                                          nghttp3_stream_http_event event) {
   int rv;
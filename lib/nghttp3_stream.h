@@ -41,10 +41,22 @@
 
 #define NGHTTP3_STREAM_MIN_CHUNK_SIZE 256
 
+/* NGHTTP3_STREAM_NUM_IN_CHUNK_CLASSES is the number of size classes
+   of the buffers which store the incoming data while a stream is
+   blocked by QPACK decoder.  The size of class i is
+   NGHTTP3_STREAM_MIN_CHUNK_SIZE << (2 * i), that is 256, 1024, 4096,
+   and 16384 bytes. */
+#define NGHTTP3_STREAM_NUM_IN_CHUNK_CLASSES 4
+
 /* NGHTTP3_MIN_UNSENT_BYTES is the minimum unsent bytes which is large
    enough to fill outgoing single QUIC packet. */
 #define NGHTTP3_MIN_UNSENT_BYTES 4096
 
+/* NGHTTP3_MAX_UNSENT_BYTES is the maximum unsent bytes which a stream
+   buffers when an application gives write budget with
+   nghttp3_conn_set_write_budget. */
+#define NGHTTP3_MAX_UNSENT_BYTES (1 << 20)
+
 /* NGHTTP3_STREAM_MIN_WRITELEN is the minimum length of write to cause
    the stream to reschedule. */
 #define NGHTTP3_STREAM_MIN_WRITELEN 800
@@ -133,6 +145,37 @@ typedef struct nghttp3_stream_read_state {
    NGHTTP3_ERR_MALFORMED_HTTP_HEADER error is encountered while
    processing incoming HTTP fields. */
 #define NGHTTP3_STREAM_FLAG_HTTP_ERROR 0x1000u
+/* NGHTTP3_STREAM_FLAG_SEND_BUFFER_HIGH indicates that the number of
+   bytes buffered for sending has reached high watermark and low
+   watermark notification is pending. */
+#define NGHTTP3_STREAM_FLAG_SEND_BUFFER_HIGH 0x2000u
+/* NGHTTP3_STREAM_FLAG_SCHEDULED indicates that a stream is scheduled
+   by an application supplied scheduler. */
+#define NGHTTP3_STREAM_FLAG_SCHEDULED 0x4000u
+
+/* NGHTTP3_TSTAMP_NONE indicates that a timestamp is not recorded. */
+#define NGHTTP3_TSTAMP_NONE UINT64_MAX
+
+/* nghttp3_stream_timer is the index of the start time of a duration
+   measured for nghttp3_conn_stats in nghttp3_stream.ts. */
+typedef enum nghttp3_stream_timer {
+  /* NGHTTP3_STREAM_TIMER_HEADERS starts when HEADERS frame header is
+     received. */
+  NGHTTP3_STREAM_TIMER_HEADERS,
+  /* NGHTTP3_STREAM_TIMER_QPACK_BLOCKED starts when the stream gets
+     blocked by QPACK decoder. */
+  NGHTTP3_STREAM_TIMER_QPACK_BLOCKED,
+  /* NGHTTP3_STREAM_TIMER_READ_DATA_BLOCKED starts when read_data
+     returns NGHTTP3_ERR_WOULDBLOCK. */
+  NGHTTP3_STREAM_TIMER_READ_DATA_BLOCKED,
+  /* NGHTTP3_STREAM_TIMER_SCHED starts when the stream is
+     scheduled. */
+  NGHTTP3_STREAM_TIMER_SCHED,
+  /* NGHTTP3_STREAM_TIMER_FIRST_QUEUED starts when the first byte is
+     queued to outq. */
+  NGHTTP3_STREAM_TIMER_FIRST_QUEUED,
+  NGHTTP3_STREAM_TIMER_MAX,
+} nghttp3_stream_timer;
 
 typedef enum nghttp3_stream_http_state {
   NGHTTP3_HTTP_STATE_NONE,
@@ -202,19 +245,10 @@ typedef struct nghttp3_http_state {
 struct nghttp3_stream {
   union {
     struct {
-      const nghttp3_mem *mem;
-      nghttp3_objalloc *out_chunk_objalloc;
-      nghttp3_objalloc *stream_objalloc;
-      nghttp3_tnode node;
-      nghttp3_pq_entry qpack_blocked_pe;
-      nghttp3_stream_callbacks callbacks;
-      nghttp3_ringbuf frq;
-      nghttp3_ringbuf chunks;
-      nghttp3_ringbuf outq;
-      /* inq stores the stream raw data which cannot be read because
-         stream is blocked by QPACK decoder. */
-      nghttp3_ringbuf inq;
-      nghttp3_qpack_stream_context qpack_sctx;
+      /* The fields below are accessed on every read and write, and
+         they are laid out so that they share the first few cache
+         lines. */
+
       /* conn is a reference to underlying connection.  It could be NULL
          if stream is not a request stream. */
       nghttp3_conn *conn;
@@ -234,22 +268,64 @@ struct nghttp3_stream {
          type NGHTTP3_BUF_TYPE_ALIEN. */
       uint64_t ack_done;
       uint64_t unscheduled_nwrite;
-      nghttp3_stream_type type;
-      nghttp3_stream_read_state rstate;
-      /* error_code indicates the reason of closure of this stream. */
-      uint64_t error_code;
+      /* mem_used is the number of bytes used by this object and the
+         buffers it owns. */
+      uint64_t mem_used;
+      /* qpack_mem_used is the number of bytes of the field being
+         decoded in qpack_sctx.  It is included in mem_used. */
+      size_t qpack_mem_used;
+      nghttp3_ringbuf outq;
+      nghttp3_ringbuf chunks;
+      nghttp3_ringbuf frq;
 
       struct {
         uint64_t offset;
+        /* nacked is the number of bytes acknowledged by peer. */
+        uint64_t nacked;
         nghttp3_stream_http_state hstate;
       } tx;
 
+      uint16_t flags;
+      nghttp3_stream_type type;
+      nghttp3_stream_read_state rstate;
+
       struct {
         nghttp3_stream_http_state hstate;
         nghttp3_http_state http;
       } rx;
 
-      uint16_t flags;
+      nghttp3_tnode node;
+
+      /* The fields below are used less frequently. */
+
+      const nghttp3_mem *mem;
+      nghttp3_objalloc *out_chunk_objalloc;
+      /* in_chunk_objalloc points to the array of
+         NGHTTP3_STREAM_NUM_IN_CHUNK_CLASSES object pools from which
+         the buffers in inq are allocated. */
+      nghttp3_objalloc *in_chunk_objalloc;
+      nghttp3_objalloc *stream_objalloc;
+      nghttp3_stream_callbacks callbacks;
+      nghttp3_pq_entry qpack_blocked_pe;
+      /* error_code indicates the reason of closure of this stream. */
+      uint64_t error_code;
+      /* inq stores the stream raw data which cannot be read because
+         stream is blocked by QPACK decoder.  It is allocated when
+         stream gets blocked for the first time, and NULL otherwise.
+         Its element is nghttp3_typed_buf.  NGHTTP3_BUF_TYPE_PRIVATE
+         buffer is allocated from in_chunk_objalloc, and
+         NGHTTP3_BUF_TYPE_ALIEN buffer refers to the memory lent by
+         an application. */
+      nghttp3_ringbuf *inq;
+      nghttp3_qpack_stream_context qpack_sctx;
+      /* ts points to the array of NGHTTP3_STREAM_TIMER_MAX start
+         times of the durations which are being measured for
+         nghttp3_conn_stats, indexed by nghttp3_stream_timer.  Each of
+         them is NGHTTP3_TSTAMP_NONE if no measurement is in progress.
+         It is allocated when a timer is started for the first time,
+         which only happens if nghttp3_callbacks.get_timestamp is set,
+         and NULL otherwise. */
+      nghttp3_tstamp *ts;
     };
 
     nghttp3_opl_entry oplent;
@@ -273,6 +349,7 @@ typedef struct nghttp3_frame_entry {
 int nghttp3_stream_new(nghttp3_stream **pstream, int64_t stream_id,
                        const nghttp3_stream_callbacks *callbacks,
                        nghttp3_objalloc *out_chunk_objalloc,
+                       nghttp3_objalloc *in_chunk_objalloc,
                        nghttp3_objalloc *stream_objalloc,
                        const nghttp3_mem *mem);
 
@@ -288,7 +365,14 @@ nghttp3_ssize nghttp3_read_varint(nghttp3_varint_read_state *rvint,
 int nghttp3_stream_frq_add(nghttp3_stream *stream,
                            const nghttp3_frame_entry *frent);
 
-int nghttp3_stream_fill_outq(nghttp3_stream *stream);
+/*
+ * nghttp3_stream_fill_outq converts frames queued in frq into bytes in
+ * outq.  It stops if the number of unsent bytes reaches
+ * |min_unsent_bytes|.  Unless an application gives write budget,
+ * nghttp3_read_data_callback is called at most once.
+ */
+int nghttp3_stream_fill_outq(nghttp3_stream *stream,
+                             uint64_t min_unsent_bytes);
 
 int nghttp3_stream_write_stream_type(nghttp3_stream *stream);
 
@@ -338,6 +422,12 @@ int nghttp3_stream_outq_write_done(nghttp3_stream *stream);
 
 int nghttp3_stream_add_ack_offset(nghttp3_stream *stream, uint64_t n);
 
+/*
+ * nghttp3_stream_get_send_buffered returns the number of bytes in
+ * outq which are either unsent or unacknowledged.
+ */
+uint64_t nghttp3_stream_get_send_buffered(nghttp3_stream *stream);
+
 /*
  * nghttp3_stream_is_active returns nonzero if |stream| is active.  In
  * other words, it has something to send.  This function does not take
@@ -352,11 +442,63 @@ int nghttp3_stream_is_active(nghttp3_stream *stream);
  */
 int nghttp3_stream_require_schedule(nghttp3_stream *stream);
 
+/*
+ * nghttp3_stream_buffer_data copies |srclen| bytes of data pointed by
+ * |src| to the end of stream->inq.  A new buffer is allocated from
+ * the smallest size class which can hold the remaining data.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory
+ */
 int nghttp3_stream_buffer_data(nghttp3_stream *stream, const uint8_t *src,
                                size_t srclen);
 
+/*
+ * nghttp3_stream_buffer_data_ref appends a reference to |srclen|
+ * bytes of data pointed by |src| to the end of stream->inq without
+ * copying it.  The memory must be kept alive until the buffer is
+ * removed by nghttp3_stream_pop_buffered_data or the stream is
+ * deleted.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP3_ERR_NOMEM
+ *     Out of memory
+ */
+int nghttp3_stream_buffer_data_ref(nghttp3_stream *stream,
+                                   const uint8_t *src, size_t srclen);
+
+/*
+ * nghttp3_stream_pop_buffered_data removes the first buffer in
+ * stream->inq.  The memory of NGHTTP3_BUF_TYPE_PRIVATE buffer is
+ * returned to its object pool.
+ */
+void nghttp3_stream_pop_buffered_data(nghttp3_stream *stream);
+
 size_t nghttp3_stream_get_buffered_datalen(nghttp3_stream *stream);
 
+/*
+ * nghttp3_stream_add_mem_used adds |n| to the number of bytes used by
+ * |stream| and its connection.
+ */
+void nghttp3_stream_add_mem_used(nghttp3_stream *stream, size_t n);
+
+/*
+ * nghttp3_stream_sub_mem_used subtracts |n| from the number of bytes
+ * used by |stream| and its connection.
+ */
+void nghttp3_stream_sub_mem_used(nghttp3_stream *stream, size_t n);
+
+/*
+ * nghttp3_stream_compact releases the excess capacity of the ring
+ * buffers in |stream|.
+ */
+void nghttp3_stream_compact(nghttp3_stream *stream);
+
 int nghttp3_stream_ensure_qpack_stream_context(nghttp3_stream *stream);
 
 void nghttp3_stream_delete_qpack_stream_context(nghttp3_stream *stream);
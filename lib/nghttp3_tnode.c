@@ -35,6 +35,8 @@ void nghttp3_tnode_init(nghttp3_tnode *tnode, int64_t id) {
   tnode->pe.index = NGHTTP3_PQ_BAD_INDEX;
   tnode->id = id;
   tnode->cycle = 0;
+  tnode->deficit = 0;
+  tnode->deadline = NGHTTP3_TNODE_NO_DEADLINE;
   tnode->pri.urgency = NGHTTP3_DEFAULT_URGENCY;
   tnode->pri.inc = 0;
 }
@@ -90,6 +92,61 @@ int nghttp3_tnode_schedule(nghttp3_tnode *tnode, nghttp3_pq *pq,
   return nghttp3_pq_push(pq, &tnode->pe);
 }
 
+/*
+ * tnode_consume_deficit subtracts |nwrite| from the deficit of
+ * |tnode|, and returns the number of rounds that |tnode| has used up.
+ * The deficit is refilled by |quantum| per round.
+ */
+static uint64_t tnode_consume_deficit(nghttp3_tnode *tnode, uint64_t nwrite,
+                                      uint64_t quantum) {
+  uint64_t over;
+
+  if (nwrite < tnode->deficit) {
+    tnode->deficit -= nwrite;
+    return 0;
+  }
+
+  over = nwrite - tnode->deficit;
+  tnode->deficit = quantum - over % quantum;
+
+  return 1 + over / quantum;
+}
+
+int nghttp3_tnode_schedule_drr(nghttp3_tnode *tnode, nghttp3_pq *pq,
+                               uint64_t nwrite, uint64_t quantum) {
+  uint64_t nround;
+
+  assert(quantum);
+
+  if (!tnode->pri.inc) {
+    return nghttp3_tnode_schedule(tnode, pq, nwrite);
+  }
+
+  if (tnode->pe.index == NGHTTP3_PQ_BAD_INDEX) {
+    tnode->deficit = quantum;
+    tnode->cycle =
+        pq_get_first_cycle(pq) + tnode_consume_deficit(tnode, nwrite, quantum);
+
+    return nghttp3_pq_push(pq, &tnode->pe);
+  }
+
+  nround = tnode_consume_deficit(tnode, nwrite, quantum);
+  if (nround == 0) {
+    return 0;
+  }
+
+  tnode->cycle += nround;
+
+  if (nghttp3_pq_size(pq) == 1) {
+    return 0;
+  }
+
+  nghttp3_pq_remove(pq, &tnode->pe);
+  tnode->pe.index = NGHTTP3_PQ_BAD_INDEX;
+
+  return nghttp3_pq_push(pq, &tnode->pe);
+}
+
 int nghttp3_tnode_is_scheduled(nghttp3_tnode *tnode) {
   return tnode->pe.index != NGHTTP3_PQ_BAD_INDEX;
 }
@@ -35,11 +35,22 @@
 
 #define NGHTTP3_TNODE_MAX_CYCLE_GAP (1llu << 24)
 
+/* NGHTTP3_TNODE_NO_DEADLINE indicates that tnode has no deadline. */
+#define NGHTTP3_TNODE_NO_DEADLINE UINT64_MAX
+
 typedef struct nghttp3_tnode {
   nghttp3_pq_entry pe;
   size_t num_children;
   int64_t id;
   uint64_t cycle;
+  /* deficit is the number of bytes that |tnode| can still write in
+     the current round before it yields to the other nodes.  It is
+     only used by nghttp3_tnode_schedule_drr. */
+  uint64_t deficit;
+  /* deadline is the completion deadline of |tnode|.  Nodes with
+     earlier deadline are scheduled first among the nodes of the same
+     urgency.  NGHTTP3_TNODE_NO_DEADLINE means no deadline. */
+  uint64_t deadline;
   /* pri is a stream priority produced by nghttp3_pri_to_uint8. */
   nghttp3_pri pri;
 } nghttp3_tnode;
@@ -58,6 +69,17 @@ void nghttp3_tnode_unschedule(nghttp3_tnode *tnode, nghttp3_pq *pq);
 int nghttp3_tnode_schedule(nghttp3_tnode *tnode, nghttp3_pq *pq,
                            uint64_t nwrite);
 
+/*
+ * nghttp3_tnode_schedule_drr is a variant of nghttp3_tnode_schedule
+ * which implements deficit round robin for incremental |tnode|.
+ * |tnode| can write up to |quantum| bytes per round, and it is
+ * repositioned in |pq| only when it exhausts its deficit.  |quantum|
+ * must be strictly greater than 0.  If |tnode| is not incremental,
+ * this function behaves like nghttp3_tnode_schedule.
+ */
+int nghttp3_tnode_schedule_drr(nghttp3_tnode *tnode, nghttp3_pq *pq,
+                               uint64_t nwrite, uint64_t quantum);
+
 /*
  * nghttp3_tnode_is_scheduled returns nonzero if |tnode| is scheduled.
  */
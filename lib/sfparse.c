@@ -30,6 +30,14 @@
 #include <assert.h>
 #include <stdlib.h>
 
+/* SF_SIMD is defined if runs of key, token, and string characters are
+   scanned 16 bytes at a time with SSE2 instructions.  Define
+   SF_NO_SIMD to use the byte at a time implementation only. */
+#if defined(__GNUC__) && defined(__SSE2__) && !defined(SF_NO_SIMD)
+#  define SF_SIMD
+#  include <emmintrin.h>
+#endif /* __GNUC__ && __SSE2__ && !SF_NO_SIMD */
+
 #define SF_STATE_DICT 0x08u
 #define SF_STATE_LIST 0x10u
 #define SF_STATE_ITEM 0x18u
@@ -187,6 +195,117 @@ static int is_ws(uint8_t c) {
 
 static int parser_eof(sf_parser *sfp) { return sfp->pos == sfp->end; }
 
+#ifdef SF_SIMD
+/*
+ * in_range returns the mask of the bytes in |x| which are in range
+ * [lo, hi], inclusive.
+ */
+static __m128i in_range(__m128i x, uint8_t lo, uint8_t hi) {
+  __m128i d = _mm_sub_epi8(x, _mm_set1_epi8((char)lo));
+
+  return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8((char)(hi - lo))), d);
+}
+
+static __m128i is_byte(__m128i x, uint8_t c) {
+  return _mm_cmpeq_epi8(x, _mm_set1_epi8((char)c));
+}
+
+/*
+ * skip_run returns the position of the first byte in the block at
+ * |p| which is not in the run given by mask |ok|, or NULL if all 16
+ * bytes are in the run.
+ */
+static const uint8_t *skip_run(const uint8_t *p, __m128i ok) {
+  int m = _mm_movemask_epi8(ok) ^ 0xffff;
+
+  if (m == 0) {
+    return NULL;
+  }
+
+  return p + __builtin_ctz((unsigned int)m);
+}
+
+/*
+ * skip_key_chars returns the position of the first byte in [p, end)
+ * which is not lcalpha, DIGIT, "_", "-", ".", or "*".  Less than 16
+ * bytes at the end are left to the caller.
+ */
+static const uint8_t *skip_key_chars(const uint8_t *p, const uint8_t *end) {
+  __m128i x, ok;
+  const uint8_t *q;
+
+  for (; end - p >= 16; p += 16) {
+    x = _mm_loadu_si128((const __m128i *)(const void *)p);
+    ok = _mm_or_si128(in_range(x, 'a', 'z'), in_range(x, '0', '9'));
+    ok = _mm_or_si128(ok, in_range(x, '-', '.'));
+    ok = _mm_or_si128(ok, is_byte(x, '_'));
+    ok = _mm_or_si128(ok, is_byte(x, '*'));
+
+    q = skip_run(p, ok);
+    if (q) {
+      return q;
+    }
+  }
+
+  return p;
+}
+
+/*
+ * skip_token_chars returns the position of the first byte in [p, end)
+ * which is not tchar, ":", or "/".  Less than 16 bytes at the end are
+ * left to the caller.
+ */
+static const uint8_t *skip_token_chars(const uint8_t *p, const uint8_t *end) {
+  __m128i x, ok;
+  const uint8_t *q;
+
+  for (; end - p >= 16; p += 16) {
+    x = _mm_loadu_si128((const __m128i *)(const void *)p);
+    /* "^", "_", "`", and lcalpha */
+    ok = _mm_or_si128(in_range(x, '^', 'z'), in_range(x, 'A', 'Z'));
+    /* "-", ".", "/", DIGIT, and ":" */
+    ok = _mm_or_si128(ok, in_range(x, '-', ':'));
+    /* "#", "$", "%", "&", and "'" */
+    ok = _mm_or_si128(ok, in_range(x, '#', '\''));
+    ok = _mm_or_si128(ok, in_range(x, '*', '+'));
+    ok = _mm_or_si128(ok, is_byte(x, '!'));
+    ok = _mm_or_si128(ok, is_byte(x, '|'));
+    ok = _mm_or_si128(ok, is_byte(x, '~'));
+
+    q = skip_run(p, ok);
+    if (q) {
+      return q;
+    }
+  }
+
+  return p;
+}
+
+/*
+ * skip_string_chars returns the position of the first byte in [p,
+ * end) which is not allowed in sf-string as is, that is, a byte
+ * which is DQUOTE, "\\", or not in %x20-7E.  Less than 16 bytes at
+ * the end are left to the caller.
+ */
+static const uint8_t *skip_string_chars(const uint8_t *p, const uint8_t *end) {
+  __m128i x, ok;
+  const uint8_t *q;
+
+  for (; end - p >= 16; p += 16) {
+    x = _mm_loadu_si128((const __m128i *)(const void *)p);
+    ok = _mm_andnot_si128(_mm_or_si128(is_byte(x, '"'), is_byte(x, '\\')),
+                          in_range(x, 0x20, 0x7e));
+
+    q = skip_run(p, ok);
+    if (q) {
+      return q;
+    }
+  }
+
+  return p;
+}
+#endif /* SF_SIMD */
+
 static void parser_discard_ows(sf_parser *sfp) {
   for (; !parser_eof(sfp) && is_ws(*sfp->pos); ++sfp->pos)
     ;
@@ -219,6 +338,10 @@ static int parser_key(sf_parser *sfp, sf_vec *dest) {
 
   base = sfp->pos++;
 
+#ifdef SF_SIMD
+  sfp->pos = skip_key_chars(sfp->pos, sfp->end);
+#endif /* SF_SIMD */
+
   for (; !parser_eof(sfp); ++sfp->pos) {
     switch (*sfp->pos) {
     case '_':
@@ -386,6 +509,10 @@ static int parser_string(sf_parser *sfp, sf_value *dest) {
     X20_21_CASES:
     X23_5B_CASES:
     X5D_7E_CASES:
+#ifdef SF_SIMD
+      /* Skip the rest of the run, and stop at its last byte. */
+      sfp->pos = skip_string_chars(sfp->pos + 1, sfp->end) - 1;
+#endif /* SF_SIMD */
       break;
     case '\\':
       ++sfp->pos;
@@ -429,6 +556,10 @@ static int parser_token(sf_parser *sfp, sf_value *dest) {
   /* The first byte has already been validated by the caller. */
   base = sfp->pos++;
 
+#ifdef SF_SIMD
+  sfp->pos = skip_token_chars(sfp->pos, sfp->end);
+#endif /* SF_SIMD */
+
   for (; !parser_eof(sfp); ++sfp->pos) {
     switch (*sfp->pos) {
     case '!':
@@ -1047,7 +1178,7 @@ void sf_unescape(sf_vec *dest, const sf_vec *src) {
   len = src->len;
 
   for (;;) {
-    q = memchr(p, '\\', len);
+    q = (const uint8_t *)memchr(p, '\\', len);
     if (q == NULL) {
       if (len == src->len) {
         *dest = *src;
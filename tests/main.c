@@ -75,6 +75,10 @@ int main(void) {
                    test_nghttp3_qpack_huffman_decode_failure_state) ||
       !CU_add_test(pSuite, "qpack_decoder_reconstruct_ricnt",
                    test_nghttp3_qpack_decoder_reconstruct_ricnt) ||
+      !CU_add_test(pSuite, "qpack_decoder_verdict",
+                   test_nghttp3_qpack_decoder_verdict) ||
+      !CU_add_test(pSuite, "qpack_decoder_validate_fields",
+                   test_nghttp3_qpack_decoder_validate_fields) ||
       !CU_add_test(pSuite, "conn_read_control",
                    test_nghttp3_conn_read_control) ||
       !CU_add_test(pSuite, "conn_write_control",
@@ -121,11 +125,49 @@ int main(void) {
                    test_nghttp3_conn_shutdown_stream_read) ||
       !CU_add_test(pSuite, "conn_stream_data_overflow",
                    test_nghttp3_conn_stream_data_overflow) ||
+      !CU_add_test(pSuite, "conn_write_budget",
+                   test_nghttp3_conn_write_budget) ||
+      !CU_add_test(pSuite, "conn_send_buffer_watermark",
+                   test_nghttp3_conn_send_buffer_watermark) ||
+      !CU_add_test(pSuite, "conn_scheduler", test_nghttp3_conn_scheduler) ||
+      !CU_add_test(pSuite, "conn_scheduler_reset_stream",
+                   test_nghttp3_conn_scheduler_reset_stream) ||
+      !CU_add_test(pSuite, "conn_stream_deadline",
+                   test_nghttp3_conn_stream_deadline) ||
+      !CU_add_test(pSuite, "conn_find_stream", test_nghttp3_conn_find_stream) ||
+      !CU_add_test(pSuite, "conn_compact", test_nghttp3_conn_compact) ||
+      !CU_add_test(pSuite, "conn_memory_limit",
+                   test_nghttp3_conn_memory_limit) ||
+      !CU_add_test(pSuite, "conn_region_allocator",
+                   test_nghttp3_conn_region_allocator) ||
+      !CU_add_test(pSuite, "conn_read_streamv",
+                   test_nghttp3_conn_read_streamv) ||
+      !CU_add_test(pSuite, "conn_read_streams",
+                   test_nghttp3_conn_read_streams) ||
+      !CU_add_test(pSuite, "conn_recv_datav", test_nghttp3_conn_recv_datav) ||
+      !CU_add_test(pSuite, "conn_qpack_unblock_budget",
+                   test_nghttp3_conn_qpack_unblock_budget) ||
+      !CU_add_test(pSuite, "conn_blocked_data_buffer",
+                   test_nghttp3_conn_blocked_data_buffer) ||
+      !CU_add_test(pSuite, "conn_stats", test_nghttp3_conn_stats) ||
+      !CU_add_test(pSuite, "conn_trace", test_nghttp3_conn_trace) ||
+      !CU_add_test(pSuite, "conn_timing", test_nghttp3_conn_timing) ||
+      !CU_add_test(pSuite, "conn_mem_tag", test_nghttp3_conn_mem_tag) ||
+      !CU_add_test(pSuite, "conn_new_versioned",
+                   test_nghttp3_conn_new_versioned) ||
       !CU_add_test(pSuite, "tnode_schedule", test_nghttp3_tnode_schedule) ||
+      !CU_add_test(pSuite, "tnode_schedule_drr",
+                   test_nghttp3_tnode_schedule_drr) ||
       !CU_add_test(pSuite, "http_parse_priority",
                    test_nghttp3_http_parse_priority) ||
+      !CU_add_test(pSuite, "http_parse_priority_long_items",
+                   test_nghttp3_http_parse_priority_long_items) ||
       !CU_add_test(pSuite, "check_header_value",
-                   test_nghttp3_check_header_value)) {
+                   test_nghttp3_check_header_value) ||
+      !CU_add_test(pSuite, "check_header_simd",
+                   test_nghttp3_check_header_simd) ||
+      !CU_add_test(pSuite, "http_field_char_class",
+                   test_nghttp3_http_field_char_class)) {
     CU_cleanup_registry();
     return (int)CU_get_error();
   }
@@ -36,6 +36,8 @@
 #include "nghttp3_vec.h"
 #include "nghttp3_test_helper.h"
 #include "nghttp3_http.h"
+#include "nghttp3_settings.h"
+#include "nghttp3_callbacks.h"
 
 static uint8_t nulldata[4096];
 
@@ -69,6 +71,34 @@ typedef struct {
     size_t ncalled;
     nghttp3_settings settings;
   } recv_settings_cb;
+  struct {
+    size_t nstream_high;
+    size_t nstream_low;
+    size_t nconn_high;
+    size_t nconn_low;
+    uint64_t buffered;
+  } send_buffer_watermark_cb;
+  struct {
+    size_t ncalled;
+    uint64_t datalen;
+  } recv_data_cb;
+  struct {
+    size_t ncalled;
+    size_t veccnt;
+    uint64_t datalen;
+  } recv_datav_cb;
+  struct {
+    size_t ncalled;
+    const uint8_t *data;
+    size_t datalen;
+  } release_blocked_data_cb;
+  struct {
+    size_t nevent;
+    nghttp3_trace_event events[64];
+  } trace_cb;
+  struct {
+    nghttp3_tstamp now;
+  } get_timestamp_cb;
 } userdata;
 
 static int acked_stream_data(nghttp3_conn *conn, int64_t stream_id,
@@ -94,6 +124,51 @@ static int begin_headers(nghttp3_conn *conn, int64_t stream_id, void *user_data,
   return 0;
 }
 
+static int recv_data(nghttp3_conn *conn, int64_t stream_id,
+                     const uint8_t *data, size_t datalen, void *user_data,
+                     void *stream_user_data) {
+  userdata *ud = user_data;
+  (void)conn;
+  (void)stream_id;
+  (void)data;
+  (void)stream_user_data;
+
+  ++ud->recv_data_cb.ncalled;
+  ud->recv_data_cb.datalen += datalen;
+
+  return 0;
+}
+
+static int recv_datav(nghttp3_conn *conn, int64_t stream_id,
+                      const nghttp3_vec *vec, size_t veccnt, void *user_data,
+                      void *stream_user_data) {
+  userdata *ud = user_data;
+  (void)conn;
+  (void)stream_id;
+  (void)stream_user_data;
+
+  ++ud->recv_datav_cb.ncalled;
+  ud->recv_datav_cb.veccnt += veccnt;
+  ud->recv_datav_cb.datalen += nghttp3_vec_len(vec, veccnt);
+
+  return 0;
+}
+
+static int release_blocked_data(nghttp3_conn *conn, int64_t stream_id,
+                                const uint8_t *data, size_t datalen,
+                                void *user_data, void *stream_user_data) {
+  userdata *ud = user_data;
+  (void)conn;
+  (void)stream_id;
+  (void)stream_user_data;
+
+  ++ud->release_blocked_data_cb.ncalled;
+  ud->release_blocked_data_cb.data = data;
+  ud->release_blocked_data_cb.datalen = datalen;
+
+  return 0;
+}
+
 static int recv_header(nghttp3_conn *conn, int64_t stream_id, int32_t token,
                        nghttp3_rcbuf *name, nghttp3_rcbuf *value, uint8_t flags,
                        void *user_data, void *stream_user_data) {
@@ -283,6 +358,95 @@ static int recv_settings(nghttp3_conn *conn, const nghttp3_settings *settings,
   return 0;
 }
 
+static int send_buffer_watermark(nghttp3_conn *conn, int64_t stream_id,
+                                 int high, uint64_t buffered, void *user_data,
+                                 void *stream_user_data) {
+  userdata *ud = user_data;
+
+  (void)conn;
+  (void)stream_user_data;
+
+  if (stream_id == -1) {
+    if (high) {
+      ++ud->send_buffer_watermark_cb.nconn_high;
+    } else {
+      ++ud->send_buffer_watermark_cb.nconn_low;
+    }
+  } else if (high) {
+    ++ud->send_buffer_watermark_cb.nstream_high;
+  } else {
+    ++ud->send_buffer_watermark_cb.nstream_low;
+  }
+
+  ud->send_buffer_watermark_cb.buffered = buffered;
+
+  return 0;
+}
+
+typedef struct {
+  int64_t stream_ids[16];
+  size_t nstream_ids;
+  size_t nschedule;
+  size_t nunschedule;
+  uint64_t nwrite;
+} lifo_sched;
+
+static int lifo_sched_schedule(nghttp3_conn *conn, int64_t stream_id,
+                               const nghttp3_pri *pri, void *sched_user_data) {
+  lifo_sched *sched = sched_user_data;
+
+  (void)conn;
+  (void)pri;
+
+  assert(sched->nstream_ids < nghttp3_arraylen(sched->stream_ids));
+
+  sched->stream_ids[sched->nstream_ids++] = stream_id;
+  ++sched->nschedule;
+
+  return 0;
+}
+
+static void lifo_sched_unschedule(nghttp3_conn *conn, int64_t stream_id,
+                                  void *sched_user_data) {
+  lifo_sched *sched = sched_user_data;
+  size_t i;
+
+  (void)conn;
+
+  for (i = 0; i < sched->nstream_ids; ++i) {
+    if (sched->stream_ids[i] == stream_id) {
+      memmove(&sched->stream_ids[i], &sched->stream_ids[i + 1],
+              sizeof(sched->stream_ids[0]) * (sched->nstream_ids - i - 1));
+      --sched->nstream_ids;
+      break;
+    }
+  }
+
+  ++sched->nunschedule;
+}
+
+static int64_t lifo_sched_next(nghttp3_conn *conn, void *sched_user_data) {
+  lifo_sched *sched = sched_user_data;
+
+  (void)conn;
+
+  if (sched->nstream_ids == 0) {
+    return -1;
+  }
+
+  return sched->stream_ids[sched->nstream_ids - 1];
+}
+
+static void lifo_sched_on_write(nghttp3_conn *conn, int64_t stream_id,
+                                uint64_t n, void *sched_user_data) {
+  lifo_sched *sched = sched_user_data;
+
+  (void)conn;
+  (void)stream_id;
+
+  sched->nwrite += n;
+}
+
 void test_nghttp3_conn_read_control(void) {
   const nghttp3_mem *mem = nghttp3_mem_default();
   nghttp3_conn *conn;
@@ -2301,7 +2465,7 @@ void test_nghttp3_conn_http_error(void) {
   stream = nghttp3_conn_find_stream(conn, 0);
 
   CU_ASSERT(!(stream->flags & NGHTTP3_STREAM_FLAG_HTTP_ERROR));
-  CU_ASSERT(0 != nghttp3_ringbuf_len(&stream->inq));
+  CU_ASSERT(0 != nghttp3_ringbuf_len(stream->inq));
 
   nghttp3_buf_reset(&buf);
   buf.last = nghttp3_put_varint(buf.last, NGHTTP3_STREAM_TYPE_QPACK_ENCODER);
@@ -2316,7 +2480,7 @@ void test_nghttp3_conn_http_error(void) {
 
   CU_ASSERT((nghttp3_ssize)nghttp3_buf_len(&ebuf) == sconsumed);
   CU_ASSERT(stream->flags & NGHTTP3_STREAM_FLAG_HTTP_ERROR);
-  CU_ASSERT(0 == nghttp3_ringbuf_len(&stream->inq));
+  CU_ASSERT(0 == nghttp3_ringbuf_len(stream->inq));
   CU_ASSERT(1 == ud.stop_sending_cb.ncalled);
   CU_ASSERT(0 == ud.stop_sending_cb.stream_id);
   CU_ASSERT(NGHTTP3_H3_MESSAGE_ERROR == ud.stop_sending_cb.app_error_code);
@@ -3582,3 +3746,2773 @@ void test_nghttp3_conn_stream_data_overflow(void) {
   nghttp3_conn_del(conn);
 #endif /* SIZE_MAX > UINT32_MAX */
 }
+
+void test_nghttp3_conn_write_budget(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  const nghttp3_nv nva[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "GET"),
+  };
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  nghttp3_data_reader dr;
+  int fin;
+  userdata ud;
+  nghttp3_stream *stream;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  nghttp3_settings_default(&settings);
+  memset(&ud, 0, sizeof(ud));
+
+  dr.read_data = step_read_data;
+
+  /* Without budget, read_data is called once per write */
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_qpack_streams(conn, 6, 10);
+
+  ud.data.left = 1000000;
+  ud.data.step = 1000;
+
+  rv = nghttp3_conn_submit_request(conn, 0, nva, nghttp3_arraylen(nva), &dr,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt > 0);
+
+    if (stream_id == 0) {
+      break;
+    }
+
+    nghttp3_conn_add_write_offset(conn, stream_id,
+                                  (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+  }
+
+  stream = nghttp3_conn_find_stream(conn, 0);
+
+  CU_ASSERT(stream->unsent_bytes < 2000);
+
+  nghttp3_conn_del(conn);
+
+  /* With budget, stream buffers as much as budget */
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_qpack_streams(conn, 6, 10);
+
+  ud.data.left = 1000000;
+  ud.data.step = 1000;
+
+  rv = nghttp3_conn_submit_request(conn, 0, nva, nghttp3_arraylen(nva), &dr,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_conn_set_write_budget(conn, 65536);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt > 0);
+
+    if (stream_id == 0) {
+      break;
+    }
+
+    nghttp3_conn_add_write_offset(conn, stream_id,
+                                  (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+  }
+
+  stream = nghttp3_conn_find_stream(conn, 0);
+
+  CU_ASSERT(stream->unsent_bytes >= conn->tx.write_budget);
+  CU_ASSERT(conn->tx.write_budget > 65000);
+
+  nghttp3_conn_add_write_offset(conn, 0, 60000);
+
+  CU_ASSERT(conn->tx.write_budget < 6000);
+
+  /* Budget does not go below the minimum write length */
+  nghttp3_conn_set_write_budget(conn, 1);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  CU_ASSERT(0 == stream_id);
+  CU_ASSERT(sveccnt > 0);
+  CU_ASSERT(stream->unsent_bytes >= NGHTTP3_STREAM_MIN_WRITELEN);
+
+  /* Reset to default */
+  nghttp3_conn_set_write_budget(conn, 0);
+
+  CU_ASSERT(!(conn->flags & NGHTTP3_CONN_FLAG_WRITE_BUDGET_SET));
+
+  nghttp3_conn_del(conn);
+
+  /* Budget is shared by all streams in a connection */
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_qpack_streams(conn, 6, 10);
+
+  ud.data.left = 1000000;
+  ud.data.step = 1000;
+
+  rv = nghttp3_conn_submit_request(conn, 0, nva, nghttp3_arraylen(nva), &dr,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_conn_set_write_budget(conn, 65536);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt > 0);
+
+    if (stream_id == 0) {
+      break;
+    }
+
+    nghttp3_conn_add_write_offset(conn, stream_id,
+                                  (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+  }
+
+  stream = nghttp3_conn_find_stream(conn, 0);
+
+  CU_ASSERT(stream->unsent_bytes >= conn->tx.write_budget);
+  CU_ASSERT(conn->tx.unsent_bytes == stream->unsent_bytes);
+
+  /* Stream 0 has used up the budget, and stream 4 only buffers the
+     minimum write length. */
+  nghttp3_conn_unschedule_stream(conn, stream);
+
+  rv = nghttp3_conn_submit_request(conn, 4, nva, nghttp3_arraylen(nva), &dr,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  CU_ASSERT(4 == stream_id);
+  CU_ASSERT(sveccnt > 0);
+
+  stream = nghttp3_conn_find_stream(conn, 4);
+
+  CU_ASSERT(stream->unsent_bytes >= NGHTTP3_STREAM_MIN_WRITELEN);
+  CU_ASSERT(stream->unsent_bytes < 2 * NGHTTP3_STREAM_MIN_WRITELEN);
+
+  stream = nghttp3_conn_find_stream(conn, 0);
+
+  CU_ASSERT(conn->tx.unsent_bytes ==
+            stream->unsent_bytes +
+                nghttp3_conn_find_stream(conn, 4)->unsent_bytes);
+
+  nghttp3_conn_del(conn);
+}
+
+void test_nghttp3_conn_send_buffer_watermark(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  const nghttp3_nv nva[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "GET"),
+  };
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  nghttp3_data_reader dr;
+  int fin;
+  userdata ud;
+  nghttp3_stream *stream;
+  uint64_t buffered;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.send_buffer_watermark = send_buffer_watermark;
+  nghttp3_settings_default(&settings);
+  settings.stream_send_buffer_high_watermark = 3000;
+  settings.stream_send_buffer_low_watermark = 1000;
+  settings.conn_send_buffer_high_watermark = 4000;
+  settings.conn_send_buffer_low_watermark = 100;
+  memset(&ud, 0, sizeof(ud));
+
+  dr.read_data = step_read_data;
+
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_qpack_streams(conn, 6, 10);
+
+  ud.data.left = 10000;
+  ud.data.step = 1000;
+
+  rv = nghttp3_conn_submit_request(conn, 0, nva, nghttp3_arraylen(nva), &dr,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+
+  /* Write data without acknowledgement until stream reaches high
+     watermark. */
+  for (; ud.send_buffer_watermark_cb.nstream_high == 0;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt > 0);
+
+    nghttp3_conn_add_write_offset(conn, stream_id,
+                                  (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+  }
+
+  stream = nghttp3_conn_find_stream(conn, 0);
+  buffered = nghttp3_stream_get_send_buffered(stream);
+
+  CU_ASSERT(buffered >= 3000);
+  CU_ASSERT(buffered == ud.send_buffer_watermark_cb.buffered);
+  CU_ASSERT(0 == ud.send_buffer_watermark_cb.nconn_high);
+  CU_ASSERT(conn->tx.send_buffered > buffered);
+
+  /* Connection reaches high watermark. */
+  for (; ud.send_buffer_watermark_cb.nconn_high == 0;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt > 0);
+
+    nghttp3_conn_add_write_offset(conn, stream_id,
+                                  (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+  }
+
+  CU_ASSERT(1 == ud.send_buffer_watermark_cb.nstream_high);
+  CU_ASSERT(conn->tx.send_buffered >= 4000);
+
+  /* Acknowledging data above low watermark does not notify. */
+  buffered = nghttp3_stream_get_send_buffered(stream);
+  rv = nghttp3_conn_add_ack_offset(conn, 0, buffered - 1001);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ud.send_buffer_watermark_cb.nstream_low);
+
+  rv = nghttp3_conn_add_ack_offset(conn, 0, 1);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == ud.send_buffer_watermark_cb.nstream_low);
+  CU_ASSERT(1000 == ud.send_buffer_watermark_cb.buffered);
+  CU_ASSERT(0 == ud.send_buffer_watermark_cb.nconn_low);
+
+  /* Acknowledge all data on the other streams */
+  rv = nghttp3_conn_add_ack_offset(
+      conn, 6, nghttp3_stream_get_send_buffered(conn->tx.qenc));
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_conn_add_ack_offset(
+      conn, 10, nghttp3_stream_get_send_buffered(conn->tx.qdec));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ud.send_buffer_watermark_cb.nconn_low);
+
+  rv = nghttp3_conn_add_ack_offset(conn, 0, 1000);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == ud.send_buffer_watermark_cb.nconn_low);
+  CU_ASSERT(0 == conn->tx.send_buffered);
+
+  nghttp3_conn_del(conn);
+}
+
+void test_nghttp3_conn_scheduler(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  const nghttp3_nv nva[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "GET"),
+  };
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  int fin;
+  nghttp3_scheduler scheduler;
+  lifo_sched sched;
+  uint64_t nwrite = 0;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  nghttp3_settings_default(&settings);
+  memset(&sched, 0, sizeof(sched));
+  memset(&scheduler, 0, sizeof(scheduler));
+
+  scheduler.schedule = lifo_sched_schedule;
+  scheduler.unschedule = lifo_sched_unschedule;
+  scheduler.user_data = &sched;
+
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, NULL);
+  nghttp3_conn_bind_qpack_streams(conn, 6, 10);
+
+  /* Mandatory callback is missing */
+  rv = nghttp3_conn_set_scheduler(conn, &scheduler);
+
+  CU_ASSERT(NGHTTP3_ERR_INVALID_ARGUMENT == rv);
+
+  scheduler.next = lifo_sched_next;
+  scheduler.on_write = lifo_sched_on_write;
+
+  rv = nghttp3_conn_set_scheduler(conn, &scheduler);
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_conn_set_scheduler(conn, &scheduler);
+
+  CU_ASSERT(NGHTTP3_ERR_INVALID_STATE == rv);
+
+  rv = nghttp3_conn_submit_request(conn, 0, nva, nghttp3_arraylen(nva), NULL,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_conn_submit_request(conn, 4, nva, nghttp3_arraylen(nva), NULL,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == sched.nschedule);
+  CU_ASSERT(2 == sched.nstream_ids);
+  CU_ASSERT(nghttp3_pq_empty(&conn->sched[NGHTTP3_DEFAULT_URGENCY].spq));
+
+  /* QPACK streams are written first */
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt > 0);
+
+    if (!nghttp3_stream_uni(stream_id)) {
+      break;
+    }
+
+    nghttp3_conn_add_write_offset(conn, stream_id,
+                                  (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+  }
+
+  /* Stream scheduled last is written first */
+  CU_ASSERT(4 == stream_id);
+  CU_ASSERT(fin);
+
+  nwrite += nghttp3_vec_len(vec, (size_t)sveccnt);
+  nghttp3_conn_add_write_offset(conn, stream_id,
+                                (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+  CU_ASSERT(1 == sched.nunschedule);
+  CU_ASSERT(1 == sched.nstream_ids);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  CU_ASSERT(sveccnt > 0);
+  CU_ASSERT(0 == stream_id);
+  CU_ASSERT(fin);
+
+  nwrite += nghttp3_vec_len(vec, (size_t)sveccnt);
+  nghttp3_conn_add_write_offset(conn, stream_id,
+                                (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+  CU_ASSERT(2 == sched.nunschedule);
+  CU_ASSERT(0 == sched.nstream_ids);
+
+  CU_ASSERT(nwrite == sched.nwrite);
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  CU_ASSERT(0 == sveccnt);
+  CU_ASSERT(-1 == stream_id);
+
+  nghttp3_conn_del(conn);
+}
+
+void test_nghttp3_conn_scheduler_reset_stream(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  const nghttp3_nv nva[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "GET"),
+  };
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  int fin;
+  nghttp3_scheduler scheduler;
+  lifo_sched sched;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  nghttp3_settings_default(&settings);
+  memset(&sched, 0, sizeof(sched));
+  memset(&scheduler, 0, sizeof(scheduler));
+
+  scheduler.schedule = lifo_sched_schedule;
+  scheduler.unschedule = lifo_sched_unschedule;
+  scheduler.next = lifo_sched_next;
+  scheduler.user_data = &sched;
+
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, NULL);
+  nghttp3_conn_bind_qpack_streams(conn, 6, 10);
+
+  rv = nghttp3_conn_set_scheduler(conn, &scheduler);
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_conn_submit_request(conn, 0, nva, nghttp3_arraylen(nva), NULL,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_conn_submit_request(conn, 4, nva, nghttp3_arraylen(nva), NULL,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt > 0);
+
+    if (!nghttp3_stream_uni(stream_id)) {
+      break;
+    }
+
+    nghttp3_conn_add_write_offset(conn, stream_id,
+                                  (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+  }
+
+  CU_ASSERT(4 == stream_id);
+
+  /* Resetting a scheduled stream unschedules it. */
+  rv = nghttp3_conn_close_stream(conn, 4, NGHTTP3_H3_REQUEST_CANCELLED);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == sched.nunschedule);
+  CU_ASSERT(1 == sched.nstream_ids);
+  CU_ASSERT(0 == sched.stream_ids[0]);
+
+  /* A stale stream ID returned by the scheduler is dropped, and it
+     does not stall the other streams. */
+  sched.stream_ids[sched.nstream_ids++] = 4;
+
+  sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                       nghttp3_arraylen(vec));
+
+  CU_ASSERT(sveccnt > 0);
+  CU_ASSERT(0 == stream_id);
+  CU_ASSERT(2 == sched.nunschedule);
+  CU_ASSERT(1 == sched.nstream_ids);
+
+  nghttp3_conn_del(conn);
+}
+
+void test_nghttp3_conn_stream_deadline(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  const nghttp3_nv nva[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "GET"),
+  };
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  int fin;
+  int64_t stream_ids[3];
+  size_t nstream_ids = 0;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  nghttp3_settings_default(&settings);
+
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, NULL);
+  nghttp3_conn_bind_qpack_streams(conn, 6, 10);
+
+  rv = nghttp3_conn_submit_request(conn, 0, nva, nghttp3_arraylen(nva), NULL,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_conn_submit_request(conn, 4, nva, nghttp3_arraylen(nva), NULL,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_conn_submit_request(conn, 8, nva, nghttp3_arraylen(nva), NULL,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_conn_set_stream_deadline(conn, 8, 100);
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_conn_set_stream_deadline(conn, 4, 200);
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_conn_set_stream_deadline(conn, 2, 200);
+
+  CU_ASSERT(NGHTTP3_ERR_INVALID_ARGUMENT == rv);
+
+  rv = nghttp3_conn_set_stream_deadline(conn, 12, 200);
+
+  CU_ASSERT(NGHTTP3_ERR_STREAM_NOT_FOUND == rv);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt >= 0);
+
+    if (sveccnt <= 0) {
+      break;
+    }
+
+    if (!nghttp3_stream_uni(stream_id)) {
+      assert(nstream_ids < nghttp3_arraylen(stream_ids));
+      stream_ids[nstream_ids++] = stream_id;
+    }
+
+    nghttp3_conn_add_write_offset(conn, stream_id,
+                                  (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+  }
+
+  /* Earliest deadline first, and a stream without deadline comes
+     last. */
+  CU_ASSERT(3 == nstream_ids);
+  CU_ASSERT(8 == stream_ids[0]);
+  CU_ASSERT(4 == stream_ids[1]);
+  CU_ASSERT(0 == stream_ids[2]);
+
+  nghttp3_conn_del(conn);
+}
+
+void test_nghttp3_conn_find_stream(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  nghttp3_stream *stream, *stream2, *stream3;
+  int64_t colliding_id;
+  int rv;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  nghttp3_settings_default(&settings);
+
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, NULL);
+
+  /* Cache is allocated lazily */
+  CU_ASSERT(NULL == conn->stream_cache);
+
+  rv = nghttp3_conn_create_stream(conn, &stream, 0);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGHTTP3_CONN_STREAM_CACHE_DEFAULT_SIZE == conn->stream_cachelen);
+  CU_ASSERT(stream == nghttp3_conn_find_stream(conn, 0));
+
+  colliding_id = (int64_t)conn->stream_cachelen;
+
+  /* Same slot, but different stream type */
+  rv = nghttp3_conn_create_stream(conn, &stream2, 2);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(stream == nghttp3_conn_find_stream(conn, 0));
+  CU_ASSERT(stream2 == nghttp3_conn_find_stream(conn, 2));
+
+  /* Newer stream evicts older one from the slot */
+  rv = nghttp3_conn_create_stream(conn, &stream3, colliding_id);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(stream3 == nghttp3_conn_find_stream(conn, colliding_id));
+  CU_ASSERT(stream == nghttp3_conn_find_stream(conn, 0));
+  CU_ASSERT(NULL == nghttp3_conn_find_stream(conn, colliding_id * 2));
+  CU_ASSERT(NULL == nghttp3_conn_find_stream(conn, 4));
+
+  rv = nghttp3_conn_close_stream(conn, colliding_id, NGHTTP3_H3_NO_ERROR);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == nghttp3_conn_find_stream(conn, colliding_id));
+  CU_ASSERT(stream == nghttp3_conn_find_stream(conn, 0));
+
+  rv = nghttp3_conn_close_stream(conn, 0, NGHTTP3_H3_NO_ERROR);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == nghttp3_conn_find_stream(conn, 0));
+  CU_ASSERT(stream2 == nghttp3_conn_find_stream(conn, 2));
+
+  /* Cache is resized from the hint, and the streams are still found
+     in the map. */
+  nghttp3_conn_set_max_concurrent_streams(conn, 5);
+
+  CU_ASSERT(NULL == conn->stream_cache);
+  CU_ASSERT(stream2 == nghttp3_conn_find_stream(conn, 2));
+
+  rv = nghttp3_conn_create_stream(conn, &stream, 4);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(32 == conn->stream_cachelen);
+  CU_ASSERT(stream == nghttp3_conn_find_stream(conn, 4));
+  CU_ASSERT(stream2 == nghttp3_conn_find_stream(conn, 2));
+
+  nghttp3_conn_del(conn);
+}
+
+static size_t count_memblock(const nghttp3_balloc *balloc) {
+  nghttp3_memblock_hd *hd;
+  size_t n = 0;
+
+  for (hd = balloc->head; hd; hd = hd->next) {
+    ++n;
+  }
+
+  return n;
+}
+
+void test_nghttp3_conn_compact(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  const nghttp3_nv nva[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "GET"),
+  };
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  int rv;
+  int64_t stream_id;
+  int64_t i;
+  nghttp3_data_reader dr;
+  int fin;
+  userdata ud;
+  nghttp3_stream *stream;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  nghttp3_settings_default(&settings);
+  memset(&ud, 0, sizeof(ud));
+
+  dr.read_data = step_read_data;
+
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_qpack_streams(conn, 6, 10);
+
+  for (i = 0; i < 100; ++i) {
+    rv = nghttp3_conn_create_stream(conn, &stream, i * 4);
+
+    CU_ASSERT(0 == rv);
+  }
+
+#ifndef NOMEMPOOL
+  CU_ASSERT(count_memblock(&conn->stream_objalloc.balloc) > 1);
+#endif /* !defined(NOMEMPOOL) */
+
+  for (i = 0; i < 99; ++i) {
+    rv = nghttp3_conn_close_stream(conn, i * 4, NGHTTP3_H3_NO_ERROR);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  nghttp3_conn_compact(conn);
+
+  /* The block which contains the open stream is kept. */
+#ifndef NOMEMPOOL
+  CU_ASSERT(2 == count_memblock(&conn->stream_objalloc.balloc));
+#endif /* !defined(NOMEMPOOL) */
+  CU_ASSERT(NULL != nghttp3_conn_find_stream(conn, 396));
+
+  rv = nghttp3_conn_close_stream(conn, 396, NGHTTP3_H3_NO_ERROR);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_conn_compact(conn);
+
+  /* Only the block which contains QPACK streams remains. */
+#ifndef NOMEMPOOL
+  CU_ASSERT(1 == count_memblock(&conn->stream_objalloc.balloc));
+#endif /* !defined(NOMEMPOOL) */
+  CU_ASSERT(NULL != nghttp3_conn_find_stream(conn, 6));
+  CU_ASSERT(NULL != nghttp3_conn_find_stream(conn, 10));
+
+  /* conn is still usable after compaction */
+  ud.data.left = 2000;
+  ud.data.step = 1000;
+
+  rv = nghttp3_conn_submit_request(conn, 400, nva, nghttp3_arraylen(nva), &dr,
+                                   NULL);
+
+  CU_ASSERT(0 == rv);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt >= 0);
+
+    if (sveccnt <= 0) {
+      break;
+    }
+
+    rv = nghttp3_conn_add_write_offset(
+        conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+    CU_ASSERT(0 == rv);
+
+    if (stream_id == 400 && fin) {
+      break;
+    }
+  }
+
+  CU_ASSERT(400 == stream_id);
+  CU_ASSERT(fin);
+
+  stream = nghttp3_conn_find_stream(conn, 400);
+
+  CU_ASSERT(0 == stream->unsent_bytes);
+
+  /* Compact again while the stream holds unacknowledged data. */
+  nghttp3_conn_compact(conn);
+
+  rv = nghttp3_conn_add_ack_offset(conn, 400, stream->tx.offset);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_conn_compact(conn);
+
+  CU_ASSERT(0 == nghttp3_ringbuf_len(&stream->outq));
+
+  /* QPACK encoding buffer which still holds data is kept. */
+  rv = nghttp3_buf_reserve(&conn->tx.qpack.rbuf, 16, NGHTTP3_MEM_TAG_QPACK,
+                           mem);
+
+  CU_ASSERT(0 == rv);
+
+  *conn->tx.qpack.rbuf.last++ = 0xff;
+
+  nghttp3_conn_compact(conn);
+
+  CU_ASSERT(1 == nghttp3_buf_len(&conn->tx.qpack.rbuf));
+  CU_ASSERT(NULL == conn->tx.qpack.ebuf.begin);
+
+  nghttp3_conn_del(conn);
+}
+
+static int sum_stream_mem_used(void *data, void *ptr) {
+  nghttp3_stream *stream = data;
+  uint64_t *psum = ptr;
+
+  *psum += stream->mem_used;
+
+  return 0;
+}
+
+static uint64_t conn_sum_stream_mem_used(nghttp3_conn *conn) {
+  uint64_t sum = 0;
+
+  nghttp3_map_each(&conn->streams, sum_stream_mem_used, &sum);
+
+  return sum;
+}
+
+void test_nghttp3_conn_memory_limit(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  nghttp3_qpack_encoder qenc;
+  int rv;
+  nghttp3_buf ebuf;
+  uint8_t rawbuf[32768];
+  nghttp3_buf buf;
+  const nghttp3_nv reqnv[] = {
+      MAKE_NV(":authority", "localhost"),
+      MAKE_NV(":method", "GET"),
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":scheme", "https"),
+  };
+  const nghttp3_nv resnv[] = {
+      MAKE_NV(":status", "200"),
+      MAKE_NV("server", "nghttp3"),
+  };
+  uint8_t largeval[4096];
+  const nghttp3_nv largenv[] = {
+      MAKE_NV(":authority", "localhost"),
+      MAKE_NV(":method", "GET"),
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":scheme", "https"),
+      {(uint8_t *)"x-large", largeval, sizeof("x-large") - 1,
+       sizeof(largeval), NGHTTP3_NV_FLAG_NONE},
+  };
+  nghttp3_frame fr;
+  nghttp3_ssize sconsumed;
+  nghttp3_stream *stream;
+  userdata ud;
+  uint64_t usage;
+  size_t indatalen;
+  int64_t i;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.stop_sending = stop_sending;
+  callbacks.reset_stream = reset_stream;
+  callbacks.deferred_consume = deferred_consume;
+  nghttp3_settings_default(&settings);
+  settings.qpack_max_dtable_capacity = 4096;
+  settings.qpack_blocked_streams = 100;
+
+  /* Buffered incoming data of the heaviest stream are discarded, and
+     the stream is reset. */
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_buf_init(&ebuf);
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+
+  nghttp3_qpack_encoder_init(&qenc, settings.qpack_max_dtable_capacity, mem);
+  nghttp3_qpack_encoder_set_max_blocked_streams(&qenc,
+                                                settings.qpack_blocked_streams);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(
+      &qenc, settings.qpack_max_dtable_capacity);
+
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_qpack_streams(conn, 2, 6);
+
+  rv = nghttp3_conn_submit_request(conn, 0, reqnv, nghttp3_arraylen(reqnv),
+                                   NULL, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_conn_submit_request(conn, 4, reqnv, nghttp3_arraylen(reqnv),
+                                   NULL, NULL);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->mem_used == conn_sum_stream_mem_used(conn));
+  CU_ASSERT(nghttp3_conn_get_stream_memory_usage(conn, 0) >=
+            sizeof(nghttp3_stream));
+  CU_ASSERT(0 == nghttp3_conn_get_stream_memory_usage(conn, 8));
+
+  usage = nghttp3_conn_get_memory_usage(conn);
+
+  CU_ASSERT(usage >= conn->mem_used);
+
+  conn->local.settings.conn_memory_limit = usage + 8192;
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)resnv;
+  fr.headers.nvlen = nghttp3_arraylen(resnv);
+
+  nghttp3_write_frame_qpack_dyn(&buf, &ebuf, &qenc, 0, &fr);
+  nghttp3_write_frame_data(&buf, 20000);
+
+  indatalen = nghttp3_buf_len(&buf);
+
+  sconsumed = nghttp3_conn_read_stream(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed > 0);
+  CU_ASSERT(sconsumed != (nghttp3_ssize)nghttp3_buf_len(&buf));
+  CU_ASSERT(1 == ud.stop_sending_cb.ncalled);
+  CU_ASSERT(0 == ud.stop_sending_cb.stream_id);
+  CU_ASSERT(NGHTTP3_H3_EXCESSIVE_LOAD == ud.stop_sending_cb.app_error_code);
+  CU_ASSERT(1 == ud.reset_stream_cb.ncalled);
+  CU_ASSERT(0 == ud.reset_stream_cb.stream_id);
+  CU_ASSERT(NGHTTP3_H3_EXCESSIVE_LOAD == ud.reset_stream_cb.app_error_code);
+  CU_ASSERT(indatalen ==
+            (size_t)sconsumed + ud.deferred_consume_cb.consumed_total);
+  CU_ASSERT(nghttp3_conn_get_memory_usage(conn) <=
+            conn->local.settings.conn_memory_limit);
+  CU_ASSERT(conn->mem_used == conn_sum_stream_mem_used(conn));
+
+  stream = nghttp3_conn_find_stream(conn, 0);
+
+  CU_ASSERT(stream->flags & NGHTTP3_STREAM_FLAG_SHUT_RD);
+  CU_ASSERT(0 == nghttp3_stream_get_buffered_datalen(stream));
+
+  /* Unblocking the stream does not process discarded data. */
+  nghttp3_buf_reset(&buf);
+  buf.last = nghttp3_put_varint(buf.last, NGHTTP3_STREAM_TYPE_QPACK_ENCODER);
+
+  sconsumed = nghttp3_conn_read_stream(conn, 7, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&buf));
+
+  sconsumed = nghttp3_conn_read_stream(conn, 7, ebuf.pos,
+                                       nghttp3_buf_len(&ebuf), /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&ebuf));
+  CU_ASSERT(1 == ud.stop_sending_cb.ncalled);
+
+  rv = nghttp3_conn_close_stream(conn, 0, NGHTTP3_H3_EXCESSIVE_LOAD);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->mem_used == conn_sum_stream_mem_used(conn));
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+  nghttp3_buf_free(&ebuf, mem);
+
+  /* Reading data which does not allocate memory does not reset a
+     stream even if the usage exceeds the limit, and the memory of the
+     reset stream is not counted for the subsequent reads. */
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_buf_init(&ebuf);
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+
+  nghttp3_qpack_encoder_init(&qenc, settings.qpack_max_dtable_capacity, mem);
+  nghttp3_qpack_encoder_set_max_blocked_streams(&qenc,
+                                                settings.qpack_blocked_streams);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(
+      &qenc, settings.qpack_max_dtable_capacity);
+
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_qpack_streams(conn, 2, 6);
+
+  for (i = 0; i < 4; ++i) {
+    rv = nghttp3_conn_submit_request(conn, i * 4, reqnv,
+                                     nghttp3_arraylen(reqnv), NULL, NULL);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  usage = nghttp3_conn_get_memory_usage(conn);
+  conn->local.settings.conn_memory_limit = usage - 1;
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)resnv;
+  fr.headers.nvlen = nghttp3_arraylen(resnv);
+
+  nghttp3_write_frame_qpack_dyn(&buf, &ebuf, &qenc, 0, &fr);
+  nghttp3_write_frame_data(&buf, 20000);
+
+  for (i = 0; i < 4; ++i) {
+    sconsumed = nghttp3_conn_read_stream(conn, i * 4, buf.pos, 1,
+                                         /* fin = */ 0);
+
+    CU_ASSERT(1 == sconsumed);
+  }
+
+  CU_ASSERT(0 == ud.stop_sending_cb.ncalled);
+  CU_ASSERT(0 == ud.reset_stream_cb.ncalled);
+  CU_ASSERT(usage == nghttp3_conn_get_memory_usage(conn));
+
+  sconsumed = nghttp3_conn_read_stream(conn, 0, buf.pos + 1,
+                                       nghttp3_buf_len(&buf) - 1,
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed > 0);
+  CU_ASSERT(1 == ud.stop_sending_cb.ncalled);
+  CU_ASSERT(0 == ud.stop_sending_cb.stream_id);
+  CU_ASSERT(1 == ud.reset_stream_cb.ncalled);
+  CU_ASSERT(0 == ud.reset_stream_cb.stream_id);
+
+  for (i = 1; i < 4; ++i) {
+    sconsumed = nghttp3_conn_read_stream(conn, i * 4, buf.pos + 1, 1,
+                                         /* fin = */ 0);
+
+    CU_ASSERT(1 == sconsumed);
+  }
+
+  CU_ASSERT(1 == ud.stop_sending_cb.ncalled);
+  CU_ASSERT(1 == ud.reset_stream_cb.ncalled);
+
+  for (i = 1; i < 4; ++i) {
+    stream = nghttp3_conn_find_stream(conn, i * 4);
+
+    CU_ASSERT(!(stream->flags & NGHTTP3_STREAM_FLAG_SHUT_RD));
+  }
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+  nghttp3_buf_free(&ebuf, mem);
+
+  /* New request stream is rejected if memory usage exceeds the
+     limit. */
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+  settings.conn_memory_limit = 1;
+
+  nghttp3_qpack_encoder_init(&qenc, 0, mem);
+
+  nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_qpack_streams(conn, 3, 7);
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)reqnv;
+  fr.headers.nvlen = nghttp3_arraylen(reqnv);
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+
+  sconsumed = nghttp3_conn_read_stream(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 1);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&buf));
+  CU_ASSERT(1 == ud.stop_sending_cb.ncalled);
+  CU_ASSERT(0 == ud.stop_sending_cb.stream_id);
+  CU_ASSERT(NGHTTP3_H3_REQUEST_REJECTED == ud.stop_sending_cb.app_error_code);
+  CU_ASSERT(1 == ud.reset_stream_cb.ncalled);
+  CU_ASSERT(NGHTTP3_H3_REQUEST_REJECTED ==
+            ud.reset_stream_cb.app_error_code);
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+
+  /* The field which is being decoded is charged to the stream. */
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+  settings.conn_memory_limit = 0;
+  memset(largeval, 'a', sizeof(largeval));
+
+  nghttp3_qpack_encoder_init(&qenc, 0, mem);
+
+  nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_qpack_streams(conn, 3, 7);
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)largenv;
+  fr.headers.nvlen = nghttp3_arraylen(largenv);
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+
+  sconsumed = nghttp3_conn_read_stream(conn, 0, buf.pos,
+                                       nghttp3_buf_len(&buf) / 2,
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&buf) / 2);
+
+  stream = nghttp3_conn_find_stream(conn, 0);
+
+  CU_ASSERT(stream->qpack_mem_used > sizeof(largeval));
+  CU_ASSERT(stream->mem_used >= sizeof(nghttp3_stream) + sizeof(largeval));
+  CU_ASSERT(conn->mem_used == conn_sum_stream_mem_used(conn));
+
+  buf.pos += sconsumed;
+
+  sconsumed = nghttp3_conn_read_stream(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&buf));
+  CU_ASSERT(0 == stream->qpack_mem_used);
+  CU_ASSERT(conn->mem_used == conn_sum_stream_mem_used(conn));
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+}
+
+typedef struct {
+  size_t nmalloc;
+  size_t nfree;
+} counting_mem_stats;
+
+static void *counting_malloc(size_t size, void *user_data) {
+  counting_mem_stats *stats = user_data;
+
+  ++stats->nmalloc;
+
+  return malloc(size);
+}
+
+static void counting_free(void *ptr, void *user_data) {
+  counting_mem_stats *stats = user_data;
+
+  if (ptr) {
+    ++stats->nfree;
+  }
+
+  free(ptr);
+}
+
+static void *counting_calloc(size_t nmemb, size_t size, void *user_data) {
+  counting_mem_stats *stats = user_data;
+
+  ++stats->nmalloc;
+
+  return calloc(nmemb, size);
+}
+
+static void *counting_realloc(void *ptr, size_t size, void *user_data) {
+  counting_mem_stats *stats = user_data;
+
+  if (ptr == NULL) {
+    ++stats->nmalloc;
+  }
+
+  return realloc(ptr, size);
+}
+
+typedef struct {
+  nghttp3_rcbuf *values[16];
+  size_t nvalues;
+} kept_headers;
+
+static int keep_header(nghttp3_conn *conn, int64_t stream_id, int32_t token,
+                       nghttp3_rcbuf *name, nghttp3_rcbuf *value, uint8_t flags,
+                       void *user_data, void *stream_user_data) {
+  kept_headers *kept = user_data;
+
+  (void)conn;
+  (void)stream_id;
+  (void)token;
+  (void)name;
+  (void)flags;
+  (void)stream_user_data;
+
+  assert(kept->nvalues < nghttp3_arraylen(kept->values));
+
+  nghttp3_rcbuf_incref(value);
+  kept->values[kept->nvalues++] = value;
+
+  return 0;
+}
+
+void test_nghttp3_conn_region_allocator(void) {
+  counting_mem_stats stats;
+  const nghttp3_mem mem = {&stats, counting_malloc, counting_free,
+                           counting_calloc, counting_realloc};
+  nghttp3_conn *cl, *sv;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  nghttp3_ssize sconsumed;
+  int rv;
+  int64_t stream_id;
+  const nghttp3_nv reqnva[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "GET"),
+  };
+  const nghttp3_nv respnva[] = {
+      MAKE_NV(":status", "200"),
+      MAKE_NV("server", "nghttp3"),
+  };
+  nghttp3_data_reader dr;
+  int fin;
+  userdata ud;
+  size_t i, j;
+  size_t nfree;
+  nghttp3_conn *src, *dest;
+  kept_headers kept;
+  nghttp3_qpack_encoder qenc;
+  nghttp3_buf ebuf, buf;
+  uint8_t rawbuf[4096];
+  nghttp3_frame fr;
+
+  memset(&stats, 0, sizeof(stats));
+  memset(&callbacks, 0, sizeof(callbacks));
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_settings_default(&settings);
+  settings.qpack_max_dtable_capacity = 4096;
+  settings.qpack_blocked_streams = 100;
+  settings.enable_region_allocator = 1;
+
+  callbacks.begin_headers = begin_headers;
+  callbacks.recv_header = recv_header;
+  callbacks.end_headers = end_headers;
+
+  rv = nghttp3_conn_client_new(&cl, &callbacks, &settings, &mem, &ud);
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_conn_server_new(&sv, &callbacks, &settings, &mem, &ud);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_conn_bind_control_stream(cl, 2);
+  nghttp3_conn_bind_control_stream(sv, 3);
+
+  nghttp3_conn_bind_qpack_streams(cl, 6, 10);
+  nghttp3_conn_bind_qpack_streams(sv, 7, 11);
+
+  dr.read_data = step_read_data;
+
+  for (i = 0; i < 32; ++i) {
+    rv = nghttp3_conn_submit_request(cl, (int64_t)(i * 4), reqnva,
+                                     nghttp3_arraylen(reqnva), NULL, NULL);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  for (src = cl, dest = sv;; src = sv, dest = cl) {
+    for (;;) {
+      sveccnt = nghttp3_conn_writev_stream(src, &stream_id, &fin, vec,
+                                           nghttp3_arraylen(vec));
+
+      CU_ASSERT(sveccnt >= 0);
+
+      if (sveccnt <= 0) {
+        break;
+      }
+
+      rv = nghttp3_conn_add_write_offset(
+          src, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+      CU_ASSERT(0 == rv);
+
+      for (j = 0; j < (size_t)sveccnt; ++j) {
+        sconsumed =
+            nghttp3_conn_read_stream(dest, stream_id, vec[j].base, vec[j].len,
+                                     fin && j == (size_t)sveccnt - 1);
+
+        CU_ASSERT(sconsumed >= 0);
+      }
+
+      rv = nghttp3_conn_add_ack_offset(src, stream_id,
+                                       nghttp3_vec_len(vec, (size_t)sveccnt));
+
+      CU_ASSERT(0 == rv);
+    }
+
+    if (src == sv) {
+      break;
+    }
+
+    ud.data.left = 32 * 20000;
+    ud.data.step = 1000;
+
+    for (i = 0; i < 32; ++i) {
+      rv = nghttp3_conn_submit_response(sv, (int64_t)(i * 4), respnva,
+                                        nghttp3_arraylen(respnva), &dr);
+
+      CU_ASSERT(0 == rv);
+    }
+  }
+
+  for (i = 0; i < 16; ++i) {
+    rv = nghttp3_conn_close_stream(cl, (int64_t)(i * 4), NGHTTP3_H3_NO_ERROR);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(stats.nmalloc > stats.nfree);
+
+  /* Connections release the memory blocks, not objects. */
+  nfree = stats.nfree;
+  nghttp3_conn_del(sv);
+
+  CU_ASSERT(stats.nfree - nfree < 16);
+
+  nfree = stats.nfree;
+  nghttp3_conn_del(cl);
+
+  CU_ASSERT(stats.nfree - nfree < 16);
+  CU_ASSERT(stats.nmalloc == stats.nfree);
+
+  /* rcbufs passed to an application outlive the connection. */
+  memset(&kept, 0, sizeof(kept));
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.recv_header = keep_header;
+  nghttp3_buf_init(&ebuf);
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+
+  nghttp3_qpack_encoder_init(&qenc, settings.qpack_max_dtable_capacity,
+                             nghttp3_mem_default());
+  nghttp3_qpack_encoder_set_max_blocked_streams(&qenc,
+                                                settings.qpack_blocked_streams);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(
+      &qenc, settings.qpack_max_dtable_capacity);
+
+  rv = nghttp3_conn_server_new(&sv, &callbacks, &settings, &mem, &kept);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_conn_bind_qpack_streams(sv, 7, 11);
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)reqnva;
+  fr.headers.nvlen = nghttp3_arraylen(reqnva);
+
+  buf.last = nghttp3_put_varint(buf.last, NGHTTP3_STREAM_TYPE_QPACK_ENCODER);
+
+  sconsumed = nghttp3_conn_read_stream(sv, 2, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&buf));
+
+  nghttp3_buf_reset(&buf);
+  nghttp3_write_frame_qpack_dyn(&buf, &ebuf, &qenc, 0, &fr);
+
+  sconsumed = nghttp3_conn_read_stream(sv, 2, ebuf.pos, nghttp3_buf_len(&ebuf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&ebuf));
+
+  sconsumed = nghttp3_conn_read_stream(sv, 0, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&buf));
+  CU_ASSERT(nghttp3_arraylen(reqnva) == kept.nvalues);
+
+  nghttp3_conn_del(sv);
+
+  for (i = 0; i < kept.nvalues; ++i) {
+    vec[0] = nghttp3_rcbuf_get_buf(kept.values[i]);
+
+    CU_ASSERT(reqnva[i].valuelen == vec[0].len);
+    CU_ASSERT(0 == memcmp(reqnva[i].value, vec[0].base, vec[0].len));
+
+    nghttp3_rcbuf_decref(kept.values[i]);
+  }
+
+  CU_ASSERT(stats.nmalloc == stats.nfree);
+
+  nghttp3_qpack_encoder_free(&qenc);
+  nghttp3_buf_free(&ebuf, nghttp3_mem_default());
+}
+
+void test_nghttp3_conn_read_streamv(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  nghttp3_qpack_encoder qenc;
+  uint8_t rawbuf[4096];
+  nghttp3_buf buf;
+  const nghttp3_nv nva[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "POST"),
+  };
+  nghttp3_frame fr;
+  nghttp3_vec vec[4096];
+  nghttp3_ssize sconsumed, sconsumedv;
+  size_t i, veccnt;
+  userdata ud, udv;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.recv_data = recv_data;
+  nghttp3_settings_default(&settings);
+
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+
+  nghttp3_qpack_encoder_init(&qenc, 0, mem);
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)nva;
+  fr.headers.nvlen = nghttp3_arraylen(nva);
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+  nghttp3_write_frame_data(&buf, 111);
+  nghttp3_write_frame_data(&buf, 1000);
+
+  /* Contiguous buffer */
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, &ud);
+
+  sconsumed = nghttp3_conn_read_stream(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 1);
+
+  CU_ASSERT(sconsumed > 0);
+  CU_ASSERT(1111 == ud.recv_data_cb.datalen);
+
+  nghttp3_conn_del(conn);
+
+  /* Split into 1 byte fragments with empty elements in between */
+  memset(&udv, 0, sizeof(udv));
+  nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, &udv);
+
+  veccnt = 0;
+
+  for (i = 0; i < nghttp3_buf_len(&buf); ++i) {
+    vec[veccnt].base = buf.pos + i;
+    vec[veccnt].len = 1;
+    ++veccnt;
+
+    if (i % 7 == 0) {
+      vec[veccnt].base = NULL;
+      vec[veccnt].len = 0;
+      ++veccnt;
+    }
+  }
+
+  sconsumedv = nghttp3_conn_read_streamv(conn, 0, vec, veccnt, /* fin = */ 1);
+
+  CU_ASSERT(sconsumed == sconsumedv);
+  CU_ASSERT(1111 == udv.recv_data_cb.datalen);
+  CU_ASSERT(nghttp3_conn_find_stream(conn, 0)->flags &
+            NGHTTP3_STREAM_FLAG_READ_EOF);
+
+  /* Empty vector does nothing */
+  sconsumedv = nghttp3_conn_read_streamv(conn, 4, NULL, 0, /* fin = */ 0);
+
+  CU_ASSERT(0 == sconsumedv);
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+}
+
+void test_nghttp3_conn_read_streams(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  nghttp3_qpack_encoder qenc;
+  uint8_t rawbuf[4096];
+  nghttp3_buf buf;
+  const nghttp3_nv nva[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "POST"),
+  };
+  nghttp3_frame fr;
+  nghttp3_stream_input inputs[8];
+  size_t consumed[8];
+  nghttp3_ssize sconsumed;
+  size_t half;
+  userdata ud;
+  int rv;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.recv_data = recv_data;
+  nghttp3_settings_default(&settings);
+
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+
+  nghttp3_qpack_encoder_init(&qenc, 0, mem);
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)nva;
+  fr.headers.nvlen = nghttp3_arraylen(nva);
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+  nghttp3_write_frame_data(&buf, 100);
+
+  half = nghttp3_buf_len(&buf) / 2;
+
+  /* Reference: the number of bytes consumed by single read */
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, &ud);
+
+  sconsumed = nghttp3_conn_read_stream(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 1);
+
+  CU_ASSERT(sconsumed > 0);
+
+  nghttp3_conn_del(conn);
+
+  /* Two requests interleaved, each split into two chunks, and an
+     empty chunk */
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, &ud);
+
+  inputs[0].stream_id = 0;
+  inputs[0].data = buf.pos;
+  inputs[0].datalen = half;
+  inputs[0].fin = 0;
+
+  inputs[1].stream_id = 4;
+  inputs[1].data = buf.pos;
+  inputs[1].datalen = half;
+  inputs[1].fin = 0;
+
+  inputs[2].stream_id = 4;
+  inputs[2].data = NULL;
+  inputs[2].datalen = 0;
+  inputs[2].fin = 0;
+
+  inputs[3].stream_id = 4;
+  inputs[3].data = buf.pos + half;
+  inputs[3].datalen = nghttp3_buf_len(&buf) - half;
+  inputs[3].fin = 1;
+
+  inputs[4].stream_id = 0;
+  inputs[4].data = buf.pos + half;
+  inputs[4].datalen = nghttp3_buf_len(&buf) - half;
+  inputs[4].fin = 1;
+
+  rv = nghttp3_conn_read_streams(conn, inputs, 5, consumed);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT((size_t)sconsumed == consumed[0] + consumed[4]);
+  CU_ASSERT((size_t)sconsumed == consumed[1] + consumed[2] + consumed[3]);
+  CU_ASSERT(0 == consumed[2]);
+  CU_ASSERT(200 == ud.recv_data_cb.datalen);
+  CU_ASSERT(nghttp3_conn_find_stream(conn, 0)->flags &
+            NGHTTP3_STREAM_FLAG_READ_EOF);
+  CU_ASSERT(nghttp3_conn_find_stream(conn, 4)->flags &
+            NGHTTP3_STREAM_FLAG_READ_EOF);
+
+  /* Connection error stops reading */
+  nghttp3_buf_reset(&buf);
+  buf.last = nghttp3_put_varint(buf.last, NGHTTP3_STREAM_TYPE_CONTROL);
+  nghttp3_write_frame_data(&buf, 0);
+
+  inputs[0].stream_id = 2;
+  inputs[0].data = buf.pos;
+  inputs[0].datalen = nghttp3_buf_len(&buf);
+  inputs[0].fin = 0;
+
+  rv = nghttp3_conn_read_streams(conn, inputs, 1, consumed);
+
+  CU_ASSERT(NGHTTP3_ERR_H3_MISSING_SETTINGS == rv);
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+}
+
+void test_nghttp3_conn_recv_datav(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  nghttp3_qpack_encoder qenc;
+  uint8_t rawbuf[4096];
+  nghttp3_buf buf;
+  const nghttp3_nv nva[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "POST"),
+  };
+  const nghttp3_nv trnva[] = {
+      MAKE_NV("foo", "bar"),
+  };
+  nghttp3_frame fr;
+  nghttp3_ssize sconsumed, sconsumedv;
+  size_t i;
+  userdata ud;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.recv_data = recv_data;
+  nghttp3_settings_default(&settings);
+
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+
+  nghttp3_qpack_encoder_init(&qenc, 0, mem);
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)nva;
+  fr.headers.nvlen = nghttp3_arraylen(nva);
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+
+  for (i = 0; i < 20; ++i) {
+    nghttp3_write_frame_data(&buf, 10);
+
+    if (i == 7) {
+      /* Reserved frame type is ignored */
+      buf.last = nghttp3_put_varint(buf.last, 0x21);
+      buf.last = nghttp3_put_varint(buf.last, 3);
+      memset(buf.last, 0, 3);
+      buf.last += 3;
+    }
+  }
+
+  fr.headers.nva = (nghttp3_nv *)trnva;
+  fr.headers.nvlen = nghttp3_arraylen(trnva);
+
+  nghttp3_write_frame_qpack(&buf, &qenc, 0, &fr);
+
+  /* recv_data is called per DATA frame */
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, &ud);
+
+  sconsumed = nghttp3_conn_read_stream(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed > 0);
+  CU_ASSERT(20 == ud.recv_data_cb.ncalled);
+  CU_ASSERT(200 == ud.recv_data_cb.datalen);
+
+  nghttp3_conn_del(conn);
+
+  /* recv_datav coalesces DATA frames up to the size of internal
+     vector, and it is flushed before trailers. */
+  callbacks.recv_datav = recv_datav;
+
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, &ud);
+
+  sconsumedv = nghttp3_conn_read_stream(
+      conn, 0, buf.pos, nghttp3_buf_len(&buf), /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == sconsumedv);
+  CU_ASSERT(0 == ud.recv_data_cb.ncalled);
+  CU_ASSERT(2 == ud.recv_datav_cb.ncalled);
+  CU_ASSERT(20 == ud.recv_datav_cb.veccnt);
+  CU_ASSERT(200 == ud.recv_datav_cb.datalen);
+
+  nghttp3_conn_del(conn);
+
+  /* The payload of a DATA frame split across reads is delivered per
+     read. */
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, &ud);
+
+  sconsumedv = 0;
+
+  for (i = 0; i < nghttp3_buf_len(&buf); i += 5) {
+    sconsumedv += nghttp3_conn_read_stream(
+        conn, 0, buf.pos + i, nghttp3_min(5, nghttp3_buf_len(&buf) - i),
+        /* fin = */ 0);
+  }
+
+  CU_ASSERT(sconsumed == sconsumedv);
+  CU_ASSERT(200 == ud.recv_datav_cb.datalen);
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+}
+
+void test_nghttp3_conn_qpack_unblock_budget(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  nghttp3_qpack_encoder qenc;
+  uint8_t rawbuf[4096];
+  nghttp3_buf buf, ebuf;
+  const nghttp3_nv reqnv[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "GET"),
+  };
+  const nghttp3_nv resnv[] = {
+      MAKE_NV(":status", "200"),
+      MAKE_NV("server", "nghttp3"),
+  };
+  nghttp3_frame fr;
+  nghttp3_ssize sconsumed;
+  size_t consumed_total = 0;
+  size_t inputlen = 0;
+  uint64_t datalen;
+  int64_t stream_id;
+  int fin;
+  nghttp3_vec vec[16];
+  size_t i;
+  int rv;
+  userdata ud;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.recv_data = recv_data;
+  callbacks.deferred_consume = deferred_consume;
+  nghttp3_settings_default(&settings);
+  settings.qpack_max_dtable_capacity = 4096;
+  settings.qpack_blocked_streams = 100;
+  settings.qpack_unblock_budget = 50;
+
+  nghttp3_buf_init(&ebuf);
+
+  nghttp3_qpack_encoder_init(&qenc, settings.qpack_max_dtable_capacity, mem);
+  nghttp3_qpack_encoder_set_max_blocked_streams(&qenc,
+                                                settings.qpack_blocked_streams);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(
+      &qenc, settings.qpack_max_dtable_capacity);
+
+  memset(&ud, 0, sizeof(ud));
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_qpack_streams(conn, 2, 6);
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)resnv;
+  fr.headers.nvlen = nghttp3_arraylen(resnv);
+
+  for (i = 0; i < 3; ++i) {
+    stream_id = (int64_t)(i * 4);
+
+    rv = nghttp3_conn_submit_request(conn, stream_id, reqnv,
+                                     nghttp3_arraylen(reqnv), NULL, NULL);
+
+    CU_ASSERT(0 == rv);
+
+    nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+
+    nghttp3_write_frame_qpack_dyn(&buf, &ebuf, &qenc, stream_id, &fr);
+    nghttp3_write_frame_data(&buf, 100);
+
+    sconsumed = nghttp3_conn_read_stream(conn, stream_id, buf.pos,
+                                         nghttp3_buf_len(&buf), /* fin = */ 1);
+
+    CU_ASSERT(sconsumed > 0);
+    CU_ASSERT(sconsumed < (nghttp3_ssize)nghttp3_buf_len(&buf));
+
+    consumed_total += (size_t)sconsumed;
+    inputlen += nghttp3_buf_len(&buf);
+  }
+
+  CU_ASSERT(0 == ud.recv_data_cb.ncalled);
+  CU_ASSERT(!nghttp3_conn_has_pending_unblocked_streams(conn));
+
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+  buf.last = nghttp3_put_varint(buf.last, NGHTTP3_STREAM_TYPE_QPACK_ENCODER);
+
+  sconsumed = nghttp3_conn_read_stream(conn, 7, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&buf));
+
+  /* Unblocking streams processes at most qpack_unblock_budget bytes,
+     and the rest is processed by the subsequent calls. */
+  sconsumed = nghttp3_conn_read_stream(conn, 7, ebuf.pos,
+                                       nghttp3_buf_len(&ebuf), /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&ebuf));
+  CU_ASSERT(nghttp3_conn_has_pending_unblocked_streams(conn));
+  CU_ASSERT(ud.recv_data_cb.datalen <= 50);
+
+  /* The remaining data are processed by nghttp3_conn_writev_stream
+     even if it produces nothing to send. */
+  for (i = 0; nghttp3_conn_has_pending_unblocked_streams(conn) && i < 100;
+       ++i) {
+    datalen = ud.recv_data_cb.datalen;
+
+    sconsumed = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                           nghttp3_arraylen(vec));
+
+    CU_ASSERT(sconsumed >= 0);
+    CU_ASSERT(ud.recv_data_cb.datalen - datalen <= 50);
+  }
+
+  CU_ASSERT(!nghttp3_conn_has_pending_unblocked_streams(conn));
+  /* DATA payload may be delivered in several pieces */
+  CU_ASSERT(ud.recv_data_cb.ncalled >= 3);
+  CU_ASSERT(300 == ud.recv_data_cb.datalen);
+  CU_ASSERT(inputlen == consumed_total +
+                            ud.deferred_consume_cb.consumed_total +
+                            ud.recv_data_cb.datalen);
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+  nghttp3_buf_free(&ebuf, mem);
+}
+
+typedef struct {
+  nghttp3_conn *conn;
+  nghttp3_qpack_encoder qenc;
+  uint8_t rawbuf[4096];
+  nghttp3_buf buf;
+  nghttp3_buf ebuf;
+} blocked_stream_fixture;
+
+/*
+ * blocked_stream_fixture_init creates a client connection with
+ * |callbacks| and |settings|, and submits a request on stream 0.
+ * Then it feeds the response HEADERS frame, which refers to the
+ * dynamic table entries not yet received, followed by 100 bytes of
+ * DATA frame.  It returns the number of bytes consumed.
+ */
+static nghttp3_ssize
+blocked_stream_fixture_init(blocked_stream_fixture *fx,
+                            const nghttp3_callbacks *callbacks,
+                            const nghttp3_settings *settings, userdata *ud) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  const nghttp3_nv reqnv[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "GET"),
+  };
+  const nghttp3_nv resnv[] = {
+      MAKE_NV(":status", "200"),
+      MAKE_NV("server", "nghttp3"),
+  };
+  nghttp3_frame fr;
+  int rv;
+
+  nghttp3_buf_init(&fx->ebuf);
+  nghttp3_buf_wrap_init(&fx->buf, fx->rawbuf, sizeof(fx->rawbuf));
+
+  nghttp3_qpack_encoder_init(&fx->qenc, settings->qpack_max_dtable_capacity,
+                             mem);
+  nghttp3_qpack_encoder_set_max_blocked_streams(
+      &fx->qenc, settings->qpack_blocked_streams);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(
+      &fx->qenc, settings->qpack_max_dtable_capacity);
+
+  memset(ud, 0, sizeof(*ud));
+  nghttp3_conn_client_new(&fx->conn, callbacks, settings, mem, ud);
+  nghttp3_conn_bind_qpack_streams(fx->conn, 2, 6);
+
+  rv = nghttp3_conn_submit_request(fx->conn, 0, reqnv,
+                                   nghttp3_arraylen(reqnv), NULL, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)resnv;
+  fr.headers.nvlen = nghttp3_arraylen(resnv);
+
+  nghttp3_write_frame_qpack_dyn(&fx->buf, &fx->ebuf, &fx->qenc, 0, &fr);
+  nghttp3_write_frame_data(&fx->buf, 100);
+
+  return nghttp3_conn_read_stream(fx->conn, 0, fx->buf.pos,
+                                  nghttp3_buf_len(&fx->buf), /* fin = */ 0);
+}
+
+/*
+ * blocked_stream_fixture_unblock feeds the QPACK encoder stream which
+ * unblocks stream 0.
+ */
+static void blocked_stream_fixture_unblock(blocked_stream_fixture *fx) {
+  uint8_t stype[8];
+  nghttp3_ssize sconsumed;
+
+  sconsumed = nghttp3_conn_read_stream(
+      fx->conn, 7, stype,
+      (size_t)(nghttp3_put_varint(stype, NGHTTP3_STREAM_TYPE_QPACK_ENCODER) -
+               stype),
+      /* fin = */ 0);
+
+  CU_ASSERT(sconsumed > 0);
+
+  sconsumed = nghttp3_conn_read_stream(fx->conn, 7, fx->ebuf.pos,
+                                       nghttp3_buf_len(&fx->ebuf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&fx->ebuf));
+}
+
+static void blocked_stream_fixture_free(blocked_stream_fixture *fx) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+
+  nghttp3_conn_del(fx->conn);
+  nghttp3_qpack_encoder_free(&fx->qenc);
+  nghttp3_buf_free(&fx->ebuf, mem);
+}
+
+void test_nghttp3_conn_blocked_data_buffer(void) {
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  blocked_stream_fixture fx;
+  nghttp3_ssize sconsumed;
+  nghttp3_stream *stream;
+  nghttp3_typed_buf *tbuf;
+  uint64_t mem_used;
+  int rv;
+  userdata ud;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.recv_data = recv_data;
+  nghttp3_settings_default(&settings);
+  settings.qpack_max_dtable_capacity = 4096;
+  settings.qpack_blocked_streams = 100;
+
+  /* Blocked data are copied to a buffer which fits them. */
+  sconsumed = blocked_stream_fixture_init(&fx, &callbacks, &settings, &ud);
+
+  CU_ASSERT(sconsumed > 0);
+
+  stream = nghttp3_conn_find_stream(fx.conn, 0);
+
+  CU_ASSERT(1 == nghttp3_ringbuf_len(stream->inq));
+
+  tbuf = nghttp3_ringbuf_get(stream->inq, 0);
+
+  CU_ASSERT(NGHTTP3_BUF_TYPE_PRIVATE == tbuf->type);
+  CU_ASSERT(NGHTTP3_STREAM_MIN_CHUNK_SIZE == nghttp3_buf_cap(&tbuf->buf));
+  CU_ASSERT((size_t)sconsumed + nghttp3_buf_len(&tbuf->buf) ==
+            nghttp3_buf_len(&fx.buf));
+  CU_ASSERT(NGHTTP3_STREAM_MIN_CHUNK_SIZE * NGHTTP3_CONN_IN_CHUNK_BLOCK_NMEMB ==
+            fx.conn->in_chunk_objalloc[0].balloc.blklen);
+
+  blocked_stream_fixture_unblock(&fx);
+
+  CU_ASSERT(0 == nghttp3_ringbuf_len(stream->inq));
+  CU_ASSERT(100 == ud.recv_data_cb.datalen);
+
+  blocked_stream_fixture_free(&fx);
+
+  /* Blocked data are kept by reference if release_blocked_data is
+     set, and they are charged to the stream. */
+  callbacks.release_blocked_data = release_blocked_data;
+
+  sconsumed = blocked_stream_fixture_init(&fx, &callbacks, &settings, &ud);
+
+  CU_ASSERT(sconsumed > 0);
+
+  stream = nghttp3_conn_find_stream(fx.conn, 0);
+  tbuf = nghttp3_ringbuf_get(stream->inq, 0);
+
+  CU_ASSERT(NGHTTP3_BUF_TYPE_ALIEN == tbuf->type);
+  CU_ASSERT(fx.buf.pos + sconsumed == tbuf->buf.pos);
+  CU_ASSERT(fx.buf.last == tbuf->buf.last);
+  CU_ASSERT(0 == ud.release_blocked_data_cb.ncalled);
+  CU_ASSERT(stream->mem_used >=
+            sizeof(nghttp3_stream) + nghttp3_buf_len(&tbuf->buf));
+  CU_ASSERT(fx.conn->mem_used == conn_sum_stream_mem_used(fx.conn));
+
+  mem_used = stream->mem_used - nghttp3_buf_len(&tbuf->buf);
+
+  blocked_stream_fixture_unblock(&fx);
+
+  CU_ASSERT(1 == ud.release_blocked_data_cb.ncalled);
+  CU_ASSERT(tbuf->buf.begin == ud.release_blocked_data_cb.data);
+  CU_ASSERT(0 == nghttp3_ringbuf_len(stream->inq));
+  CU_ASSERT(100 == ud.recv_data_cb.datalen);
+  CU_ASSERT(mem_used == stream->mem_used);
+  CU_ASSERT(fx.conn->mem_used == conn_sum_stream_mem_used(fx.conn));
+
+  blocked_stream_fixture_free(&fx);
+
+  /* The data kept by reference are released when the stream is
+     closed. */
+  sconsumed = blocked_stream_fixture_init(&fx, &callbacks, &settings, &ud);
+
+  CU_ASSERT(sconsumed > 0);
+
+  nghttp3_conn_shutdown_stream_read(fx.conn, 0);
+  rv = nghttp3_conn_close_stream(fx.conn, 0, NGHTTP3_H3_NO_ERROR);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ud.release_blocked_data_cb.ncalled);
+
+  blocked_stream_fixture_unblock(&fx);
+
+  CU_ASSERT(NULL == nghttp3_conn_find_stream(fx.conn, 0));
+  CU_ASSERT(1 == ud.release_blocked_data_cb.ncalled);
+  CU_ASSERT(fx.rawbuf + sconsumed == ud.release_blocked_data_cb.data);
+  CU_ASSERT(0 == ud.recv_data_cb.datalen);
+
+  blocked_stream_fixture_free(&fx);
+}
+
+void test_nghttp3_conn_stats(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  nghttp3_qpack_encoder qenc;
+  uint8_t rawbuf[4096];
+  nghttp3_buf buf, ebuf;
+  const nghttp3_nv reqnv[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "POST"),
+  };
+  const nghttp3_nv resnv[] = {
+      MAKE_NV(":status", "200"),
+      MAKE_NV("server", "nghttp3"),
+  };
+  nghttp3_frame fr;
+  nghttp3_ssize sconsumed;
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  nghttp3_data_reader dr;
+  nghttp3_conn_stats stats;
+  uint8_t stype[8];
+  size_t stypelen;
+  size_t blocked;
+  int64_t stream_id;
+  int fin;
+  int rv;
+  userdata ud;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.recv_data = recv_data;
+  nghttp3_settings_default(&settings);
+  settings.qpack_max_dtable_capacity = 4096;
+  settings.qpack_blocked_streams = 100;
+
+  memset(&ud, 0, sizeof(ud));
+  ud.data.left = 2000;
+  ud.data.step = 1000;
+
+  dr.read_data = step_read_data;
+
+  nghttp3_buf_init(&ebuf);
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+
+  nghttp3_qpack_encoder_init(&qenc, settings.qpack_max_dtable_capacity, mem);
+  nghttp3_qpack_encoder_set_max_blocked_streams(&qenc,
+                                                settings.qpack_blocked_streams);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(
+      &qenc, settings.qpack_max_dtable_capacity);
+
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_control_stream(conn, 2);
+  nghttp3_conn_bind_qpack_streams(conn, 6, 10);
+
+  nghttp3_conn_get_stats(conn, &stats);
+
+  CU_ASSERT(0 == stats.tx_frames[NGHTTP3_STATS_FRAME_SETTINGS].frames);
+  CU_ASSERT(0 == stats.sched_pushes);
+
+  rv = nghttp3_conn_submit_request(conn, 0, reqnv, nghttp3_arraylen(reqnv),
+                                   &dr, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt >= 0);
+
+    if (sveccnt <= 0) {
+      break;
+    }
+
+    rv = nghttp3_conn_add_write_offset(
+        conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+    CU_ASSERT(0 == rv);
+  }
+
+  /* Without get_timestamp, no timing is recorded for the stream. */
+  CU_ASSERT(NULL == nghttp3_conn_find_stream(conn, 0)->ts);
+
+  nghttp3_conn_get_stats(conn, &stats);
+
+  CU_ASSERT(1 == stats.tx_frames[NGHTTP3_STATS_FRAME_SETTINGS].frames);
+  CU_ASSERT(0 < stats.tx_frames[NGHTTP3_STATS_FRAME_SETTINGS].bytes);
+  CU_ASSERT(1 == stats.tx_frames[NGHTTP3_STATS_FRAME_HEADERS].frames);
+  CU_ASSERT(2 == stats.tx_frames[NGHTTP3_STATS_FRAME_DATA].frames);
+  CU_ASSERT(2000 == stats.tx_frames[NGHTTP3_STATS_FRAME_DATA].bytes);
+  CU_ASSERT(sizeof(":path/:authorityexample.com:schemehttps:methodPOST") - 1 ==
+            stats.tx_field_bytes);
+  CU_ASSERT(stats.tx_field_bytes >
+            stats.tx_frames[NGHTTP3_STATS_FRAME_HEADERS].bytes);
+  CU_ASSERT(0 < stats.sched_pushes);
+  CU_ASSERT(stats.sched_pushes >= stats.sched_pops);
+  CU_ASSERT(0 < stats.max_outq_len);
+  CU_ASSERT(2000 < stats.max_send_buffered);
+  CU_ASSERT(0 == stats.rx_frames[NGHTTP3_STATS_FRAME_HEADERS].frames);
+  CU_ASSERT(0 == stats.sched_wait_time.count);
+  CU_ASSERT(0 == stats.first_byte_time.count);
+
+  /* A response which refers to the dynamic table gets blocked until
+     the encoder stream arrives. */
+  stypelen = (size_t)(nghttp3_put_varint(stype,
+                                         NGHTTP3_STREAM_TYPE_QPACK_ENCODER) -
+                      stype);
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)resnv;
+  fr.headers.nvlen = nghttp3_arraylen(resnv);
+
+  nghttp3_write_frame_qpack_dyn(&buf, &ebuf, &qenc, 0, &fr);
+  nghttp3_write_frame_data(&buf, 100);
+
+  sconsumed = nghttp3_conn_read_stream(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed > 0);
+
+  blocked = nghttp3_buf_len(&buf) - (size_t)sconsumed;
+
+  nghttp3_conn_get_stats(conn, &stats);
+
+  CU_ASSERT(1 == stats.rx_frames[NGHTTP3_STATS_FRAME_HEADERS].frames);
+  CU_ASSERT(1 == stats.qpack_blocked_streams);
+  CU_ASSERT(1 == stats.max_qpack_blocked_streams);
+  CU_ASSERT(blocked == stats.qpack_blocked_bytes);
+  CU_ASSERT(0 == stats.rx_field_bytes);
+
+  nghttp3_conn_read_stream(conn, 7, stype, stypelen, /* fin = */ 0);
+  sconsumed = nghttp3_conn_read_stream(conn, 7, ebuf.pos,
+                                       nghttp3_buf_len(&ebuf), /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&ebuf));
+
+  nghttp3_conn_get_stats(conn, &stats);
+
+  CU_ASSERT(1 == stats.rx_frames[NGHTTP3_STATS_FRAME_DATA].frames);
+  CU_ASSERT(100 == stats.rx_frames[NGHTTP3_STATS_FRAME_DATA].bytes);
+  CU_ASSERT(nghttp3_buf_len(&ebuf) == stats.rx_qpack_encoder_stream_bytes);
+  CU_ASSERT(sizeof(":status200servernghttp3") - 1 == stats.rx_field_bytes);
+  CU_ASSERT(qenc.ctx.next_absidx == stats.qpack_decoder_dtable_inserts);
+  CU_ASSERT(0 < stats.qpack_decoder_dtable_inserts);
+  CU_ASSERT(0 < stats.qpack_decoder_dtable_hits);
+  CU_ASSERT(0 == stats.qpack_decoder_dtable_evictions);
+  CU_ASSERT(1 == stats.qpack_blocked_streams);
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+  nghttp3_buf_free(&ebuf, mem);
+}
+
+static void trace(nghttp3_conn *conn, const nghttp3_trace_event *ev,
+                  void *user_data) {
+  userdata *ud = user_data;
+
+  (void)conn;
+
+  if (ud->trace_cb.nevent < nghttp3_arraylen(ud->trace_cb.events)) {
+    ud->trace_cb.events[ud->trace_cb.nevent++] = *ev;
+  }
+}
+
+/*
+ * find_trace_event returns the index of the first event recorded in
+ * |ud| whose type is |type| and whose frame type, QPACK instruction,
+ * or stream state is |sub|.  |stream_id| is ignored for QPACK
+ * instructions, and |sub| is ignored for scheduling events.  It
+ * returns the number of the recorded events if no such event is
+ * found.
+ */
+static size_t find_trace_event(const userdata *ud, uint32_t type,
+                               int64_t stream_id, uint64_t sub) {
+  const nghttp3_trace_event *ev;
+  size_t i;
+
+  for (i = 0; i < ud->trace_cb.nevent; ++i) {
+    ev = &ud->trace_cb.events[i];
+
+    if (ev->type != type) {
+      continue;
+    }
+
+    switch (type) {
+    case NGHTTP3_TRACE_EVENT_FRAME_SENT:
+    case NGHTTP3_TRACE_EVENT_FRAME_RECV:
+      if (ev->data.frame.stream_id == stream_id &&
+          (uint64_t)ev->data.frame.type == sub) {
+        return i;
+      }
+      break;
+    case NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT:
+    case NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_RECV:
+      if (ev->data.qpack.instruction == sub) {
+        return i;
+      }
+      break;
+    case NGHTTP3_TRACE_EVENT_STREAM_STATE:
+      if (ev->data.stream.stream_id == stream_id &&
+          ev->data.stream.state == sub) {
+        return i;
+      }
+      break;
+    case NGHTTP3_TRACE_EVENT_SCHEDULE:
+      if (ev->data.schedule.stream_id == stream_id) {
+        return i;
+      }
+      break;
+    }
+  }
+
+  return i;
+}
+
+void test_nghttp3_conn_trace(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  nghttp3_qpack_encoder qenc;
+  uint8_t rawbuf[4096];
+  nghttp3_buf buf, ebuf;
+  const nghttp3_nv reqnv[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "POST"),
+  };
+  const nghttp3_nv resnv[] = {
+      MAKE_NV(":status", "200"),
+      MAKE_NV("server", "nghttp3"),
+  };
+  nghttp3_frame fr;
+  nghttp3_ssize sconsumed;
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  nghttp3_data_reader dr;
+  uint8_t stype[8];
+  size_t stypelen;
+  size_t blocked, unblocked, idx;
+  int64_t stream_id;
+  int fin;
+  int rv;
+  userdata ud;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.trace = trace;
+  nghttp3_settings_default(&settings);
+  settings.qpack_max_dtable_capacity = 4096;
+  settings.qpack_blocked_streams = 100;
+
+  memset(&ud, 0, sizeof(ud));
+  ud.data.left = 2000;
+  ud.data.step = 1000;
+  ud.data.nblock = 1;
+
+  dr.read_data = block_then_step_read_data;
+
+  nghttp3_buf_init(&ebuf);
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+
+  nghttp3_qpack_encoder_init(&qenc, settings.qpack_max_dtable_capacity, mem);
+  nghttp3_qpack_encoder_set_max_blocked_streams(&qenc,
+                                                settings.qpack_blocked_streams);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(
+      &qenc, settings.qpack_max_dtable_capacity);
+
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_control_stream(conn, 2);
+  nghttp3_conn_bind_qpack_streams(conn, 6, 10);
+
+  CU_ASSERT(find_trace_event(&ud, NGHTTP3_TRACE_EVENT_STREAM_STATE, 2,
+                             NGHTTP3_TRACE_STREAM_OPENED) < ud.trace_cb.nevent);
+  CU_ASSERT(find_trace_event(&ud, NGHTTP3_TRACE_EVENT_STREAM_STATE, 10,
+                             NGHTTP3_TRACE_STREAM_OPENED) < ud.trace_cb.nevent);
+
+  rv = nghttp3_conn_submit_request(conn, 0, reqnv, nghttp3_arraylen(reqnv),
+                                   &dr, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt >= 0);
+
+    if (sveccnt <= 0) {
+      break;
+    }
+
+    rv = nghttp3_conn_add_write_offset(
+        conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(find_trace_event(&ud, NGHTTP3_TRACE_EVENT_FRAME_SENT, 2,
+                             NGHTTP3_FRAME_SETTINGS) < ud.trace_cb.nevent);
+  CU_ASSERT(find_trace_event(&ud, NGHTTP3_TRACE_EVENT_FRAME_SENT, 0,
+                             NGHTTP3_FRAME_HEADERS) < ud.trace_cb.nevent);
+  CU_ASSERT(find_trace_event(&ud, NGHTTP3_TRACE_EVENT_SCHEDULE, 0, 0) <
+            ud.trace_cb.nevent);
+  CU_ASSERT(find_trace_event(&ud, NGHTTP3_TRACE_EVENT_STREAM_STATE, 0,
+                             NGHTTP3_TRACE_STREAM_READ_DATA_BLOCKED) <
+            ud.trace_cb.nevent);
+  CU_ASSERT(find_trace_event(&ud, NGHTTP3_TRACE_EVENT_FRAME_SENT, 0,
+                             NGHTTP3_FRAME_DATA) == ud.trace_cb.nevent);
+
+  rv = nghttp3_conn_resume_stream(conn, 0);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(find_trace_event(&ud, NGHTTP3_TRACE_EVENT_STREAM_STATE, 0,
+                             NGHTTP3_TRACE_STREAM_READ_DATA_RESUMED) <
+            ud.trace_cb.nevent);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt >= 0);
+
+    if (sveccnt <= 0) {
+      break;
+    }
+
+    rv = nghttp3_conn_add_write_offset(
+        conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+    CU_ASSERT(0 == rv);
+  }
+
+  idx = find_trace_event(&ud, NGHTTP3_TRACE_EVENT_FRAME_SENT, 0,
+                         NGHTTP3_FRAME_DATA);
+
+  CU_ASSERT(idx < ud.trace_cb.nevent);
+
+  if (idx < ud.trace_cb.nevent) {
+    CU_ASSERT(1000 == ud.trace_cb.events[idx].data.frame.length);
+  }
+
+  /* A response which refers to the dynamic table gets blocked until
+     the encoder stream arrives. */
+  stypelen = (size_t)(nghttp3_put_varint(stype,
+                                         NGHTTP3_STREAM_TYPE_QPACK_ENCODER) -
+                      stype);
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)resnv;
+  fr.headers.nvlen = nghttp3_arraylen(resnv);
+
+  nghttp3_write_frame_qpack_dyn(&buf, &ebuf, &qenc, 0, &fr);
+  nghttp3_write_frame_data(&buf, 100);
+
+  sconsumed = nghttp3_conn_read_stream(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed > 0);
+  CU_ASSERT(find_trace_event(&ud, NGHTTP3_TRACE_EVENT_FRAME_RECV, 0,
+                             NGHTTP3_FRAME_HEADERS) < ud.trace_cb.nevent);
+
+  blocked = find_trace_event(&ud, NGHTTP3_TRACE_EVENT_STREAM_STATE, 0,
+                             NGHTTP3_TRACE_STREAM_QPACK_BLOCKED);
+
+  CU_ASSERT(blocked < ud.trace_cb.nevent);
+
+  nghttp3_conn_read_stream(conn, 7, stype, stypelen, /* fin = */ 0);
+  sconsumed = nghttp3_conn_read_stream(conn, 7, ebuf.pos,
+                                       nghttp3_buf_len(&ebuf), /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&ebuf));
+  CU_ASSERT(find_trace_event(&ud, NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_RECV,
+                             -1, NGHTTP3_TRACE_QPACK_SET_DTABLE_CAPACITY) <
+            ud.trace_cb.nevent);
+
+  idx = find_trace_event(&ud, NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_RECV, -1,
+                         NGHTTP3_TRACE_QPACK_INSERT_WITH_STATIC_NAME_REF);
+
+  CU_ASSERT(idx < ud.trace_cb.nevent);
+
+  if (idx < ud.trace_cb.nevent) {
+    CU_ASSERT(1 == ud.trace_cb.events[idx].data.qpack.insert_count);
+  }
+
+  unblocked = find_trace_event(&ud, NGHTTP3_TRACE_EVENT_STREAM_STATE, 0,
+                               NGHTTP3_TRACE_STREAM_QPACK_UNBLOCKED);
+
+  CU_ASSERT(unblocked < ud.trace_cb.nevent);
+  CU_ASSERT(blocked < unblocked);
+  CU_ASSERT(find_trace_event(&ud, NGHTTP3_TRACE_EVENT_FRAME_RECV, 0,
+                             NGHTTP3_FRAME_DATA) < ud.trace_cb.nevent);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt >= 0);
+
+    if (sveccnt <= 0) {
+      break;
+    }
+
+    rv = nghttp3_conn_add_write_offset(
+        conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(find_trace_event(&ud, NGHTTP3_TRACE_EVENT_QPACK_INSTRUCTION_SENT,
+                             -1, NGHTTP3_TRACE_QPACK_SECTION_ACK) <
+            ud.trace_cb.nevent);
+
+  rv = nghttp3_conn_close_stream(conn, 0, NGHTTP3_H3_NO_ERROR);
+
+  CU_ASSERT(0 == rv);
+
+  idx = find_trace_event(&ud, NGHTTP3_TRACE_EVENT_STREAM_STATE, 0,
+                         NGHTTP3_TRACE_STREAM_CLOSED);
+
+  CU_ASSERT(idx < ud.trace_cb.nevent);
+
+  if (idx < ud.trace_cb.nevent) {
+    CU_ASSERT(NGHTTP3_H3_NO_ERROR ==
+              ud.trace_cb.events[idx].data.stream.app_error_code);
+  }
+
+  CU_ASSERT(ud.trace_cb.nevent < nghttp3_arraylen(ud.trace_cb.events));
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+  nghttp3_buf_free(&ebuf, mem);
+}
+
+static nghttp3_tstamp get_timestamp(nghttp3_conn *conn, void *user_data) {
+  userdata *ud = user_data;
+
+  (void)conn;
+
+  return ud->get_timestamp_cb.now;
+}
+
+void test_nghttp3_conn_timing(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  nghttp3_qpack_encoder qenc;
+  uint8_t rawbuf[4096];
+  nghttp3_buf buf, ebuf;
+  const nghttp3_nv reqnv[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "POST"),
+  };
+  const nghttp3_nv resnv[] = {
+      MAKE_NV(":status", "200"),
+      MAKE_NV("server", "nghttp3"),
+  };
+  nghttp3_frame fr;
+  nghttp3_ssize sconsumed;
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  nghttp3_data_reader dr;
+  nghttp3_conn_stats stats;
+  uint8_t stype[8];
+  size_t stypelen;
+  int64_t stream_id;
+  int fin;
+  int rv;
+  userdata ud;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.get_timestamp = get_timestamp;
+  nghttp3_settings_default(&settings);
+  settings.qpack_max_dtable_capacity = 4096;
+  settings.qpack_blocked_streams = 100;
+
+  memset(&ud, 0, sizeof(ud));
+  ud.data.left = 2000;
+  ud.data.step = 1000;
+  ud.data.nblock = 1;
+  ud.get_timestamp_cb.now = 1000;
+
+  dr.read_data = block_then_step_read_data;
+
+  nghttp3_buf_init(&ebuf);
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+
+  nghttp3_qpack_encoder_init(&qenc, settings.qpack_max_dtable_capacity, mem);
+  nghttp3_qpack_encoder_set_max_blocked_streams(&qenc,
+                                                settings.qpack_blocked_streams);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(
+      &qenc, settings.qpack_max_dtable_capacity);
+
+  nghttp3_conn_client_new(&conn, &callbacks, &settings, mem, &ud);
+  nghttp3_conn_bind_control_stream(conn, 2);
+  nghttp3_conn_bind_qpack_streams(conn, 6, 10);
+
+  rv = nghttp3_conn_submit_request(conn, 0, reqnv, nghttp3_arraylen(reqnv),
+                                   &dr, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  /* The stream waits in the scheduler for 500ns, and read_data
+     blocks. */
+  ud.get_timestamp_cb.now = 1500;
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt >= 0);
+
+    if (sveccnt <= 0) {
+      break;
+    }
+
+    rv = nghttp3_conn_add_write_offset(
+        conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(NULL != nghttp3_conn_find_stream(conn, 0)->ts);
+
+  nghttp3_conn_get_stats(conn, &stats);
+
+  CU_ASSERT(1 == stats.sched_wait_time.count);
+  CU_ASSERT(500 == stats.sched_wait_time.sum);
+  CU_ASSERT(500 == stats.sched_wait_time.min);
+  CU_ASSERT(500 == stats.sched_wait_time.max);
+  CU_ASSERT(1 == stats.sched_wait_time.buckets[8]);
+  CU_ASSERT(1 == stats.first_byte_time.count);
+  CU_ASSERT(0 == stats.first_byte_time.max);
+  CU_ASSERT(1 == stats.first_byte_time.buckets[0]);
+  CU_ASSERT(0 == stats.read_data_blocked_time.count);
+
+  ud.get_timestamp_cb.now = 4000;
+
+  rv = nghttp3_conn_resume_stream(conn, 0);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_conn_get_stats(conn, &stats);
+
+  CU_ASSERT(1 == stats.read_data_blocked_time.count);
+  CU_ASSERT(2500 == stats.read_data_blocked_time.sum);
+  CU_ASSERT(1 == stats.read_data_blocked_time.buckets[11]);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt >= 0);
+
+    if (sveccnt <= 0) {
+      break;
+    }
+
+    rv = nghttp3_conn_add_write_offset(
+        conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+    CU_ASSERT(0 == rv);
+  }
+
+  nghttp3_conn_get_stats(conn, &stats);
+
+  CU_ASSERT(500 == stats.sched_wait_time.max);
+  CU_ASSERT(0 == stats.sched_wait_time.min);
+  CU_ASSERT(1 == stats.first_byte_time.count);
+
+  /* A response which refers to the dynamic table gets blocked for
+     4000ns until the encoder stream arrives. */
+  stypelen = (size_t)(nghttp3_put_varint(stype,
+                                         NGHTTP3_STREAM_TYPE_QPACK_ENCODER) -
+                      stype);
+
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)resnv;
+  fr.headers.nvlen = nghttp3_arraylen(resnv);
+
+  nghttp3_write_frame_qpack_dyn(&buf, &ebuf, &qenc, 0, &fr);
+
+  ud.get_timestamp_cb.now = 5000;
+
+  sconsumed = nghttp3_conn_read_stream(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed > 0);
+
+  nghttp3_conn_get_stats(conn, &stats);
+
+  CU_ASSERT(0 == stats.qpack_blocked_time.count);
+  CU_ASSERT(0 == stats.headers_time.count);
+
+  ud.get_timestamp_cb.now = 9000;
+
+  nghttp3_conn_read_stream(conn, 7, stype, stypelen, /* fin = */ 0);
+  sconsumed = nghttp3_conn_read_stream(conn, 7, ebuf.pos,
+                                       nghttp3_buf_len(&ebuf), /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&ebuf));
+
+  nghttp3_conn_get_stats(conn, &stats);
+
+  CU_ASSERT(1 == stats.qpack_blocked_time.count);
+  CU_ASSERT(4000 == stats.qpack_blocked_time.sum);
+  CU_ASSERT(1 == stats.qpack_blocked_time.buckets[11]);
+  CU_ASSERT(1 == stats.headers_time.count);
+  CU_ASSERT(4000 == stats.headers_time.sum);
+
+  nghttp3_conn_del(conn);
+  nghttp3_qpack_encoder_free(&qenc);
+  nghttp3_buf_free(&ebuf, mem);
+}
+
+void test_nghttp3_conn_mem_tag(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_mem_counter *counter;
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  nghttp3_qpack_encoder qenc;
+  uint8_t rawbuf[4096];
+  nghttp3_buf buf, ebuf;
+  const nghttp3_nv reqnv[] = {
+      MAKE_NV(":path", "/"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":method", "GET"),
+  };
+  const nghttp3_nv resnv[] = {
+      MAKE_NV(":status", "200"),
+      MAKE_NV("server", "nghttp3"),
+  };
+  nghttp3_frame fr;
+  nghttp3_ssize sconsumed;
+  nghttp3_vec vec[256];
+  nghttp3_ssize sveccnt;
+  uint8_t stype[8];
+  size_t stypelen;
+  int64_t stream_id;
+  int fin;
+  int rv;
+  uint32_t tag;
+
+  rv = nghttp3_mem_counter_new(&counter, mem);
+
+  CU_ASSERT(0 == rv);
+
+  for (tag = 0; tag < NGHTTP3_MEM_TAG_MAX; ++tag) {
+    CU_ASSERT(0 == nghttp3_mem_counter_get_live_bytes(counter, tag));
+  }
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  nghttp3_settings_default(&settings);
+  settings.qpack_max_dtable_capacity = 4096;
+  settings.qpack_blocked_streams = 100;
+
+  nghttp3_buf_init(&ebuf);
+  nghttp3_buf_wrap_init(&buf, rawbuf, sizeof(rawbuf));
+
+  nghttp3_qpack_encoder_init(&qenc, settings.qpack_max_dtable_capacity, mem);
+  nghttp3_qpack_encoder_set_max_blocked_streams(&qenc,
+                                                settings.qpack_blocked_streams);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(
+      &qenc, settings.qpack_max_dtable_capacity);
+
+  rv = nghttp3_conn_client_new(&conn, &callbacks, &settings,
+                               nghttp3_mem_counter_get_mem(counter), NULL);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(nghttp3_mem_counter_get_live_bytes(counter,
+                                               NGHTTP3_MEM_TAG_CONN) >=
+            sizeof(nghttp3_conn));
+
+  nghttp3_conn_bind_control_stream(conn, 2);
+  nghttp3_conn_bind_qpack_streams(conn, 6, 10);
+
+  rv = nghttp3_conn_submit_request(conn, 0, reqnv, nghttp3_arraylen(reqnv),
+                                   NULL, NULL);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(nghttp3_mem_counter_get_live_bytes(counter,
+                                               NGHTTP3_MEM_TAG_STREAM) > 0);
+
+  for (;;) {
+    sveccnt = nghttp3_conn_writev_stream(conn, &stream_id, &fin, vec,
+                                         nghttp3_arraylen(vec));
+
+    CU_ASSERT(sveccnt >= 0);
+
+    if (sveccnt <= 0) {
+      break;
+    }
+
+    rv = nghttp3_conn_add_write_offset(
+        conn, stream_id, (size_t)nghttp3_vec_len(vec, (size_t)sveccnt));
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(nghttp3_mem_counter_get_live_bytes(
+                counter, NGHTTP3_MEM_TAG_OUT_CHUNK) > 0);
+
+  /* The response inserts a field into the decoder's dynamic table. */
+  fr.hd.type = NGHTTP3_FRAME_HEADERS;
+  fr.headers.nva = (nghttp3_nv *)resnv;
+  fr.headers.nvlen = nghttp3_arraylen(resnv);
+
+  nghttp3_write_frame_qpack_dyn(&buf, &ebuf, &qenc, 0, &fr);
+
+  stypelen = (size_t)(nghttp3_put_varint(stype,
+                                         NGHTTP3_STREAM_TYPE_QPACK_ENCODER) -
+                      stype);
+
+  nghttp3_conn_read_stream(conn, 7, stype, stypelen, /* fin = */ 0);
+  sconsumed = nghttp3_conn_read_stream(conn, 7, ebuf.pos,
+                                       nghttp3_buf_len(&ebuf), /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&ebuf));
+
+  sconsumed = nghttp3_conn_read_stream(conn, 0, buf.pos, nghttp3_buf_len(&buf),
+                                       /* fin = */ 0);
+
+  CU_ASSERT(sconsumed == (nghttp3_ssize)nghttp3_buf_len(&buf));
+  CU_ASSERT(nghttp3_mem_counter_get_live_bytes(
+                counter, NGHTTP3_MEM_TAG_QPACK_ENTRY) > 0);
+  CU_ASSERT(nghttp3_mem_counter_get_live_bytes(counter,
+                                               NGHTTP3_MEM_TAG_RCBUF) > 0);
+  /* Decoder has buffered Section Acknowledgement for the response. */
+  CU_ASSERT(nghttp3_mem_counter_get_live_bytes(counter,
+                                               NGHTTP3_MEM_TAG_QPACK) > 0);
+
+  nghttp3_conn_del(conn);
+
+  /* Everything the connection allocated has been released. */
+  for (tag = 0; tag < NGHTTP3_MEM_TAG_MAX; ++tag) {
+    CU_ASSERT(0 == nghttp3_mem_counter_get_live_bytes(counter, tag));
+  }
+
+  nghttp3_mem_counter_del(counter);
+  nghttp3_qpack_encoder_free(&qenc);
+  nghttp3_buf_free(&ebuf, mem);
+}
+
+void test_nghttp3_conn_new_versioned(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_conn *conn;
+  nghttp3_callbacks callbacks;
+  nghttp3_settings settings;
+  size_t len;
+  int rv;
+
+  /* Fields added after NGHTTP3_SETTINGS_V1 and NGHTTP3_CALLBACKS_V1
+     must not be read. */
+  memset(&settings, 0xff, sizeof(settings));
+  nghttp3_settings_default_versioned(NGHTTP3_SETTINGS_V1, &settings);
+
+  len = nghttp3_settingslen_version(NGHTTP3_SETTINGS_V1);
+
+  CU_ASSERT(len < sizeof(settings));
+  CU_ASSERT(0xff == ((uint8_t *)&settings)[len]);
+  CU_ASSERT(NGHTTP3_VARINT_MAX == settings.max_field_section_size);
+
+  memset(&callbacks, 0xff, sizeof(callbacks));
+  memset(&callbacks, 0, nghttp3_callbackslen_version(NGHTTP3_CALLBACKS_V1));
+
+  rv = nghttp3_conn_client_new_versioned(&conn, NGHTTP3_CALLBACKS_V1,
+                                         &callbacks, NGHTTP3_SETTINGS_V1,
+                                         &settings, mem, NULL);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGHTTP3_VARINT_MAX ==
+            conn->local.settings.max_field_section_size);
+  CU_ASSERT(0 == conn->local.settings.stream_send_buffer_high_watermark);
+  CU_ASSERT(0 == conn->local.settings.conn_memory_limit);
+  CU_ASSERT(0 == conn->local.settings.enable_region_allocator);
+  CU_ASSERT(0 == conn->local.settings.qpack_unblock_budget);
+  CU_ASSERT(!(conn->flags & NGHTTP3_CONN_FLAG_REGION_ALLOCATOR));
+  CU_ASSERT(NULL == conn->callbacks.send_buffer_watermark);
+  CU_ASSERT(NULL == conn->callbacks.recv_datav);
+  CU_ASSERT(NULL == conn->callbacks.trace);
+  CU_ASSERT(NULL == conn->callbacks.get_timestamp);
+
+  nghttp3_conn_del(conn);
+
+  /* Low watermark must be less than high watermark */
+  memset(&callbacks, 0, sizeof(callbacks));
+  nghttp3_settings_default(&settings);
+  settings.stream_send_buffer_high_watermark = 1000;
+  settings.stream_send_buffer_low_watermark = 1000;
+
+  rv = nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, NULL);
+
+  CU_ASSERT(NGHTTP3_ERR_INVALID_ARGUMENT == rv);
+
+  nghttp3_settings_default(&settings);
+  settings.conn_send_buffer_high_watermark = 1000;
+  settings.conn_send_buffer_low_watermark = 1001;
+
+  rv = nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, NULL);
+
+  CU_ASSERT(NGHTTP3_ERR_INVALID_ARGUMENT == rv);
+
+  /* Low watermark is ignored if high watermark is 0 */
+  nghttp3_settings_default(&settings);
+  settings.conn_send_buffer_low_watermark = 1000;
+
+  rv = nghttp3_conn_server_new(&conn, &callbacks, &settings, mem, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_conn_del(conn);
+}
@@ -54,5 +54,24 @@ void test_nghttp3_conn_request_priority(void);
 void test_nghttp3_conn_set_stream_priority(void);
 void test_nghttp3_conn_shutdown_stream_read(void);
 void test_nghttp3_conn_stream_data_overflow(void);
+void test_nghttp3_conn_write_budget(void);
+void test_nghttp3_conn_send_buffer_watermark(void);
+void test_nghttp3_conn_scheduler(void);
+void test_nghttp3_conn_scheduler_reset_stream(void);
+void test_nghttp3_conn_stream_deadline(void);
+void test_nghttp3_conn_find_stream(void);
+void test_nghttp3_conn_compact(void);
+void test_nghttp3_conn_memory_limit(void);
+void test_nghttp3_conn_region_allocator(void);
+void test_nghttp3_conn_read_streamv(void);
+void test_nghttp3_conn_read_streams(void);
+void test_nghttp3_conn_recv_datav(void);
+void test_nghttp3_conn_qpack_unblock_budget(void);
+void test_nghttp3_conn_blocked_data_buffer(void);
+void test_nghttp3_conn_stats(void);
+void test_nghttp3_conn_trace(void);
+void test_nghttp3_conn_timing(void);
+void test_nghttp3_conn_mem_tag(void);
+void test_nghttp3_conn_new_versioned(void);
 
 #endif /* NGTCP2_CONN_TEST_H */
@@ -25,6 +25,7 @@
 #include "nghttp3_http_test.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 #include <CUnit/CUnit.h>
@@ -258,3 +259,242 @@ void test_nghttp3_check_header_value(void) {
   CU_ASSERT(!check_header_value(" "));
   CU_ASSERT(!check_header_value("\t"));
 }
+
+void test_nghttp3_check_header_simd(void) {
+  uint8_t name[80], value[80];
+  size_t len, i;
+  unsigned int c;
+  int nfail = 0;
+
+  /* Place every byte value at every position of various lengths, so
+     that both aligned blocks and the overlapping last block are
+     exercised.  The verdicts must match the table based
+     implementation. */
+  for (len = 1; len <= sizeof(name); ++len) {
+    memset(name, 'a', len);
+    memset(value, 'a', len);
+
+    for (i = 0; i < len; ++i) {
+      for (c = 0; c < 256; ++c) {
+        name[i] = (uint8_t)c;
+        value[i] = (uint8_t)c;
+
+        if (nghttp3_check_header_name(name, len) !=
+                nghttp3_check_header_name_generic(name, len) ||
+            nghttp3_check_header_value(value, len) !=
+                nghttp3_check_header_value_generic(value, len)) {
+          ++nfail;
+        }
+      }
+
+      name[i] = 'a';
+      value[i] = 'a';
+    }
+  }
+
+  CU_ASSERT(0 == nfail);
+
+  memset(name, 'a', sizeof(name));
+  name[0] = ':';
+
+  CU_ASSERT(nghttp3_check_header_name(name, sizeof(name)));
+
+  name[sizeof(name) - 1] = 'A';
+
+  CU_ASSERT(!nghttp3_check_header_name(name, sizeof(name)));
+
+  memset(value, 0x80, sizeof(value));
+
+  CU_ASSERT(nghttp3_check_header_value(value, sizeof(value)));
+
+  value[40] = 0x7f;
+
+  CU_ASSERT(!nghttp3_check_header_value(value, sizeof(value)));
+}
+
+static int parse_priority_urgency(const uint8_t *v, size_t len,
+                                  uint32_t *purgency) {
+  nghttp3_pri pri = {(uint32_t)-1, UINT8_MAX};
+  int rv;
+
+  rv = nghttp3_http_parse_priority(&pri, v, len);
+  *purgency = pri.urgency;
+
+  return rv;
+}
+
+void test_nghttp3_http_parse_priority_long_items(void) {
+  uint8_t v[128];
+  uint8_t *p;
+  size_t len, i, j;
+  uint32_t urgency;
+  int rv;
+  int nfail = 0;
+
+  /* Keys, tokens, and strings are scanned in blocks.  Place a byte
+     which ends the run at every position of various lengths so that
+     both full blocks and the remaining tail are exercised. */
+  for (len = 1; len <= 48; ++len) {
+    /* key */
+    p = v;
+    memset(p, 'k', len);
+    p += len;
+    memcpy(p, "=?1, u=5", sizeof("=?1, u=5") - 1);
+    p += sizeof("=?1, u=5") - 1;
+
+    rv = parse_priority_urgency(v, (size_t)(p - v), &urgency);
+    if (rv != 0 || urgency != 5) {
+      ++nfail;
+    }
+
+    for (i = 0; i < len; ++i) {
+      v[i] = 'K';
+
+      rv = parse_priority_urgency(v, (size_t)(p - v), &urgency);
+      if (rv != NGHTTP3_ERR_INVALID_ARGUMENT) {
+        ++nfail;
+      }
+
+      v[i] = 'k';
+    }
+
+    /* token */
+    p = v;
+    memcpy(p, "x=", 2);
+    p += 2;
+    memset(p, 't', len);
+    p += len;
+    memcpy(p, ", u=4", sizeof(", u=4") - 1);
+    p += sizeof(", u=4") - 1;
+
+    rv = parse_priority_urgency(v, (size_t)(p - v), &urgency);
+    if (rv != 0 || urgency != 4) {
+      ++nfail;
+    }
+
+    for (i = 1; i < len; ++i) {
+      for (j = 0; j < 2; ++j) {
+        v[2 + i] = j == 0 ? '/' : '"';
+
+        rv = parse_priority_urgency(v, (size_t)(p - v), &urgency);
+        if (j == 0 ? (rv != 0 || urgency != 4)
+                   : rv != NGHTTP3_ERR_INVALID_ARGUMENT) {
+          ++nfail;
+        }
+      }
+
+      v[2 + i] = 't';
+    }
+
+    /* string */
+    p = v;
+    memcpy(p, "x=\"", 3);
+    p += 3;
+    memset(p, 's', len);
+    p += len;
+    memcpy(p, "\", u=3", sizeof("\", u=3") - 1);
+    p += sizeof("\", u=3") - 1;
+
+    rv = parse_priority_urgency(v, (size_t)(p - v), &urgency);
+    if (rv != 0 || urgency != 3) {
+      ++nfail;
+    }
+
+    for (i = 0; i < len; ++i) {
+      for (j = 0; j < 3; ++j) {
+        v[3 + i] = j == 0 ? '\'' : j == 1 ? 0x7f : '\\';
+
+        rv = parse_priority_urgency(v, (size_t)(p - v), &urgency);
+        if (j == 0 ? (rv != 0 || urgency != 3)
+                   : rv != NGHTTP3_ERR_INVALID_ARGUMENT) {
+          ++nfail;
+        }
+      }
+
+      v[3 + i] = 's';
+    }
+  }
+
+  CU_ASSERT(0 == nfail);
+}
+
+static int check_field_verdict(int32_t token, const uint8_t *s, size_t len) {
+  uint8_t cls = 0;
+  uint8_t name_verdict;
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    cls |= nghttp3_http_field_char_class[s[i]];
+  }
+
+  if (nghttp3_http_field_value_verdict(token, s, len, cls) !=
+      nghttp3_http_check_field_value(token, s, len)) {
+    return 0;
+  }
+
+  name_verdict = nghttp3_http_field_name_verdict(s, len, cls);
+
+  if (len && s[0] == ':') {
+    return name_verdict == 0;
+  }
+
+  return name_verdict == nghttp3_http_check_field_name(s, len);
+}
+
+void test_nghttp3_http_field_char_class(void) {
+  const int32_t tokens[] = {
+      -1,
+      NGHTTP3_QPACK_TOKEN__METHOD,
+      NGHTTP3_QPACK_TOKEN__SCHEME,
+      NGHTTP3_QPACK_TOKEN__AUTHORITY,
+      NGHTTP3_QPACK_TOKEN_HOST,
+      NGHTTP3_QPACK_TOKEN__PATH,
+      NGHTTP3_QPACK_TOKEN_CONTENT_TYPE,
+  };
+  uint8_t s[8];
+  size_t i, j, len;
+  unsigned int c, d;
+  int nfail = 0;
+
+  /* The verdicts computed from the character classes must match the
+     ones computed by scanning the bytes. */
+  for (i = 0; i < nghttp3_arraylen(tokens); ++i) {
+    if (!check_field_verdict(tokens[i], s, 0)) {
+      ++nfail;
+    }
+
+    for (c = 0; c < 256; ++c) {
+      s[0] = (uint8_t)c;
+
+      if (!check_field_verdict(tokens[i], s, 1)) {
+        ++nfail;
+      }
+
+      for (d = 0; d < 256; ++d) {
+        s[1] = (uint8_t)d;
+
+        if (!check_field_verdict(tokens[i], s, 2)) {
+          ++nfail;
+        }
+      }
+    }
+
+    for (len = 3; len <= sizeof(s); ++len) {
+      memset(s, 'a', len);
+
+      for (j = 0; j < len; ++j) {
+        for (c = 0; c < 256; ++c) {
+          s[j] = (uint8_t)c;
+
+          if (!check_field_verdict(tokens[i], s, len)) {
+            ++nfail;
+          }
+        }
+
+        s[j] = 'a';
+      }
+    }
+  }
+
+  CU_ASSERT(0 == nfail);
+}
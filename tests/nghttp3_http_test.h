@@ -30,6 +30,9 @@
 #endif /* HAVE_CONFIG_H */
 
 void test_nghttp3_http_parse_priority(void);
+void test_nghttp3_http_parse_priority_long_items(void);
 void test_nghttp3_check_header_value(void);
+void test_nghttp3_check_header_simd(void);
+void test_nghttp3_http_field_char_class(void);
 
 #endif /* NGTCP2_CONN_TEST_H */
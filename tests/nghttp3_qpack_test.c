@@ -30,6 +30,7 @@
 #include <CUnit/CUnit.h>
 
 #include "nghttp3_qpack.h"
+#include "nghttp3_http.h"
 #include "nghttp3_macro.h"
 #include "nghttp3_test_helper.h"
 
@@ -679,7 +680,7 @@ void test_nghttp3_qpack_decoder_feedback(void) {
   nghttp3_buf_init(&ebuf);
   nghttp3_buf_init(&dbuf);
 
-  nghttp3_buf_reserve(&dbuf, 4096, mem);
+  nghttp3_buf_reserve(&dbuf, 4096, NGHTTP3_MEM_TAG_OTHER, mem);
 
   rv = nghttp3_qpack_encoder_init(&enc, 4096, mem);
 
@@ -883,3 +884,296 @@ void test_nghttp3_qpack_decoder_reconstruct_ricnt(void) {
 
   nghttp3_qpack_decoder_free(&dec);
 }
+
+static const nghttp3_qpack_field_validator http_field_validator = {
+    nghttp3_http_field_char_class,
+    nghttp3_http_field_name_verdict,
+    nghttp3_http_field_value_verdict,
+    NGHTTP3_HTTP_FIELD_NAME_MASK,
+};
+
+void test_nghttp3_qpack_decoder_verdict(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_qpack_encoder enc;
+  nghttp3_qpack_decoder dec, nvdec;
+  nghttp3_qpack_stream_context sctx;
+  nghttp3_qpack_entry *ent;
+  nghttp3_qpack_nv qnv;
+  nghttp3_buf pbuf, rbuf, ebuf;
+  nghttp3_nv nva[] = {
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":authority", "bad authority"),
+      MAKE_NV("date", "bar1"),
+      MAKE_NV("X-Upper", "bar2"),
+      MAKE_NV("x-ctrl", "bar\x01"),
+  };
+  uint8_t flags;
+  uint8_t verdict;
+  size_t i;
+  int rv;
+  nghttp3_ssize nread;
+
+  for (i = 0; i < nghttp3_arraylen(nva); ++i) {
+    nva[i].flags = NGHTTP3_NV_FLAG_TRY_INDEX;
+  }
+
+  nghttp3_buf_init(&pbuf);
+  nghttp3_buf_init(&rbuf);
+  nghttp3_buf_init(&ebuf);
+
+  rv = nghttp3_qpack_encoder_init(&enc, 4096, mem);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_qpack_encoder_set_max_blocked_streams(&enc, 1);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(&enc, 4096);
+
+  rv = nghttp3_qpack_decoder_init(&dec, 4096, 1, mem);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_qpack_decoder_set_field_validator(&dec, &http_field_validator);
+
+  rv = nghttp3_qpack_encoder_encode(&enc, &pbuf, &rbuf, &ebuf, 0, nva,
+                                    nghttp3_arraylen(nva));
+
+  CU_ASSERT(0 == rv);
+
+  nread = nghttp3_qpack_decoder_read_encoder(&dec, ebuf.pos,
+                                             nghttp3_buf_len(&ebuf));
+
+  CU_ASSERT((nghttp3_ssize)nghttp3_buf_len(&ebuf) == nread);
+  CU_ASSERT(nghttp3_arraylen(nva) == dec.ctx.next_absidx);
+
+  /* Each entry caches the verdict of its value, and the verdict of
+     its name if the name is a literal. */
+  for (i = 0; i < dec.ctx.next_absidx; ++i) {
+    ent = nghttp3_qpack_context_dtable_get(&dec.ctx, i);
+    verdict = nghttp3_http_check_field_value(
+        ent->nv.token, ent->nv.value->base, ent->nv.value->len);
+
+    if (ent->nv.token == -1) {
+      verdict |= nghttp3_http_check_field_name(ent->nv.name->base,
+                                               ent->nv.name->len);
+    }
+
+    CU_ASSERT(verdict == ent->verdict);
+  }
+
+  ent = nghttp3_qpack_context_dtable_get(&dec.ctx, 0);
+
+  CU_ASSERT((NGHTTP3_HTTP_FIELD_VALUE_CHECKED |
+             NGHTTP3_HTTP_FIELD_VALUE_REQ_VALID |
+             NGHTTP3_HTTP_FIELD_VALUE_RES_VALID) == ent->verdict);
+
+  /* Space is not allowed in :authority of request, but host field in
+     response is only checked as a regular field value. */
+  ent = nghttp3_qpack_context_dtable_get(&dec.ctx, 1);
+
+  CU_ASSERT((NGHTTP3_HTTP_FIELD_VALUE_CHECKED |
+             NGHTTP3_HTTP_FIELD_VALUE_RES_VALID) == ent->verdict);
+
+  ent = nghttp3_qpack_context_dtable_get(&dec.ctx, 3);
+
+  CU_ASSERT((NGHTTP3_HTTP_FIELD_NAME_CHECKED | NGHTTP3_HTTP_FIELD_NAME_UPPER |
+             NGHTTP3_HTTP_FIELD_VALUE_CHECKED |
+             NGHTTP3_HTTP_FIELD_VALUE_REQ_VALID |
+             NGHTTP3_HTTP_FIELD_VALUE_RES_VALID) == ent->verdict);
+
+  ent = nghttp3_qpack_context_dtable_get(&dec.ctx, 4);
+
+  CU_ASSERT((NGHTTP3_HTTP_FIELD_NAME_CHECKED | NGHTTP3_HTTP_FIELD_NAME_VALID |
+             NGHTTP3_HTTP_FIELD_VALUE_CHECKED) == ent->verdict);
+
+  /* The verdict is passed to the emitted field. */
+  nghttp3_qpack_stream_context_init(&sctx, 0, mem);
+
+  nread = nghttp3_qpack_decoder_read_request(
+      &dec, &sctx, &qnv, &flags, pbuf.pos, nghttp3_buf_len(&pbuf), 0);
+
+  CU_ASSERT((nghttp3_ssize)nghttp3_buf_len(&pbuf) == nread);
+
+  for (i = 0; nghttp3_buf_len(&rbuf);) {
+    nread = nghttp3_qpack_decoder_read_request(
+        &dec, &sctx, &qnv, &flags, rbuf.pos, nghttp3_buf_len(&rbuf), 1);
+
+    CU_ASSERT(nread > 0);
+
+    if (nread < 0) {
+      break;
+    }
+
+    rbuf.pos += nread;
+
+    if (flags & NGHTTP3_QPACK_DECODE_FLAG_FINAL) {
+      break;
+    }
+    if (flags & NGHTTP3_QPACK_DECODE_FLAG_EMIT) {
+      ent = nghttp3_qpack_context_dtable_get(&dec.ctx, i++);
+
+      CU_ASSERT(ent->verdict == sctx.verdict);
+
+      nghttp3_rcbuf_decref(qnv.name);
+      nghttp3_rcbuf_decref(qnv.value);
+    }
+  }
+
+  CU_ASSERT(nghttp3_arraylen(nva) == i);
+
+  /* Decoder without field validator does not compute verdicts. */
+  rv = nghttp3_qpack_decoder_init(&nvdec, 4096, 1, mem);
+
+  CU_ASSERT(0 == rv);
+
+  nread = nghttp3_qpack_decoder_read_encoder(&nvdec, ebuf.pos,
+                                             nghttp3_buf_len(&ebuf));
+
+  CU_ASSERT((nghttp3_ssize)nghttp3_buf_len(&ebuf) == nread);
+
+  for (i = 0; i < nvdec.ctx.next_absidx; ++i) {
+    ent = nghttp3_qpack_context_dtable_get(&nvdec.ctx, i);
+
+    CU_ASSERT(0 == ent->verdict);
+  }
+
+  nghttp3_qpack_decoder_free(&nvdec);
+  nghttp3_qpack_stream_context_free(&sctx);
+  nghttp3_qpack_decoder_free(&dec);
+  nghttp3_qpack_encoder_free(&enc);
+  nghttp3_buf_free(&ebuf, mem);
+  nghttp3_buf_free(&rbuf, mem);
+  nghttp3_buf_free(&pbuf, mem);
+}
+
+void test_nghttp3_qpack_decoder_validate_fields(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_qpack_encoder enc;
+  nghttp3_qpack_decoder dec;
+  nghttp3_qpack_stream_context sctx;
+  nghttp3_qpack_nv qnv;
+  nghttp3_buf pbuf, rbuf, ebuf;
+  nghttp3_nv nva[] = {
+      MAKE_NV(":method", "GET"),
+      MAKE_NV(":method", "BAD METHOD"),
+      MAKE_NV(":path", "/foo bar"),
+      MAKE_NV(":scheme", "https"),
+      MAKE_NV(":scheme", "1https"),
+      MAKE_NV(":authority", "example.com"),
+      MAKE_NV(":pseudo", "value"),
+      MAKE_NV("content-type", "text/html"),
+      MAKE_NV("x-huffman", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"),
+      MAKE_NV("x-huffman-bad", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\x01"),
+      MAKE_NV("X-Upper", "bar"),
+      MAKE_NV("x-(bad)", "bar"),
+      MAKE_NV("x-ws", " bar"),
+      MAKE_NV("x-empty", ""),
+  };
+  uint8_t flags;
+  uint8_t verdict;
+  size_t i, n, nchecked = 0;
+  int rv;
+  nghttp3_ssize nread;
+
+  /* Insert every other field into dynamic table, so that the fields
+     are decoded from both encoder stream and request stream. */
+  for (i = 0; i < nghttp3_arraylen(nva); ++i) {
+    nva[i].flags =
+        i & 1 ? NGHTTP3_NV_FLAG_TRY_INDEX : NGHTTP3_NV_FLAG_NEVER_INDEX;
+  }
+
+  nghttp3_buf_init(&pbuf);
+  nghttp3_buf_init(&rbuf);
+  nghttp3_buf_init(&ebuf);
+
+  rv = nghttp3_qpack_encoder_init(&enc, 4096, mem);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_qpack_encoder_set_max_blocked_streams(&enc, 1);
+  nghttp3_qpack_encoder_set_max_dtable_capacity(&enc, 4096);
+
+  rv = nghttp3_qpack_decoder_init(&dec, 4096, 1, mem);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_qpack_decoder_set_field_validator(&dec, &http_field_validator);
+
+  rv = nghttp3_qpack_encoder_encode(&enc, &pbuf, &rbuf, &ebuf, 0, nva,
+                                    nghttp3_arraylen(nva));
+
+  CU_ASSERT(0 == rv);
+
+  nread = nghttp3_qpack_decoder_read_encoder(&dec, ebuf.pos,
+                                             nghttp3_buf_len(&ebuf));
+
+  CU_ASSERT((nghttp3_ssize)nghttp3_buf_len(&ebuf) == nread);
+
+  nghttp3_qpack_stream_context_init(&sctx, 0, mem);
+
+  nread = nghttp3_qpack_decoder_read_request(
+      &dec, &sctx, &qnv, &flags, pbuf.pos, nghttp3_buf_len(&pbuf), 0);
+
+  CU_ASSERT((nghttp3_ssize)nghttp3_buf_len(&pbuf) == nread);
+
+  for (n = 0; nghttp3_buf_len(&rbuf);) {
+    nread = nghttp3_qpack_decoder_read_request(
+        &dec, &sctx, &qnv, &flags, rbuf.pos, nghttp3_buf_len(&rbuf), 1);
+
+    CU_ASSERT(nread > 0);
+
+    if (nread < 0) {
+      break;
+    }
+
+    rbuf.pos += nread;
+
+    if (flags & NGHTTP3_QPACK_DECODE_FLAG_FINAL) {
+      break;
+    }
+    if (flags & NGHTTP3_QPACK_DECODE_FLAG_EMIT) {
+      ++n;
+
+      /* Value is validated while it is decoded or when it is inserted
+         into dynamic table.  A field in static table is left to HTTP
+         layer. */
+      if (sctx.verdict & NGHTTP3_HTTP_FIELD_VALUE_CHECKED) {
+        ++nchecked;
+
+        verdict = nghttp3_http_check_field_value(qnv.token, qnv.value->base,
+                                                 qnv.value->len);
+
+        CU_ASSERT(verdict ==
+                  (sctx.verdict & (NGHTTP3_HTTP_FIELD_VALUE_CHECKED |
+                                   NGHTTP3_HTTP_FIELD_VALUE_REQ_VALID |
+                                   NGHTTP3_HTTP_FIELD_VALUE_RES_VALID)));
+      }
+
+      /* Regular field name which is not in static table is validated
+         while it is decoded. */
+      if (qnv.name->base[0] != ':' && qnv.token == -1) {
+        CU_ASSERT(sctx.verdict & NGHTTP3_HTTP_FIELD_NAME_CHECKED);
+      }
+
+      if (sctx.verdict & NGHTTP3_HTTP_FIELD_NAME_CHECKED) {
+        verdict =
+            nghttp3_http_check_field_name(qnv.name->base, qnv.name->len);
+
+        CU_ASSERT(verdict == (sctx.verdict & NGHTTP3_HTTP_FIELD_NAME_MASK));
+      }
+
+      nghttp3_rcbuf_decref(qnv.name);
+      nghttp3_rcbuf_decref(qnv.value);
+    }
+  }
+
+  CU_ASSERT(nghttp3_arraylen(nva) == n);
+  /* :scheme: https is in static table. */
+  CU_ASSERT(n - 1 == nchecked);
+
+  nghttp3_qpack_stream_context_free(&sctx);
+  nghttp3_qpack_decoder_free(&dec);
+  nghttp3_qpack_encoder_free(&enc);
+  nghttp3_buf_free(&ebuf, mem);
+  nghttp3_buf_free(&rbuf, mem);
+  nghttp3_buf_free(&pbuf, mem);
+}
@@ -38,5 +38,7 @@ void test_nghttp3_qpack_decoder_stream_overflow(void);
 void test_nghttp3_qpack_huffman(void);
 void test_nghttp3_qpack_huffman_decode_failure_state(void);
 void test_nghttp3_qpack_decoder_reconstruct_ricnt(void);
+void test_nghttp3_qpack_decoder_verdict(void);
+void test_nghttp3_qpack_decoder_validate_fields(void);
 
 #endif /* NGTCP2_QPCK_TEST_H */
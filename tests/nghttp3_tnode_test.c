@@ -166,3 +166,97 @@ void test_nghttp3_tnode_schedule(void) {
 
   nghttp3_pq_free(&pq);
 }
+
+void test_nghttp3_tnode_schedule_drr(void) {
+  const nghttp3_mem *mem = nghttp3_mem_default();
+  nghttp3_tnode node, node2;
+  nghttp3_pq pq;
+  int rv;
+  nghttp3_tnode *p;
+
+  nghttp3_pq_init(&pq, cycle_less, mem);
+
+  nghttp3_tnode_init(&node, 0);
+  node.pri.inc = 1;
+
+  rv = nghttp3_tnode_schedule_drr(&node, &pq, 0, 4096);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == node.cycle);
+  CU_ASSERT(4096 == node.deficit);
+
+  nghttp3_tnode_init(&node2, 4);
+  node2.pri.inc = 1;
+
+  rv = nghttp3_tnode_schedule_drr(&node2, &pq, 0, 4096);
+
+  CU_ASSERT(0 == rv);
+
+  /* Writing less than quantum keeps node at the top */
+  rv = nghttp3_tnode_schedule_drr(&node, &pq, 1000, 4096);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == node.cycle);
+  CU_ASSERT(3096 == node.deficit);
+
+  p = nghttp3_struct_of(nghttp3_pq_top(&pq), nghttp3_tnode, pe);
+
+  CU_ASSERT(0 == p->id);
+
+  rv = nghttp3_tnode_schedule_drr(&node, &pq, 3000, 4096);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == node.cycle);
+  CU_ASSERT(96 == node.deficit);
+
+  /* Exhausting deficit moves node to the next round, and overdraft
+     is carried over. */
+  rv = nghttp3_tnode_schedule_drr(&node, &pq, 196, 4096);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == node.cycle);
+  CU_ASSERT(3996 == node.deficit);
+
+  p = nghttp3_struct_of(nghttp3_pq_top(&pq), nghttp3_tnode, pe);
+
+  CU_ASSERT(4 == p->id);
+
+  /* Writing several quanta at once skips several rounds */
+  rv = nghttp3_tnode_schedule_drr(&node2, &pq, 4096 * 2 + 1, 4096);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == node2.cycle);
+  CU_ASSERT(4095 == node2.deficit);
+
+  p = nghttp3_struct_of(nghttp3_pq_top(&pq), nghttp3_tnode, pe);
+
+  CU_ASSERT(0 == p->id);
+
+  nghttp3_pq_free(&pq);
+
+  /* Non-incremental node is not affected by quantum */
+  nghttp3_pq_init(&pq, cycle_less, mem);
+
+  nghttp3_tnode_init(&node, 0);
+
+  rv = nghttp3_tnode_schedule_drr(&node, &pq, 0, 4096);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp3_tnode_init(&node2, 4);
+
+  rv = nghttp3_tnode_schedule_drr(&node2, &pq, 0, 4096);
+
+  CU_ASSERT(0 == rv);
+
+  rv = nghttp3_tnode_schedule_drr(&node, &pq, 100000, 4096);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == node.cycle);
+
+  p = nghttp3_struct_of(nghttp3_pq_top(&pq), nghttp3_tnode, pe);
+
+  CU_ASSERT(0 == p->id);
+
+  nghttp3_pq_free(&pq);
+}